@@ -48,7 +48,8 @@ class BlackJackGui:
             self.host, 
             self.port, 
             incoming_callback=self.protocol.on_network_message,
-            tick_callback=self.protocol.on_tick
+            tick_callback=self.protocol.on_tick,
+            binary_callback=self.protocol.on_binary_message
         )
         self.protocol.set_network(self.network)
         self.protocol.connected = True
@@ -242,7 +243,8 @@ class BlackJackGui:
                         host=self.host,
                         port=self.port,
                         incoming_callback=self.protocol.on_network_message,
-                        tick_callback=self.protocol.on_tick
+                        tick_callback=self.protocol.on_tick,
+                        binary_callback=self.protocol.on_binary_message
                     )
                     
                     success, msg = new_network.start()
@@ -380,6 +382,10 @@ class BlackJackGui:
             # update players online 
             online_count, room_count, room_data = args.split(":", 2)
             self.frames["Lobby"].update_room_list(room_data)
+        elif cmd == "LBBYDELT":
+            # only the rooms changed since the last lobby update
+            online_count, room_data = args.split(":", 1)
+            self.frames["Lobby"].update_room_list(room_data, partial=True)
         elif cmd == "REQ_BET_":
             # open betting modal
             self.frames["GameRoom"].ready_modal.destroy()
@@ -499,6 +505,11 @@ class Lobby(tk.Frame):
         header = tk.Label(self, text="Lobby - Choose a Room", font=("Arial", 24), bg="#f0f0f0")
         header.pack(pady=10, fill="x")
 
+        # server picks a room with free seats, or opens a new one
+        quick_join_btn = tk.Button(self, text="QUICK JOIN", bg="#4CAF50", fg="white", font=("Arial", 12, "bold"),
+                                   command=lambda: self.join_room_request(None))
+        quick_join_btn.pack(pady=(0, 5))
+
         container_frame = tk.Frame(self, bg="#f0f0f0")
         container_frame.pack(fill="both", expand=True, padx=10, pady=10)
 
@@ -554,11 +565,12 @@ class Lobby(tk.Frame):
         return card
 
 
-    def update_room_list(self, room_string):
+    def update_room_list(self, room_string, partial=False):
         # room string format: R0;0/7;0:R1;0/7;0:R2;0/7;0:R3;0/7;0:R4;0/7;0:R5;0/7;0: 
         # R0 = room id
         # 0/7 = players
         # 0 = GameState enum value
+        # partial = delta update, rooms not listed are unchanged, "R5;-" = room 5 was closed
         self.hide_loading()
         raw_items = [x for x in room_string.split(":") if x]
 
@@ -571,7 +583,10 @@ class Lobby(tk.Frame):
         existing_ids = set(self.room_widgets.keys())
         incoming_ids = set(incoming_data.keys())
 
-        for rid in existing_ids - incoming_ids: #remove missing rooms, in current server state should never happen
+        closed_ids = {rid for rid, data in incoming_data.items() if data == "-"}
+        for rid in closed_ids:
+            del incoming_data[rid]
+        for rid in ((closed_ids & existing_ids) if partial else existing_ids - incoming_ids): #remove rooms the server reclaimed
             self.room_widgets[rid].destroy()
             del self.room_widgets[rid]
 
@@ -3,6 +3,75 @@
 """ responsibilities: Protocol logic, message validation, ACK tracking """
 import time
 
+from network import BINARY_MARKER
+
+# Binary opcodes, fixed by the server's Commands.h
+CLIENT_OPCODES = {
+    "PING____": 0x01, "PONG____": 0x02, "LOGIN___": 0x03, "JOIN____": 0x04,
+    "LVRO____": 0x05, "RDY_____": 0x06, "NRD_____": 0x07, "PAG_____": 0x08,
+    "BT______": 0x09, "HIT_____": 0x0A, "STAND___": 0x0B, "REC__GAM": 0x0C,
+    "WATCH___": 0x0D,
+}
+SERVER_MESSAGES = {
+    0x01: "PING____", 0x02: "PONG____",
+    0x10: "REQ_NICK", 0x11: "ACK__NIC", 0x12: "NACK_NIC", 0x13: "ACK__REC",
+    0x14: "INV_MESS", 0x15: "DISCONNECT", 0x16: "CON_FAIL",
+    0x20: "LBBYINFO", 0x21: "LBBYDELT", 0x22: "ACK__JON", 0x23: "NACK_JON",
+    0x24: "ACK_LVRO", 0x25: "NACKLVRO", 0x26: "ACK__WAT", 0x27: "NACK_WAT",
+    0x30: "ROMSTAUP", 0x31: "ROSTER__", 0x32: "GAMESTAT", 0x33: "ACK__RDY",
+    0x34: "ACK__NRD", 0x35: "REQ_BET_", 0x36: "ACK___BT", 0x37: "NACK__BT",
+    0x38: "NACK_HIT", 0x39: "BUST____", 0x3A: "HIT21___", 0x3B: "ACK_STND",
+    0x3C: "ROUNDEND", 0x3D: "ACK__PAG", 0x3E: "NACK_PAG", 0x3F: "NACK_CMD",
+}
+CARD_RANKS = ["2", "3", "4", "5", "6", "7", "8", "9", "10", "J", "Q", "K", "A"]
+CARD_SUITS = "HDCS"
+ROOM_CLOSED = 0xFF
+
+
+class BinaryReader:
+    """Sequential reads out of a binary frame payload."""
+    def __init__(self, data):
+        self.data = data
+        self.pos = 0
+
+    def more(self):
+        return self.pos < len(self.data)
+
+    def byte(self):
+        value = self.data[self.pos]
+        self.pos += 1
+        return value
+
+    def varint(self):
+        value, shift = 0, 0
+        while True:
+            byte = self.byte()
+            value |= (byte & 0x7F) << shift
+            shift += 7
+            if not byte & 0x80:
+                return value
+
+    def string(self):
+        length = self.varint()
+        value = self.data[self.pos:self.pos + length].decode('utf-8', errors='ignore')
+        self.pos += length
+        return value
+
+    def hand(self):
+        """Card count and card bytes, in the text form ("NO" without cards)."""
+        cards = [self.byte() for _ in range(self.byte())]
+        if not cards:
+            return "NO"
+        return ";".join(CARD_RANKS[card // 4] + CARD_SUITS[card % 4] for card in cards)
+
+
+def put_varint(out, value):
+    while value >= 0x80:
+        out.append((value & 0x7F) | 0x80)
+        value >>= 7
+    out.append(value)
+
+
 class ProtocolController:
     """
     Manages the 'BJ:' protocol logic.
@@ -28,17 +97,32 @@ class ProtocolController:
         self.reconnect_atmpt = 0
         self.connected = False
 
+        # Binary wire format, the server switches to it after a LOGIN___ with BIN1
+        self.binary = False
+        # Seat -> nickname of the current room, binary GAMESTAT only carries seats
+        self.seat_names = {}
+
     def set_network(self, network_layer):
         self.network = network_layer
+        # A new connection starts in the text format until the next login
+        self.binary = False
 
     def send_nickname_request(self, nickname):
         """Initiates the handshake logic."""
-        payload = f"BJ:LOGIN___:{nickname}"
+        # Older servers ignore the extra argument and keep talking text
+        payload = f"BJ:LOGIN___:{nickname}:BIN1"
         self._send_with_ack_logic(payload)
         print(f"Sending: {payload}")
 
     def send_join_room_request(self, room_name):
-        payload = f"BJ:JOIN____:{room_name}"
+        # no room = let the server pick one
+        payload = "BJ:JOIN____" if room_name is None else f"BJ:JOIN____:{room_name}"
+        self._send_with_ack_logic(payload)
+        print(f"Sending: {payload}")
+
+    def send_watch_request(self, room_name):
+        # watch without a seat, LVRO goes back to the lobby
+        payload = f"BJ:WATCH___:{room_name}"
         self._send_with_ack_logic(payload)
         print(f"Sending: {payload}")
 
@@ -84,7 +168,7 @@ class ProtocolController:
 
     def send_fire_and_forget(self, payload): 
         if self.network:
-            self.network.send_message(payload)
+            self._transmit(payload)
 
     def _send_with_ack_logic(self, payload): 
         self.pending_msg = payload
@@ -93,7 +177,22 @@ class ProtocolController:
         self.last_send_time = time.time()
         
         if self.network:
+            self._transmit(payload)
+
+    def _transmit(self, payload):
+        """Sends a "BJ:" payload in the wire format the server talks to us in."""
+        if not self.binary:
             self.network.send_message(payload)
+            return
+        cmd, *args = payload[3:].split(":")
+        body = bytearray([CLIENT_OPCODES[cmd]])
+        for arg in args:
+            encoded = arg.encode('utf-8')
+            put_varint(body, len(encoded))
+            body += encoded
+        frame = bytearray([BINARY_MARKER])
+        put_varint(frame, len(body))
+        self.network.send_bytes(bytes(frame + body))
 
     
 
@@ -115,7 +214,66 @@ class ProtocolController:
         content = raw_msg[3:].strip() # Remove "BJ:"
 
         cmd, args = (content.split(":", 1) + [None])[:2]
+        self._dispatch(cmd, args)
+
+    def on_binary_message(self, frame):
+        """Decodes a binary frame back into the text form of its message."""
+        self.binary = True
+        self.last_message_time = time.time()
+        cmd = SERVER_MESSAGES.get(frame[0]) if frame else None
+        if cmd is None:
+            print(f"DEBUG: Discarding unknown binary message: {frame[:1].hex()}")
+            return
+        try:
+            args = self._decode_binary(cmd, BinaryReader(frame[1:]))
+        except IndexError:
+            print(f"DEBUG: Discarding truncated binary {cmd}")
+            return
+        if cmd != "ROSTER__":
+            self._dispatch(cmd, args)
+
+    def _decode_binary(self, cmd, reader):
+        if cmd in ("LBBYINFO", "LBBYDELT"):
+            text = f"ONLINE;{reader.varint()}:"
+            if cmd == "LBBYINFO":
+                text += f"ROOMS;{reader.varint()}:"
+            while reader.more():
+                room_id = reader.varint()
+                players = reader.byte()
+                if players == ROOM_CLOSED:
+                    text += f"R{room_id};-:"
+                    continue
+                seats = reader.byte()
+                text += f"R{room_id};{players}/{seats};{reader.byte()}:"
+            return text
+        if cmd == "ROMSTAUP":
+            self.seat_names = {}
+            text = ""
+            while reader.more():
+                seat, status, bet = reader.byte(), reader.byte(), reader.varint()
+                nick = reader.string()
+                self.seat_names[seat] = nick
+                text += f"P;{nick};{status};BET;{bet}:"
+            return text
+        if cmd == "ROSTER__":
+            self.seat_names = {}
+            while reader.more():
+                seat = reader.byte()
+                self.seat_names[seat] = reader.string()
+            return None
+        if cmd == "GAMESTAT":
+            text = f"D;{reader.hand()}:"
+            while reader.more():
+                seat, status = reader.byte(), reader.byte()
+                nick = self.seat_names.get(seat, f"seat{seat}")
+                text += f"P;{nick};{status};{reader.hand()}:"
+            return text
+        # Every other message carries its text arguments
+        if not reader.data:
+            return None
+        return reader.data.decode('utf-8', errors='ignore').strip()
 
+    def _dispatch(self, cmd, args):
         if cmd.split("_")[0] == "ACK" and self.waiting_for_ack:
             self.waiting_for_ack = False
             self.pending_msg = None
@@ -128,7 +286,7 @@ class ProtocolController:
             self.reconnect_atmpt = 0
             pong_msg = "BJ:PONG____"
             if self.network:
-                self.network.send_message(pong_msg)
+                self._transmit(pong_msg)
         elif cmd == "mark_offline":
             self.invalid_msg_count += 1
             self.connected = False
@@ -161,7 +319,7 @@ class ProtocolController:
                     print(f"Timeout. Retry {self.retry_count}...")
                     
                     if self.network:
-                        self.network.send_message(self.pending_msg)
+                        self._transmit(self.pending_msg)
                 else:
                     self.waiting_for_ack = False
                     self.pending_msg = None
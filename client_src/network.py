@@ -6,16 +6,20 @@ import selectors
 import threading
 import queue
 
+# First byte of a binary frame, text lines always start with 'B'
+BINARY_MARKER = 0xB1
+
 class NetworkClient:
     """
     Handles low-level TCP socket operations using a selector-based event loop.
     Runs in its own thread to ensure non-blocking I/O.
     """
-    def __init__(self, host, port, incoming_callback, tick_callback):
+    def __init__(self, host, port, incoming_callback, tick_callback, binary_callback=None):
         self.host = host
         self.port = port
         self.incoming_callback = incoming_callback  # Function to call with complete msgs
         self.tick_callback = tick_callback          # Function to call for logic updates (timers)
+        self.binary_callback = binary_callback      # Function to call with complete binary frames (opcode + payload)
         
         self._selector = selectors.DefaultSelector() # Auto-selects best polling method (poll/epoll/select)
         self._socket = None
@@ -53,6 +57,10 @@ class NetworkClient:
         if not message.endswith('\n'):
             message += '\n'
         self._send_queue.put(message.encode('utf-8'))
+
+    def send_bytes(self, frame):
+        """Queues an already encoded binary frame."""
+        self._send_queue.put(frame)
     
     def clean_send_queue(self):
         """Empties the send queue."""
@@ -110,17 +118,23 @@ class NetworkClient:
             if data:
                 self._recv_buffer += data
                 # Message Reassembly Logic:
-                # We split by newline. The last element is the "remainder" 
-                # (incomplete message) which goes back into the buffer.
-                if b'\n' in self._recv_buffer:
-                    lines = self._recv_buffer.split(b'\n')
-                    # The last part is incomplete or empty; save it
-                    self._recv_buffer = lines[-1]
-                    
-                    # Process all complete parts
-                    for line in lines[:-1]:
-                        msg_str = line.decode('utf-8', errors='ignore')
-                        self.incoming_callback(msg_str)
+                # Lines end with a newline, binary frames announce their length.
+                # Whatever is incomplete stays in the buffer for the next read.
+                while self._recv_buffer:
+                    if self._recv_buffer[0] == BINARY_MARKER:
+                        frame = self._take_binary_frame()
+                        if frame is None:
+                            break
+                        if self.binary_callback:
+                            self.binary_callback(frame)
+                        continue
+                    newline = self._recv_buffer.find(b'\n')
+                    if newline < 0:
+                        break
+                    line = self._recv_buffer[:newline]
+                    self._recv_buffer = self._recv_buffer[newline + 1:]
+                    msg_str = line.decode('utf-8', errors='ignore')
+                    self.incoming_callback(msg_str)
             else:
                 # Empty data means server closed connection
                 self._close_connection("Server closed connection")
@@ -129,6 +143,24 @@ class NetworkClient:
         except Exception as e:
             self._close_connection(f"Read error: {e}")
 
+    def _take_binary_frame(self):
+        """Removes one complete binary frame from the buffer, None if it is still incomplete."""
+        length, shift, pos = 0, 0, 1
+        while True:
+            if pos >= len(self._recv_buffer) or pos > 10:
+                return None
+            byte = self._recv_buffer[pos]
+            length |= (byte & 0x7F) << shift
+            shift += 7
+            pos += 1
+            if not byte & 0x80:
+                break
+        if len(self._recv_buffer) < pos + length:
+            return None
+        frame = self._recv_buffer[pos:pos + length]
+        self._recv_buffer = self._recv_buffer[pos + length:]
+        return frame
+
     def is_connected(self):
         """Checks if the socket is currently connected."""
         return self._running and self._socket is not None
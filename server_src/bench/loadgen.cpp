@@ -0,0 +1,635 @@
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <iostream>
+#include <stdexcept>
+#include <queue>
+#include <random>
+#include <string>
+#include <vector>
+
+// Bots speaking the real BJ: protocol against a running server, one epoll loop for all of them.
+// Every bot has at most one command in flight, its round-trip time is measured up to the reply.
+
+using Clock = std::chrono::steady_clock;
+
+namespace
+{
+    struct Options
+    {
+        std::string host = "127.0.0.1";
+        int port = 10000;
+        int bots = 100;
+        int rooms = 6;
+        int thinkMs = 50;
+        double churn = 0.0; // chance per finished round that a bot drops and reconnects
+        int seconds = 10;
+        int bet = 10;
+    };
+
+    enum class Phase
+    {
+        CONNECTING, // waiting for REQ_NICK
+        LOGGING_IN,
+        LOBBY,      // logged in, about to join
+        SEATED,     // joined, about to send ready
+        WAITING,    // ready, waiting for REQ_BET_
+        PLAYING,    // bet placed, acting on GAMESTAT turns
+        ROUND_OVER  // ROUNDEND seen, about to send PAG
+    };
+
+    // Wire name, reply prefixes that complete the command
+    struct CommandSpec
+    {
+        const char *name;
+        std::vector<std::string> replies;
+    };
+
+    const std::vector<CommandSpec> COMMANDS = {
+        {"LOGIN___", {"ACK__NIC", "ACK__REC", "NACK_NIC"}},
+        {"JOIN____", {"ACK__JON", "NACK_JON"}},
+        {"RDY_____", {"ACK__RDY"}},
+        {"BT______", {"ACK___BT", "NACK__BT"}},
+        {"HIT_____", {"GAMESTAT", "NACK_HIT", "BUST____", "HIT21___"}},
+        {"STAND___", {"ACK_STND", "NACK_STD"}},
+        {"PAG_____", {"ACK__PAG", "NACK_PAG"}},
+        {"PING____", {"PONG____"}},
+    };
+    enum CommandIndex
+    {
+        CMD_LOGIN,
+        CMD_JOIN,
+        CMD_READY,
+        CMD_BET,
+        CMD_HIT,
+        CMD_STAND,
+        CMD_PLAY_AGAIN,
+        CMD_PING
+    };
+
+    struct Bot
+    {
+        int fd = -1;
+        uint32_t generation = 0; // bumped on reconnect, stale timers are ignored
+        std::string nickname;
+        int room = 0;
+        Phase phase = Phase::CONNECTING;
+        std::string inbox;
+        std::string outbox;
+        int pending = -1; // command in flight
+        Clock::time_point sentAt;
+        uint32_t wakeToken = 0;       // only the latest scheduled wakeup acts
+        bool actionScheduled = false; // think time before the next command is running
+        bool pingScheduled = false;
+        bool betDue = false;
+        bool myTurn = false;
+        std::string gameState; // args of the last GAMESTAT
+    };
+
+    struct Wakeup
+    {
+        Clock::time_point at;
+        size_t bot;
+        uint32_t generation;
+        uint32_t token;
+        bool operator>(const Wakeup &other) const { return at > other.at; }
+    };
+
+    // Blackjack total of "10H;AS" style cards
+    int handValue(const std::string &cards)
+    {
+        int total = 0, aces = 0;
+        size_t start = 0;
+        while (start < cards.size())
+        {
+            size_t end = cards.find(';', start);
+            std::string card = cards.substr(start, end == std::string::npos ? std::string::npos : end - start);
+            start = end == std::string::npos ? cards.size() : end + 1;
+            if (card.size() < 2)
+                continue;
+            char rank = card[0];
+            if (rank == 'A')
+            {
+                total += 11;
+                ++aces;
+            }
+            else if (rank == 'K' || rank == 'Q' || rank == 'J' || card.size() == 3)
+                total += 10;
+            else if (rank >= '2' && rank <= '9')
+                total += rank - '0';
+        }
+        while (total > 21 && aces-- > 0)
+            total -= 10;
+        return total;
+    }
+
+    constexpr std::chrono::seconds PING_INTERVAL{1};
+
+    class LoadGenerator
+    {
+    public:
+        explicit LoadGenerator(const Options &opts) : options(opts), random(std::random_device{}()), samples(COMMANDS.size()), sent(COMMANDS.size(), 0) {}
+
+        int run()
+        {
+            epollFd = epoll_create1(EPOLL_CLOEXEC);
+            if (epollFd < 0)
+            {
+                std::perror("epoll_create1");
+                return 1;
+            }
+            bots.resize(static_cast<size_t>(options.bots));
+            start = Clock::now();
+            for (size_t i = 0; i < bots.size(); ++i)
+            {
+                bots[i].nickname = "bot" + std::to_string(i);
+                bots[i].room = static_cast<int>(i % static_cast<size_t>(options.rooms));
+                // Spread the connects over the first 100 ms instead of one SYN burst
+                schedule(i, start + std::chrono::microseconds(100000 * i / bots.size()));
+            }
+
+            auto end = start + std::chrono::seconds(options.seconds);
+            std::vector<epoll_event> events(1024);
+            while (Clock::now() < end)
+            {
+                int timeout = nextTimeoutMs(end);
+                int ready = epoll_wait(epollFd, events.data(), static_cast<int>(events.size()), timeout);
+                if (ready < 0 && errno != EINTR)
+                {
+                    std::perror("epoll_wait");
+                    return 1;
+                }
+                for (int i = 0; i < ready; ++i)
+                {
+                    size_t index = events[static_cast<size_t>(i)].data.u64;
+                    if (events[static_cast<size_t>(i)].events & (EPOLLIN | EPOLLHUP | EPOLLERR))
+                        onReadable(index);
+                    if (bots[index].fd >= 0 && (events[static_cast<size_t>(i)].events & EPOLLOUT))
+                        flush(index);
+                }
+                runDueWakeups();
+            }
+            report(Clock::now() - start);
+            for (Bot &bot : bots)
+            {
+                if (bot.fd >= 0)
+                    close(bot.fd);
+            }
+            close(epollFd);
+            return 0;
+        }
+
+    private:
+        void schedule(size_t index, Clock::time_point at)
+        {
+            Bot &bot = bots[index];
+            wakeups.push({at, index, bot.generation, ++bot.wakeToken});
+        }
+
+        Clock::time_point afterThink()
+        {
+            if (options.thinkMs <= 0)
+                return Clock::now();
+            std::uniform_int_distribution<int> jitter(options.thinkMs / 2, options.thinkMs + options.thinkMs / 2);
+            return Clock::now() + std::chrono::milliseconds(jitter(random));
+        }
+
+        int nextTimeoutMs(Clock::time_point end)
+        {
+            Clock::time_point next = end;
+            if (!wakeups.empty())
+                next = std::min(next, wakeups.top().at);
+            auto wait = std::chrono::duration_cast<std::chrono::milliseconds>(next - Clock::now()).count();
+            return static_cast<int>(std::max<int64_t>(0, wait));
+        }
+
+        void runDueWakeups()
+        {
+            auto now = Clock::now();
+            while (!wakeups.empty() && wakeups.top().at <= now)
+            {
+                Wakeup wakeup = wakeups.top();
+                wakeups.pop();
+                Bot &bot = bots[wakeup.bot];
+                if (wakeup.generation != bot.generation)
+                    continue;
+                if (bot.fd < 0)
+                    connectBot(wakeup.bot);
+                else if (wakeup.token == bot.wakeToken)
+                    act(wakeup.bot);
+            }
+        }
+
+        void connectBot(size_t index)
+        {
+            Bot &bot = bots[index];
+            int fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+            sockaddr_in addr{};
+            addr.sin_family = AF_INET;
+            addr.sin_port = htons(static_cast<uint16_t>(options.port));
+            inet_pton(AF_INET, options.host.c_str(), &addr.sin_addr);
+            int one = 1;
+            setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+            if (connect(fd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) < 0 && errno != EINPROGRESS)
+            {
+                close(fd);
+                ++connectFailures;
+                schedule(index, Clock::now() + std::chrono::seconds(1));
+                return;
+            }
+            epoll_event event{};
+            event.events = EPOLLIN | EPOLLOUT | EPOLLET;
+            event.data.u64 = index;
+            epoll_ctl(epollFd, EPOLL_CTL_ADD, fd, &event);
+            bot.fd = fd;
+            bot.phase = Phase::CONNECTING;
+            bot.inbox.clear();
+            bot.outbox.clear();
+            bot.pending = -1;
+            bot.actionScheduled = false;
+            bot.pingScheduled = false;
+            bot.betDue = false;
+            bot.myTurn = false;
+            ++connects;
+        }
+
+        void disconnect(size_t index, bool reconnect)
+        {
+            Bot &bot = bots[index];
+            epoll_ctl(epollFd, EPOLL_CTL_DEL, bot.fd, nullptr);
+            close(bot.fd);
+            bot.fd = -1;
+            ++bot.generation;
+            if (reconnect)
+                schedule(index, afterThink());
+        }
+
+        void send(size_t index, int command, const std::string &args = "")
+        {
+            Bot &bot = bots[index];
+            bot.outbox += "BJ:";
+            bot.outbox += COMMANDS[static_cast<size_t>(command)].name;
+            if (!args.empty())
+                bot.outbox += ":" + args;
+            bot.outbox += '\n';
+            bot.pending = command;
+            bot.sentAt = Clock::now();
+            ++sent[static_cast<size_t>(command)];
+            flush(index);
+        }
+
+        void sendRaw(size_t index, const char *line)
+        {
+            bots[index].outbox += line;
+            flush(index);
+        }
+
+        void flush(size_t index)
+        {
+            Bot &bot = bots[index];
+            while (!bot.outbox.empty())
+            {
+                ssize_t written = ::send(bot.fd, bot.outbox.data(), bot.outbox.size(), MSG_NOSIGNAL);
+                if (written < 0)
+                {
+                    if (errno == EINTR)
+                        continue;
+                    if (errno != EAGAIN && errno != EWOULDBLOCK)
+                        lost(index);
+                    return;
+                }
+                bot.outbox.erase(0, static_cast<size_t>(written));
+            }
+        }
+
+        void lost(size_t index)
+        {
+            ++dropped;
+            disconnect(index, true);
+        }
+
+        void onReadable(size_t index)
+        {
+            Bot &bot = bots[index];
+            char buffer[16384];
+            while (bot.fd >= 0)
+            {
+                ssize_t received = recv(bot.fd, buffer, sizeof(buffer), 0);
+                if (received < 0 && errno == EINTR)
+                    continue;
+                if (received < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+                    return;
+                if (received <= 0)
+                {
+                    lost(index);
+                    return;
+                }
+                bot.inbox.append(buffer, static_cast<size_t>(received));
+                size_t lineStart = 0, newline;
+                uint32_t generation = bot.generation;
+                while ((newline = bot.inbox.find('\n', lineStart)) != std::string::npos)
+                {
+                    std::string line = bot.inbox.substr(lineStart, newline - lineStart);
+                    lineStart = newline + 1;
+                    onLine(index, line);
+                    if (bot.generation != generation)
+                        return; // dropped while handling the line
+                }
+                bot.inbox.erase(0, lineStart);
+            }
+        }
+
+        void onLine(size_t index, const std::string &line)
+        {
+            Bot &bot = bots[index];
+            if (line.size() < 11 || line.compare(0, 3, "BJ:") != 0)
+                return;
+            std::string command = line.substr(3, 8);
+            std::string args = line.size() > 12 ? line.substr(12) : "";
+            ++received;
+
+            if (command == "PING____")
+            {
+                sendRaw(index, "BJ:PONG____\n");
+                return;
+            }
+            if (command == "CON_FAIL")
+            {
+                ++rejected;
+                disconnect(index, true);
+                return;
+            }
+            if (command == "DISCONNECT")
+            {
+                ++kicked;
+                return;
+            }
+
+            // Complete the command in flight
+            if (bot.pending >= 0)
+            {
+                for (const std::string &reply : COMMANDS[static_cast<size_t>(bot.pending)].replies)
+                {
+                    if (command == reply)
+                    {
+                        auto rtt = std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - bot.sentAt);
+                        samples[static_cast<size_t>(bot.pending)].push_back(static_cast<uint32_t>(rtt.count()));
+                        bot.pending = -1;
+                        break;
+                    }
+                }
+            }
+
+            if (command == "REQ_NICK")
+                bot.phase = Phase::LOGGING_IN;
+            else if (command == "ACK__NIC" || command == "ACK__REC")
+                bot.phase = Phase::LOBBY;
+            else if (command == "NACK_NIC" || command == "NACK_PAG")
+            {
+                // Taken (a previous session still winding down) or out of credits: fresh identity
+                bot.nickname = "bot" + std::to_string(index) + "_" + std::to_string(++renames);
+                if (command == "NACK_PAG")
+                {
+                    disconnect(index, true);
+                    return;
+                }
+            }
+            else if (command == "ACK__JON")
+                bot.phase = Phase::SEATED;
+            else if (command == "NACK_JON")
+                bot.room = (bot.room + 1) % options.rooms; // full, try the next room
+            else if (command == "REQ_BET_")
+            {
+                bot.phase = Phase::PLAYING;
+                bot.betDue = true;
+                bot.myTurn = false;
+            }
+            else if (command == "GAMESTAT")
+            {
+                bot.gameState = args;
+                bot.myTurn = bot.phase == Phase::PLAYING && args.find("P;" + bot.nickname + ";1;") != std::string::npos;
+            }
+            else if (command == "ROUNDEND")
+            {
+                bot.phase = Phase::ROUND_OVER;
+                bot.myTurn = false;
+                ++rounds;
+            }
+
+            if (bot.pending >= 0 || bot.actionScheduled)
+                return;
+            if (wantsAction(bot))
+            {
+                // Supersedes a scheduled PING
+                bot.actionScheduled = true;
+                bot.pingScheduled = false;
+                schedule(index, afterThink());
+            }
+            else if (bot.phase == Phase::WAITING && !bot.pingScheduled)
+            {
+                // Waiting for the rest of the room, keep measuring with PINGs
+                bot.pingScheduled = true;
+                schedule(index, Clock::now() + PING_INTERVAL);
+            }
+        }
+
+        bool wantsAction(const Bot &bot) const
+        {
+            switch (bot.phase)
+            {
+            case Phase::CONNECTING:
+            case Phase::WAITING:
+                return false;
+            case Phase::PLAYING:
+                return bot.myTurn || bot.betDue;
+            default:
+                return true;
+            }
+        }
+
+        void act(size_t index)
+        {
+            Bot &bot = bots[index];
+            bot.actionScheduled = false;
+            bot.pingScheduled = false;
+            // The reply of the command in flight schedules the next action
+            if (bot.pending >= 0)
+                return;
+            switch (bot.phase)
+            {
+            case Phase::CONNECTING:
+                break;
+            case Phase::LOGGING_IN:
+                send(index, CMD_LOGIN, bot.nickname);
+                break;
+            case Phase::LOBBY:
+                send(index, CMD_JOIN, std::to_string(bot.room));
+                break;
+            case Phase::SEATED:
+                send(index, CMD_READY);
+                bot.phase = Phase::WAITING;
+                break;
+            case Phase::WAITING:
+                send(index, CMD_PING);
+                break;
+            case Phase::PLAYING:
+                if (bot.betDue)
+                {
+                    bot.betDue = false;
+                    send(index, CMD_BET, std::to_string(options.bet));
+                    break;
+                }
+                if (bot.myTurn)
+                {
+                    // Dealer-style strategy: hit below 17
+                    const std::string &state = bot.gameState;
+                    size_t mine = state.find("P;" + bot.nickname + ";1;");
+                    int value = 21;
+                    if (mine != std::string::npos)
+                    {
+                        size_t cardsStart = mine + 2 + bot.nickname.size() + 3;
+                        size_t cardsEnd = state.find(':', cardsStart);
+                        value = handValue(state.substr(cardsStart, cardsEnd - cardsStart));
+                    }
+                    bot.myTurn = false;
+                    send(index, value < 17 ? CMD_HIT : CMD_STAND);
+                }
+                break;
+            case Phase::ROUND_OVER:
+            {
+                std::bernoulli_distribution churn(options.churn);
+                if (churn(random))
+                {
+                    ++churned;
+                    disconnect(index, true);
+                    return;
+                }
+                send(index, CMD_PLAY_AGAIN);
+                bot.phase = Phase::SEATED;
+                break;
+            }
+            }
+        }
+
+        void report(Clock::duration elapsed)
+        {
+            double seconds = std::chrono::duration<double>(elapsed).count();
+            uint64_t totalSent = 0;
+            std::vector<uint32_t> all;
+            std::printf("%-9s %9s %9s %9s %9s %9s\n", "command", "sent", "replies", "p50 us", "p99 us", "p999 us");
+            for (size_t i = 0; i < COMMANDS.size(); ++i)
+            {
+                totalSent += sent[i];
+                all.insert(all.end(), samples[i].begin(), samples[i].end());
+                printRow(COMMANDS[i].name, sent[i], samples[i]);
+            }
+            printRow("all", totalSent, all);
+            std::printf("\n%.1f s, %d bots: %.0f commands/s, %.0f server lines/s, %llu rounds\n", seconds, options.bots,
+                        static_cast<double>(totalSent) / seconds, static_cast<double>(received) / seconds, static_cast<unsigned long long>(rounds));
+            std::printf("connects %llu, churned %llu, rejected %llu, dropped %llu, kicked %llu, connect failures %llu\n",
+                        static_cast<unsigned long long>(connects), static_cast<unsigned long long>(churned), static_cast<unsigned long long>(rejected),
+                        static_cast<unsigned long long>(dropped), static_cast<unsigned long long>(kicked), static_cast<unsigned long long>(connectFailures));
+        }
+
+        static void printRow(const char *name, uint64_t count, std::vector<uint32_t> &values)
+        {
+            if (count == 0)
+                return;
+            std::sort(values.begin(), values.end());
+            auto quantile = [&values](double q) -> unsigned long
+            {
+                if (values.empty())
+                    return 0;
+                size_t rank = static_cast<size_t>(q * static_cast<double>(values.size() - 1));
+                return values[rank];
+            };
+            std::printf("%-9s %9llu %9zu %9lu %9lu %9lu\n", name, static_cast<unsigned long long>(count), values.size(), quantile(0.5),
+                        quantile(0.99), quantile(0.999));
+        }
+
+        Options options;
+        std::mt19937_64 random;
+        int epollFd = -1;
+        Clock::time_point start;
+        std::vector<Bot> bots;
+        std::priority_queue<Wakeup, std::vector<Wakeup>, std::greater<Wakeup>> wakeups;
+        std::vector<std::vector<uint32_t>> samples; // round-trip microseconds per command
+        std::vector<uint64_t> sent;
+        uint64_t received = 0, rounds = 0, connects = 0, churned = 0, rejected = 0, dropped = 0, kicked = 0, connectFailures = 0, renames = 0;
+    };
+}
+
+static void printHelp()
+{
+    std::cout << "Usage: ./bj_loadgen [options]\n";
+    std::cout << "Options:\n";
+    std::cout << "  -i <ip>       Server address (default: 127.0.0.1)\n";
+    std::cout << "  -p <port>     Server port (default: 10000)\n";
+    std::cout << "  -n <bots>     Simulated players (default: 100)\n";
+    std::cout << "  -r <rooms>    Rooms the bots are spread over (default: 6)\n";
+    std::cout << "  -t <ms>       Mean think time before each command (default: 50)\n";
+    std::cout << "  -c <percent>  Chance a bot reconnects after a round (0-100, default: 0)\n";
+    std::cout << "  -b <credits>  Bet per round (default: 10)\n";
+    std::cout << "  -d <seconds>  Run time (default: 10)\n";
+    std::cout << "  -h, --help    Show this help message\n";
+}
+
+int main(int argc, char *argv[])
+{
+    Options options;
+    for (int i = 1; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        if (arg == "-h" || arg == "--help")
+        {
+            printHelp();
+            return 0;
+        }
+        if (i + 1 >= argc)
+        {
+            std::cerr << "Missing value for " << arg << "\n";
+            return 1;
+        }
+        std::string value = argv[++i];
+        try
+        {
+            if (arg == "-i")
+                options.host = value;
+            else if (arg == "-p")
+                options.port = std::stoi(value);
+            else if (arg == "-n")
+                options.bots = std::max(1, std::stoi(value));
+            else if (arg == "-r")
+                options.rooms = std::max(1, std::stoi(value));
+            else if (arg == "-t")
+                options.thinkMs = std::max(0, std::stoi(value));
+            else if (arg == "-c")
+                options.churn = std::min(100, std::max(0, std::stoi(value))) / 100.0;
+            else if (arg == "-b")
+                options.bet = std::max(1, std::stoi(value));
+            else if (arg == "-d")
+                options.seconds = std::max(1, std::stoi(value));
+            else
+            {
+                std::cerr << "Unknown argument: " << arg << "\n";
+                printHelp();
+                return 1;
+            }
+        }
+        catch (const std::exception &)
+        {
+            std::cerr << "Invalid value for " << arg << ": '" << value << "'\n";
+            return 1;
+        }
+    }
+    return LoadGenerator(options).run();
+}
@@ -0,0 +1,195 @@
+#include "core/Logger.h"
+#include "game/Card.h"
+#include "game/GameRoom.h"
+#include "game/Shoe.h"
+#include "network/ClientConnection.h"
+#include "network/Shard.h"
+#include "network/TcpServer.h"
+#include "protocol/Parser.h"
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+// Hot functions of the server in isolation, ns per operation. Run before and after a change
+// on an otherwise idle machine, differences under a few percent are noise.
+
+using Clock = std::chrono::steady_clock;
+
+// Keeps the compiler from dropping a result that is never used
+template <typename T>
+static void keep(const T &value)
+{
+    asm volatile("" : : "r,m"(value) : "memory");
+}
+
+// Calls 'body' (one batch of 'perBatch' operations) until at least 200 ms have passed
+template <typename Body>
+static void bench(const char *name, size_t perBatch, Body body)
+{
+    for (int i = 0; i < 3; ++i)
+        body(); // warm caches and branch predictors
+
+    size_t batches = 0;
+    auto start = Clock::now();
+    auto elapsed = Clock::duration::zero();
+    while (elapsed < std::chrono::milliseconds(200))
+    {
+        for (int i = 0; i < 16; ++i)
+            body();
+        batches += 16;
+        elapsed = Clock::now() - start;
+    }
+    double ns = std::chrono::duration<double, std::nano>(elapsed).count() / static_cast<double>(batches * perBatch);
+    std::printf("%-32s %10.1f ns/op %14.0f ops/s\n", name, ns, 1e9 / ns);
+}
+
+static const std::vector<std::string> LINES = {
+    "BJ:LOGIN___:alice",
+    "BJ:JOIN____:3",
+    "BJ:RDY_____",
+    "BJ:BT______:250",
+    "BJ:HIT_____",
+    "BJ:STAND___",
+    "BJ:PAG_____",
+    "BJ:PING____",
+    "BJ:pong____",
+    "garbage without header",
+};
+
+static void benchParser()
+{
+    bench("Parser::parseView", LINES.size(), []()
+          {
+              for (const std::string &line : LINES)
+                  keep(Parser::parseView(line));
+          });
+    bench("Parser::parse (owning)", LINES.size(), []()
+          {
+              for (const std::string &line : LINES)
+                  keep(Parser::parse(line));
+          });
+
+    // The same commands as binary frame payloads
+    std::vector<std::string> payloads;
+    for (const std::string &line : LINES)
+    {
+        MessageView msg = Parser::parseView(line);
+        if (!msg.valid)
+            continue;
+        std::string payload(1, '\0');
+        for (unsigned code = 1; code < 0x100; ++code)
+        {
+            if (opcodeFromBinary(static_cast<uint8_t>(code)) == msg.opcode)
+                payload[0] = static_cast<char>(code);
+        }
+        for (std::string_view arg : msg.args)
+            Wire::putString(payload, arg);
+        payloads.push_back(payload);
+    }
+    bench("Parser::parseBinaryView", payloads.size(), [&]()
+          {
+              for (const std::string &payload : payloads)
+                  keep(Parser::parseBinaryView(payload));
+          });
+}
+
+static void benchFraming()
+{
+    // One receive buffer worth of complete lines, framed like a busy client's stream
+    std::string stream;
+    size_t lines = 0;
+    while (true)
+    {
+        const std::string &line = LINES[lines % LINES.size()];
+        if (stream.size() + line.size() + 2 > ClientConnection::RECV_BUFFER_SIZE)
+            break;
+        stream += line;
+        stream += lines % 3 == 0 ? "\r\n" : "\n";
+        ++lines;
+    }
+
+    ClientConnection conn(-1, 64 * 1024);
+    bench("ClientConnection::nextMessage", lines, [&]()
+          {
+              char *dest = conn.getWritePtr();
+              std::memcpy(dest, stream.data(), stream.size());
+              conn.commitWrite(stream.size());
+              std::string_view line;
+              bool binary = false;
+              while (conn.nextMessage(line, binary))
+                  keep(line);
+          });
+}
+
+static void benchHand()
+{
+    Shoe shoe(6, 42);
+    std::vector<Card> cards;
+    for (size_t i = 0; i < 4096; ++i)
+        cards.push_back(shoe.draw());
+
+    // Typical hand: three cards, value read after every card
+    bench("Hand::add + value (3 cards)", cards.size() / 3, [&]()
+          {
+              for (size_t i = 0; i + 3 <= cards.size(); i += 3)
+              {
+                  Hand hand;
+                  for (size_t c = i; c < i + 3; ++c)
+                  {
+                      hand.add(cards[c]);
+                      keep(hand.value());
+                  }
+              }
+          });
+}
+
+static void benchGameState()
+{
+    // Rooms need a shard and the shard a server, neither is started
+    Config config;
+    config.seed = 42;
+    TcpServer server(config);
+    Shard shard(0, 1, config, server);
+    GameRoom room(0, shard);
+    for (int i = 0; i < MAX_PLAYERS; ++i)
+    {
+        Player player(-1);
+        player.setNickname("player" + std::to_string(i));
+        room.addPlayer(shard.getPlayers().add(std::move(player)));
+    }
+    room.dealCards();
+
+    bench("GameRoom::getGameState text", 1, [&]()
+          {
+              TextStateSerializer out;
+              room.getGameState(out);
+              keep(out.text());
+          });
+    bench("GameRoom::getGameState binary", 1, [&]()
+          {
+              BinaryStateSerializer out;
+              room.getGameState(out);
+              keep(out.finish("GAMESTAT"));
+          });
+    bench("GameRoom::getGameStateFrame dirty", 1, [&]()
+          {
+              room.markStateDirty();
+              keep(room.getGameStateFrame());
+          });
+    bench("GameRoom::getGameStateFrame cached", 1, [&]()
+          { keep(room.getGameStateFrame()); });
+    std::printf("GAMESTAT wire size: text %zu bytes, binary %zu bytes\n", room.getGameStateFrame()->size(),
+                room.getGameStateFrame(WireFormat::BINARY)->size());
+}
+
+int main()
+{
+    Logger::setLevel(LogLevel::ERROR);
+    benchParser();
+    benchFraming();
+    benchHand();
+    benchGameState();
+    return 0;
+}
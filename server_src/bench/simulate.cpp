@@ -0,0 +1,493 @@
+#include "core/Config.h"
+#include "core/Logger.h"
+#include "game/CommandLog.h"
+#include "game/GameRoom.h"
+#include "game/RoomHost.h"
+#include "protocol/Parser.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <iostream>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+// The game engine without a network: GameRoom on a RoomHost that counts and drops its output.
+// Plays seeded rounds with basic strategy bots on every core, for payout / RTP checks and
+// engine-only throughput, or replays command logs a server recorded with -z and checks that
+// every player leaves with the balance it left with in production.
+
+using Clock = std::chrono::steady_clock;
+
+namespace
+{
+    struct Options
+    {
+        uint64_t rounds = 1000000;
+        int players = 5;
+        int threads = 0; // one per core
+        uint64_t seed = 1;
+        int decks = 6;
+        int bet = 10;
+        WireFormat format = WireFormat::TEXT;
+        std::vector<std::string> replays;
+        bool verbose = false;
+    };
+
+    // Bots never run dry, their balance is topped up before a round they cannot pay for
+    constexpr int BANKROLL = 1000000;
+
+    class SimHost : public RoomHost
+    {
+    public:
+        SimHost(const Config &cfg, WireFormat wireFormat) : config(cfg), format(wireFormat), epoch(Clock::now()), timers(epoch) {}
+
+        PlayerTable &getPlayers() override { return players; }
+        const Config &getConfig() const override { return config; }
+        // Timers are scheduled and cancelled as in the server, but never run: time stands still
+        TimerWheel &getTimers() override { return timers; }
+        TimerWheel::Clock::time_point now() const override { return epoch; }
+        bool isDraining() const override { return false; }
+
+        WireFormat getWireFormat(int) const override { return format; }
+        void sendMessage(int fd, const std::string &command, const std::string &args) override
+        {
+            ++messages;
+            if (printResults && command == "ROUNDEND")
+            {
+                const Player *player = players.findByFd(fd);
+                std::printf("%llu room %d %s ROUNDEND %s\n", static_cast<unsigned long long>(currentMs), player->getRoomId(),
+                            player->getNickname().c_str(), args.c_str());
+            }
+        }
+        void sendFrame(int, const Frame &frame, uint8_t) override
+        {
+            ++frames;
+            frameBytes += frame->size();
+        }
+        void publishRoomStatus(const GameRoom &) override {}
+        void persistCredits(const Player &) override {}
+
+        void scheduleRoomUpdate(GameRoom &room) override { pendingUpdates.push_back(&room); }
+        // Nobody watches a simulated room
+        void scheduleSpectatorFanOut(GameRoom &) override {}
+
+        void returnToLobby(PlayerHandle player) override { release(player); }
+        void evictPlayer(PlayerHandle player) override { release(player); }
+        void destroyPlayer(PlayerHandle player) override { release(player); }
+
+        // Seats a new player, 'fd' only tells the players apart in the output
+        PlayerHandle addPlayer(const std::string &nickname, int credits, int roomId)
+        {
+            int fd = static_cast<int>(nextFd);
+            if (freeFds.empty())
+                ++nextFd;
+            else
+            {
+                fd = freeFds.back();
+                freeFds.pop_back();
+            }
+            Player player(fd);
+            player.setNickname(nickname);
+            player.setCredits(credits);
+            player.setRoomId(roomId);
+            player.setState(PlayerState::IN_GAMEROOM);
+            return players.add(std::move(player));
+        }
+        void release(PlayerHandle id)
+        {
+            auto player = players.take(id);
+            if (player)
+                freeFds.push_back(player->getFd());
+        }
+
+        // Runs the updates the rooms asked for, as Shard::onTick does
+        void runUpdates()
+        {
+            while (!pendingUpdates.empty())
+            {
+                due.swap(pendingUpdates);
+                for (GameRoom *room : due)
+                {
+                    if (!room->takeUpdateRequest())
+                        continue;
+                    if (room->getState() != GameState::ROUND_END || room->areAllPlayersOffline())
+                        room->update();
+                }
+                due.clear();
+            }
+        }
+        // A replay runs the updates where the log has them
+        void dropUpdates() { pendingUpdates.clear(); }
+
+        uint64_t messages = 0;
+        uint64_t frames = 0;
+        uint64_t frameBytes = 0;
+        bool printResults = false;
+        uint64_t currentMs = 0;
+
+    private:
+        Config config;
+        WireFormat format;
+        TimerWheel::Clock::time_point epoch;
+        TimerWheel timers;
+        PlayerTable players;
+        std::vector<GameRoom *> pendingUpdates;
+        std::vector<GameRoom *> due;
+        size_t nextFd = 0;
+        std::vector<int> freeFds;
+    };
+
+    // Basic strategy for a table without doubles and splits, 'up' is the dealer's open card
+    bool wantsHit(const Hand &hand, Card up)
+    {
+        int total = hand.value();
+        int dealer = cardValue(up);
+        if (hand.isSoft())
+            return total <= 17 || (total == 18 && dealer >= 9);
+        if (total <= 11)
+            return true;
+        if (total == 12)
+            return dealer < 4 || dealer > 6;
+        if (total <= 16)
+            return dealer > 6;
+        return false;
+    }
+
+    struct Stats
+    {
+        uint64_t rounds = 0, hands = 0, wins = 0, blackjacks = 0, pushes = 0, losses = 0, busts = 0;
+        uint64_t wagered = 0, returned = 0;
+        uint64_t messages = 0, frames = 0, frameBytes = 0;
+        bool failed = false;
+
+        void add(const Stats &other)
+        {
+            rounds += other.rounds;
+            hands += other.hands;
+            wins += other.wins;
+            blackjacks += other.blackjacks;
+            pushes += other.pushes;
+            losses += other.losses;
+            busts += other.busts;
+            wagered += other.wagered;
+            returned += other.returned;
+            messages += other.messages;
+            frames += other.frames;
+            frameBytes += other.frameBytes;
+            failed = failed || other.failed;
+        }
+    };
+
+    // One room with options.players bots through 'rounds' rounds, commands go through GameRoom::handle
+    void simulate(const Options &options, int roomId, uint64_t rounds, Stats &stats)
+    {
+        Config config;
+        config.seed = options.seed;
+        config.decks = options.decks;
+        SimHost host(config, options.format);
+        GameRoom room(roomId, host);
+        PlayerTable &players = host.getPlayers();
+
+        std::vector<PlayerHandle> seats;
+        for (int i = 0; i < options.players; ++i)
+        {
+            seats.push_back(host.addPlayer("bot" + std::to_string(i), BANKROLL, roomId));
+            room.addPlayer(seats.back());
+        }
+        host.runUpdates();
+
+        const std::string betLine = "BJ:BT______:" + std::to_string(options.bet);
+        const MessageView ready = Parser::parseView("BJ:RDY_____");
+        const MessageView bet = Parser::parseView(betLine);
+        const MessageView hit = Parser::parseView("BJ:HIT_____");
+        const MessageView stand = Parser::parseView("BJ:STAND___");
+        const MessageView again = Parser::parseView("BJ:PAG_____");
+        std::vector<int> before(seats.size());
+
+        for (uint64_t round = 0; round < rounds; ++round)
+        {
+            for (PlayerHandle id : seats)
+            {
+                Player &player = *players.get(id);
+                if (player.getCredits() < options.bet)
+                    player.setCredits(BANKROLL);
+                room.handle(id, ready);
+                host.runUpdates();
+            }
+            for (size_t i = 0; i < seats.size(); ++i)
+            {
+                before[i] = players.get(seats[i])->getCredits();
+                room.handle(seats[i], bet);
+                host.runUpdates();
+            }
+            PlayerHandle turn;
+            while ((turn = room.getCurrentTurn()))
+            {
+                room.handle(turn, wantsHit(players.get(turn)->getHand(), room.getDealerHand()[0]) ? hit : stand);
+                host.runUpdates();
+            }
+            if (room.getState() != GameState::ROUND_END)
+            {
+                std::cerr << "Room " << roomId << " stuck in " << GameRoom::getStateName(room.getState()) << " in round " << round << "\n";
+                stats.failed = true;
+                return;
+            }
+
+            // Payouts are in the balances, the hands stay up until the next round
+            for (size_t i = 0; i < seats.size(); ++i)
+            {
+                const Player &player = *players.get(seats[i]);
+                uint64_t returned = static_cast<uint64_t>(player.getCredits() - before[i] + options.bet);
+                stats.wagered += options.bet;
+                stats.returned += returned;
+                if (returned == 0)
+                {
+                    ++stats.losses;
+                    stats.busts += player.getHand().isBust();
+                }
+                else if (returned == static_cast<uint64_t>(options.bet))
+                    ++stats.pushes;
+                else
+                {
+                    ++stats.wins;
+                    stats.blackjacks += player.getHand().isBlackjack();
+                }
+            }
+            for (PlayerHandle id : seats)
+            {
+                room.handle(id, again);
+                host.runUpdates();
+            }
+        }
+        stats.rounds += rounds;
+        stats.hands += rounds * seats.size();
+        stats.messages += host.messages;
+        stats.frames += host.frames;
+        stats.frameBytes += host.frameBytes;
+    }
+
+    double percent(uint64_t part, uint64_t whole) { return whole == 0 ? 0.0 : 100.0 * static_cast<double>(part) / static_cast<double>(whole); }
+
+    int runSimulation(const Options &options)
+    {
+        int threads = options.threads > 0 ? options.threads : static_cast<int>(std::max(1u, std::thread::hardware_concurrency()));
+        threads = static_cast<int>(std::min<uint64_t>(threads, std::max<uint64_t>(1, options.rounds)));
+        std::vector<Stats> results(threads);
+        std::vector<std::thread> workers;
+
+        auto start = Clock::now();
+        for (int t = 0; t < threads; ++t)
+        {
+            // Thread t plays room t, so its shoe is the one room t of a server with this seed deals from
+            uint64_t rounds = options.rounds / threads + (static_cast<uint64_t>(t) < options.rounds % threads ? 1 : 0);
+            workers.emplace_back([&options, &results, t, rounds]()
+                                 { simulate(options, t, rounds, results[t]); });
+        }
+        for (auto &worker : workers)
+            worker.join();
+        double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+
+        Stats total;
+        for (const Stats &stats : results)
+            total.add(stats);
+        if (total.failed)
+            return 1;
+
+        std::printf("%llu rounds of %d hands on %d threads in %.2f s: %.0f rounds/s, %.0f hands/s\n",
+                    static_cast<unsigned long long>(total.rounds), options.players, threads, seconds,
+                    total.rounds / seconds, total.hands / seconds);
+        std::printf("hands: won %.2f %% (blackjack %.2f %%), pushed %.2f %%, lost %.2f %% (bust %.2f %%)\n",
+                    percent(total.wins, total.hands), percent(total.blackjacks, total.hands), percent(total.pushes, total.hands),
+                    percent(total.losses, total.hands), percent(total.busts, total.hands));
+        std::printf("RTP %.3f %%: %llu returned of %llu wagered\n", percent(total.returned, total.wagered),
+                    static_cast<unsigned long long>(total.returned), static_cast<unsigned long long>(total.wagered));
+        std::printf("output per round: %.1f messages, %.1f frames, %.0f frame bytes\n", static_cast<double>(total.messages) / total.rounds,
+                    static_cast<double>(total.frames) / total.rounds, static_cast<double>(total.frameBytes) / total.rounds);
+        return 0;
+    }
+
+    // Applies one shard's command log to fresh rooms. False if the replay went differently
+    bool replay(const std::string &path, bool verbose)
+    {
+        FILE *in = std::fopen(path.c_str(), "r");
+        if (in == nullptr)
+        {
+            std::cerr << "Cannot open " << path << "\n";
+            return false;
+        }
+        uint64_t seed = 0;
+        int decks = 0;
+        if (!CommandLog::readHeader(in, seed, decks))
+        {
+            std::cerr << path << " is not a command log\n";
+            std::fclose(in);
+            return false;
+        }
+
+        Config config;
+        config.seed = seed;
+        config.decks = decks;
+        SimHost host(config, WireFormat::TEXT);
+        host.printResults = verbose;
+        std::unordered_map<int, std::unique_ptr<GameRoom>> rooms;
+
+        CommandLog::Entry entry;
+        bool malformed = false;
+        uint64_t entries = 0, mismatches = 0, unknown = 0;
+        auto start = Clock::now();
+        while (CommandLog::read(in, entry, malformed))
+        {
+            ++entries;
+            host.currentMs = entry.ms;
+            auto it = rooms.find(entry.roomId);
+            if (entry.type == 'J')
+            {
+                // A room is created by its first player, its shoe starts over as in the server
+                if (it == rooms.end())
+                    it = rooms.emplace(entry.roomId, std::make_unique<GameRoom>(entry.roomId, host)).first;
+                it->second->addPlayer(host.addPlayer(entry.nickname, entry.value, entry.roomId));
+                host.dropUpdates();
+                continue;
+            }
+            if (it == rooms.end())
+            {
+                ++unknown;
+                continue;
+            }
+            GameRoom &room = *it->second;
+            PlayerHandle id = entry.nickname.empty() ? PlayerHandle{} : room.findPlayer(entry.nickname);
+            if (!entry.nickname.empty() && !id)
+            {
+                ++unknown;
+                if (verbose)
+                    std::printf("%llu room %d: %s is not seated\n", static_cast<unsigned long long>(entry.ms), entry.roomId, entry.nickname.c_str());
+                continue;
+            }
+
+            switch (entry.type)
+            {
+            case 'L':
+                if (host.getPlayers().get(id)->getCredits() != entry.value)
+                {
+                    ++mismatches;
+                    std::printf("%llu room %d: %s left with %d credits, recorded %d\n", static_cast<unsigned long long>(entry.ms), entry.roomId,
+                                entry.nickname.c_str(), host.getPlayers().get(id)->getCredits(), entry.value);
+                }
+                room.removePlayer(id);
+                host.release(id);
+                break;
+            case 'O':
+                room.setPlayerOffline(id, entry.value != 0);
+                break;
+            case 'C':
+                room.handle(id, Parser::parseView(entry.message));
+                break;
+            case 'T':
+                room.onTurnTimeout();
+                break;
+            case 'U':
+                room.takeUpdateRequest();
+                room.update();
+                break;
+            case 'R':
+                room.ResetDefaultState();
+                break;
+            case 'A':
+                room.abortRound();
+                break;
+            case 'X':
+                rooms.erase(it);
+                break;
+            }
+            host.dropUpdates();
+        }
+        double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+        std::fclose(in);
+
+        std::printf("%s: %llu entries over %.1f s of server time replayed in %.3f s (%.0f entries/s), %llu mismatched balances, %llu unknown players%s\n",
+                    path.c_str(), static_cast<unsigned long long>(entries), entry.ms / 1000.0, seconds, entries / std::max(seconds, 1e-9),
+                    static_cast<unsigned long long>(mismatches), static_cast<unsigned long long>(unknown),
+                    malformed ? ", stopped at a malformed or cut off line" : "");
+        return mismatches == 0 && unknown == 0 && !malformed;
+    }
+}
+
+static void printHelp()
+{
+    std::cout << "Usage: ./bj_sim [options]\n";
+    std::cout << "Options:\n";
+    std::cout << "  -r <rounds>   Rounds to simulate (default: 1000000)\n";
+    std::cout << "  -p <players>  Bots per room (1-" << MAX_PLAYERS << ", default: 5)\n";
+    std::cout << "  -t <threads>  Worker threads, one room each (default: one per core)\n";
+    std::cout << "  -s <seed>     Shoe seed, as the server's -s (default: 1)\n";
+    std::cout << "  -d <decks>    Decks per shoe (1-8, default: 6)\n";
+    std::cout << "  -b <credits>  Bet per hand (default: 10)\n";
+    std::cout << "  -f <format>   Snapshot wire format: text or binary (default: text)\n";
+    std::cout << "  -R <log>      Replay a command log written by the server's -z instead, repeatable\n";
+    std::cout << "  -v <0|1>      Print every replayed round result (default: 0)\n";
+    std::cout << "  -h, --help    Show this help message\n";
+}
+
+int main(int argc, char *argv[])
+{
+    Logger::setLevel(LogLevel::ERROR);
+    Options options;
+    for (int i = 1; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        if (arg == "-h" || arg == "--help")
+        {
+            printHelp();
+            return 0;
+        }
+        if (i + 1 >= argc)
+        {
+            std::cerr << "Missing value for " << arg << "\n";
+            return 1;
+        }
+        std::string value = argv[++i];
+        try
+        {
+            if (arg == "-r")
+                options.rounds = std::stoull(value);
+            else if (arg == "-p")
+                options.players = std::min(MAX_PLAYERS, std::max(1, std::stoi(value)));
+            else if (arg == "-t")
+                options.threads = std::max(1, std::stoi(value));
+            else if (arg == "-s")
+                options.seed = std::stoull(value);
+            else if (arg == "-d")
+                options.decks = std::min(8, std::max(1, std::stoi(value)));
+            else if (arg == "-b")
+                options.bet = std::max(1, std::stoi(value));
+            else if (arg == "-f" && (value == "text" || value == "binary"))
+                options.format = value == "binary" ? WireFormat::BINARY : WireFormat::TEXT;
+            else if (arg == "-R")
+                options.replays.push_back(value);
+            else if (arg == "-v")
+                options.verbose = std::stoi(value) != 0;
+            else
+            {
+                std::cerr << "Unknown argument: " << arg << " " << value << "\n";
+                printHelp();
+                return 1;
+            }
+        }
+        catch (const std::exception &)
+        {
+            std::cerr << "Invalid value for " << arg << ": '" << value << "'\n";
+            return 1;
+        }
+    }
+
+    if (options.replays.empty())
+        return runSimulation(options);
+    bool same = true;
+    for (const std::string &path : options.replays)
+        same = replay(path, options.verbose) && same;
+    return same ? 0 : 1;
+}
@@ -4,23 +4,65 @@
  * 
  * Config.h - Configuration structure for the blackjack server
  * Contains server configuration parameters including IP address, port, 
- * number of game rooms, and maximum players allowed.
+ * number of game rooms (fixed pool and on-demand limit), maximum players allowed and worker threads.
  */
 
 #ifndef CONFIG_H
 #define CONFIG_H
 
 #include <string>
+#include <cstddef>
+#include <cstdint>
 
 struct Config
 {
     std::string ipAddress;
     int port;
+    // Rooms open at startup, they are never reclaimed
     int rooms;
+    // More rooms are opened on demand while every room is full or mid-round, up to this many
+    int maxRooms;
+    // Seconds an on-demand room stays empty before it is reclaimed
+    int roomIdleTimeout;
     int maxPlayers;
+    // Unsent bytes allowed per connection before the client is dropped as too slow
+    size_t sendHighWaterMark;
+    // Room shard threads, 0 = one per core (never more than rooms)
+    int workers;
+    // Decks per room shoe
+    int decks;
+    // Seed of all room shoes, 0 = random at startup (logged for audit)
+    uint64_t seed;
+    // Disconnected sessions kept for reconnect: lifetime in seconds and how many at most
+    int sessionTtl;
+    size_t maxSessions;
+    // Minimum milliseconds between two lobby broadcasts, 0 = every loop pass with a change
+    int lobbyInterval;
+    // Port of the HTTP metrics endpoint, 0 = disabled
+    int adminPort;
+    // Directory keeping player credits across restarts, empty = credits are not saved
+    std::string dataDir;
+    // Seconds running rounds get to finish on shutdown / hot restart before they are called off
+    int drainTimeout;
+    // Pending connections the kernel queues per listening socket
+    int listenBacklog;
+    // Every worker thread accepts on its own SO_REUSEPORT listener too, spreading connection storms
+    bool reusePort;
+    // Command cost tokens each connection earns per second (see Commands.h), 0 = no rate limit
+    int rateLimit;
+    // Tokens a connection can save up for bursts
+    int rateBurst;
+    // Prefix of the per-shard room command logs, empty = not recorded
+    std::string commandLog;
+    // Prefix of the binary per-round journal, empty = rounds not journaled
+    std::string journal;
 
-    // Defaults: Port 10000, 6 rooms max, 20 players max connected
-    Config() : ipAddress("0.0.0.0"), port(10000), rooms(6), maxPlayers(20) {}
+    // Defaults: Port 10000, 6 rooms up front and up to 1000, empty extra rooms reclaimed after 60 s, 20 players max connected, 64 KiB send backlog, auto workers, 6 decks,
+    // sessions kept 30 minutes, at most 1000, lobby updates at most every 100 ms, no admin endpoint,
+    // credits not saved, rounds get 30 s to finish on shutdown, backlog of 1024, lobby thread accepts alone,
+    // rate limit of 40 tokens per second with bursts of up to 80 (10 room commands), room commands not recorded, rounds not journaled
+    Config() : ipAddress("0.0.0.0"), port(10000), rooms(6), maxRooms(1000), roomIdleTimeout(60), maxPlayers(20), sendHighWaterMark(64 * 1024), workers(0), decks(6), seed(0),
+               sessionTtl(30 * 60), maxSessions(1000), lobbyInterval(100), adminPort(0), dataDir(""), drainTimeout(30), listenBacklog(1024), reusePort(false), rateLimit(40), rateBurst(80), commandLog(""), journal("") {}
 };
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,48 @@
+/**
+ * Server for blackjack
+ * Author: Marek Manzel
+ *
+ * FixedVector.h - Fixed-capacity inline vector
+ * Small vector that stores up to N elements inside the object itself and never
+ * allocates. Used where the element count has a small protocol-defined bound.
+ */
+
+#ifndef FIXED_VECTOR_H
+#define FIXED_VECTOR_H
+
+#include <array>
+#include <cstddef>
+
+template <typename T, size_t N>
+class FixedVector
+{
+public:
+    // Returns false (and drops the element) when the vector is full
+    bool push_back(const T &value)
+    {
+        if (count == N)
+            return false;
+        items[count++] = value;
+        return true;
+    }
+
+    void clear() { count = 0; }
+    size_t size() const { return count; }
+    bool empty() const { return count == 0; }
+    bool full() const { return count == N; }
+    static constexpr size_t capacity() { return N; }
+
+    T &operator[](size_t i) { return items[i]; }
+    const T &operator[](size_t i) const { return items[i]; }
+
+    T *begin() { return items.data(); }
+    T *end() { return items.data() + count; }
+    const T *begin() const { return items.data(); }
+    const T *end() const { return items.data() + count; }
+
+private:
+    std::array<T, N> items{};
+    size_t count = 0;
+};
+
+#endif
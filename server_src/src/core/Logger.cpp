@@ -1,33 +1,254 @@
 #include "Logger.h"
+#include "Utils.h"
+#include <cerrno>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
 #include <ctime>
+#include <fcntl.h>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <unistd.h>
 #include <vector>
 
-std::mutex Logger::logMutex;
+namespace
+{
+    // Bytes of formatted lines, written by one thread and drained by the writer
+    class LogRing
+    {
+    public:
+        static constexpr size_t CAPACITY = 64 * 1024;
+
+        // Whole line or nothing, false if the ring is full
+        bool write(const char *data, size_t size)
+        {
+            size_t t = tail.load(std::memory_order_relaxed);
+            size_t h = head.load(std::memory_order_acquire);
+            if (CAPACITY - (t - h) < size)
+                return false;
+            size_t offset = t % CAPACITY;
+            size_t first = std::min(size, CAPACITY - offset);
+            std::memcpy(buffer + offset, data, first);
+            std::memcpy(buffer, data + first, size - first);
+            tail.store(t + size, std::memory_order_release);
+            return true;
+        }
+
+        // Appends everything published so far to 'out'
+        bool drainTo(std::string &out)
+        {
+            size_t h = head.load(std::memory_order_relaxed);
+            size_t t = tail.load(std::memory_order_acquire);
+            if (h == t)
+                return false;
+            size_t offset = h % CAPACITY;
+            size_t size = t - h;
+            size_t first = std::min(size, CAPACITY - offset);
+            out.append(buffer + offset, first);
+            out.append(buffer, size - first);
+            head.store(t, std::memory_order_release);
+            return true;
+        }
+
+        std::atomic<uint64_t> dropped{0};
+        std::atomic<bool> retired{false}; // owning thread exited
+
+    private:
+        char buffer[CAPACITY];
+        alignas(64) std::atomic<size_t> head{0};
+        alignas(64) std::atomic<size_t> tail{0};
+    };
+
+    class LogBackend
+    {
+    public:
+        // Never destroyed: other threads may still log while the process exits
+        static LogBackend &instance()
+        {
+            static LogBackend *backend = new LogBackend();
+            return *backend;
+        }
+
+        std::shared_ptr<LogRing> registerRing()
+        {
+            auto ring = std::make_shared<LogRing>();
+            std::lock_guard<std::mutex> lock(ringsMutex);
+            rings.push_back(ring);
+            return ring;
+        }
+
+        void setFd(int newFd)
+        {
+            std::lock_guard<std::mutex> lock(drainMutex);
+            int old = fd.exchange(newFd);
+            if (old != STDOUT_FILENO)
+                close(old);
+        }
+
+        // Moves every ring's lines into one batched write
+        bool drain()
+        {
+            std::lock_guard<std::mutex> lock(drainMutex);
+            batch.clear();
+            {
+                std::lock_guard<std::mutex> ringsLock(ringsMutex);
+                for (size_t i = 0; i < rings.size();)
+                {
+                    LogRing &ring = *rings[i];
+                    bool retired = ring.retired.load(std::memory_order_acquire);
+                    ring.drainTo(batch);
+                    uint64_t dropped = ring.dropped.exchange(0, std::memory_order_relaxed);
+                    if (dropped > 0)
+                        batch += "[WARN] " + std::to_string(dropped) + " log lines dropped (buffer full)\n";
+                    if (retired)
+                    {
+                        rings[i] = rings.back();
+                        rings.pop_back();
+                        continue;
+                    }
+                    ++i;
+                }
+            }
+            if (batch.empty())
+                return false;
+            Utils::writeAll(fd.load(), batch.data(), batch.size()); // nowhere left to report a failure
+            return true;
+        }
+
+    private:
+        LogBackend() : fd(STDOUT_FILENO)
+        {
+            std::atexit(Logger::flush);
+            std::thread([this]()
+                        { run(); })
+                .detach();
+        }
+
+        void run()
+        {
+            // Sleep longer the longer nothing is logged, a busy server is drained every few ms
+            auto idle = std::chrono::milliseconds(1);
+            while (true)
+            {
+                if (drain())
+                    idle = std::chrono::milliseconds(1);
+                else
+                    idle = std::min(idle * 2, std::chrono::milliseconds(50));
+                std::this_thread::sleep_for(idle);
+            }
+        }
+
+        std::atomic<int> fd;
+        std::mutex ringsMutex; // registration and draining only, never while logging
+        std::mutex drainMutex;
+        std::vector<std::shared_ptr<LogRing>> rings;
+        std::string batch;
+    };
+
+    struct ThreadLog
+    {
+        std::shared_ptr<LogRing> ring;
+        std::string line;
+        std::time_t cachedSecond = -1;
+        char timeBuf[20] = {};
+
+        ~ThreadLog()
+        {
+            if (ring)
+                ring->retired.store(true, std::memory_order_release);
+        }
+    };
+
+    thread_local ThreadLog threadLog;
+
+    const char *levelString(LogLevel level)
+    {
+        switch (level)
+        {
+        case LogLevel::INFO:
+            return "[INFO] ";
+        case LogLevel::WARNING:
+            return "[WARN] ";
+        case LogLevel::ERROR:
+            return "[ERR]  ";
+        case LogLevel::DEBUG:
+            return "[DEBUG]";
+        }
+        return "";
+    }
+}
 
 void Logger::log(LogLevel level, const std::string &message)
 {
-    std::lock_guard<std::mutex> lock(logMutex);
+    if (!enabled(level))
+        return;
 
-    std::time_t now = std::time(nullptr);
-    char timeBuf[20];
-    std::strftime(timeBuf, sizeof(timeBuf), "%Y-%m-%d %H:%M:%S", std::localtime(&now));
+    ThreadLog &local = threadLog;
+    if (!local.ring)
+        local.ring = LogBackend::instance().registerRing();
 
-    std::string levelStr;
-    switch (level)
+    // Timestamp is only reformatted when the second changes
+    std::time_t now = std::time(nullptr);
+    if (now != local.cachedSecond)
     {
-    case LogLevel::INFO:
-        levelStr = "[INFO] ";
-        break;
-    case LogLevel::WARNING:
-        levelStr = "[WARN] ";
-        break;
-    case LogLevel::ERROR:
-        levelStr = "[ERR]  ";
-        break;
-    case LogLevel::DEBUG:
-        levelStr = "[DEBUG]";
-        break;
+        std::tm tm;
+        localtime_r(&now, &tm);
+        std::strftime(local.timeBuf, sizeof(local.timeBuf), "%Y-%m-%d %H:%M:%S", &tm);
+        local.cachedSecond = now;
     }
 
-    std::cout << timeBuf << " " << levelStr << message << std::endl;
-}
\ No newline at end of file
+    local.line.assign(local.timeBuf);
+    local.line += ' ';
+    local.line += levelString(level);
+    local.line.append(message, 0, LogRing::CAPACITY / 2);
+    local.line += '\n';
+
+    if (!local.ring->write(local.line.data(), local.line.size()))
+        local.ring->dropped.fetch_add(1, std::memory_order_relaxed);
+}
+
+bool Logger::parseLevel(const std::string &name, LogLevel &level)
+{
+    if (name == "error")
+        level = LogLevel::ERROR;
+    else if (name == "warn")
+        level = LogLevel::WARNING;
+    else if (name == "info")
+        level = LogLevel::INFO;
+    else if (name == "debug")
+        level = LogLevel::DEBUG;
+    else
+        return false;
+    return true;
+}
+
+bool Logger::setOutputFile(const std::string &path)
+{
+    int fd = open(path.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+    if (fd < 0)
+        return false;
+    LogBackend::instance().setFd(fd);
+    return true;
+}
+
+void Logger::flush()
+{
+    LogBackend::instance().drain();
+}
+
+bool LogRateLimit::allow(uint64_t &suppressed)
+{
+    int64_t second = std::chrono::duration_cast<std::chrono::seconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+    int64_t current = window.load(std::memory_order_relaxed);
+    if (current != second && window.compare_exchange_strong(current, second, std::memory_order_relaxed))
+        count.store(0, std::memory_order_relaxed);
+
+    if (count.fetch_add(1, std::memory_order_relaxed) < LIMIT)
+    {
+        suppressed = dropped.exchange(0, std::memory_order_relaxed);
+        return true;
+    }
+    dropped.fetch_add(1, std::memory_order_relaxed);
+    return false;
+}
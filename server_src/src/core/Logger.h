@@ -2,23 +2,27 @@
  * Server for blackjack
  * Author: Marek Manzel
  * 
- * Logger.h - Thread-safe logging system for the blackjack server
+ * Logger.h - Asynchronous logging system for the blackjack server
  * Provides static methods for logging messages with different severity levels
- * (INFO, WARNING, ERROR, DEBUG) to the console with timestamps.
+ * (ERROR, WARNING, INFO, DEBUG) with timestamps. Each thread formats its lines
+ * into its own lock-free ring, a background writer batches them to stdout or
+ * a log file. Use the LOG_* macros: below the configured level they cost one
+ * branch and the message is never built.
  */
 
 #ifndef LOGGER_H
 #define LOGGER_H
 
+#include <atomic>
+#include <cstdint>
 #include <string>
-#include <mutex>
-#include <iostream>
 
+// Ordered by verbosity, a level enables itself and everything above it
 enum class LogLevel
 {
-    INFO,
-    WARNING,
     ERROR,
+    WARNING,
+    INFO,
     DEBUG
 };
 
@@ -27,11 +31,66 @@ class Logger
 public:
     static void log(LogLevel level, const std::string &message);
     static void error(const std::string &message) { log(LogLevel::ERROR, message); }
+    static void warning(const std::string &message) { log(LogLevel::WARNING, message); }
     static void info(const std::string &message) { log(LogLevel::INFO, message); }
     static void debug(const std::string &message) { log(LogLevel::DEBUG, message); }
 
+    static bool enabled(LogLevel level) { return static_cast<int>(level) <= minLevel.load(std::memory_order_relaxed); }
+    static void setLevel(LogLevel level) { minLevel.store(static_cast<int>(level), std::memory_order_relaxed); }
+    // "error", "warn", "info" or "debug"
+    static bool parseLevel(const std::string &name, LogLevel &level);
+
+    // Appends to 'path' instead of stdout, false if it cannot be opened
+    static bool setOutputFile(const std::string &path);
+    // Writes everything logged so far, called at exit
+    static void flush();
+
 private:
-    static std::mutex logMutex;
+    static inline std::atomic<int> minLevel{static_cast<int>(LogLevel::DEBUG)};
 };
 
-#endif
\ No newline at end of file
+// Lets a call site through LIMIT times per second, the rest is counted and
+// reported with the next line that gets through
+class LogRateLimit
+{
+public:
+    static constexpr uint32_t LIMIT = 10;
+
+    // Returns false if the line should be dropped, 'suppressed' = lines dropped since the last one
+    bool allow(uint64_t &suppressed);
+
+private:
+    std::atomic<int64_t> window{-1};
+    std::atomic<uint32_t> count{0};
+    std::atomic<uint64_t> dropped{0};
+};
+
+#define BJ_LOG(level, ...)                      \
+    do                                          \
+    {                                           \
+        if (Logger::enabled(level))             \
+            Logger::log(level, __VA_ARGS__);    \
+    } while (0)
+
+#define LOG_ERROR(...) BJ_LOG(LogLevel::ERROR, __VA_ARGS__)
+#define LOG_WARN(...) BJ_LOG(LogLevel::WARNING, __VA_ARGS__)
+#define LOG_INFO(...) BJ_LOG(LogLevel::INFO, __VA_ARGS__)
+#define LOG_DEBUG(...) BJ_LOG(LogLevel::DEBUG, __VA_ARGS__)
+
+// For lines that can repeat per message or per client (e.g. a flood of slow clients)
+#define BJ_LOG_LIMITED(level, ...)                                                                \
+    do                                                                                            \
+    {                                                                                             \
+        static LogRateLimit bjLogLimit;                                                           \
+        uint64_t bjLogSuppressed = 0;                                                             \
+        if (Logger::enabled(level) && bjLogLimit.allow(bjLogSuppressed))                          \
+            Logger::log(level, bjLogSuppressed == 0 ? std::string(__VA_ARGS__)                    \
+                                                    : std::string(__VA_ARGS__) + " (" +           \
+                                                          std::to_string(bjLogSuppressed) +       \
+                                                          " similar messages suppressed)");       \
+    } while (0)
+
+#define LOG_ERROR_LIMITED(...) BJ_LOG_LIMITED(LogLevel::ERROR, __VA_ARGS__)
+#define LOG_WARN_LIMITED(...) BJ_LOG_LIMITED(LogLevel::WARNING, __VA_ARGS__)
+
+#endif
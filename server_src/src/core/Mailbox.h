@@ -0,0 +1,122 @@
+/**
+ * Server for blackjack
+ * Author: Marek Manzel
+ *
+ * Mailbox.h - Bounded lock-free multi-producer / single-consumer queue
+ * Other threads post messages, the owning loop drains them in one batch after
+ * being woken up. Posting never takes a lock and never touches the state of
+ * the receiving loop; a full mailbox rejects the message and the producer
+ * keeps it for a later retry. Depth, high-water and rejection counters are
+ * kept for monitoring.
+ */
+
+#ifndef MAILBOX_H
+#define MAILBOX_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <vector>
+
+template <typename T, size_t Capacity = 1024>
+class Mailbox
+{
+    static_assert(Capacity >= 2 && (Capacity & (Capacity - 1)) == 0, "Mailbox capacity must be a power of two");
+
+public:
+    Mailbox() : slots(new Slot[Capacity]), tail(0), head(0), highWater(0), rejected(0)
+    {
+        for (size_t i = 0; i < Capacity; ++i)
+            slots[i].sequence.store(i, std::memory_order_relaxed);
+    }
+
+    Mailbox(const Mailbox &) = delete;
+    Mailbox &operator=(const Mailbox &) = delete;
+
+    // Any thread. Moves from 'message' only on success, false if the mailbox is full
+    bool post(T &message)
+    {
+        size_t pos = tail.load(std::memory_order_relaxed);
+        Slot *slot;
+        while (true)
+        {
+            slot = &slots[pos & (Capacity - 1)];
+            size_t sequence = slot->sequence.load(std::memory_order_acquire);
+            intptr_t diff = static_cast<intptr_t>(sequence) - static_cast<intptr_t>(pos);
+            if (diff == 0)
+            {
+                // Slot is free for this position, claim it
+                if (tail.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                    break;
+            }
+            else if (diff < 0)
+            {
+                // Consumer has not freed the slot from the previous lap yet
+                rejected.fetch_add(1, std::memory_order_relaxed);
+                return false;
+            }
+            else
+            {
+                pos = tail.load(std::memory_order_relaxed);
+            }
+        }
+
+        slot->value.emplace(std::move(message));
+        slot->sequence.store(pos + 1, std::memory_order_release);
+
+        size_t current = pos + 1 - head.load(std::memory_order_relaxed);
+        size_t seen = highWater.load(std::memory_order_relaxed);
+        while (current > seen && !highWater.compare_exchange_weak(seen, current, std::memory_order_relaxed))
+        {
+        }
+        return true;
+    }
+
+    // Owning loop only. Appends every published message to 'out'
+    void drain(std::vector<T> &out)
+    {
+        size_t pos = head.load(std::memory_order_relaxed);
+        while (true)
+        {
+            Slot &slot = slots[pos & (Capacity - 1)];
+            size_t sequence = slot.sequence.load(std::memory_order_acquire);
+            if (sequence != pos + 1)
+                break; // empty, or the producer of this slot has not finished writing
+
+            out.push_back(std::move(*slot.value));
+            slot.value.reset();
+            slot.sequence.store(pos + Capacity, std::memory_order_release);
+            ++pos;
+        }
+        head.store(pos, std::memory_order_relaxed);
+    }
+
+    // Approximate when read from another thread
+    size_t depth() const
+    {
+        size_t t = tail.load(std::memory_order_relaxed);
+        size_t h = head.load(std::memory_order_relaxed);
+        return t > h ? t - h : 0;
+    }
+    size_t getHighWater() const { return highWater.load(std::memory_order_relaxed); }
+    uint64_t getRejected() const { return rejected.load(std::memory_order_relaxed); }
+    static constexpr size_t capacity() { return Capacity; }
+
+private:
+    struct Slot
+    {
+        std::atomic<size_t> sequence;
+        std::optional<T> value;
+    };
+
+    std::unique_ptr<Slot[]> slots;
+    // Producers and the consumer write different counters, keep them on separate cache lines
+    alignas(64) std::atomic<size_t> tail;
+    alignas(64) std::atomic<size_t> head;
+    alignas(64) std::atomic<size_t> highWater;
+    std::atomic<uint64_t> rejected;
+};
+
+#endif
@@ -0,0 +1,113 @@
+#include "Metrics.h"
+#include <cstdio>
+
+uint64_t Histogram::count() const
+{
+    uint64_t total = 0;
+    for (const auto &bucket : buckets)
+        total += bucket.load(std::memory_order_relaxed);
+    return total;
+}
+
+uint64_t Histogram::upperBound(size_t index) const
+{
+    if (index == 0)
+        return uint64_t{1} << minShift;
+    // Bucket 1 + 2k is [2^o, 1.5 * 2^o), bucket 2 + 2k is [1.5 * 2^o, 2^(o+1)) with o = minShift + k
+    unsigned octave = minShift + static_cast<unsigned>((index - 1) / SUB_BUCKETS);
+    uint64_t base = uint64_t{1} << octave;
+    return (index - 1) % SUB_BUCKETS == 0 ? base + base / 2 : base * 2;
+}
+
+static std::string formatValue(double value)
+{
+    char buffer[32];
+    std::snprintf(buffer, sizeof(buffer), "%.9g", value);
+    return buffer;
+}
+
+void Histogram::render(std::string &out, const std::string &name, const std::string &labels, double unit) const
+{
+    const std::string prefix = labels.empty() ? "" : labels + ",";
+    const std::string suffix = labels.empty() ? "" : "{" + labels + "}";
+
+    // Buckets are read one by one while other threads keep recording, the snapshot is only
+    // approximately consistent. _count is the cumulative total so it always matches +Inf
+    uint64_t cumulative = 0;
+    size_t used = 1 + static_cast<size_t>(octaves) * SUB_BUCKETS;
+    for (size_t i = 0; i < used; ++i)
+    {
+        cumulative += buckets[i].load(std::memory_order_relaxed);
+        out += name + "_bucket{" + prefix + "le=\"" + formatValue(static_cast<double>(upperBound(i)) * unit) + "\"} " +
+               std::to_string(cumulative) + "\n";
+    }
+    cumulative += buckets[BUCKETS - 1].load(std::memory_order_relaxed);
+    out += name + "_bucket{" + prefix + "le=\"+Inf\"} " + std::to_string(cumulative) + "\n";
+    out += name + "_sum" + suffix + " " + formatValue(static_cast<double>(sum.load(std::memory_order_relaxed)) * unit) + "\n";
+    out += name + "_count" + suffix + " " + std::to_string(cumulative) + "\n";
+}
+
+static void renderHeader(std::string &out, const char *name, const char *type, const char *help)
+{
+    out += std::string("# HELP ") + name + " " + help + "\n";
+    out += std::string("# TYPE ") + name + " " + type + "\n";
+}
+
+static void renderCounter(std::string &out, const char *name, const char *help, const Counter &counter)
+{
+    renderHeader(out, name, "counter", help);
+    out += std::string(name) + " " + std::to_string(counter.get()) + "\n";
+}
+
+static void renderGauge(std::string &out, const char *name, const char *help, const Gauge &gauge)
+{
+    renderHeader(out, name, "gauge", help);
+    out += std::string(name) + " " + std::to_string(gauge.get()) + "\n";
+}
+
+static void renderHistogram(std::string &out, const char *name, const char *help, const Histogram &histogram, double unit)
+{
+    renderHeader(out, name, "histogram", help);
+    histogram.render(out, name, "", unit);
+}
+
+std::string Metrics::renderPrometheus()
+{
+    static const char *const commandNames[COMMAND_COUNT] = {
+#define BJ_COMMAND_NAME(name, wire, binary, cost) wire,
+        BJ_CLIENT_COMMANDS(BJ_COMMAND_NAME)
+#undef BJ_COMMAND_NAME
+        "UNKNOWN"};
+    constexpr double NANOSECONDS = 1e-9;
+
+    std::string out;
+    out.reserve(32 * 1024);
+
+    renderCounter(out, "bj_received_bytes_total", "Bytes read from client sockets", bytesIn);
+    renderCounter(out, "bj_sent_bytes_total", "Bytes written to client sockets", bytesOut);
+    renderCounter(out, "bj_accepted_connections_total", "Client connections accepted", accepted);
+    renderCounter(out, "bj_rejected_connections_total", "Client connections refused because max players was reached", rejected);
+    renderGauge(out, "bj_connections", "Client connections currently open", connections);
+    renderGauge(out, "bj_rooms", "Game rooms currently open", rooms);
+    renderGauge(out, "bj_spectators", "Clients currently watching a room without a seat", spectators);
+    renderCounter(out, "bj_invalid_message_kicks_total", "Clients disconnected for invalid or oversized messages", invalidMessageKicks);
+    renderCounter(out, "bj_heartbeat_timeouts_total", "Clients disconnected for not answering heartbeats", heartbeatTimeouts);
+    renderCounter(out, "bj_slow_client_drops_total", "Clients disconnected because their send queue exceeded the high-water mark", slowClientDrops);
+    renderCounter(out, "bj_rate_limit_kicks_total", "Clients disconnected for exceeding the rate limit without pause", rateLimitKicks);
+    renderCounter(out, "bj_rate_limited_messages_total", "Messages dropped unprocessed by the per-connection rate limit", rateLimitedMessages);
+    renderCounter(out, "bj_journal_events_total", "Round journal events written to disk", journalEvents);
+    renderCounter(out, "bj_journal_lost_events_total", "Round journal events dropped because a room's ring was full or the write failed", journalLost);
+
+    renderHistogram(out, "bj_loop_pass_seconds", "Time an event loop spends handling one batch of ready events", loopPass, NANOSECONDS);
+    renderHistogram(out, "bj_parse_seconds", "Time to parse one protocol line", parse, NANOSECONDS);
+    renderHistogram(out, "bj_send_queue_bytes", "Unsent bytes of a connection when its queue is flushed", sendQueueBytes, 1.0);
+
+    // Commands only show up once used, PING/PONG are answered by the loop and never dispatched
+    renderHeader(out, "bj_command_seconds", "histogram", "Time to handle one client command in the lobby or a room");
+    for (size_t i = 0; i < COMMAND_COUNT; ++i)
+    {
+        if (commands[i].count() > 0)
+            commands[i].render(out, "bj_command_seconds", std::string("command=\"") + commandNames[i] + "\"", NANOSECONDS);
+    }
+    return out;
+}
@@ -0,0 +1,134 @@
+/**
+ * Server for blackjack
+ * Author: Marek Manzel
+ *
+ * Metrics.h - Process-wide counters and latency histograms
+ * Every event loop updates the same metrics with relaxed atomic adds, nothing
+ * on the hot path takes a lock or allocates. Histograms are HDR-style: two
+ * linear sub-buckets per power of two, so the relative error of a bucket bound
+ * stays under 50 % from microseconds to seconds with a fixed, small table.
+ * Metrics::renderPrometheus() formats a snapshot in the Prometheus text
+ * format, the admin endpoint serves it.
+ */
+
+#ifndef METRICS_H
+#define METRICS_H
+
+#include "../protocol/Commands.h"
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string>
+
+class Counter
+{
+public:
+    void add(uint64_t n = 1) { value.fetch_add(n, std::memory_order_relaxed); }
+    uint64_t get() const { return value.load(std::memory_order_relaxed); }
+
+private:
+    std::atomic<uint64_t> value{0};
+};
+
+class Gauge
+{
+public:
+    void add(int64_t n) { value.fetch_add(n, std::memory_order_relaxed); }
+    int64_t get() const { return value.load(std::memory_order_relaxed); }
+
+private:
+    std::atomic<int64_t> value{0};
+};
+
+class Histogram
+{
+public:
+    static constexpr unsigned SUB_BUCKETS = 2;
+    static constexpr unsigned MAX_OCTAVES = 32;
+
+    // Values below 2^minShift share the first bucket, values from 2^(minShift + octaves) on
+    // are only counted towards +Inf. The default suits nanosecond latencies, 1 us .. ~17 s
+    Histogram(unsigned minShift = 10, unsigned octaves = 24) : minShift(minShift), octaves(octaves < MAX_OCTAVES ? octaves : MAX_OCTAVES) {}
+
+    void record(uint64_t value)
+    {
+        buckets[bucketOf(value)].fetch_add(1, std::memory_order_relaxed);
+        sum.fetch_add(value, std::memory_order_relaxed);
+    }
+    void record(std::chrono::steady_clock::duration elapsed)
+    {
+        record(static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count()));
+    }
+    void recordSince(std::chrono::steady_clock::time_point start) { record(std::chrono::steady_clock::now() - start); }
+
+    uint64_t count() const;
+    // Appends the _bucket/_sum/_count series, bounds and sum are multiplied by 'unit'
+    // (1e-9 turns nanoseconds into the seconds Prometheus expects). 'labels' is "" or "a=\"b\""
+    void render(std::string &out, const std::string &name, const std::string &labels, double unit) const;
+
+private:
+    size_t bucketOf(uint64_t value) const
+    {
+        if (value < (uint64_t{1} << minShift))
+            return 0;
+        unsigned octave = 63 - static_cast<unsigned>(__builtin_clzll(value));
+        if (octave >= minShift + octaves)
+            return BUCKETS - 1;
+        // Bit below the leading one picks the lower or upper half of the octave
+        unsigned half = octave > 0 ? static_cast<unsigned>((value >> (octave - 1)) & 1) : 0;
+        return 1 + (octave - minShift) * SUB_BUCKETS + half;
+    }
+    // Exclusive upper bound of bucket 'index' (ignored for the overflow bucket)
+    uint64_t upperBound(size_t index) const;
+
+    static constexpr size_t BUCKETS = 1 + MAX_OCTAVES * SUB_BUCKETS + 1;
+
+    unsigned minShift;
+    unsigned octaves;
+    std::array<std::atomic<uint64_t>, BUCKETS> buckets{};
+    std::atomic<uint64_t> sum{0};
+};
+
+class Metrics
+{
+public:
+    // Traffic
+    static inline Counter bytesIn;
+    static inline Counter bytesOut;
+    static inline Counter accepted;
+    static inline Counter rejected; // max players reached
+    static inline Gauge connections;
+    // Game rooms open, the fixed pool and the ones opened on demand
+    static inline Gauge rooms;
+    // Clients watching a room without a seat
+    static inline Gauge spectators;
+
+    // Clients dropped by the server
+    static inline Counter invalidMessageKicks;
+    static inline Counter heartbeatTimeouts;
+    static inline Counter slowClientDrops;
+    static inline Counter rateLimitKicks;
+    // Messages dropped unprocessed by the per-connection rate limit
+    static inline Counter rateLimitedMessages;
+
+    // Round journal events written / dropped (room ring full or write failed)
+    static inline Counter journalEvents;
+    static inline Counter journalLost;
+
+    // Nanoseconds from the poller waking up to the end of the pass, 1 us .. ~17 s
+    static inline Histogram loopPass;
+    // Nanoseconds, 16 ns .. ~16 ms
+    static inline Histogram parse{4, 20};
+    // Unsent bytes of a connection when its queue is flushed, 16 B .. 1 MiB
+    static inline Histogram sendQueueBytes{4, 16};
+    // Nanoseconds to dispatch one command to the lobby / a room, indexed by Command
+    static inline std::array<Histogram, COMMAND_COUNT> commands;
+
+    static Histogram &command(Command command) { return commands[static_cast<size_t>(command)]; }
+
+    // Snapshot of everything in the Prometheus text exposition format
+    static std::string renderPrometheus();
+};
+
+#endif
@@ -0,0 +1,67 @@
+/**
+ * Server for blackjack
+ * Author: Marek Manzel
+ *
+ * Random.h - Small, fast, seedable PRNG (xoshiro256**)
+ * One instance per owner (e.g. per room), no shared or hidden global state,
+ * the same seed always gives the same sequence.
+ */
+
+#ifndef RANDOM_H
+#define RANDOM_H
+
+#include <array>
+#include <cstdint>
+
+class Xoshiro256
+{
+public:
+    explicit Xoshiro256(uint64_t seed) { reseed(seed); }
+
+    void reseed(uint64_t seed)
+    {
+        // State expanded with splitmix64 as recommended, never all zero
+        for (auto &word : state)
+            word = splitmix64(seed);
+    }
+
+    uint64_t next()
+    {
+        uint64_t result = rotl(state[1] * 5, 7) * 9;
+        uint64_t t = state[1] << 17;
+        state[2] ^= state[0];
+        state[3] ^= state[1];
+        state[1] ^= state[2];
+        state[0] ^= state[3];
+        state[2] ^= t;
+        state[3] = rotl(state[3], 45);
+        return result;
+    }
+
+    // Uniform in [0, bound), without modulo bias
+    uint64_t below(uint64_t bound)
+    {
+        uint64_t threshold = (0 - bound) % bound;
+        uint64_t value;
+        do
+        {
+            value = next();
+        } while (value < threshold);
+        return value % bound;
+    }
+
+    static uint64_t splitmix64(uint64_t &x)
+    {
+        uint64_t z = (x += 0x9E3779B97F4A7C15ull);
+        z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+        z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+        return z ^ (z >> 31);
+    }
+
+private:
+    static uint64_t rotl(uint64_t x, int k) { return (x << k) | (x >> (64 - k)); }
+
+    std::array<uint64_t, 4> state;
+};
+
+#endif
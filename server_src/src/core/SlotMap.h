@@ -0,0 +1,220 @@
+/**
+ * Server for blackjack
+ * Author: Marek Manzel
+ *
+ * SlotMap.h - Generational slot storage and fd-indexed tables
+ * SlotMap keeps its elements inline in fixed-size chunks, so neighbouring
+ * objects share cache lines and an element never moves while it is alive.
+ * Elements are addressed by a handle of slot index + generation; a freed slot
+ * bumps its generation, so a handle kept past an erase (e.g. by a timer)
+ * resolves to nullptr instead of a reused object.
+ * FdTable maps socket descriptors straight to their owned objects by array
+ * index, with the same generation check for handles captured by timers.
+ * Neither is thread-safe, each event loop owns its own tables.
+ */
+
+#ifndef SLOT_MAP_H
+#define SLOT_MAP_H
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <utility>
+#include <vector>
+
+struct SlotHandle
+{
+    uint32_t index = 0;
+    uint32_t generation = 0; // 0 is never live, a default handle refers to nothing
+
+    explicit operator bool() const { return generation != 0; }
+    bool operator==(const SlotHandle &other) const { return index == other.index && generation == other.generation; }
+    bool operator!=(const SlotHandle &other) const { return !(*this == other); }
+};
+
+template <typename T, size_t ChunkSize = 64>
+class SlotMap
+{
+public:
+    using Handle = SlotHandle;
+
+    SlotMap() = default;
+    SlotMap(const SlotMap &) = delete;
+    SlotMap &operator=(const SlotMap &) = delete;
+
+    template <typename... Args>
+    Handle emplace(Args &&...args)
+    {
+        uint32_t index;
+        if (!freeSlots.empty())
+        {
+            // Most recently freed first, its chunk is likely still cached
+            index = freeSlots.back();
+            freeSlots.pop_back();
+        }
+        else
+        {
+            index = static_cast<uint32_t>(used++);
+            if (index / ChunkSize == chunks.size())
+                chunks.push_back(std::make_unique<Chunk>());
+        }
+        Slot &s = slot(index);
+        s.value.emplace(std::forward<Args>(args)...);
+        ++count;
+        return Handle{index, s.generation};
+    }
+
+    // nullptr for a stale or default handle
+    T *get(Handle handle)
+    {
+        if (handle.index >= used)
+            return nullptr;
+        Slot &s = slot(handle.index);
+        return (s.value && s.generation == handle.generation) ? &*s.value : nullptr;
+    }
+    const T *get(Handle handle) const { return const_cast<SlotMap *>(this)->get(handle); }
+    bool contains(Handle handle) const { return get(handle) != nullptr; }
+
+    // Removes the element and returns it, empty for a stale handle
+    std::optional<T> take(Handle handle)
+    {
+        T *value = get(handle);
+        if (value == nullptr)
+            return std::nullopt;
+        std::optional<T> out(std::move(*value));
+        release(handle.index);
+        return out;
+    }
+
+    bool erase(Handle handle)
+    {
+        if (get(handle) == nullptr)
+            return false;
+        release(handle.index);
+        return true;
+    }
+
+    size_t size() const { return count; }
+    bool empty() const { return count == 0; }
+
+    // f(Handle, T &) for every live element in slot order, must not insert or erase
+    template <typename F>
+    void forEach(F f)
+    {
+        for (size_t index = 0; index < used; ++index)
+        {
+            Slot &s = slot(index);
+            if (s.value)
+                f(Handle{static_cast<uint32_t>(index), s.generation}, *s.value);
+        }
+    }
+
+private:
+    struct Slot
+    {
+        uint32_t generation = 1;
+        std::optional<T> value;
+    };
+    using Chunk = std::array<Slot, ChunkSize>;
+
+    Slot &slot(size_t index) { return (*chunks[index / ChunkSize])[index % ChunkSize]; }
+
+    void release(uint32_t index)
+    {
+        Slot &s = slot(index);
+        s.value.reset();
+        if (++s.generation == 0)
+            s.generation = 1;
+        freeSlots.push_back(index);
+        --count;
+    }
+
+    // Chunks never move, element addresses stay valid until the element is erased
+    std::vector<std::unique_ptr<Chunk>> chunks;
+    std::vector<uint32_t> freeSlots;
+    size_t used = 0; // slots ever handed out
+    size_t count = 0;
+};
+
+template <typename T>
+class FdTable
+{
+public:
+    struct Handle
+    {
+        int fd = -1;
+        uint32_t generation = 0;
+    };
+
+    FdTable() = default;
+    FdTable(const FdTable &) = delete;
+    FdTable &operator=(const FdTable &) = delete;
+
+    // Takes ownership, an entry already registered for 'fd' is replaced
+    Handle insert(int fd, std::unique_ptr<T> value)
+    {
+        if (static_cast<size_t>(fd) >= entries.size())
+            entries.resize(static_cast<size_t>(fd) + 1);
+        Entry &entry = entries[fd];
+        if (!entry.value)
+            ++count;
+        entry.value = std::move(value);
+        if (++entry.generation == 0)
+            entry.generation = 1;
+        return Handle{fd, entry.generation};
+    }
+
+    T *find(int fd) const
+    {
+        if (fd < 0 || static_cast<size_t>(fd) >= entries.size())
+            return nullptr;
+        return entries[fd].value.get();
+    }
+    // nullptr once the descriptor was released, even if its number was reused since
+    T *find(Handle handle) const
+    {
+        T *value = find(handle.fd);
+        return (value != nullptr && entries[handle.fd].generation == handle.generation) ? value : nullptr;
+    }
+    Handle handleOf(int fd) const
+    {
+        return find(fd) != nullptr ? Handle{fd, entries[fd].generation} : Handle{};
+    }
+
+    // Gives up ownership without destroying the object (e.g. to move it to another loop)
+    std::unique_ptr<T> release(int fd)
+    {
+        if (find(fd) == nullptr)
+            return nullptr;
+        --count;
+        return std::move(entries[fd].value);
+    }
+    void erase(int fd) { release(fd); }
+
+    size_t size() const { return count; }
+
+    // f(int fd, T &) for every entry in descriptor order, must not insert or erase
+    template <typename F>
+    void forEach(F f)
+    {
+        for (size_t fd = 0; fd < entries.size(); ++fd)
+        {
+            if (entries[fd].value)
+                f(static_cast<int>(fd), *entries[fd].value);
+        }
+    }
+
+private:
+    struct Entry
+    {
+        uint32_t generation = 0;
+        std::unique_ptr<T> value;
+    };
+
+    std::vector<Entry> entries;
+    size_t count = 0;
+};
+
+#endif
@@ -0,0 +1,150 @@
+#include "TimerWheel.h"
+#include <algorithm>
+
+TimerWheel::TimerWheel(Clock::time_point startTime) : start(startTime), currentTick(0), nextId(1) {}
+
+uint64_t TimerWheel::toTick(Clock::time_point time, bool roundUp) const
+{
+    int64_t ms = std::chrono::duration_cast<std::chrono::milliseconds>(time - start).count();
+    if (ms <= 0)
+        return 0;
+    return static_cast<uint64_t>(roundUp ? (ms + TICK_MS - 1) / TICK_MS : ms / TICK_MS);
+}
+
+TimerWheel::TimerId TimerWheel::schedule(Clock::time_point deadline, std::function<void()> callback)
+{
+    // Never in the current tick, it was already processed
+    uint64_t expiry = std::max(toTick(deadline, true), currentTick + 1);
+    TimerId id = nextId++;
+    timers.emplace(id, Timer{expiry, std::move(callback)});
+    place(id, expiry);
+    return id;
+}
+
+void TimerWheel::cancel(TimerId id)
+{
+    timers.erase(id);
+}
+
+void TimerWheel::place(TimerId id, uint64_t expiry)
+{
+    // Too far out for the wheel: park in the furthest slot, it is re-placed on cascade
+    uint64_t target = std::min(expiry, currentTick + MAX_SPAN);
+
+    // Level = highest 6-bit group in which the expiry differs from the current tick
+    uint64_t diff = target ^ currentTick;
+    int level = 0;
+    while (level < LEVELS - 1 && (diff >> (SLOT_BITS * (level + 1))) != 0)
+        ++level;
+    wheel[level][(target >> (SLOT_BITS * level)) & SLOT_MASK].push_back(id);
+}
+
+void TimerWheel::cascade(int level)
+{
+    auto &slot = wheel[level][(currentTick >> (SLOT_BITS * level)) & SLOT_MASK];
+    std::vector<TimerId> ids;
+    ids.swap(slot);
+    for (TimerId id : ids)
+    {
+        auto it = timers.find(id);
+        if (it != timers.end())
+            place(id, it->second.expiry);
+    }
+}
+
+size_t TimerWheel::advance(Clock::time_point now)
+{
+    uint64_t target = toTick(now, false);
+    if (timers.empty())
+    {
+        // Nothing to fire, slots only hold cancelled ids
+        if (target > currentTick)
+        {
+            for (auto &level : wheel)
+                for (auto &slot : level)
+                    slot.clear();
+            currentTick = target;
+        }
+        return 0;
+    }
+
+    size_t fired = 0;
+    std::vector<TimerId> due;
+    while (currentTick < target)
+    {
+        ++currentTick;
+
+        // Entering a new block of a level moves its timers one level down, highest level first
+        if ((currentTick & SLOT_MASK) == 0)
+        {
+            int top = 1;
+            while (top < LEVELS - 1 && ((currentTick >> (SLOT_BITS * top)) & SLOT_MASK) == 0)
+                ++top;
+            for (int level = top; level >= 1; --level)
+                cascade(level);
+        }
+
+        due.clear();
+        due.swap(wheel[0][currentTick & SLOT_MASK]);
+        for (TimerId id : due)
+        {
+            auto it = timers.find(id);
+            if (it == timers.end())
+                continue;
+            if (it->second.expiry > currentTick)
+            {
+                // Was parked beyond the wheel span
+                place(id, it->second.expiry);
+                continue;
+            }
+            // Removed before running, the callback may schedule or cancel freely
+            std::function<void()> callback = std::move(it->second.callback);
+            timers.erase(it);
+            callback();
+            ++fired;
+        }
+
+        if (timers.empty())
+        {
+            currentTick = target;
+            break;
+        }
+    }
+    return fired;
+}
+
+int TimerWheel::timeoutMs(Clock::time_point now) const
+{
+    if (timers.empty())
+        return -1;
+
+    // First slot with a live timer; for upper levels that is the tick at which the slot cascades
+    uint64_t next = 0;
+    for (int level = 0; level < LEVELS && next == 0; ++level)
+    {
+        int shift = SLOT_BITS * level;
+        uint64_t index = (currentTick >> shift) & SLOT_MASK;
+        for (uint64_t step = 1; step <= SLOTS && next == 0; ++step)
+        {
+            uint64_t slotIndex = (index + step) & SLOT_MASK;
+            for (TimerId id : wheel[level][slotIndex])
+            {
+                if (timers.count(id))
+                {
+                    // Start tick of that slot in the current or next block of this level
+                    next = ((currentTick >> shift) + step) << shift;
+                    break;
+                }
+            }
+        }
+    }
+    if (next == 0)
+        next = currentTick + 1;
+
+    int64_t deadlineMs = static_cast<int64_t>(next) * TICK_MS;
+    int64_t nowMs = std::chrono::duration_cast<std::chrono::milliseconds>(now - start).count();
+    int64_t wait = deadlineMs - nowMs;
+    if (wait < 0)
+        return 0;
+    return static_cast<int>(std::min<int64_t>(wait, 60 * 1000));
+}
@@ -0,0 +1,70 @@
+/**
+ * Server for blackjack
+ * Author: Marek Manzel
+ *
+ * TimerWheel.h - Hierarchical timer wheel driven by an event loop
+ * Timers are kept in 4 levels of 64 slots with 10 ms ticks (up to ~46 hours),
+ * scheduling and cancelling are O(1) and advancing only touches the timers
+ * that expire or cascade to a lower level. The owning loop uses the time to
+ * the next deadline as its poll timeout. Not thread-safe, one wheel per loop.
+ */
+
+#ifndef TIMER_WHEEL_H
+#define TIMER_WHEEL_H
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <unordered_map>
+#include <vector>
+
+class TimerWheel
+{
+public:
+    using Clock = std::chrono::steady_clock;
+    // 0 is never handed out, usable as "no timer"
+    using TimerId = uint64_t;
+
+    explicit TimerWheel(Clock::time_point start = Clock::now());
+
+    // Callback runs from advance() on the first tick at or after 'deadline'
+    TimerId schedule(Clock::time_point deadline, std::function<void()> callback);
+    // Unknown or already fired timers are ignored
+    void cancel(TimerId id);
+
+    // Fires every timer due by 'now', returns how many ran
+    size_t advance(Clock::time_point now);
+
+    // Milliseconds until the loop has to call advance() again, -1 if no timer is pending
+    int timeoutMs(Clock::time_point now) const;
+
+    size_t size() const { return timers.size(); }
+
+private:
+    static constexpr int LEVELS = 4;
+    static constexpr int SLOT_BITS = 6;
+    static constexpr size_t SLOTS = 1 << SLOT_BITS;
+    static constexpr uint64_t SLOT_MASK = SLOTS - 1;
+    static constexpr int64_t TICK_MS = 10;
+    static constexpr uint64_t MAX_SPAN = (uint64_t(1) << (SLOT_BITS * LEVELS)) - 1;
+
+    struct Timer
+    {
+        uint64_t expiry; // tick
+        std::function<void()> callback;
+    };
+
+    uint64_t toTick(Clock::time_point time, bool roundUp) const;
+    void place(TimerId id, uint64_t expiry);
+    void cascade(int level);
+
+    Clock::time_point start;
+    uint64_t currentTick; // every tick up to and including this one was processed
+    TimerId nextId;
+    std::unordered_map<TimerId, Timer> timers;
+    // Slots hold ids only, cancelled timers are skipped when the slot comes up
+    std::array<std::array<std::vector<TimerId>, SLOTS>, LEVELS> wheel;
+};
+
+#endif
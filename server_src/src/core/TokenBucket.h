@@ -0,0 +1,59 @@
+/**
+ * Server for blackjack
+ * Author: Marek Manzel
+ *
+ * TokenBucket.h - Per-connection rate limiter
+ * The bucket holds up to 'burst' tokens and refills at 'rate' tokens per second
+ * of loop time. Every command takes its cost from the bucket (see Commands.h),
+ * a command the bucket cannot pay for is dropped unprocessed. Rate and burst
+ * come with every call, so the bucket holds only its state: the tokens, the
+ * time of the last refill and the count of consecutive denials.
+ */
+
+#ifndef TOKEN_BUCKET_H
+#define TOKEN_BUCKET_H
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+
+class TokenBucket
+{
+public:
+    using Clock = std::chrono::steady_clock;
+
+    // False if the bucket holds fewer than 'cost' tokens, nothing is taken then
+    bool take(Clock::time_point now, uint32_t cost, int rate, int burst)
+    {
+        if (lastRefill == Clock::time_point{})
+        {
+            // A new connection starts with a full bucket
+            tokens = burst;
+        }
+        else if (now > lastRefill)
+        {
+            double elapsed = std::chrono::duration<double>(now - lastRefill).count();
+            tokens = std::min<double>(burst, tokens + elapsed * rate);
+        }
+        lastRefill = now;
+
+        if (tokens < cost)
+        {
+            ++denied;
+            return false;
+        }
+        tokens -= cost;
+        denied = 0;
+        return true;
+    }
+
+    // Commands dropped since the last one that was let through
+    uint32_t getConsecutiveDenied() const { return denied; }
+
+private:
+    double tokens = 0;
+    Clock::time_point lastRefill{};
+    uint32_t denied = 0;
+};
+
+#endif
@@ -3,12 +3,15 @@
  * Author: Marek Manzel
  *
  * Utils.h - Utility functions for the blackjack server
- * Contains helper methods for nickname validation and string manipulation.
+ * Contains helper methods for nickname validation, string manipulation and
+ * writing whole buffers to files.
  */
 
 #ifndef UTILS_H
 #define UTILS_H
 
+#include <unistd.h>
+#include <cerrno>
 #include <string>
 #include <vector>
 #include <sstream>
@@ -43,6 +46,26 @@ public:
         }
         return tokens;
     }
+
+    // Writes the whole buffer to fd, retried on EINTR and short writes.
+    // False on any other error, errno tells which
+    static bool writeAll(int fd, const void *data, size_t size)
+    {
+        const char *bytes = static_cast<const char *>(data);
+        while (size > 0)
+        {
+            ssize_t written = ::write(fd, bytes, size);
+            if (written < 0)
+            {
+                if (errno == EINTR)
+                    continue;
+                return false;
+            }
+            bytes += written;
+            size -= static_cast<size_t>(written);
+        }
+        return true;
+    }
 };
 
 #endif
\ No newline at end of file
@@ -0,0 +1,117 @@
+/**
+ * Server for blackjack
+ * Author: Marek Manzel
+ *
+ * Card.h - Compact card and hand representation
+ * A card is one byte (rank * 4 + suit), a hand keeps its cards inline and
+ * updates its blackjack total and soft-ace count on every added card, so
+ * evaluating a hand is O(1) and allocation-free. Cards become wire strings
+ * ("10H", "AS") only when a snapshot is serialized.
+ */
+
+#ifndef CARD_H
+#define CARD_H
+
+#include <array>
+#include <cstdint>
+#include <string>
+
+// rank 0..12 = 2..10, J, Q, K, A; suit 0..3 = H, D, C, S
+using Card = uint8_t;
+
+constexpr int CARD_RANKS = 13;
+constexpr int CARD_SUITS = 4;
+constexpr int DECK_SIZE = CARD_RANKS * CARD_SUITS;
+constexpr int CARD_RANK_ACE = 12;
+
+constexpr Card makeCard(int rank, int suit) { return static_cast<Card>(rank * CARD_SUITS + suit); }
+constexpr int cardRank(Card card) { return card / CARD_SUITS; }
+constexpr int cardSuit(Card card) { return card % CARD_SUITS; }
+
+// Blackjack value with an ace counted as 11
+constexpr int cardValue(Card card)
+{
+    constexpr std::array<uint8_t, CARD_RANKS> values = {2, 3, 4, 5, 6, 7, 8, 9, 10, 10, 10, 10, 11};
+    return values[cardRank(card)];
+}
+
+inline void appendCard(std::string &out, Card card)
+{
+    static const char *const ranks[CARD_RANKS] = {"2", "3", "4", "5", "6", "7", "8", "9", "10", "J", "Q", "K", "A"};
+    static const char suits[CARD_SUITS] = {'H', 'D', 'C', 'S'};
+    out += ranks[cardRank(card)];
+    out += suits[cardSuit(card)];
+}
+
+class Hand
+{
+public:
+    // Every card counts at least 1, so 21 cards are at least 21 and a 22nd is never
+    // asked for, however many decks the shoe holds
+    static constexpr size_t MAX_CARDS = 21;
+
+    void clear()
+    {
+        count = 0;
+        total = 0;
+        softAces = 0;
+    }
+
+    // False if the hand is full, the card is not taken
+    bool add(Card card)
+    {
+        if (count >= MAX_CARDS)
+            return false;
+        cards[count++] = card;
+        total += cardValue(card);
+        if (cardRank(card) == CARD_RANK_ACE)
+            ++softAces;
+        // Count aces as 1 instead of 11 while over 21
+        while (total > 21 && softAces > 0)
+        {
+            total -= 10;
+            --softAces;
+        }
+        return true;
+    }
+
+    size_t size() const { return count; }
+    bool empty() const { return count == 0; }
+    Card operator[](size_t index) const { return cards[index]; }
+
+    int value() const { return total; }
+    bool isSoft() const { return softAces > 0; }
+    bool isBust() const { return total > 21; }
+    bool isFull() const { return count >= MAX_CARDS; }
+    bool isBlackjack() const { return count == 2 && total == 21; }
+
+    // "AS;10H", "NO" for an empty hand
+    void appendTo(std::string &out) const
+    {
+        if (count == 0)
+        {
+            out += "NO";
+            return;
+        }
+        for (size_t i = 0; i < count; ++i)
+        {
+            if (i > 0)
+                out += ';';
+            appendCard(out, cards[i]);
+        }
+    }
+    std::string toString() const
+    {
+        std::string out;
+        appendTo(out);
+        return out;
+    }
+
+private:
+    std::array<Card, MAX_CARDS> cards{};
+    uint8_t count = 0;
+    uint8_t total = 0;
+    uint8_t softAces = 0; // aces still counted as 11
+};
+
+#endif
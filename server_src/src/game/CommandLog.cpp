@@ -0,0 +1,131 @@
+#include "CommandLog.h"
+#include <cstring>
+
+bool CommandLog::open(const std::string &path, uint64_t seed, int decks, TimePoint now)
+{
+    close();
+    file = fopen(path.c_str(), "w");
+    if (file == nullptr)
+        return false;
+    // Written in large blocks, a recorded pass costs no syscall
+    setvbuf(file, nullptr, _IOFBF, 1 << 20);
+    start = now;
+    lastFlush = now;
+    fprintf(file, "BJLOG 1 %llu %d\n", static_cast<unsigned long long>(seed), decks);
+    return true;
+}
+
+void CommandLog::close()
+{
+    if (file == nullptr)
+        return;
+    fclose(file);
+    file = nullptr;
+}
+
+void CommandLog::flush(TimePoint now, std::chrono::milliseconds interval)
+{
+    if (file == nullptr || now - lastFlush < interval)
+        return;
+    fflush(file);
+    lastFlush = now;
+}
+
+unsigned long long CommandLog::elapsed(TimePoint now) const
+{
+    return static_cast<unsigned long long>(std::chrono::duration_cast<std::chrono::milliseconds>(now - start).count());
+}
+
+void CommandLog::writePlayer(char type, TimePoint now, int roomId, const Player &player, int value)
+{
+    if (file != nullptr)
+        fprintf(file, "%c %llu %d %s %d\n", type, elapsed(now), roomId, player.getNickname().c_str(), value);
+}
+
+void CommandLog::writeRoom(char type, TimePoint now, int roomId)
+{
+    if (file != nullptr)
+        fprintf(file, "%c %llu %d\n", type, elapsed(now), roomId);
+}
+
+void CommandLog::command(TimePoint now, int roomId, const Player &player, const MessageView &msg)
+{
+    if (file == nullptr)
+        return;
+    std::string line = "BJ:" + msg.commandName();
+    for (std::string_view arg : msg.args)
+    {
+        line += ':';
+        // Room commands take numbers, separators inside a binary argument would not parse back
+        for (char c : arg)
+            line += (c == ':' || c == '\n' || c == '\r') ? '?' : c;
+    }
+    fprintf(file, "C %llu %d %s %s\n", elapsed(now), roomId, player.getNickname().c_str(), line.c_str());
+}
+
+bool CommandLog::readHeader(FILE *in, uint64_t &seed, int &decks)
+{
+    unsigned long long value = 0;
+    if (fscanf(in, "BJLOG 1 %llu %d\n", &value, &decks) != 2)
+        return false;
+    seed = value;
+    return true;
+}
+
+bool CommandLog::read(FILE *in, Entry &entry, bool &error)
+{
+    error = false;
+    // Command lines are bounded by the protocol's line limit
+    char line[4096];
+    if (fgets(line, sizeof(line), in) == nullptr)
+        return false;
+    size_t length = strlen(line);
+    if (length == 0 || line[length - 1] != '\n')
+    {
+        // Cut off by a crash, or longer than any valid line
+        error = true;
+        return false;
+    }
+    line[length - 1] = '\0';
+
+    unsigned long long ms = 0;
+    char nickname[32] = "";
+    int consumed = 0;
+    if (sscanf(line, "%c %llu %d%n", &entry.type, &ms, &entry.roomId, &consumed) != 3)
+    {
+        error = true;
+        return false;
+    }
+    entry.ms = ms;
+    entry.nickname.clear();
+    entry.message.clear();
+    entry.value = 0;
+    const char *rest = line + consumed;
+
+    switch (entry.type)
+    {
+    case 'J':
+    case 'L':
+    case 'O':
+        if (sscanf(rest, " %31s %d", nickname, &entry.value) != 2)
+            error = true;
+        break;
+    case 'C':
+        if (sscanf(rest, " %31s %n", nickname, &consumed) != 1)
+            error = true;
+        else
+            entry.message = rest + consumed;
+        break;
+    case 'T':
+    case 'U':
+    case 'R':
+    case 'A':
+    case 'X':
+        break;
+    default:
+        error = true;
+        break;
+    }
+    entry.nickname = nickname;
+    return !error;
+}
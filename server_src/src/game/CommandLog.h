@@ -0,0 +1,84 @@
+/**
+ * Server for blackjack
+ * Author: Marek Manzel
+ *
+ * CommandLog.h - Record of every input to the rooms of one shard, for replay
+ * A room is deterministic: its shoe follows from the server seed and the room
+ * ID, everything else from the calls its host makes. The log records those
+ * calls in order, one line each:
+ *   "J <ms> <room> <nick> <credits>"   seated (the room is created by the first one)
+ *   "L <ms> <room> <nick> <credits>"   left, with the balance it left with
+ *   "O <ms> <room> <nick> <0|1>"       offline flag changed
+ *   "C <ms> <room> <nick> BJ:<cmd>..." command handled, in text form whatever the wire format
+ *   "T <ms> <room>"                    turn timer ran out
+ *   "U <ms> <room>"                    scheduled update() ran
+ *   "R <ms> <room>" / "A <ms> <room>"  reset after the last player left / round called off
+ *   "X <ms> <room>"                    room reclaimed
+ * after a "BJLOG 1 <seed> <decks>" header. <ms> counts from the opening of the
+ * log. Lines are buffered and written in large blocks, the tail of a crashed
+ * run may be missing.
+ */
+
+#ifndef COMMAND_LOG_H
+#define COMMAND_LOG_H
+
+#include "Player.h"
+#include "../core/TimerWheel.h"
+#include "../protocol/Message.h"
+#include <cstdint>
+#include <cstdio>
+#include <string>
+
+class CommandLog
+{
+public:
+    using TimePoint = TimerWheel::Clock::time_point;
+
+    CommandLog() = default;
+    ~CommandLog() { close(); }
+    CommandLog(const CommandLog &) = delete;
+    CommandLog &operator=(const CommandLog &) = delete;
+
+    // Writing. Starts a new log at 'path', false if it cannot be created
+    bool open(const std::string &path, uint64_t seed, int decks, TimePoint start);
+    void close();
+    bool isOpen() const { return file != nullptr; }
+    // Writes out what is buffered, at most once per 'interval'
+    void flush(TimePoint now, std::chrono::milliseconds interval = std::chrono::milliseconds(0));
+
+    void seated(TimePoint now, int roomId, const Player &player) { writePlayer('J', now, roomId, player, player.getCredits()); }
+    void left(TimePoint now, int roomId, const Player &player) { writePlayer('L', now, roomId, player, player.getCredits()); }
+    void offline(TimePoint now, int roomId, const Player &player, bool offline) { writePlayer('O', now, roomId, player, offline); }
+    void command(TimePoint now, int roomId, const Player &player, const MessageView &msg);
+    void turnTimeout(TimePoint now, int roomId) { writeRoom('T', now, roomId); }
+    void update(TimePoint now, int roomId) { writeRoom('U', now, roomId); }
+    void reset(TimePoint now, int roomId) { writeRoom('R', now, roomId); }
+    void abort(TimePoint now, int roomId) { writeRoom('A', now, roomId); }
+    void closed(TimePoint now, int roomId) { writeRoom('X', now, roomId); }
+
+    // Reading, one line per call
+    struct Entry
+    {
+        char type = 0;
+        uint64_t ms = 0;
+        int roomId = -1;
+        std::string nickname;
+        int value = 0;       // credits or offline flag
+        std::string message; // command line of a 'C' entry
+    };
+    // False if 'in' does not start with a log header
+    static bool readHeader(FILE *in, uint64_t &seed, int &decks);
+    // False at the end of the log. A malformed line ends it as well, 'error' is set then
+    static bool read(FILE *in, Entry &entry, bool &error);
+
+private:
+    void writePlayer(char type, TimePoint now, int roomId, const Player &player, int value);
+    void writeRoom(char type, TimePoint now, int roomId);
+    unsigned long long elapsed(TimePoint now) const;
+
+    FILE *file = nullptr;
+    TimePoint start{};
+    TimePoint lastFlush{};
+};
+
+#endif
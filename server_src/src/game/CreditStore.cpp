@@ -0,0 +1,292 @@
+#include "CreditStore.h"
+#include "../core/Logger.h"
+#include "../core/Utils.h"
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cerrno>
+#include <cstddef>
+#include <cstring>
+
+namespace
+{
+    constexpr char SNAPSHOT_MAGIC[4] = {'B', 'J', 'C', 'S'};
+    constexpr uint32_t SNAPSHOT_VERSION = 1;
+    // Compaction waits for at least this many log records, small tables would be rewritten constantly
+    constexpr size_t MIN_COMPACT_RECORDS = 1024;
+
+    struct SnapshotHeader
+    {
+        char magic[4];
+        uint32_t version;
+        uint64_t count;
+    };
+
+    static_assert(sizeof(CreditStore::Record) == 32, "Credit record layout changed");
+}
+
+CreditStore::CreditStore(const std::string &directory, std::chrono::milliseconds interval)
+    : snapshotPath(directory + "/credits.snap"), logPath(directory + "/credits.log"), flushInterval(interval), logFd(-1), logRecords(0),
+      isRunning(false)
+{
+    mkdir(directory.c_str(), 0755);
+}
+
+CreditStore::~CreditStore()
+{
+    if (writer.joinable())
+    {
+        {
+            std::lock_guard<std::mutex> lock(wakeMutex);
+            isRunning = false;
+        }
+        wake.notify_one();
+        writer.join();
+    }
+    if (logFd != -1)
+        close(logFd);
+}
+
+CreditStore::Record CreditStore::makeRecord(const std::string &nickname, int64_t credits)
+{
+    Record record{};
+    std::memcpy(record.nickname, nickname.data(), std::min(nickname.size(), MAX_NICKNAME));
+    record.credits = credits;
+    record.checksum = checksumOf(record);
+    return record;
+}
+
+uint32_t CreditStore::checksumOf(const Record &record)
+{
+    // FNV-1a over everything before the checksum
+    uint32_t hash = 2166136261u;
+    const unsigned char *bytes = reinterpret_cast<const unsigned char *>(&record);
+    for (size_t i = 0; i < offsetof(Record, checksum); ++i)
+    {
+        hash ^= bytes[i];
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+bool CreditStore::open()
+{
+    if (!loadSnapshot() || !replayLog())
+        return false;
+
+    logFd = ::open(logPath.c_str(), O_WRONLY | O_APPEND | O_CREAT | O_CLOEXEC, 0644);
+    if (logFd < 0)
+    {
+        LOG_ERROR("CreditStore: cannot open " + logPath + ": " + std::strerror(errno));
+        return false;
+    }
+    LOG_INFO("CreditStore: " + std::to_string(balances.size()) + " balances loaded, " + std::to_string(logRecords) + " log records replayed");
+
+    isRunning = true;
+    writer = std::thread([this]()
+                         { run(); });
+    return true;
+}
+
+bool CreditStore::loadSnapshot()
+{
+    int fd = ::open(snapshotPath.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+    {
+        if (errno == ENOENT)
+            return true; // first start
+        LOG_ERROR("CreditStore: cannot open " + snapshotPath + ": " + std::strerror(errno));
+        return false;
+    }
+
+    struct stat info;
+    if (fstat(fd, &info) < 0 || static_cast<size_t>(info.st_size) < sizeof(SnapshotHeader))
+    {
+        close(fd);
+        LOG_ERROR("CreditStore: snapshot " + snapshotPath + " is truncated");
+        return false;
+    }
+
+    // Mapped read-only, records are read in place without a copy of the file
+    size_t size = static_cast<size_t>(info.st_size);
+    void *mapped = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (mapped == MAP_FAILED)
+    {
+        LOG_ERROR("CreditStore: cannot map " + snapshotPath + ": " + std::strerror(errno));
+        return false;
+    }
+    madvise(mapped, size, MADV_SEQUENTIAL);
+
+    const SnapshotHeader *header = static_cast<const SnapshotHeader *>(mapped);
+    bool valid = std::memcmp(header->magic, SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC)) == 0 && header->version == SNAPSHOT_VERSION &&
+                 header->count <= (size - sizeof(SnapshotHeader)) / sizeof(Record);
+    if (valid)
+    {
+        const Record *records = reinterpret_cast<const Record *>(static_cast<const char *>(mapped) + sizeof(SnapshotHeader));
+        balances.reserve(header->count);
+        for (uint64_t i = 0; i < header->count && valid; ++i)
+        {
+            valid = checksumOf(records[i]) == records[i].checksum;
+            balances[std::string(records[i].nickname, strnlen(records[i].nickname, MAX_NICKNAME))] = records[i].credits;
+        }
+    }
+    munmap(mapped, size);
+
+    if (!valid)
+    {
+        // Snapshots are replaced atomically, a bad one is not a crash artefact
+        LOG_ERROR("CreditStore: snapshot " + snapshotPath + " is corrupt");
+        return false;
+    }
+    return true;
+}
+
+bool CreditStore::replayLog()
+{
+    int fd = ::open(logPath.c_str(), O_RDWR | O_CLOEXEC);
+    if (fd < 0)
+        return errno == ENOENT;
+
+    Record record;
+    off_t good = 0;
+    while (true)
+    {
+        ssize_t got = pread(fd, &record, sizeof(record), good);
+        if (got != static_cast<ssize_t>(sizeof(record)) || checksumOf(record) != record.checksum)
+            break;
+        balances[std::string(record.nickname, strnlen(record.nickname, MAX_NICKNAME))] = record.credits;
+        good += static_cast<off_t>(sizeof(record));
+        ++logRecords;
+    }
+
+    // A crash mid-append leaves a partial record, later appends must not follow it
+    struct stat info;
+    if (fstat(fd, &info) == 0 && info.st_size > good)
+    {
+        LOG_WARN("CreditStore: dropping " + std::to_string(info.st_size - good) + " bytes of torn log tail");
+        if (ftruncate(fd, good) < 0)
+            LOG_ERROR("CreditStore: cannot truncate " + logPath);
+    }
+    close(fd);
+    return true;
+}
+
+bool CreditStore::record(const std::string &nickname, int credits)
+{
+    Record record = makeRecord(nickname, credits);
+    return queue.post(record);
+}
+
+std::optional<int> CreditStore::lookup(const std::string &nickname) const
+{
+    std::lock_guard<std::mutex> lock(tableMutex);
+    auto it = balances.find(nickname);
+    if (it == balances.end())
+        return std::nullopt;
+    return static_cast<int>(it->second);
+}
+
+size_t CreditStore::size() const
+{
+    std::lock_guard<std::mutex> lock(tableMutex);
+    return balances.size();
+}
+
+void CreditStore::run()
+{
+    while (true)
+    {
+        bool stopping;
+        {
+            std::unique_lock<std::mutex> lock(wakeMutex);
+            wake.wait_for(lock, flushInterval, [this]()
+                          { return !isRunning; });
+            stopping = !isRunning;
+        }
+        writeBatch();
+        if (stopping)
+            break;
+    }
+    // Leave a compact snapshot behind on a clean shutdown, startup then has no log to replay.
+    // The table also holds a batch the log would not take
+    if (logRecords > 0 || !batch.empty())
+        compact();
+}
+
+void CreditStore::writeBatch()
+{
+    // A batch that failed to write is still at the front and goes out again with the new records
+    size_t pending = batch.size();
+    queue.drain(batch);
+    if (batch.empty())
+        return;
+
+    {
+        std::lock_guard<std::mutex> lock(tableMutex);
+        for (size_t i = pending; i < batch.size(); ++i)
+            balances[std::string(batch[i].nickname, strnlen(batch[i].nickname, MAX_NICKNAME))] = batch[i].credits;
+    }
+
+    // One append and one sync for the whole batch
+    if (!Utils::writeAll(logFd, batch.data(), batch.size() * sizeof(Record)) || fdatasync(logFd) < 0)
+    {
+        LOG_ERROR_LIMITED("CreditStore: writing " + logPath + " failed: " + std::strerror(errno));
+        // A short write leaves part of the batch behind, later appends must start at a whole
+        // record or replaying stops at the fragment and cuts off everything after it
+        if (ftruncate(logFd, static_cast<off_t>(logRecords * sizeof(Record))) < 0)
+            LOG_ERROR_LIMITED("CreditStore: cannot truncate " + logPath);
+        return;
+    }
+    logRecords += batch.size();
+    batch.clear();
+
+    if (logRecords >= MIN_COMPACT_RECORDS && logRecords > size())
+        compact();
+}
+
+bool CreditStore::compact()
+{
+    std::vector<Record> records;
+    {
+        std::lock_guard<std::mutex> lock(tableMutex);
+        records.reserve(balances.size());
+        for (const auto &entry : balances)
+            records.push_back(makeRecord(entry.first, entry.second));
+    }
+
+    // Written next to the snapshot and renamed over it, a crash leaves either the old or the new one
+    std::string tempPath = snapshotPath + ".tmp";
+    int fd = ::open(tempPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0)
+    {
+        LOG_ERROR_LIMITED("CreditStore: cannot create " + tempPath + ": " + std::strerror(errno));
+        return false;
+    }
+    SnapshotHeader header{};
+    std::memcpy(header.magic, SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC));
+    header.version = SNAPSHOT_VERSION;
+    header.count = records.size();
+    bool written = Utils::writeAll(fd, &header, sizeof(header)) && Utils::writeAll(fd, records.data(), records.size() * sizeof(Record)) && fsync(fd) == 0;
+    close(fd);
+    if (!written || rename(tempPath.c_str(), snapshotPath.c_str()) < 0)
+    {
+        LOG_ERROR_LIMITED("CreditStore: writing snapshot " + snapshotPath + " failed: " + std::strerror(errno));
+        unlink(tempPath.c_str());
+        return false;
+    }
+
+    // Everything in the log is in the snapshot now. Crashing before the truncate only replays it again
+    if (ftruncate(logFd, 0) < 0)
+    {
+        LOG_ERROR_LIMITED("CreditStore: cannot truncate " + logPath);
+        return false;
+    }
+    LOG_INFO("CreditStore: compacted " + std::to_string(logRecords) + " log records into a snapshot of " + std::to_string(records.size()));
+    logRecords = 0;
+    // Records of a failed batch are in the table, the snapshot holds them
+    batch.clear();
+    return true;
+}
@@ -0,0 +1,94 @@
+/**
+ * Server for blackjack
+ * Author: Marek Manzel
+ *
+ * CreditStore.h - Durable player balances with write-behind persistence
+ * Game threads hand balance changes to a lock-free queue and never touch the
+ * disk. A writer thread drains the queue every flush interval, appends the
+ * batch to credits.log with one write + fdatasync and applies it to the
+ * in-memory table. A batch that fails to write is cut back to the last
+ * whole record and retried with the next one. Once the log has grown past
+ * the table, the table is written as a compacted snapshot (credits.snap,
+ * replaced atomically) and the log starts over. At startup the snapshot is mapped into memory and
+ * the log replayed on top; a torn record at the end of the log is cut off.
+ * Records hold absolute balances, so replaying one twice is harmless.
+ */
+
+#ifndef CREDIT_STORE_H
+#define CREDIT_STORE_H
+
+#include "../core/Mailbox.h"
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+class CreditStore
+{
+public:
+    // Nicknames are validated to at most 10 characters, the record keeps them inline
+    static constexpr size_t MAX_NICKNAME = 15;
+
+    // On-disk layout of both files, 32 bytes, little-endian host order
+    struct Record
+    {
+        char nickname[MAX_NICKNAME + 1];
+        int64_t credits;
+        uint32_t checksum;
+        uint32_t reserved;
+    };
+
+    CreditStore(const std::string &directory, std::chrono::milliseconds flushInterval = std::chrono::milliseconds(100));
+    ~CreditStore();
+
+    CreditStore(const CreditStore &) = delete;
+    CreditStore &operator=(const CreditStore &) = delete;
+
+    // Loads the saved balances and starts the writer, false if the directory is unusable
+    bool open();
+
+    // Any thread, lock-free. False if the queue is full, the caller retries later
+    bool record(const std::string &nickname, int credits);
+    // Any thread. Last balance the writer has taken in for 'nickname' (at most one flush
+    // interval behind record()), empty if never saved
+    std::optional<int> lookup(const std::string &nickname) const;
+
+    size_t size() const;
+
+private:
+    static Record makeRecord(const std::string &nickname, int64_t credits);
+    static uint32_t checksumOf(const Record &record);
+
+    bool loadSnapshot();
+    bool replayLog();
+    void run();
+    void writeBatch();
+    // Writes the table to a new snapshot and empties the log
+    bool compact();
+
+    std::string snapshotPath;
+    std::string logPath;
+    std::chrono::milliseconds flushInterval;
+    int logFd;
+    size_t logRecords;
+
+    Mailbox<Record, 4096> queue;
+    std::vector<Record> batch;
+
+    // Written by the writer thread, read by lookups from the game threads
+    mutable std::mutex tableMutex;
+    std::unordered_map<std::string, int64_t> balances;
+
+    std::atomic<bool> isRunning;
+    std::mutex wakeMutex;
+    std::condition_variable wake;
+    std::thread writer;
+};
+
+#endif
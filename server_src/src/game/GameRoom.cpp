@@ -1,72 +1,214 @@
 #include "GameRoom.h"
 #include "../core/Logger.h"
-#include "../network/TcpServer.h"
-#include "../core/Utils.h"
+#include "../core/Metrics.h"
+#include "CommandLog.h"
+#include "../protocol/Parser.h"
 #include <algorithm>
+#include <cstdio>
 
-TcpServer *GameRoom::server = nullptr;
-
-GameRoom::GameRoom(int id) : roomId(id)
+GameRoom::GameRoom(int id, RoomHost &owner)
+    : roomId(id), host(owner), playerTable(owner.getPlayers()),
+      shoe(owner.getConfig().decks, owner.getConfig().seed + static_cast<uint64_t>(id) * 0x9E3779B97F4A7C15ull),
+      roundNumber(0), turnTimer(0), readyCount(0), betCount(0), offlineCount(0), updateRequested(false), seatMask(0), spectatorFanOutRequested(false), stateVersion(1)
 {
-    dealerCards = std::vector<std::string>();
+    if (RoundJournal *roundJournal = host.getJournal())
+        journal = roundJournal->openRing(id);
     ResetDefaultState();
 }
 
+GameRoom::~GameRoom()
+{
+    if (journal)
+        journal->retired.store(true, std::memory_order_release);
+}
+
 void GameRoom::ResetDefaultState()
 {
 
     gameState = GameState::WAITING_FOR_PLAYERS;
-    dealerCards.clear();
-    turnOrder = std::deque<std::shared_ptr<Player>>();
+    dealerHand.clear();
+    turnOrder = std::deque<PlayerHandle>();
+    stopTurnTimer();
+    markStateDirty();
 
     if (players.empty())
     {
-        Logger::info("GameRoom: Room " + std::to_string(roomId) + " is already in default state");
+        LOG_INFO("GameRoom: Room " + std::to_string(roomId) + " is already in default state");
         return;
     }
-    for (auto &player : players)
+    // Collected first, removePlayer() erases from the vector being walked
+    std::vector<PlayerHandle> offline;
+    for (PlayerHandle id : players)
     {
-        player->resetGameAttributes();
-        if (player->isOffline())
-        {
-            Logger::info("GameRoom: Removing offline player " + player->getNickname() + " from room " + std::to_string(roomId));
-            server->lobby.removePlayer(player->getFd());
-            removePlayer(player);
-        }
+        Player &player = at(id);
+        player.resetGameAttributes();
+        if (player.isOffline())
+            offline.push_back(id);
+    }
+    readyCount = 0;
+    betCount = 0;
+    for (PlayerHandle id : offline)
+    {
+        LOG_INFO("GameRoom: Removing offline player " + at(id).getNickname() + " from room " + std::to_string(roomId));
+        removePlayer(id);
+        host.evictPlayer(id);
+    }
+    if (!offline.empty())
+    {
+        broadcastRoomState();
+        host.publishRoomStatus(*this);
     }
 
-    Logger::info("GameRoom: Room " + std::to_string(roomId) + " reset to default state");
+    LOG_INFO("GameRoom: Room " + std::to_string(roomId) + " reset to default state");
 }
 
 void GameRoom::broadcastMessage(const std::string &message, const std::string &args)
 {
-    for (const auto &player : players)
+    broadcastPerFormat([&](WireFormat format)
+                       { return makeFrame(format, message, args); }, SNAPSHOT_NONE);
+}
+
+void GameRoom::broadcastGameState()
+{
+    broadcastPerFormat([this](WireFormat format)
+                       { return getGameStateFrame(format); }, SNAPSHOT_GAMESTAT);
+    notifySpectators(SNAPSHOT_GAMESTAT);
+}
+
+void GameRoom::broadcastRoomState()
+{
+    broadcastPerFormat([this](WireFormat format)
+                       { return getRoomStateFrame(format); }, SNAPSHOT_ROMSTAUP);
+    notifySpectators(SNAPSHOT_ROMSTAUP);
+}
+
+void GameRoom::broadcastPerFormat(const std::function<Frame(WireFormat)> &build, uint8_t snapshotKind)
+{
+    std::array<Frame, WIRE_FORMATS> frames;
+    for (PlayerHandle id : players)
     {
-        if (player->isOffline())
+        const Player &player = at(id);
+        if (player.isOffline())
             continue;
-        server->sendMessage(player->getFd(), message, args);
+        WireFormat format = host.getWireFormat(player.getFd());
+        Frame &frame = frames[static_cast<size_t>(format)];
+        if (!frame)
+            frame = build(format);
+        host.sendFrame(player.getFd(), frame, snapshotKind);
+    }
+}
+
+void GameRoom::notifySpectators(uint8_t snapshotKind)
+{
+    if (spectators.empty())
+        return;
+    spectatorKinds.erase(std::remove(spectatorKinds.begin(), spectatorKinds.end(), snapshotKind), spectatorKinds.end());
+    spectatorKinds.push_back(snapshotKind);
+    if (!spectatorFanOutRequested)
+    {
+        spectatorFanOutRequested = true;
+        host.scheduleSpectatorFanOut(*this);
     }
 }
 
-bool GameRoom::allPlayersPlacedBets() const
+void GameRoom::fanOutToSpectators()
 {
-    for (const auto &player : players)
+    spectatorFanOutRequested = false;
+    for (uint8_t kind : spectatorKinds)
     {
-        if (!player->getPlacedBet())
+        // Built at most once per format, usually the frame the players got already
+        std::array<Frame, WIRE_FORMATS> frames;
+        for (PlayerHandle id : spectators)
         {
-            return false;
+            int fd = at(id).getFd();
+            WireFormat format = host.getWireFormat(fd);
+            Frame &frame = frames[static_cast<size_t>(format)];
+            if (!frame)
+                frame = getSnapshotFrame(kind, format);
+            host.sendFrame(fd, frame, kind);
         }
     }
-    return true;
+    spectatorKinds.clear();
 }
 
-bool GameRoom::placeBet(std::shared_ptr<Player> player, int amount)
+void GameRoom::journalEvent(JournalEventType type, int seat, Card card, int total, int32_t amount) const
 {
-    if (amount > 0 && amount <= player->getCredits())
+    if (!journal)
+        return;
+    // Bets are placed for the round about to be dealt
+    uint64_t round = gameState == GameState::BETTING ? roundNumber + 1 : roundNumber;
+    journal->record(host.now(), type, static_cast<uint32_t>(round), seat, card, total, amount);
+}
+
+Frame GameRoom::getSnapshotFrame(uint8_t snapshotKind, WireFormat format) const
+{
+    return snapshotKind == SNAPSHOT_GAMESTAT ? getGameStateFrame(format) : getRoomStateFrame(format);
+}
+
+void GameRoom::addSpectator(PlayerHandle id)
+{
+    Player &spectator = at(id);
+    spectator.setRoomId(roomId);
+    spectator.setState(PlayerState::SPECTATING);
+    spectators.push_back(id);
+    Metrics::spectators.add(1);
+    sendSpectatorSnapshot(id);
+    LOG_INFO("GameRoom: Spectator " + spectator.getNickname() + " watching room " + std::to_string(roomId) + ", " + std::to_string(spectators.size()) + " watching");
+}
+
+void GameRoom::removeSpectator(PlayerHandle id)
+{
+    auto it = std::find(spectators.begin(), spectators.end(), id);
+    if (it == spectators.end())
+        return;
+    // Order among spectators does not matter
+    *it = spectators.back();
+    spectators.pop_back();
+    Metrics::spectators.add(-1);
+    Player &spectator = at(id);
+    spectator.setRoomId(-1);
+    spectator.setState(PlayerState::LOBBY);
+    LOG_INFO("GameRoom: Spectator " + spectator.getNickname() + " stopped watching room " + std::to_string(roomId));
+}
+
+void GameRoom::sendSpectatorSnapshot(PlayerHandle id)
+{
+    int fd = at(id).getFd();
+    WireFormat format = host.getWireFormat(fd);
+    // What the players see right now: the hands once dealt, the seats and bets before
+    if (gameState == GameState::PLAYING || gameState == GameState::ROUND_END)
     {
-        player->setCredits(player->getCredits() - amount);
-        player->setBetAmount(amount);
-        player->setPlacedBet(true);
+        if (format == WireFormat::BINARY)
+            host.sendFrame(fd, getRosterFrame());
+        host.sendFrame(fd, getGameStateFrame(format), SNAPSHOT_GAMESTAT);
+    }
+    else
+    {
+        host.sendFrame(fd, getRoomStateFrame(format), SNAPSHOT_ROMSTAUP);
+    }
+}
+
+void GameRoom::broadcastFrame(const Frame &frame, uint8_t snapshotKind)
+{
+    for (PlayerHandle id : players)
+    {
+        const Player &player = at(id);
+        if (player.isOffline())
+            continue;
+        host.sendFrame(player.getFd(), frame, snapshotKind);
+    }
+}
+
+bool GameRoom::placeBet(Player &player, int amount)
+{
+    if (amount > 0 && amount <= player.getCredits())
+    {
+        player.setCredits(player.getCredits() - amount);
+        player.setBetAmount(amount);
+        if (!player.getPlacedBet())
+            ++betCount;
+        player.setPlacedBet(true);
+        markStateDirty();
         return true;
     }
     return false;
@@ -74,15 +216,18 @@ bool GameRoom::placeBet(std::shared_ptr<Player> player, int amount)
 
 void GameRoom::update()
 {
+    GameState previousState = gameState;
     // Gameloop update logic based on current game state
     switch (gameState)
     {
     case GameState::WAITING_FOR_PLAYERS:
-        if (players.size() >= 1 && areAllPlayersReady())
+        // A draining shard lets running rounds finish but starts no new ones
+        if (players.size() >= 1 && areAllPlayersReady() && !host.isDraining())
         {
             gameState = GameState::BETTING;
-            Logger::info("GameRoom: Room " + std::to_string(roomId) + " transitioning to BETTING state");
-            server->lobby.dirtyPlayerState();
+            journalEvent(JournalEventType::ROUND_BEGIN, static_cast<int>(players.size()));
+            LOG_INFO("GameRoom: Room " + std::to_string(roomId) + " transitioning to BETTING state");
+            host.publishRoomStatus(*this);
             // Notify players
             broadcastMessage("REQ_BET_");
         }
@@ -94,19 +239,20 @@ void GameRoom::update()
         if (allPlayersPlacedBets())
         {
             gameState = GameState::PLAYING;
-            server->lobby.dirtyPlayerState();
-            Logger::info("GameRoom: Room " + std::to_string(roomId) + " transitioning to PLAYING state");
+            host.publishRoomStatus(*this);
+            LOG_INFO("GameRoom: Room " + std::to_string(roomId) + " transitioning to PLAYING state");
             // Notify players
             dealCards();
             startTurnTimer();
-            broadcastMessage("GAMESTAT", getGameState());
+            broadcastGameState();
         }
         if (areAllPlayersOffline() || players.empty())
         {
-            Logger::info("GameRoom: All players offline in room " + std::to_string(roomId) + ", resetting to WAITING_FOR_PLAYERS state");
+            LOG_INFO("GameRoom: All players offline in room " + std::to_string(roomId) + ", resetting to WAITING_FOR_PLAYERS state");
+            journalEvent(JournalEventType::ROUND_ABORT, JOURNAL_DEALER);
             ResetDefaultState();
             gameState = GameState::WAITING_FOR_PLAYERS;
-            server->lobby.dirtyPlayerState();
+            host.publishRoomStatus(*this);
         }
         break;
 
@@ -115,178 +261,250 @@ void GameRoom::update()
         if (isTurnOver())
         {
             gameState = GameState::ROUND_END;
-            Logger::info("GameRoom: Room " + std::to_string(roomId) + " transitioning to ROUND_END state");
+            stopTurnTimer();
+            LOG_INFO("GameRoom: Room " + std::to_string(roomId) + " transitioning to ROUND_END state");
             dealerPlay();
-            broadcastMessage("GAMESTAT", getGameState());
-            server->lobby.dirtyPlayerState();
+            broadcastGameState();
+            host.publishRoomStatus(*this);
             // Notify players of round end and results
-            for (const auto &player : players)
+            for (PlayerHandle id : players)
             {
-                if (player->isOffline())
+                Player &player = at(id);
+                if (player.isOffline())
                     continue;
-                server->sendMessage(player->getFd(), "ROUNDEND", getCredits(player));
+                host.sendMessage(player.getFd(), "ROUNDEND", getCredits(player));
             }
-        }
-        else if (getTurnElapsedSeconds() >= 80)
-        {
-            // Auto-stand for current player
-            auto currentPlayer = turnOrder.front();
-            Logger::info("GameRoom: Player " + currentPlayer->getNickname() + " timed out in room " + std::to_string(roomId) + ", auto-standing");
-            playerStand(currentPlayer);
-            startTurnTimer(); // Reset timer for next player
-            broadcastMessage("GAMESTAT", getGameState());
+            journalEvent(JournalEventType::ROUND_END, JOURNAL_DEALER, JOURNAL_NO_CARD, dealerHand.value());
         }
         break;
 
     case GameState::ROUND_END:
         // Handle end of round logic here
         ResetDefaultState();
-        server->lobby.dirtyPlayerState();
-        Logger::info("GameRoom: Room " + std::to_string(roomId) + " transitioning to WAITING_FOR_PLAYERS state");
+        host.publishRoomStatus(*this);
+        LOG_INFO("GameRoom: Room " + std::to_string(roomId) + " transitioning to WAITING_FOR_PLAYERS state");
         break;
     }
+
+    // The new state's condition may already hold (e.g. a round ending with everyone offline)
+    if (gameState != previousState)
+        requestUpdate();
 }
 
-bool GameRoom::areAllPlayersOffline() const
+void GameRoom::abortRound()
 {
-    for (const auto &player : players)
+    if (gameState == GameState::BETTING || gameState == GameState::PLAYING)
     {
-        if (!player->isOffline())
+        journalEvent(JournalEventType::ROUND_ABORT, JOURNAL_DEALER);
+        for (PlayerHandle id : players)
         {
-            return false;
+            Player &player = at(id);
+            if (player.getPlacedBet())
+                player.setCredits(player.getCredits() + player.getBetAmount());
         }
     }
-    return true;
+    ResetDefaultState();
+    host.publishRoomStatus(*this);
+}
+
+void GameRoom::startTurnTimer()
+{
+    TimerWheel &timers = host.getTimers();
+    timers.cancel(turnTimer);
+    turnTimer = timers.schedule(host.now() + TURN_TIMEOUT, [this]()
+                                { onTurnTimeout(); });
+}
+
+void GameRoom::stopTurnTimer()
+{
+    host.getTimers().cancel(turnTimer);
+    turnTimer = 0;
+}
+
+void GameRoom::onTurnTimeout()
+{
+    turnTimer = 0;
+    if (gameState != GameState::PLAYING || turnOrder.empty())
+        return;
+
+    // Auto-stand for current player
+    PlayerHandle currentPlayer = turnOrder.front();
+    // The one input that does not come through the host, a replay has to be told
+    if (CommandLog *log = host.getCommandLog())
+        log->turnTimeout(host.now(), roomId);
+    LOG_INFO("GameRoom: Player " + at(currentPlayer).getNickname() + " timed out in room " + std::to_string(roomId) + ", auto-standing");
+    journalEvent(JournalEventType::TIMEOUT, at(currentPlayer).getSeat(), JOURNAL_NO_CARD, at(currentPlayer).getHand().value());
+    playerStand(currentPlayer); // Starts the timer for the next player
+    broadcastGameState();
+    requestUpdate();
 }
 
-std::string GameRoom::getCredits(std::shared_ptr<Player> player) const
+void GameRoom::requestUpdate()
+{
+    if (updateRequested)
+        return;
+    updateRequested = true;
+    host.scheduleRoomUpdate(*this);
+}
+
+bool GameRoom::takeUpdateRequest()
+{
+    bool requested = updateRequested;
+    updateRequested = false;
+    return requested;
+}
+
+void GameRoom::countPlayer(const Player &player, int sign)
+{
+    auto apply = [sign](size_t &counter, bool flag)
+    {
+        if (flag)
+            counter = sign > 0 ? counter + 1 : counter - 1;
+    };
+    apply(readyCount, player.getReady());
+    apply(betCount, player.getPlacedBet());
+    apply(offlineCount, player.isOffline());
+}
+
+void GameRoom::setPlayerOffline(PlayerHandle id, bool offline)
+{
+    Player &player = at(id);
+    if (player.isOffline() == offline)
+        return;
+    player.setOffline(offline);
+    if (offline)
+        ++offlineCount;
+    else
+        --offlineCount;
+    // Snapshots show offline seats
+    markStateDirty();
+    requestUpdate();
+}
+
+std::string GameRoom::getCredits(Player &player) const
 {
-    if (player == nullptr)
-        return "CREDITS;0;BET;0";
     // evaluate credits and bet amount
-    int handValue = calculateHandValue(player->getPlayerCards());
-    int dealerValue = calculateHandValue(getDealerCards());
+    int handValue = player.getHand().value();
+    int dealerValue = dealerHand.value();
     int winnings = 0;
+    JournalOutcome outcome = JournalOutcome::WIN;
 
     if (handValue > 21 || (dealerValue <= 21 && dealerValue > handValue))
     {
         // player loses bet
-        Logger::info("GameRoom: Player " + player->getNickname() + " lost the round in room " + std::to_string(roomId));
-        winnings = -player->getBetAmount();
+        LOG_INFO("GameRoom: Player " + player.getNickname() + " lost the round in room " + std::to_string(roomId));
+        winnings = -player.getBetAmount();
+        outcome = JournalOutcome::LOSS;
     }
     else if (handValue == dealerValue)
     {
         // push, return bet
-        winnings = player->getBetAmount();
-        player->setCredits(player->getCredits() + winnings);
-        Logger::info("GameRoom: Player " + player->getNickname() + " pushed the round in room " + std::to_string(roomId));
+        winnings = player.getBetAmount();
+        outcome = JournalOutcome::PUSH;
+        player.setCredits(player.getCredits() + winnings);
+        LOG_INFO("GameRoom: Player " + player.getNickname() + " pushed the round in room " + std::to_string(roomId));
     }
-    else if (handValue == 21 && Utils::splitString(player->getPlayerCards(), ';').size() == 2)
+    else if (player.getHand().isBlackjack())
     {
         // player wins 1.5 times the bet
-        winnings = static_cast<int>(player->getBetAmount() * 1.5);
-        player->setCredits(player->getCredits() + winnings);
-        Logger::info("GameRoom: Player " + player->getNickname() + " got blackjack in room " + std::to_string(roomId));
+        winnings = static_cast<int>(player.getBetAmount() * 1.5);
+        outcome = JournalOutcome::BLACKJACK;
+        player.setCredits(player.getCredits() + winnings);
+        LOG_INFO("GameRoom: Player " + player.getNickname() + " got blackjack in room " + std::to_string(roomId));
     }
     else
     {
         // player wins, give double the bet
-        winnings = player->getBetAmount() * 2;
-        player->setCredits(player->getCredits() + winnings);
-        Logger::info("GameRoom: Player " + player->getNickname() + " won the round in room " + std::to_string(roomId));
+        winnings = player.getBetAmount() * 2;
+        player.setCredits(player.getCredits() + winnings);
+        LOG_INFO("GameRoom: Player " + player.getNickname() + " won the round in room " + std::to_string(roomId));
     }
 
-    return std::to_string(player->getCredits()) + ";" + std::to_string(winnings);
+    journalEvent(JournalEventType::PAYOUT, player.getSeat(), static_cast<Card>(outcome), handValue, winnings);
+    // Written behind by the credit store, the round never waits for the disk
+    host.persistCredits(player);
+    return std::to_string(player.getCredits()) + ";" + std::to_string(winnings);
 }
 
 void GameRoom::dealerPlay()
 {
-    int dealerSum = calculateHandValue(getDealerCards());
-    while (dealerSum < 17)
+    while (dealerHand.value() < 17)
     {
-        dealerCards.push_back(generateCard());
-        dealerSum = calculateHandValue(getDealerCards());
+        Card card = generateCard();
+        dealerHand.add(card);
+        journalEvent(JournalEventType::DEALER_DRAW, JOURNAL_DEALER, card, dealerHand.value());
     }
+    markStateDirty();
 }
 
 void GameRoom::dealCards()
 {
-    dealerCards.clear();
-    dealerCards.push_back(generateCard());
-    dealerCards.push_back(generateCard());
-    for (const auto &player : players)
-    {
-        player->clearPlayerCards();
-        player->addPlayerCard(generateCard());
-        player->addPlayerCard(generateCard());
-        turnOrder.push_back(player);
+    bool shuffled = shoe.beginRound();
+    ++roundNumber;
+    // Shuffle seed + position reproduce every card of the round
+    char audit[96];
+    snprintf(audit, sizeof(audit), "round %llu shoe seed %016llx card %zu/%zu%s", static_cast<unsigned long long>(roundNumber),
+             static_cast<unsigned long long>(shoe.getShuffleSeed()), shoe.getPosition(), shoe.size(), shuffled ? " (reshuffled)" : "");
+    LOG_INFO("GameRoom: Room " + std::to_string(roomId) + " " + audit);
+
+    dealerHand.clear();
+    for (int i = 0; i < 2; ++i)
+    {
+        Card card = generateCard();
+        dealerHand.add(card);
+        journalEvent(JournalEventType::DEAL, JOURNAL_DEALER, card, dealerHand.value());
+    }
+    for (PlayerHandle id : players)
+    {
+        Player &player = at(id);
+        player.clearPlayerCards();
+        for (int i = 0; i < 2; ++i)
+        {
+            Card card = generateCard();
+            player.addPlayerCard(card);
+            journalEvent(JournalEventType::DEAL, player.getSeat(), card, player.getHand().value());
+        }
+        turnOrder.push_back(id);
     }
+    markStateDirty();
 }
 
-bool GameRoom::playerHit(std::shared_ptr<Player> player)
+bool GameRoom::playerHit(PlayerHandle id)
 {
-    if (player == nullptr || turnOrder.empty())
+    if (turnOrder.empty())
         return false;
 
-    Logger::info("number of players in queue: " + std::to_string(turnOrder.size()));
+    LOG_DEBUG("number of players in queue: " + std::to_string(turnOrder.size()));
     // Check if it's the player's turn
-    if (turnOrder.front() != player)
+    if (turnOrder.front() != id)
         return false;
 
     // evaluate hit action here
-    int sum = calculateHandValue(player->getPlayerCards());
-    if (sum >= 21)
-        return false; // Cannot hit if already 21 or bust
+    Player &player = at(id);
+    // Cannot hit if already 21 or bust, nor draw a card the hand could not take
+    if (player.getHand().value() >= 21 || player.getHand().isFull())
+        return false;
 
-    player->addPlayerCard(generateCard());
+    Card card = generateCard();
+    player.addPlayerCard(card);
+    journalEvent(JournalEventType::HIT, player.getSeat(), card, player.getHand().value());
     startTurnTimer();
+    markStateDirty();
     return true;
 }
 
-int GameRoom::calculateHandValue(const std::string &cards) const
+void GameRoom::playerStand(PlayerHandle id)
 {
-    int sum = 0;
-    int aces = 0;
-
-    auto cardList = Utils::splitString(cards, ';');
-    for (const auto &card : cardList)
-    {
-        std::string rank = card.substr(0, card.size() - 1); // Exclude suit
-        if (rank == "A")
-        {
-            sum += 11;
-            aces++;
-        }
-        else if (rank == "K" || rank == "Q" || rank == "J")
-        {
-            sum += 10; // Face cards are worth 10
-        }
-        else
-        {
-            sum += std::stoi(rank); // Numeric cards are worth their face value
-        }
-    }
-
-    // Adjust for Aces
-    while (sum > 21 && aces > 0)
-    {
-        sum -= 10; // Count Ace as 1 instead of 11
-        aces--;
-    }
-
-    return sum;
-}
-
-void GameRoom::playerStand(std::shared_ptr<Player> player)
-{
-    if (player == nullptr || turnOrder.empty())
+    if (turnOrder.empty())
         return;
 
     // Check if it's the player's turn
-    if (turnOrder.front() == player)
+    if (turnOrder.front() == id)
     {
+        journalEvent(JournalEventType::STAND, at(id).getSeat(), JOURNAL_NO_CARD, at(id).getHand().value());
         turnOrder.pop_front();
         startTurnTimer(); // Reset timer for next player
+        markStateDirty();
     }
 }
 
@@ -295,322 +513,340 @@ bool GameRoom::isTurnOver()
     return turnOrder.empty();
 }
 
-std::string GameRoom::generateCard()
+Card GameRoom::generateCard()
 {
-    // Example implementation: generate a random card
-    const std::vector<std::string> suits = {"H", "D", "C", "S"};
-    const std::vector<std::string> ranks = {"2", "3", "4", "5", "6", "7", "8", "9", "10", "J", "Q", "K", "A"};
-
-    std::string suit = suits[rand() % suits.size()];
-    std::string rank = ranks[rand() % ranks.size()];
-
-    return rank + suit;
+    return shoe.draw();
 }
 
 std::string GameRoom::getDealerCards() const
 {
-    std::string cards;
-    if (dealerCards.empty())
-        return "NO";
-    for (const auto &card : dealerCards)
-    {
-        if (!cards.empty())
-            cards += ";";
-        cards += card;
-    }
-    return cards;
+    return dealerHand.toString();
 }
 
-// corection of turn state and creating game state string
-std::string GameRoom::getGameState() const
+// corection of turn state and serializing the game state
+void GameRoom::getGameState(StateSerializer &out) const
 {
-    std::string state = "D;" + getDealerCards() + ":";
-    for (const auto &player : players)
+    out.dealer(dealerHand);
+    for (PlayerHandle id : players)
     {
-        player->setTurn(false);
-        if (player == turnOrder.front())
+        Player &player = at(id);
+        player.setTurn(false);
+        if (!turnOrder.empty() && id == turnOrder.front())
         {
 
-            player->setTurn(true);
+            player.setTurn(true);
         }
-        state += "P;" + player->getNickname() + ";" + (player->isOffline() ? "2" : (player->getTurn() ? "1" : "0")) +
-                 ";" + player->getPlayerCards() + ":";
+        out.seatHand(player.getSeat(), player.getNickname(), player.isOffline() ? 2 : (player.getTurn() ? 1 : 0), player.getHand());
     }
-    return state;
 }
 
-void GameRoom::addPlayer(std::shared_ptr<Player> player)
+void GameRoom::addPlayer(PlayerHandle player)
 {
     if (players.size() < MAX_PLAYERS)
     {
         players.push_back(player);
-        Logger::info("GameRoom: Player added to room " + std::to_string(roomId));
+        // Lowest free seat, a player keeps it until leaving the room
+        int seat = __builtin_ctz(~seatMask);
+        seatMask |= 1u << seat;
+        at(player).setSeat(seat);
+        countPlayer(at(player), 1);
+        markStateDirty();
+        requestUpdate();
+        LOG_INFO("GameRoom: Player added to room " + std::to_string(roomId));
     }
     else
     {
-        Logger::error("GameRoom: Room " + std::to_string(roomId) + " is full");
+        LOG_ERROR("GameRoom: Room " + std::to_string(roomId) + " is full");
     }
 }
 
-void GameRoom::removePlayer(std::shared_ptr<Player> player)
+PlayerHandle GameRoom::findPlayer(const std::string &nickname) const
+{
+    for (PlayerHandle id : players)
+    {
+        if (at(id).getNickname() == nickname)
+            return id;
+    }
+    return PlayerHandle{};
+}
+
+void GameRoom::removePlayer(PlayerHandle player)
 {
     auto it = std::find(players.begin(), players.end(), player);
     if (it != players.end())
     {
-        if (player == turnOrder.front()) // If the player being removed has the turn, artificially end their turn
+        if (!turnOrder.empty() && player == turnOrder.front()) // If the player being removed has the turn, artificially end their turn
         {
             playerStand(player);
-            broadcastMessage("GAMESTAT", getGameState());
+            broadcastGameState();
         }
         else
         {
             // Just remove from turn order if not the current turn
             turnOrder.erase(std::remove(turnOrder.begin(), turnOrder.end(), player), turnOrder.end());
         }
-        player->setRoomId(-1);
-        player->setState(PlayerState::LOBBY);
-        player->resetGameAttributes();
+        Player &removed = at(player);
+        countPlayer(removed, -1);
+        removed.setRoomId(-1);
+        seatMask &= ~(1u << removed.getSeat());
+        removed.setSeat(-1);
+        removed.setState(PlayerState::LOBBY);
+        removed.resetGameAttributes();
         players.erase(it);
-        Logger::info("GameRoom: Player removed from room " + std::to_string(roomId));
+        markStateDirty();
+        requestUpdate();
+        LOG_INFO("GameRoom: Player removed from room " + std::to_string(roomId));
     }
 }
 
-bool GameRoom::areAllPlayersReady() const
+void GameRoom::getRoomState(StateSerializer &out) const
 {
-    for (const auto &player : players)
+    for (PlayerHandle id : players)
     {
-        if (player == nullptr)
-            continue;
-        if (!player->getReady())
-        {
-            return false;
-        }
+        const Player &player = at(id);
+        out.seatStatus(player.getSeat(), player.getNickname(), player.isOffline() ? 2 : (player.getReady() ? 1 : 0), player.getBetAmount());
     }
-    return true;
 }
 
-std::string GameRoom::getRoomState() const
+Frame GameRoom::cachedFrame(FrameCache &cache, WireFormat format, const char *command, void (GameRoom::*fill)(StateSerializer &) const) const
+{
+    CachedFrame &entry = cache[static_cast<size_t>(format)];
+    if (!entry.frame || entry.version != stateVersion)
+    {
+        entry.frame = serializeState(format, command, [this, fill](StateSerializer &out)
+                                     { (this->*fill)(out); });
+        entry.version = stateVersion;
+    }
+    return entry.frame;
+}
+
+Frame GameRoom::getRoomStateFrame(WireFormat format) const
+{
+    return cachedFrame(roomStateFrames, format, "ROMSTAUP", &GameRoom::getRoomState);
+}
+
+Frame GameRoom::getGameStateFrame(WireFormat format) const
 {
-    std::string state = "";
+    return cachedFrame(gameStateFrames, format, "GAMESTAT", &GameRoom::getGameState);
+}
 
-    for (const auto &player : players)
+Frame GameRoom::getRosterFrame() const
+{
+    BinaryStateSerializer out;
+    for (PlayerHandle id : players)
     {
-        if (player == nullptr)
-            continue;
-        state += "P;" + player->getNickname() + ";" + (player->isOffline() ? "2" : (player->getReady() ? "1" : "0")) +
-                 ";BET;" + std::to_string(player->getBetAmount()) + ":";
+        const Player &player = at(id);
+        out.seatName(player.getSeat(), player.getNickname());
     }
+    return out.finish("ROSTER__");
+}
+
+void GameRoom::handleReady(PlayerHandle, Player &player, const MessageView &)
+{
+    if (!player.getReady())
+        ++readyCount;
+    player.setReady(true);
+    markStateDirty();
+    LOG_INFO("GameRoom: Player " + player.getNickname() + " is ready in room " + std::to_string(roomId));
+    host.sendMessage(player.getFd(), "ACK__RDY", " ");
+}
 
-    return state;
+void GameRoom::handleNotReady(PlayerHandle, Player &player, const MessageView &)
+{
+    if (player.getReady())
+        --readyCount;
+    player.setReady(false);
+    markStateDirty();
+    LOG_INFO("GameRoom: Player " + player.getNickname() + " is not ready in room " + std::to_string(roomId));
+    host.sendMessage(player.getFd(), "ACK__NRD", " ");
 }
 
-void GameRoom::handleStateWaitingForPlayers(std::shared_ptr<Player> player, const Message &msg)
+void GameRoom::handlePlayAgain(PlayerHandle id, Player &player, const MessageView &)
 {
-    if (msg.command == "RDY_____")
+    if (player.getCredits() <= 0)
     {
-        player->setReady(true);
-        Logger::info("GameRoom: Player " + player->getNickname() + " is ready in room " + std::to_string(roomId));
-        server->sendMessage(player->getFd(), "ACK__RDY", " ");
+        host.sendMessage(player.getFd(), "NACK_PAG", "Insufficient credits to continue");
+        LOG_INFO("GameRoom: Player " + player.getNickname() + " cannot prepare for next game due to insufficient credits in room " + std::to_string(roomId));
+        removePlayer(id);
+        host.publishRoomStatus(*this);
+        host.returnToLobby(id);
         return;
     }
-    else if (msg.command == "NRD_____")
+    LOG_INFO("GameRoom: Player " + player.getNickname() + " is preparing for next game in room " + std::to_string(roomId));
+    update();
+    host.sendMessage(player.getFd(), "ACK__PAG", std::to_string(roomId));
+}
+
+void GameRoom::handleBet(PlayerHandle, Player &player, const MessageView &msg)
+{
+    // Process bet amount from msg.args
+    int betAmount = 0;
+    if (msg.args.size() < 1 || !Parser::parseInt(msg.args[0], betAmount))
     {
-        player->setReady(false);
-        Logger::info("GameRoom: Player " + player->getNickname() + " is not ready in room " + std::to_string(roomId));
-        server->sendMessage(player->getFd(), "ACK__NRD", " ");
+        host.sendMessage(player.getFd(), "NACK__BT", "Invalid bet amount");
         return;
     }
-    else if (msg.command == "PAG_____")
+
+    if (placeBet(player, betAmount))
     {
-        if (player->getCredits() <= 0)
-        {
-            server->sendMessage(player->getFd(), "NACK_PAG", "Insufficient credits to continue");
-            removePlayer(player);
-            Logger::info("GameRoom: Player " + player->getNickname() + " cannot prepare for next game due to insufficient credits in room " + std::to_string(roomId));
-            return;
-        }
-        Logger::info("GameRoom: Player " + player->getNickname() + " is preparing for next game in room " + std::to_string(roomId));
-        update();
-        server->sendMessage(player->getFd(), "ACK__PAG", std::to_string(roomId));
-        return;
+        // Names the seat for the events of this round
+        if (journal)
+            journal->recordSeat(host.now(), player.getSeat(), player.getNickname());
+        journalEvent(JournalEventType::BET, player.getSeat(), JOURNAL_NO_CARD, 0, betAmount);
+        LOG_INFO("GameRoom: Player " + player.getNickname() + " placed a bet of " + std::to_string(betAmount) + " in room " + std::to_string(roomId));
+        host.sendMessage(player.getFd(), "ACK___BT", " " + std::to_string(betAmount));
     }
     else
     {
-        handleInvalidMessage(player);
-        server->sendMessage(player->getFd(), "NACK_CMD", "Invalid command during WAITING_FOR_PLAYERS");
+        host.sendMessage(player.getFd(), "NACK__BT", "Invalid bet amount");
+        LOG_INFO("GameRoom: Player " + player.getNickname() + " attempted invalid bet of " + std::to_string(betAmount) + " in room " + std::to_string(roomId));
     }
 }
 
-void GameRoom::handleStateBetting(std::shared_ptr<Player> player, const Message &msg)
+void GameRoom::handleHit(PlayerHandle id, Player &player, const MessageView &)
 {
-    // Handle messages specific to BETTING state
-    if (msg.command == "BT______")
+    LOG_INFO("GameRoom: Player " + player.getNickname() + " requested HIT in room " + std::to_string(roomId));
+    if (playerHit(id))
     {
-        // Example: Process bet amount from msg.args
-        if (msg.args.size() >= 1)
-        {
-            int betAmount = 0;
-            try
-            {
-                betAmount = std::stoi(msg.args[0]);
-            }
-            catch (const std::exception &e)
-            {
-                server->sendMessage(player->getFd(), "NACK__BT", "Invalid bet amount");
-                return;
-            }
-
-            if (placeBet(player, betAmount))
-            {
-                Logger::info("GameRoom: Player " + player->getNickname() + " placed a bet of " + std::to_string(betAmount) + " in room " + std::to_string(roomId));
-                server->sendMessage(player->getFd(), "ACK___BT", " " + std::to_string(betAmount));
-            }
-            else
-            {
-                server->sendMessage(player->getFd(), "NACK__BT", "Invalid bet amount");
-                Logger::info("GameRoom: Player " + player->getNickname() + " attempted invalid bet of " + std::to_string(betAmount) + " in room " + std::to_string(roomId));
-            }
-            return;
-        }
+        LOG_INFO("GameRoom: Player " + player.getNickname() + " received a new card in room " + std::to_string(roomId));
     }
     else
     {
-        handleInvalidMessage(player);
-        server->sendMessage(player->getFd(), "NACK_CMD", "Invalid command during BETTING");
+        host.sendMessage(player.getFd(), "NACK_HIT", "Cannot hit at this time");
+    }
+
+    const Hand &hand = player.getHand();
+    if (hand.isBust())
+    {
+        LOG_INFO("GameRoom: Player " + player.getNickname() + " busted in room " + std::to_string(roomId));
+        // Once, on the hit that busted, the turn ends with it
+        if (getCurrentTurn() == id)
+            journalEvent(JournalEventType::BUST, player.getSeat(), JOURNAL_NO_CARD, hand.value());
+        playerStand(id); // Automatically stand if busted
+        host.sendMessage(player.getFd(), "BUST____", " ");
+    }
+    else if (hand.value() == 21)
+    {
+        LOG_INFO("GameRoom: Player " + player.getNickname() + " hit 21 in room " + std::to_string(roomId));
+        playerStand(id); // Automatically stand if hit 21
+        host.sendMessage(player.getFd(), "HIT21___", " ");
     }
 }
 
-void GameRoom::handleStatePlaying(std::shared_ptr<Player> player, const Message &msg)
+void GameRoom::handleStand(PlayerHandle id, Player &player, const MessageView &)
 {
-    // Handle messages specific to PLAYING state
-    if (msg.command == "HIT_____")
-    {
-        Logger::info("GameRoom: Player " + player->getNickname() + " requested HIT in room " + std::to_string(roomId));
-        if (playerHit(player))
-        {
-            Logger::info("GameRoom: Player " + player->getNickname() + " received a new card in room " + std::to_string(roomId));
-        }
-        else
-        {
-            server->sendMessage(player->getFd(), "NACK_HIT", "Cannot hit at this time");
-        }
+    LOG_INFO("GameRoom: Player " + player.getNickname() + " requested STAND in room " + std::to_string(roomId));
+    playerStand(id);
+    host.sendMessage(player.getFd(), "ACK_STND", " ");
+}
 
-        if (calculateHandValue(player->getPlayerCards()) > 21)
-        {
-            Logger::info("GameRoom: Player " + player->getNickname() + " busted in room " + std::to_string(roomId));
-            playerStand(player); // Automatically stand if busted
-            server->sendMessage(player->getFd(), "BUST____", " ");
-        }
-        else if (calculateHandValue(player->getPlayerCards()) == 21)
-        {
-            Logger::info("GameRoom: Player " + player->getNickname() + " hit 21 in room " + std::to_string(roomId));
-            playerStand(player); // Automatically stand if hit 21
-            server->sendMessage(player->getFd(), "HIT21___", " ");
-        }
-        return;
+// reconnection of offline player
+void GameRoom::handleReconnect(PlayerHandle, Player &player, const MessageView &)
+{
+    if (gameState == GameState::PLAYING)
+    {
+        LOG_INFO("GameRoom: Player " + player.getNickname() + " reconnected during PLAYING state in room " + std::to_string(roomId));
+        // A binary client matches the GAMESTAT seats to names through the roster
+        if (host.getWireFormat(player.getFd()) == WireFormat::BINARY)
+            host.sendFrame(player.getFd(), getRosterFrame());
+        broadcastGameState();
     }
-    else if (msg.command == "STAND___")
+    else if (gameState == GameState::ROUND_END)
     {
-        Logger::info("GameRoom: Player " + player->getNickname() + " requested STAND in room " + std::to_string(roomId));
-        playerStand(player);
-        server->sendMessage(player->getFd(), "ACK_STND", " ");
-        return;
+        LOG_INFO("GameRoom: Player " + player.getNickname() + " reconnected during ROUND_END state in room " + std::to_string(roomId));
+        host.sendMessage(player.getFd(), "ROUNDEND", getCredits(player));
+        broadcastRoomState();
     }
     else
     {
-        handleInvalidMessage(player);
-        server->sendMessage(player->getFd(), "NACK_CMD", "Invalid command during PLAYING");
+        LOG_INFO("GameRoom: Player " + player.getNickname() + " reconnected during BETTING state in room " + std::to_string(roomId));
+        broadcastRoomState();
     }
 }
 
-void GameRoom::handleStateRoundEnd(std::shared_ptr<Player> player, const Message &msg)
+void GameRoom::handleInvalidMessage(PlayerHandle id)
 {
-    // Handle messages specific to ROUND_END state
-    if (msg.command == "PAG_____")
+    Player &player = at(id);
+    player.incrementInvalidMsg();
+    if (player.getInvalidMsgCount() > 5)
     {
-        if (player->getCredits() <= 0)
-        {
-            server->sendMessage(player->getFd(), "NACK_PAG", "Insufficient credits to continue");
-            removePlayer(player);
-            Logger::info("GameRoom: Player " + player->getNickname() + " cannot prepare for next game due to insufficient credits in room " + std::to_string(roomId));
-            return;
-        }
-        Logger::info("GameRoom: Player " + player->getNickname() + " is preparing for next game in room " + std::to_string(roomId));
-        update();
-        server->sendMessage(player->getFd(), "ACK__PAG", std::to_string(roomId));
-        return;
-    }
-    else
-    {
-        handleInvalidMessage(player);
-        server->sendMessage(player->getFd(), "NACK_CMD", "Invalid command during ROUND_END");
+        LOG_ERROR("GameRoom: Player " + player.getNickname() + " exceeded invalid message limit in room " + std::to_string(roomId));
+        Metrics::invalidMessageKicks.add();
+        host.sendMessage(player.getFd(), "DISCONNECT", "Too many invalid messages");
+        removePlayer(id);
+        host.publishRoomStatus(*this);
+        host.destroyPlayer(id);
     }
 }
 
-void GameRoom::handleInvalidMessage(std::shared_ptr<Player> player)
+const char *GameRoom::getStateName(GameState state)
 {
-    player->incrementInvalidMsg();
-    if (player->getInvalidMsgCount() > 5)
+    switch (state)
     {
-        Logger::error("GameRoom: Player " + player->getNickname() + " exceeded invalid message limit in room " + std::to_string(roomId));
-        server->sendMessage(player->getFd(), "DISCONNECT", "Too many invalid messages");
-        removePlayer(player);
-        server->lobby.destroyPlayer(player->getFd());
+    case GameState::WAITING_FOR_PLAYERS:
+        return "WAITING_FOR_PLAYERS";
+    case GameState::BETTING:
+        return "BETTING";
+    case GameState::PLAYING:
+        return "PLAYING";
+    case GameState::ROUND_END:
+        return "ROUND_END";
     }
+    return "UNKNOWN";
 }
 
-void GameRoom::handle(std::shared_ptr<Player> player, const Message &msg)
+// Commands accepted in each game state, anything else is answered with NACK_CMD
+constexpr GameRoom::HandlerTable GameRoom::buildHandlerTable()
 {
-    std::lock_guard<std::mutex> lock(roomMutex);
+    HandlerTable table{};
+    auto set = [&table](GameState state, Command command, Handler handler, bool snapshotAfter = true)
+    {
+        table[static_cast<size_t>(state)][static_cast<size_t>(command)] = {handler, snapshotAfter};
+    };
 
-    Logger::debug("GameRoom: Handling message " + msg.command + " from player " + player->getNickname() + " in room " + std::to_string(roomId));
+    set(GameState::WAITING_FOR_PLAYERS, Command::READY, &GameRoom::handleReady);
+    set(GameState::WAITING_FOR_PLAYERS, Command::NOT_READY, &GameRoom::handleNotReady);
+    set(GameState::WAITING_FOR_PLAYERS, Command::PLAY_AGAIN, &GameRoom::handlePlayAgain);
+    set(GameState::BETTING, Command::BET, &GameRoom::handleBet);
+    set(GameState::PLAYING, Command::HIT, &GameRoom::handleHit);
+    set(GameState::PLAYING, Command::STAND, &GameRoom::handleStand);
+    set(GameState::ROUND_END, Command::PLAY_AGAIN, &GameRoom::handlePlayAgain);
 
-    // reconnection of offline player
-    if (msg.command == "REC__GAM")
+    // Reconnect is valid in every state and sends its own snapshots
+    for (size_t state = 0; state < GAME_STATE_COUNT; ++state)
     {
-
-        if (gameState == GameState::PLAYING)
-        {
-            Logger::info("GameRoom: Player " + player->getNickname() + " reconnected during PLAYING state in room " + std::to_string(roomId));
-            broadcastMessage("GAMESTAT", getGameState());
-        }
-        else if (gameState == GameState::ROUND_END)
-        {
-            Logger::info("GameRoom: Player " + player->getNickname() + " reconnected during ROUND_END state in room " + std::to_string(roomId));
-            server->sendMessage(player->getFd(), "ROUNDEND", getCredits(player));
-            broadcastMessage("ROMSTAUP", getRoomState());
-        }
-        else
-        {
-            Logger::info("GameRoom: Player " + player->getNickname() + " reconnected during BETTING state in room " + std::to_string(roomId));
-            broadcastMessage("ROMSTAUP", getRoomState());
-        }
-        return;
+        set(static_cast<GameState>(state), Command::RECONNECT_GAME, &GameRoom::handleReconnect, false);
     }
+    return table;
+}
 
-    // Handle game-specific messages here
-    switch (gameState)
-    {
-    case GameState::WAITING_FOR_PLAYERS:
-        handleStateWaitingForPlayers(player, msg);
-        broadcastMessage("ROMSTAUP", getRoomState());
-        break;
-    case GameState::BETTING:
-        handleStateBetting(player, msg);
-        broadcastMessage("ROMSTAUP", getRoomState());
-        break;
+const GameRoom::HandlerTable GameRoom::handlerTable = GameRoom::buildHandlerTable();
 
-    case GameState::PLAYING:
-        handleStatePlaying(player, msg);
-        broadcastMessage("GAMESTAT", getGameState());
-        break;
-    case GameState::ROUND_END:
-        handleStateRoundEnd(player, msg);
-        broadcastMessage("ROMSTAUP", getRoomState());
-        break;
+void GameRoom::handle(PlayerHandle id, const MessageView &msg)
+{
+    Player &player = at(id);
+    LOG_DEBUG("GameRoom: Handling message " + msg.commandName() + " from player " + player.getNickname() + " in room " + std::to_string(roomId));
 
-    default:
-        break;
+    // Handle game-specific messages here
+    GameState dispatchState = gameState;
+    const HandlerEntry &entry = handlerTable[static_cast<size_t>(dispatchState)][static_cast<size_t>(msg.command)];
+    if (entry.handler == nullptr)
+    {
+        int fd = player.getFd();
+        // Can destroy the player
+        handleInvalidMessage(id);
+        host.sendMessage(fd, "NACK_CMD", std::string("Invalid command during ") + getStateName(dispatchState));
     }
+    else
+    {
+        (this->*entry.handler)(id, player, msg);
+        if (!entry.snapshotAfter)
+            return;
+    }
+
+    if (dispatchState == GameState::PLAYING)
+        broadcastGameState();
+    else
+        broadcastRoomState();
     update();
-}
\ No newline at end of file
+}
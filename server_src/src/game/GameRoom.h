@@ -6,6 +6,12 @@
  * Manages a single blackjack game instance with up to 7 players.
  * Handles game states (waiting, betting, playing, round end), card dealing,
  * betting logic, and game flow coordination.
+ * Any number of spectators can watch a room without a seat. They get the same
+ * cached ROMSTAUP / GAMESTAT frames as the players, fanned out by the shard
+ * once per loop pass, so commands and broadcasts never walk the spectators.
+ * The room only talks to its owner through RoomHost, in the server that is
+ * the shard it lives on. With a RoundJournal the room records every step of
+ * its rounds into a ring of its own.
  */
 
 #ifndef GAME_ROOM_H
@@ -14,15 +20,22 @@
 #define MAX_PLAYERS 7
 
 #include <memory>
+#include <array>
+#include <functional>
 #include <string>
 #include <vector>
 #include <queue>
 #include <chrono>
-#include <mutex>
+#include "core/TimerWheel.h"
 #include "game/Player.h"
+#include "game/PlayerTable.h"
+#include "game/RoomHost.h"
+#include "game/RoundJournal.h"
+#include "game/Shoe.h"
 #include "protocol/Message.h"
-
-class TcpServer;
+#include "protocol/Frame.h"
+#include "protocol/StateSerializer.h"
+#include "protocol/Wire.h"
 
 enum class GameState
 {
@@ -32,66 +45,171 @@ enum class GameState
     ROUND_END
 };
 
+constexpr size_t GAME_STATE_COUNT = 4;
+
 class GameRoom
 {
 public:
-    GameRoom(int id);
+    // Rooms live in a host (a shard) and are only touched from its thread, seated players
+    // are stored in the host's player table and referenced by handle
+    GameRoom(int id, RoomHost &host);
+    // Retires the room's journal ring, the writer drains it one last time
+    ~GameRoom();
 
     void ResetDefaultState();
+    // Shutdown: ends the room's round right away, bets of a round still running are returned
+    void abortRound();
 
-    void addPlayer(std::shared_ptr<Player> player);
+    void addPlayer(PlayerHandle player);
 
-    void removePlayer(std::shared_ptr<Player> player);
+    void removePlayer(PlayerHandle player);
 
     int getPlayerCount() const { return players.size(); }
 
+    // Watchers are shard players in SPECTATING state, they get the current snapshot right away
+    void addSpectator(PlayerHandle spectator);
+    void removeSpectator(PlayerHandle spectator);
+    size_t getSpectatorCount() const { return spectators.size(); }
+    const std::vector<PlayerHandle> &getSpectators() const { return spectators; }
+    // Current snapshot to one spectator, e.g. after REC__GAM
+    void sendSpectatorSnapshot(PlayerHandle spectator);
+    // Shard only, sends the snapshots broadcast since the last call to every spectator
+    void fanOutToSpectators();
+
     GameState getState() const { return gameState; }
+    int getId() const { return roomId; }
 
-    static void setServer(TcpServer *srv) { server = srv; }
+    // Seated player with the given nickname, a null handle if none
+    PlayerHandle findPlayer(const std::string &nickname) const;
+    // Player whose turn it is, a null handle outside PLAYING
+    PlayerHandle getCurrentTurn() const { return turnOrder.empty() ? PlayerHandle{} : turnOrder.front(); }
+    const Hand &getDealerHand() const { return dealerHand; }
+
+    // Framed once per wire format in use, recipients of one format share the frame
     void broadcastMessage(const std::string &message, const std::string &args = "");
-    void handle(std::shared_ptr<Player> player, const Message &msg);
-    void handleStateWaitingForPlayers(std::shared_ptr<Player> player, const Message &msg);
-    void handleStateBetting(std::shared_ptr<Player> player, const Message &msg);
-    void handleStatePlaying(std::shared_ptr<Player> player, const Message &msg);
-    void handleStateRoundEnd(std::shared_ptr<Player> player, const Message &msg);
-    void handleInvalidMessage(std::shared_ptr<Player> player);
-
-    bool areAllPlayersReady() const;
-    bool areAllPlayersOffline() const;
-    bool placeBet(std::shared_ptr<Player> player, int amount);
-    bool allPlayersPlacedBets() const;
+    // Sends one shared frame to every online player of the room
+    void broadcastFrame(const Frame &frame, uint8_t snapshotKind = SNAPSHOT_NONE);
+    void broadcastGameState();
+    void broadcastRoomState();
+    // Dispatches through the per-state handler table, O(1) per command
+    void handle(PlayerHandle player, const MessageView &msg);
+    void handleInvalidMessage(PlayerHandle player);
+    static const char *getStateName(GameState state);
+
+    // O(1), answered from the ready / bet / offline counters
+    bool areAllPlayersReady() const { return readyCount == players.size(); }
+    bool areAllPlayersOffline() const { return offlineCount == players.size(); }
+    bool placeBet(Player &player, int amount);
+    bool allPlayersPlacedBets() const { return betCount == players.size(); }
     void update();
-    std::string getRoomState() const;
-    std::string getGameState() const;
 
-    void startTurnTimer() { playerGotTurnTime = std::chrono::steady_clock::now(); }
-    long getTurnElapsedSeconds() const
-    {
-        auto now = std::chrono::steady_clock::now();
-        return std::chrono::duration_cast<std::chrono::seconds>(now - playerGotTurnTime).count();
-    };
+    // Queues update() for the shard's tick; rooms are only re-evaluated after a command,
+    // a timer or a change of their players, never by polling
+    void requestUpdate();
+    // Shard only, returns true if an update was queued and clears the request
+    bool takeUpdateRequest();
+
+    // Offline flag of a seated player, goes through the room to keep the counters right
+    void setPlayerOffline(PlayerHandle player, bool offline);
+    void getRoomState(StateSerializer &out) const;
+    void getGameState(StateSerializer &out) const;
+
+    // Pre-framed ROMSTAUP / GAMESTAT snapshots, rebuilt only when the room changed
+    // since the last call for that format, otherwise the cached buffer is shared again
+    Frame getRoomStateFrame(WireFormat format = WireFormat::TEXT) const;
+    Frame getGameStateFrame(WireFormat format = WireFormat::TEXT) const;
+    // Binary ROSTER__ of the seated players, GAMESTAT refers to them by seat only
+    Frame getRosterFrame() const;
+
+    // Bumped on every change visible in the room/game state snapshots
+    void markStateDirty() { ++stateVersion; }
+    uint64_t getStateVersion() const { return stateVersion; }
+
+    // Current player is auto-stood when the turn timer runs out
+    void startTurnTimer();
+    void stopTurnTimer();
+    // Auto-stands the current player, run by the turn timer or a replay of it
+    void onTurnTimeout();
+    static constexpr std::chrono::seconds TURN_TIMEOUT{80};
 
     void dealCards();
     std::string getDealerCards() const;
     void dealerPlay();
-    std::string generateCard();
-    int calculateHandValue(const std::string &cards) const;
+    Card generateCard();
     bool isTurnOver();
-    bool playerHit(std::shared_ptr<Player> player);
-    void playerStand(std::shared_ptr<Player> player);
-    std::string getCredits(std::shared_ptr<Player> player) const;
+    bool playerHit(PlayerHandle player);
+    void playerStand(PlayerHandle player);
+    std::string getCredits(Player &player) const;
 
 private:
-    std::mutex roomMutex;
+    // Command handlers, registered per state in buildHandlerTable()
+    void handleReady(PlayerHandle id, Player &player, const MessageView &msg);
+    void handleNotReady(PlayerHandle id, Player &player, const MessageView &msg);
+    void handlePlayAgain(PlayerHandle id, Player &player, const MessageView &msg);
+    void handleBet(PlayerHandle id, Player &player, const MessageView &msg);
+    void handleHit(PlayerHandle id, Player &player, const MessageView &msg);
+    void handleStand(PlayerHandle id, Player &player, const MessageView &msg);
+    void handleReconnect(PlayerHandle id, Player &player, const MessageView &msg);
+
+    // Seated handles always resolve, the shard removes players from their room first
+    Player &at(PlayerHandle player) const { return *playerTable.get(player); }
+    // Adds (+1) or removes (-1) the player's flags to/from the counters
+    void countPlayer(const Player &player, int sign);
+    // Sends every online player the frame 'build' returns for its wire format, built once per format
+    void broadcastPerFormat(const std::function<Frame(WireFormat)> &build, uint8_t snapshotKind);
+    // Queues the snapshot kind for the spectators, sent with the shard's next fan-out
+    void notifySpectators(uint8_t snapshotKind);
+    Frame getSnapshotFrame(uint8_t snapshotKind, WireFormat format) const;
+    // Appends an event of the current round to the journal ring, nothing while not journaling
+    void journalEvent(JournalEventType type, int seat, Card card = JOURNAL_NO_CARD, int total = 0, int32_t amount = 0) const;
+
+    using Handler = void (GameRoom::*)(PlayerHandle, Player &, const MessageView &);
+    struct HandlerEntry
+    {
+        Handler handler = nullptr;
+        bool snapshotAfter = true; // broadcast the room/game snapshot and run update() afterwards
+    };
+    using HandlerTable = std::array<std::array<HandlerEntry, COMMAND_COUNT>, GAME_STATE_COUNT>;
+    static constexpr HandlerTable buildHandlerTable();
+    static const HandlerTable handlerTable;
+
     int roomId;
-    std::vector<std::shared_ptr<Player>> players;
-    static TcpServer *server;
+    std::vector<PlayerHandle> players;
+    RoomHost &host;
+    PlayerTable &playerTable;
+    Shoe shoe;
+    uint64_t roundNumber;
+    std::shared_ptr<JournalRing> journal;
 
     // Game state variables
     GameState gameState;
-    std::vector<std::string> dealerCards;
-    std::deque<std::shared_ptr<Player>> turnOrder;
-    std::chrono::steady_clock::time_point playerGotTurnTime;
+    Hand dealerHand;
+    std::deque<PlayerHandle> turnOrder;
+    TimerWheel::TimerId turnTimer;
+    // Seated players that are ready / have placed a bet / are offline
+    size_t readyCount;
+    size_t betCount;
+    size_t offlineCount;
+    bool updateRequested;
+    // Bit s set when seat s is taken
+    uint32_t seatMask;
+    std::vector<PlayerHandle> spectators;
+    // Snapshot kinds due for the spectators, the one broadcast last at the end
+    std::vector<uint8_t> spectatorKinds;
+    bool spectatorFanOutRequested;
+
+    // Snapshot cache, one entry per wire format
+    struct CachedFrame
+    {
+        Frame frame;
+        uint64_t version = 0;
+    };
+    using FrameCache = std::array<CachedFrame, WIRE_FORMATS>;
+    Frame cachedFrame(FrameCache &cache, WireFormat format, const char *command, void (GameRoom::*fill)(StateSerializer &) const) const;
+
+    uint64_t stateVersion;
+    mutable FrameCache roomStateFrames;
+    mutable FrameCache gameStateFrames;
 };
 
 #endif // GAME_ROOM_H
\ No newline at end of file
@@ -1,311 +1,718 @@
 #include "Lobby.h"
 #include "../core/Logger.h"
+#include "../core/Metrics.h"
+#include "CreditStore.h"
 #include "../network/TcpServer.h"
 #include "../core/Utils.h"
+#include "../protocol/Parser.h"
 
-Lobby::Lobby(TcpServer &srv) : server(srv) {}
+Lobby::Lobby(TcpServer &srv)
+    : sessions(srv.getTimers(), std::chrono::seconds(srv.getConfig().sessionTtl), srv.getConfig().maxSessions),
+      maxRooms(static_cast<size_t>(srv.getConfig().maxRooms)), roomIdleTimeout(srv.getConfig().roomIdleTimeout),
+      broadcastInterval(srv.getConfig().lobbyInterval), nextBroadcast(srv.now()), server(srv)
+{
+    // A session that expires takes its balance along, the credit store keeps it for the next login
+    sessions.setEvictCallback([this](const Player &player)
+                              { server.persistCredits(player); });
+}
 
 void Lobby::addPlayer(int fd)
 {
-    players[fd] = std::make_shared<Player>(fd);
-    players[fd]->refreshLastActivity();
-    Logger::debug("Lobby: Player added on FD " + std::to_string(fd));
+    Player player(fd);
+    player.refreshLastActivity(server.now());
+    players.add(std::move(player));
+    LOG_DEBUG("Lobby: Player added on FD " + std::to_string(fd));
     server.sendMessage(fd, "REQ_NICK", " ");
 }
 
 void Lobby::removePlayer(int fd)
 {
-    auto it = players.find(fd);
-    if (it != players.end())
+    auto player = players.take(players.handleOf(fd));
+    if (player)
     {
-        if (it->second->getState() == PlayerState::IN_GAMEROOM)
-        {
-            auto roomIt = rooms.find(it->second->getRoomId());
-            if (roomIt != rooms.end() && roomIt->second.getState() != GameState::PLAYING)
-            {
-                roomIt->second.removePlayer(it->second);
-                roomIt->second.broadcastMessage("ROMSTAUP", roomIt->second.getRoomState());
-            }
-            else
-            {
-                roomIt->second.broadcastMessage("GAMESTAT", roomIt->second.getGameState());
-            }
-        }
-        if (!it->second->getNickname().empty())
+        if (!player->getNickname().empty())
         {
-            disconnectedPlayers[it->second->getNickname()] = it->second;
+            unindexNickname(*player);
+            sessions.park(std::move(*player), server.now());
         }
-        players.erase(fd);
         dirtyPlayerState();
-        Logger::debug("Lobby: Player flagged as disconnected on FD " + std::to_string(fd));
+        LOG_DEBUG("Lobby: Player flagged as disconnected on FD " + std::to_string(fd));
     }
 }
 
-std::shared_ptr<Player> Lobby::getPlayer(int fd)
+void Lobby::update()
 {
-    auto it = players.find(fd);
-    if (it != players.end())
+    // Returning players are about to be disconnected or handed over, the lobby is not shown again
+    if (!playerStateChanged || server.isDraining())
+        return;
+
+    if (server.now() < nextBroadcast)
     {
-        return it->second;
+        // Changes under churn are batched, the timer wakes the loop once the interval is over
+        if (broadcastTimer == 0)
+            broadcastTimer = server.getTimers().schedule(nextBroadcast, [this]()
+                                                         { broadcastTimer = 0; });
+        return;
     }
-    return nullptr;
+    broadcastLobbyState();
+    playerStateChanged = false;
+    nextBroadcast = server.now() + broadcastInterval;
 }
 
-void Lobby::update()
+void Lobby::broadcastLobbyState()
+{
+    uint64_t previous = lobbyVersion++;
+    // A delta touching most rooms is not worth it over the snapshot
+    bool useDelta = changedRooms.size() * 2 <= openRooms;
+
+    // Built on first use per wire format, every recipient of a format shares the same frame
+    std::array<Frame, WIRE_FORMATS> snapshots;
+    std::array<Frame, WIRE_FORMATS> deltas;
+    players.forEach([&](PlayerHandle, Player &player)
+                    {
+                        if (player.getNickname().empty())
+                            return; // Skip players without a nickname (not fully logged in)
+                        if (player.getState() != PlayerState::LOBBY)
+                            return; // Skip players not in the lobby
+
+                        size_t format = static_cast<size_t>(server.getWireFormat(player.getFd()));
+                        // New, returning or reconnected players start over from a snapshot
+                        if (useDelta && player.getLobbyVersion() != 0 && player.getLobbyVersion() == previous)
+                        {
+                            if (!deltas[format])
+                                deltas[format] = serializeState(static_cast<WireFormat>(format), "LBBYDELT", [this](StateSerializer &out)
+                                                                { getLobbyDelta(out); });
+                            server.sendFrame(player.getFd(), deltas[format]);
+                        }
+                        else
+                        {
+                            if (!snapshots[format])
+                                snapshots[format] = serializeState(static_cast<WireFormat>(format), "LBBYINFO", [this](StateSerializer &out)
+                                                                   { getLobbyState(out); });
+                            server.sendFrame(player.getFd(), snapshots[format], SNAPSHOT_LBBYINFO);
+                        }
+                        player.setLobbyVersion(lobbyVersion); });
+
+    for (int roomId : changedRooms)
+        rooms[roomId].changed = false;
+    changedRooms.clear();
+}
+
+void Lobby::setRoomSummary(int roomId, int playerCount, GameState state)
 {
+    RoomSummary &room = rooms[roomId];
+    if (room.playerCount == playerCount && room.state == state)
+        return; // shards re-publish unchanged status often
+    room.playerCount = playerCount;
+    room.state = state;
+    room.idleSince = server.now();
+    markRoomChanged(roomId);
+    reindexRoom(roomId);
+    if (playerCount == 0 && state == GameState::WAITING_FOR_PLAYERS && roomId >= fixedRooms)
+        armReclaimTimer(roomId);
+}
 
-    if (playerStateChanged)
+void Lobby::markRoomChanged(int roomId)
+{
+    RoomSummary &room = rooms[roomId];
+    if (!room.changed)
     {
-        auto lobbyState = getLobbyState();
-        broadcastMessage("LBBYINFO", lobbyState);
-        playerStateChanged = false;
+        room.changed = true;
+        changedRooms.push_back(roomId);
     }
+    playerStateChanged = true;
+}
 
-    // Get new players lobby information
-    for (auto &pair : players)
+bool Lobby::isJoinable(int roomId) const
+{
+    if (roomId < 0 || roomId >= static_cast<int>(rooms.size()))
+        return false;
+    const RoomSummary &room = rooms[roomId];
+    return room.open && !room.closing && room.state == GameState::WAITING_FOR_PLAYERS && room.playerCount < MAX_PLAYERS;
+}
+
+void Lobby::reindexRoom(int roomId)
+{
+    const RoomSummary &room = rooms[roomId];
+    if (isJoinable(roomId))
+        joinable.insert(roomId, room.playerCount);
+    else
+        joinable.erase(roomId);
+}
+
+int Lobby::matchRoom()
+{
+    int roomId = joinable.pick();
+    return roomId >= 0 ? roomId : openRoom();
+}
+
+int Lobby::openRoom()
+{
+    if (openRooms >= maxRooms)
+        return -1;
+    int roomId;
+    if (!freeRoomIds.empty())
     {
-        auto player = pair.second;
-        // Here you can add code to update player state in the lobby if needed
-        if (player->getNickname().empty())
-        {
-            // server.sendMessage(player->getFd(), "REQ_NICK", " ");
-        }
+        roomId = freeRoomIds.top();
+        freeRoomIds.pop();
     }
-
-    for (auto &room : rooms)
+    else
     {
-        if (room.second.getState() != GameState::ROUND_END || (room.second.areAllPlayersOffline() && room.second.getState() == GameState::ROUND_END))
-            room.second.update();
+        roomId = static_cast<int>(rooms.size());
+        rooms.emplace_back();
     }
+
+    RoomSummary &room = rooms[roomId];
+    room.playerCount = 0;
+    room.state = GameState::WAITING_FOR_PLAYERS;
+    room.open = true;
+    room.closing = false;
+    room.onShard = false;
+    room.idleSince = server.now();
+    ++openRooms;
+    Metrics::rooms.add(1);
+    markRoomChanged(roomId);
+    reindexRoom(roomId);
+    armReclaimTimer(roomId);
+    LOG_INFO("Lobby: Opened room " + std::to_string(roomId) + ", " + std::to_string(openRooms) + " rooms open");
+    return roomId;
+}
+
+void Lobby::armReclaimTimer(int roomId)
+{
+    if (rooms[roomId].reclaimTimer != 0)
+        return;
+    rooms[roomId].reclaimTimer = server.getTimers().schedule(rooms[roomId].idleSince + roomIdleTimeout, [this, roomId]()
+                                                             {
+                                                                 RoomSummary &room = rooms[roomId];
+                                                                 room.reclaimTimer = 0;
+                                                                 if (!room.open || room.closing || room.playerCount > 0 || room.state != GameState::WAITING_FOR_PLAYERS)
+                                                                     return;
+                                                                 // Used again in the meantime, wait for the rest of the new quiet period
+                                                                 if (server.now() - room.idleSince < roomIdleTimeout)
+                                                                 {
+                                                                     armReclaimTimer(roomId);
+                                                                     return;
+                                                                 }
+                                                                 room.closing = true;
+                                                                 markRoomChanged(roomId);
+                                                                 reindexRoom(roomId);
+                                                                 server.closeRoom(roomId); });
 }
 
 void Lobby::broadcastMessage(const std::string &command, const std::string &args)
 {
-    for (const auto &pair : players)
+    // Serialized once per wire format, every lobby player of a format shares the same frame
+    std::array<Frame, WIRE_FORMATS> frames;
+    uint8_t kind = (command == "LBBYINFO") ? SNAPSHOT_LBBYINFO : SNAPSHOT_NONE;
+    players.forEach([&](PlayerHandle, Player &player)
+                    {
+                        if (player.getNickname().empty())
+                            return; // Skip players without a nickname (not fully logged in)
+                        if (player.getState() != PlayerState::LOBBY)
+                            return; // Skip players not in the lobby
+                        WireFormat format = server.getWireFormat(player.getFd());
+                        Frame &frame = frames[static_cast<size_t>(format)];
+                        if (!frame)
+                            frame = makeFrame(format, command, args);
+                        server.sendFrame(player.getFd(), frame, kind); });
+}
+
+void Lobby::getLobbyState(StateSerializer &out)
+{
+    out.online(getOnlineCount());
+    out.roomCount(openRooms);
+    for (size_t i = 0; i < rooms.size(); ++i)
     {
-        if (pair.second->getNickname().empty())
-            continue; // Skip players without a nickname (not fully logged in)
-        if (pair.second->getState() != PlayerState::LOBBY)
-            continue; // Skip players not in the lobby
-        server.sendMessage(pair.second->getFd(), command, args);
+        if (!rooms[i].open || rooms[i].closing)
+            continue;
+        out.room(static_cast<int>(i), rooms[i].playerCount, MAX_PLAYERS, static_cast<int>(rooms[i].state));
     }
 }
 
-std::string Lobby::getLobbyState()
+void Lobby::getLobbyDelta(StateSerializer &out)
 {
-    std::string state = "";
-    state += "ONLINE;" + std::to_string(players.size()) + ":";
-    state += "ROOMS;" + std::to_string(rooms.size()) + ":";
-    for (const auto &roomPair : rooms)
+    out.online(getOnlineCount());
+    for (int i : changedRooms)
     {
-        state += "R" + std::to_string(roomPair.first) + ";" +
-                 std::to_string(roomPair.second.getPlayerCount()) + "/" + std::to_string(MAX_PLAYERS) + ";" + std::to_string(static_cast<int>(roomPair.second.getState())) + ":";
+        if (!rooms[i].open || rooms[i].closing)
+        {
+            out.roomClosed(i);
+            continue;
+        }
+        out.room(i, rooms[i].playerCount, MAX_PLAYERS, static_cast<int>(rooms[i].state));
     }
-    return state;
 }
 
 bool Lobby::initGamerooms(int numberOfRooms)
 {
-    for (int i = 0; i < numberOfRooms; ++i)
+    rooms.assign(numberOfRooms, RoomSummary());
+    for (int roomId = 0; roomId < numberOfRooms; ++roomId)
     {
-        rooms.try_emplace(i, i);
+        rooms[roomId].open = true;
+        rooms[roomId].onShard = true; // created by the shards at startup
+        reindexRoom(roomId);
     }
-    Logger::info("Lobby: Initialized " + std::to_string(numberOfRooms) + " game rooms");
+    fixedRooms = numberOfRooms;
+    openRooms = static_cast<size_t>(numberOfRooms);
+    Metrics::rooms.add(numberOfRooms);
+    LOG_INFO("Lobby: Initialized " + std::to_string(numberOfRooms) + " game rooms, up to " + std::to_string(maxRooms) + " on demand");
     return true;
 }
 
-void Lobby::handle(std::shared_ptr<Player> player, const Message &msg)
+// Commands handled by the lobby itself, per player state
+// Players seated in a room are served by its shard and never reach this table
+constexpr Lobby::HandlerTable Lobby::buildHandlerTable()
 {
-    if (player->getNickname().empty() && msg.command != "LOGIN___")
+    HandlerTable table{};
+    auto set = [&table](PlayerState state, Command command, Handler handler)
     {
-        Logger::error("Lobby: Player FD " + std::to_string(player->getFd()) + " attempted command without login");
+        table[static_cast<size_t>(state)][static_cast<size_t>(command)] = handler;
+    };
+
+    set(PlayerState::LOBBY, Command::LOGIN, &Lobby::handleLogin);
+    set(PlayerState::LOBBY, Command::JOIN, &Lobby::handleJoin);
+    set(PlayerState::LOBBY, Command::WATCH, &Lobby::handleWatch);
+    set(PlayerState::LOBBY, Command::LEAVE_ROOM, &Lobby::handleLeaveRoom);
+    return table;
+}
+
+const Lobby::HandlerTable Lobby::handlerTable = Lobby::buildHandlerTable();
+
+void Lobby::handle(Player &player, const MessageView &msg)
+{
+    if (player.getNickname().empty() && msg.command != Command::LOGIN)
+    {
+        LOG_ERROR("Lobby: Player FD " + std::to_string(player.getFd()) + " attempted command without login");
         handleInvalidMessage(player);
         return;
     }
-    if (msg.command == "LVRO____")
+
+    Handler handler = handlerTable[static_cast<size_t>(player.getState())][static_cast<size_t>(msg.command)];
+    if (handler != nullptr)
     {
-        // Player wants to leave the game room
-        auto it = rooms.find(player->getRoomId());
-        if (it != rooms.end())
-        {
-            it->second.removePlayer(player);
-            server.sendMessage(player->getFd(), "ACK_LVRO", " ");
-            if (it->second.getPlayerCount() == 0)
-            {
-                it->second.ResetDefaultState();
-                Logger::info("Lobby: Room " + std::to_string(it->first) + " reset to default state (no players left)");
-                dirtyPlayerState();
-                return;
-            }
-            if (it->second.getState() == GameState::WAITING_FOR_PLAYERS) // Only broadcast if in waiting state - avoid mid-game updates
-            {
-                it->second.broadcastMessage("ROMSTAUP", it->second.getRoomState());
-            }
-            playerStateChanged = true;
-        }
-        else
-        {
-            // invalid room
-            Logger::error("Lobby: Player FD " + std::to_string(player->getFd()) + " is in unknown room " + std::to_string(player->getRoomId()));
-            server.sendMessage(player->getFd(), "NACKLVRO", "Not in a valid room");
-            handleInvalidMessage(player);
-        }
+        (this->*handler)(player, msg);
     }
-    else if (player->getState() == PlayerState::IN_GAMEROOM)
+    else
     {
-        // Forward message to the appropriate game room
-        auto it = rooms.find(player->getRoomId());
-        if (it != rooms.end())
-        {
-            it->second.handle(player, msg);
-        }
-        else
-        {
-            Logger::error("Lobby: Player FD " + std::to_string(player->getFd()) + " is in unknown room " + std::to_string(player->getRoomId()));
-        }
+        int fd = player.getFd();
+        // Can destroy the player
+        handleInvalidMessage(player);
+        LOG_ERROR("Lobby: Player FD " + std::to_string(fd) + " sent invalid command " + msg.commandName());
     }
-    // Handle messages from players in the lobby
-    else if (msg.command == "LOGIN___")
+}
+
+void Lobby::handleLeaveRoom(Player &player, const MessageView &)
+{
+    // LVRO from a seated player is handled by its room's shard, here the player is in no room
+    LOG_ERROR("Lobby: Player FD " + std::to_string(player.getFd()) + " is in unknown room " + std::to_string(player.getRoomId()));
+    server.sendMessage(player.getFd(), "NACKLVRO", "Not in a valid room");
+    handleInvalidMessage(player);
+}
+
+void Lobby::handleLogin(Player &player, const MessageView &msg)
+{
+    // Login command has no arguments
+    if (msg.args.size() < 1)
     {
-        // Login command has no arguments
-        if (msg.args.size() < 1)
-        {
-            Logger::error("Lobby: LOGIN___ command missing arguments");
-            server.sendMessage(player->getFd(), "NACK_NIC", "Nickname required");
-            handleInvalidMessage(player);
-            return;
-        }
-        // Check if nickname is already taken
-        if (nicknameExists(msg.args[0]) && msg.args[0] != player->getNickname())
-        {
-            Logger::error("Lobby: Player FD " + std::to_string(player->getFd()) + " failed LOGIN___ command - nickname already taken (" + msg.args[0] + ")");
-            server.sendMessage(player->getFd(), "NACK_NIC", "Nickname already taken");
-            return;
-        }
-        // reconnecting disconnected player
-        if (disconnectedPlayers.count(msg.args[0]) > 0)
-        {
-            auto oldPlayer = disconnectedPlayers[msg.args[0]];
-
-            int newFd = player->getFd();
-            oldPlayer->setFd(newFd);
-            players[newFd] = oldPlayer;
-            disconnectedPlayers.erase(msg.args[0]);
-            oldPlayer->refreshLastActivity();
-            oldPlayer->resetInvalidMsgCount();
-            server.sendMessage(newFd, "ACK__REC", msg.args[0] + ";" + std::to_string(oldPlayer->getCredits()) + ";" + std::to_string(oldPlayer->getRoomId()));
-            Logger::info("Lobby: Player FD " + std::to_string(newFd) + " reconnected with nickname " + oldPlayer->getNickname());
-            playerStateChanged = true;
-            return;
-        }
+        LOG_ERROR("Lobby: LOGIN___ command missing arguments");
+        server.sendMessage(player.getFd(), "NACK_NIC", "Nickname required");
+        handleInvalidMessage(player);
+        return;
+    }
+    const std::string nickname(msg.args[0]);
+    // Asked for before anything else, already the answer goes out in binary
+    if (msg.args.size() >= 2 && msg.args[1] == Wire::LOGIN_TOKEN)
+        server.setWireFormat(player.getFd(), WireFormat::BINARY);
+    // Check if nickname is already taken
+    if (nicknameExists(nickname) && nickname != player.getNickname())
+    {
+        LOG_ERROR("Lobby: Player FD " + std::to_string(player.getFd()) + " failed LOGIN___ command - nickname already taken (" + nickname + ")");
+        server.sendMessage(player.getFd(), "NACK_NIC", "Nickname already taken");
+        return;
+    }
+    // disconnected mid-round, the seat is still held by the room's shard
+    auto parked = parkedSessions.find(nickname);
+    if (parked != parkedSessions.end())
+    {
+        int fd = player.getFd();
+        int roomId = parked->second;
+        parkedSessions.erase(parked);
+        seatedPlayers[nickname] = roomId;
+        unindexNickname(player);
+        players.take(players.handleOf(fd));
 
-        if(player->getNickname() != msg.args[0] && player->getNickname() != ""){
-            handleInvalidMessage(player);
-            server.sendMessage(player->getFd(), "INV_MESS", "Already logged in");
-			return;
-        }
+        ShardMessage reattach{ShardMessage::Type::REATTACH};
+        reattach.roomId = roomId;
+        reattach.nickname = nickname;
+        server.handOffToShard(fd, std::move(reattach));
+        LOG_INFO("Lobby: Player FD " + std::to_string(fd) + " reattaching to room " + std::to_string(roomId) + " as " + nickname);
+        playerStateChanged = true;
+        return;
+    }
+    completeLogin(player, nickname);
+}
 
-        // check if nickname is valid
-        if (Utils::validateNickname(msg.args[0]))
-        {
-            player->setNickname(msg.args[0]);
-            Logger::info("Lobby: Player FD " + std::to_string(player->getFd()) + " set nickname to " + player->getNickname());
-            server.sendMessage(player->getFd(), "ACK__NIC", msg.args[0] + ";" + std::to_string(player->getCredits()));
-            playerStateChanged = true;
-        }
-        else
+void Lobby::completeLogin(Player &player, const std::string &nickname)
+{
+    // reconnecting disconnected player
+    if (sessions.contains(nickname))
+    {
+        int newFd = player.getFd();
+        unindexNickname(player);
+        // The session takes over the slot of the fresh player, the FD index stays valid
+        player = std::move(*sessions.take(nickname));
+        player.setFd(newFd);
+        player.setLobbyVersion(0);
+        nicknameIndex[nickname] = newFd;
+        player.refreshLastActivity(server.now());
+        player.resetInvalidMsgCount();
+        server.sendMessage(newFd, "ACK__REC", nickname + ";" + std::to_string(player.getCredits()) + ";" + std::to_string(player.getRoomId()));
+        LOG_INFO("Lobby: Player FD " + std::to_string(newFd) + " reconnected with nickname " + player.getNickname());
+        playerStateChanged = true;
+        return;
+    }
+
+    if(player.getNickname() != nickname && player.getNickname() != ""){
+        int fd = player.getFd();
+        // Can destroy the player
+        handleInvalidMessage(player);
+        server.sendMessage(fd, "INV_MESS", "Already logged in");
+        return;
+    }
+
+    // check if nickname is valid
+    if (Utils::validateNickname(nickname))
+    {
+        player.setNickname(nickname);
+        CreditStore *store = server.getCreditStore();
+        std::optional<int> saved = store != nullptr ? store->lookup(nickname) : std::nullopt;
+        if (saved)
+            player.setCredits(*saved);
+        nicknameIndex[nickname] = player.getFd();
+        LOG_INFO("Lobby: Player FD " + std::to_string(player.getFd()) + " set nickname to " + player.getNickname());
+        server.sendMessage(player.getFd(), "ACK__NIC", nickname + ";" + std::to_string(player.getCredits()));
+        playerStateChanged = true;
+    }
+    else
+    {
+        server.sendMessage(player.getFd(), "NACK_NIC", "Invalid nickname");
+        LOG_ERROR("Lobby: LOGIN___ invalid nickname" + (nickname.empty() ? "" : " (" + nickname + ")"));
+    }
+}
+
+void Lobby::handleJoin(Player &player, const MessageView &msg)
+{
+    // Handle player joining a game room
+    int roomId = -1;
+    int fd = player.getFd();
+    if (server.isDraining())
+    {
+        server.sendMessage(fd, "NACK_JON", "Server shutting down");
+    }
+    else if (msg.args.empty())
+    {
+        // No room given: auto-matchmaking, opens a room when none takes players
+        roomId = player.getCredits() > 0 ? matchRoom() : -1;
+        if (roomId < 0 || !assignPlayerToRoom(player, roomId))
         {
-            server.sendMessage(player->getFd(), "NACK_NIC", "Invalid nickname");
-            Logger::error("Lobby: LOGIN___ invalid nickname" + (msg.args[0].empty() ? "" : " (" + msg.args[0] + ")"));
+            server.sendMessage(fd, "NACK_JON", roomId < 0 && player.getCredits() > 0 ? "No room available" : "Cannot join room");
         }
     }
-    else if (msg.command == "JOIN____")
+    else if (msg.args.size() == 1 && Parser::parseInt(msg.args[0], roomId))
     {
-        // Handle player joining a game room
-        if (msg.args.size() == 1)
+        // ACK__JON and the room snapshot come from the shard once the player is seated
+        if (!assignPlayerToRoom(player, roomId))
         {
-            int roomId = std::stoi(msg.args[0]);
-            if (assignPlayerToRoom(player, roomId))
-            {
-                server.sendMessage(player->getFd(), "ACK__JON", " ");
-                auto it = rooms.find(roomId);
-                it->second.broadcastMessage("ROMSTAUP", it->second.getRoomState());
-            }
-            else
-            {
-                server.sendMessage(player->getFd(), "NACK_JON", "Cannot join room");
-            }
+            server.sendMessage(fd, "NACK_JON", "Cannot join room");
         }
-        else
+    }
+    else
+    {
+        LOG_ERROR("Lobby: JOIN____ command missing arguments");
+        handleInvalidMessage(player);
+        server.sendMessage(fd, "NACK_JON", "Missing room ID");
+    }
+}
+
+void Lobby::handleWatch(Player &player, const MessageView &msg)
+{
+    int roomId = -1;
+    int fd = player.getFd();
+    if (server.isDraining())
+    {
+        server.sendMessage(fd, "NACK_WAT", "Server shutting down");
+    }
+    else if (msg.args.size() == 1 && Parser::parseInt(msg.args[0], roomId))
+    {
+        // ACK__WAT and the current snapshot come from the shard
+        if (!assignSpectatorToRoom(player, roomId))
         {
-            Logger::error("Lobby: JOIN____ command missing arguments");
-            handleInvalidMessage(player);
-            server.sendMessage(player->getFd(), "NACK_JON", "Missing room ID");
+            server.sendMessage(fd, "NACK_WAT", "Cannot watch room");
         }
     }
     else
     {
+        LOG_ERROR("Lobby: WATCH___ command missing arguments");
         handleInvalidMessage(player);
-        Logger::error("Lobby: Player FD " + std::to_string(player->getFd()) + " sent invalid command " + msg.command);
+        server.sendMessage(fd, "NACK_WAT", "Missing room ID");
     }
 }
 
-void Lobby::handleInvalidMessage(std::shared_ptr<Player> player)
+void Lobby::handleInvalidMessage(Player &player)
 {
-    player->incrementInvalidMsg();
-    Logger::error("Lobby: Player FD " + std::to_string(player->getFd()) + " sent invalid message");
-    if (player->getInvalidMsgCount() > 5)
+    player.incrementInvalidMsg();
+    LOG_ERROR("Lobby: Player FD " + std::to_string(player.getFd()) + " sent invalid message");
+    if (player.getInvalidMsgCount() > 5)
     {
-        Logger::error("Lobby: Player FD " + std::to_string(player->getFd()) + " exceeded invalid message limit");
-        server.sendMessage(player->getFd(), "DISCONNECT", "Too many invalid messages");
-        destroyPlayer(player->getFd());
+        LOG_ERROR("Lobby: Player FD " + std::to_string(player.getFd()) + " exceeded invalid message limit");
+        Metrics::invalidMessageKicks.add();
+        server.sendMessage(player.getFd(), "DISCONNECT", "Too many invalid messages");
+        int fd = player.getFd();
+        destroyPlayer(fd);
+        // DISCONNECT notice is flushed before the close at the end of the pass
+        server.scheduleDisconnect(fd);
     }
 }
 
 void Lobby::destroyPlayer(int fd)
 {
-    auto it = players.find(fd);
-    if (it != players.end())
+    auto player = players.take(players.handleOf(fd));
+    if (player)
     {
-        if (it->second->getState() == PlayerState::IN_GAMEROOM)
-        {
-            auto roomIt = rooms.find(it->second->getRoomId());
-            if (roomIt != rooms.end())
-            {
-                roomIt->second.removePlayer(it->second);
-                roomIt->second.broadcastMessage("ROMSTAUP", roomIt->second.getRoomState());
-            }
-        }
-        players.erase(fd);
+        unindexNickname(*player);
         dirtyPlayerState();
-        Logger::debug("Lobby: Player destroyed on FD " + std::to_string(fd));
+        LOG_DEBUG("Lobby: Player destroyed on FD " + std::to_string(fd));
     }
 }
 
-bool Lobby::assignPlayerToRoom(std::shared_ptr<Player> player, int roomId)
+bool Lobby::assignPlayerToRoom(Player &player, int roomId)
 {
-    auto it = rooms.find(roomId);
-    if (it != rooms.end() && it->second.getPlayerCount() < MAX_PLAYERS && it->second.getState() == GameState::WAITING_FOR_PLAYERS && player->getCredits() > 0)
+    // The directory can be one report behind, the shard has the final word and sends the player back if full
+    if (isJoinable(roomId) && player.getCredits() > 0)
     {
-        it->second.addPlayer(player);
-        player->setRoomId(roomId);
-        player->setState(PlayerState::IN_GAMEROOM);
+        int fd = player.getFd();
+        // Counted right away so JOINs in the same pass see the seat as taken
+        setRoomSummary(roomId, rooms[roomId].playerCount + 1, rooms[roomId].state);
+        unindexNickname(player);
+        seatedPlayers[player.getNickname()] = roomId;
+
+        ShardMessage join{ShardMessage::Type::JOIN_ROOM};
+        join.player = players.take(players.handleOf(fd));
+        join.roomId = roomId;
+        // The first player into an on-demand room brings it into existence on the shard
+        join.openRoom = !rooms[roomId].onShard;
+        rooms[roomId].onShard = true;
+        server.handOffToShard(fd, std::move(join));
         playerStateChanged = true;
-        Logger::info("Lobby: Player FD " + std::to_string(player->getFd()) + " assigned to room " + std::to_string(roomId));
+        LOG_INFO("Lobby: Player FD " + std::to_string(fd) + " handed over to room " + std::to_string(roomId));
         return true;
     }
-    Logger::error("Lobby: Room " + std::to_string(roomId) + " not found");
+    LOG_ERROR("Lobby: Room " + std::to_string(roomId) + " not found");
+    return false;
+}
+
+bool Lobby::assignSpectatorToRoom(Player &player, int roomId)
+{
+    // Any listed room can be watched, full or mid-round; spectators take no seat
+    if (roomId >= 0 && roomId < static_cast<int>(rooms.size()) && rooms[roomId].open && !rooms[roomId].closing)
+    {
+        int fd = player.getFd();
+        unindexNickname(player);
+        seatedPlayers[player.getNickname()] = roomId;
+
+        ShardMessage watch{ShardMessage::Type::WATCH_ROOM};
+        watch.player = players.take(players.handleOf(fd));
+        watch.roomId = roomId;
+        watch.openRoom = !rooms[roomId].onShard;
+        rooms[roomId].onShard = true;
+        server.handOffToShard(fd, std::move(watch));
+        playerStateChanged = true;
+        LOG_INFO("Lobby: Player FD " + std::to_string(fd) + " handed over to watch room " + std::to_string(roomId));
+        return true;
+    }
+    LOG_ERROR("Lobby: Room " + std::to_string(roomId) + " not found");
     return false;
 }
 
 bool Lobby::nicknameExists(const std::string nickname)
 {
-    for (const auto &pair : players)
+    return nicknameIndex.count(nickname) > 0 || seatedPlayers.count(nickname) > 0;
+}
+
+void Lobby::unindexNickname(const Player &player)
+{
+    if (player.getNickname().empty())
+        return;
+    auto it = nicknameIndex.find(player.getNickname());
+    if (it != nicknameIndex.end() && it->second == player.getFd())
+        nicknameIndex.erase(it);
+}
+
+void Lobby::handleShardMessage(LobbyMessage &msg)
+{
+    switch (msg.type)
+    {
+    case LobbyMessage::Type::RETURN_TO_LOBBY:
     {
-        if (pair.second->getNickname() == nickname)
+        int fd = msg.conn->getFd();
+        seatedPlayers.erase(msg.nickname);
+        msg.player->setLobbyVersion(0);
+        players.add(std::move(*msg.player));
+        nicknameIndex[msg.nickname] = fd;
+        playerStateChanged = true;
+        LOG_DEBUG("Lobby: Player FD " + std::to_string(fd) + " returned to lobby");
+        // Lines buffered for a hot restart are processed by the new process
+        if (server.adoptConnection(std::move(msg.conn)) && !server.isRestarting())
+            server.resumeConnection(fd);
+        break;
+    }
+    case LobbyMessage::Type::REATTACH_FAILED:
+    {
+        // The seat is gone, continue as a regular login on a fresh player
+        int fd = msg.conn->getFd();
+        seatedPlayers.erase(msg.nickname);
+        Player fresh(fd);
+        fresh.refreshLastActivity(server.now());
+        PlayerHandle handle = players.add(std::move(fresh));
+        if (server.adoptConnection(std::move(msg.conn)))
         {
-            return true;
+            completeLogin(*players.get(handle), msg.nickname);
+            server.resumeConnection(fd);
         }
+        break;
     }
-    return false;
+    case LobbyMessage::Type::SESSION_RETURNED:
+        if (msg.wasConnected)
+            seatedPlayers.erase(msg.nickname);
+        parkedSessions.erase(msg.nickname);
+        if (!msg.nickname.empty())
+            sessions.park(std::move(*msg.player), server.now());
+        playerStateChanged = true;
+        break;
+    case LobbyMessage::Type::SESSION_PARKED:
+        seatedPlayers.erase(msg.nickname);
+        parkedSessions[msg.nickname] = msg.roomId;
+        playerStateChanged = true;
+        break;
+    case LobbyMessage::Type::PLAYER_DESTROYED:
+        seatedPlayers.erase(msg.nickname);
+        playerStateChanged = true;
+        break;
+    case LobbyMessage::Type::ROOM_STATUS:
+        if (msg.roomId >= 0 && msg.roomId < static_cast<int>(rooms.size()) && rooms[msg.roomId].open)
+        {
+            RoomSummary &room = rooms[msg.roomId];
+            if (room.closing)
+            {
+                // The shard kept the room, it got a player before the close request arrived
+                room.closing = false;
+                markRoomChanged(msg.roomId);
+                reindexRoom(msg.roomId);
+            }
+            setRoomSummary(msg.roomId, msg.playerCount, msg.roomState);
+        }
+        break;
+    case LobbyMessage::Type::SHARD_DRAINED:
+        server.onShardDrained();
+        break;
+    case LobbyMessage::Type::NEW_CONNECTION:
+    {
+        int fd = msg.conn->getFd();
+        if (server.adoptConnection(std::move(msg.conn)))
+            addPlayer(fd);
+        break;
+    }
+    case LobbyMessage::Type::ROOM_CLOSED:
+        if (msg.roomId >= 0 && msg.roomId < static_cast<int>(rooms.size()) && rooms[msg.roomId].open)
+        {
+            RoomSummary &room = rooms[msg.roomId];
+            room.open = false;
+            room.closing = false;
+            room.onShard = false;
+            room.playerCount = 0;
+            room.state = GameState::WAITING_FOR_PLAYERS;
+            markRoomChanged(msg.roomId);
+            reindexRoom(msg.roomId);
+            freeRoomIds.push(msg.roomId);
+            --openRooms;
+            Metrics::rooms.add(-1);
+            LOG_INFO("Lobby: Room " + std::to_string(msg.roomId) + " reclaimed, " + std::to_string(openRooms) + " rooms open");
+        }
+        break;
+    }
+}
+
+void Lobby::disconnectAll(const std::string &reason)
+{
+    std::vector<int> fds;
+    players.forEach([this, &fds](PlayerHandle, Player &player)
+                    {
+                        server.persistCredits(player);
+                        fds.push_back(player.getFd()); });
+    sessions.forEach([this](const Player &player)
+                     { server.persistCredits(player); });
+    for (int fd : fds)
+    {
+        server.sendMessage(fd, "DISCONNECT", reason);
+        server.scheduleDisconnect(fd);
+    }
+    LOG_INFO("Lobby: Disconnected " + std::to_string(fds.size()) + " players, saved " + std::to_string(sessions.size()) + " sessions");
+}
+
+std::vector<HotRestart::PlayerState> Lobby::getRestartState()
+{
+    std::vector<HotRestart::PlayerState> states;
+    players.forEach([&states](PlayerHandle, Player &player)
+                    {
+                        HotRestart::PlayerState state;
+                        state.fd = player.getFd();
+                        state.nickname = player.getNickname();
+                        state.credits = player.getCredits();
+                        // Players back from a drained shard still carry their room
+                        state.roomId = player.getRoomId();
+                        states.push_back(std::move(state)); });
+    sessions.forEach([&states](const Player &player)
+                     {
+                         HotRestart::PlayerState state;
+                         state.nickname = player.getNickname();
+                         state.credits = player.getCredits();
+                         states.push_back(std::move(state)); });
+    return states;
+}
+
+void Lobby::restorePlayers(const std::vector<HotRestart::PlayerState> &states)
+{
+    // Old room ID -> room in this process
+    std::unordered_map<int, int> seating;
+    for (const HotRestart::PlayerState &state : states)
+    {
+        Player player(state.fd);
+        player.setNickname(state.nickname);
+        player.setCredits(state.credits);
+        player.refreshLastActivity(server.now());
+        if (state.fd < 0)
+        {
+            if (!state.nickname.empty())
+                sessions.park(std::move(player), server.now());
+            continue;
+        }
+
+        PlayerHandle handle = players.add(std::move(player));
+        if (!state.nickname.empty())
+            nicknameIndex[state.nickname] = state.fd;
+        if (state.roomId >= 0 && !state.nickname.empty())
+        {
+            auto it = seating.find(state.roomId);
+            int roomId = it != seating.end() ? it->second : (isJoinable(state.roomId) ? state.roomId : openRoom());
+            seating[state.roomId] = roomId;
+            // The client gets a fresh room snapshot with the ACK__JON from the shard
+            if (assignPlayerToRoom(*players.get(handle), roomId))
+                continue;
+            server.sendMessage(state.fd, "ACK_LVRO", " ");
+        }
+        server.resumeConnection(state.fd);
+    }
+    playerStateChanged = true;
+    LOG_INFO("Lobby: Restored " + std::to_string(states.size()) + " players from the previous process");
 }
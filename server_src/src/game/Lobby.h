@@ -6,16 +6,36 @@
  * Manages player connections, nickname validation, room assignments, and
  * coordinates between the network layer and individual game rooms.
  * Handles player state changes and message routing.
+ * Rooms themselves run on the shards, the lobby keeps a directory of their
+ * last reported status and hands players over with their connections.
+ * Lobby players get the directory as a full LBBYINFO snapshot once and then
+ * as LBBYDELT deltas carrying only the rooms that changed, at most one
+ * broadcast per configured interval.
+ * The startup rooms are always open. When no room takes players (all full
+ * or mid-round) an auto-matching JOIN opens another one on its shard, up to
+ * the configured limit, and rooms opened that way are reclaimed once they
+ * were empty for the idle timeout. Joinable rooms are kept in a SeatIndex,
+ * so auto-matching never walks the directory.
  */
 
 #ifndef LOBBY_H
 #define LOBBY_H
 
 #include "Player.h"
-#include <map>
-#include <memory>
+#include "PlayerTable.h"
+#include "SessionStore.h"
+#include "SeatIndex.h"
+#include <unordered_map>
+#include <array>
+#include <chrono>
+#include <functional>
+#include <queue>
+#include <vector>
 #include "game/GameRoom.h"
 #include "../protocol/Message.h"
+#include "../protocol/StateSerializer.h"
+#include "../network/LoopMessage.h"
+#include "../network/HotRestart.h"
 
 class TcpServer;
 
@@ -31,37 +51,127 @@ public:
     void removePlayer(int fd);
     // Destroys a player completely
     void destroyPlayer(int fd);
-    void handleInvalidMessage(std::shared_ptr<Player> player);
+    void handleInvalidMessage(Player &player);
 
     // Retrieves all players
-    std::map<int, std::shared_ptr<Player>> &getAllPlayers() { return players; }
+    PlayerTable &getAllPlayers() { return players; }
 
-    // checks if a nickname is already taken
+    // checks if a nickname is already taken (lobby players and players seated in rooms), O(1)
     bool nicknameExists(const std::string nickname);
 
-    // Retrieves player object by socket FD
-    std::shared_ptr<Player> getPlayer(int fd);
+    // Disconnected players that can still reconnect
+    SessionStore &getSessions() { return sessions; }
 
-    // Additional lobby management
-    void handle(std::shared_ptr<Player> player, const Message &msg);
+    // Logged in or connecting players, lobby and rooms together
+    size_t getOnlineCount() const { return players.size() + seatedPlayers.size(); }
 
+    // Retrieves player object by socket FD, nullptr if none
+    Player *getPlayer(int fd) { return players.findByFd(fd); }
+
+    // Routes a message through the per-state handler table
+    void handle(Player &player, const MessageView &msg);
+
+    // Applies a report or returning player posted by a shard
+    void handleShardMessage(LobbyMessage &msg);
+
+    // Sets up the room directory, the rooms are created on the shards
     bool initGamerooms(int numberOfRooms);
 
-    std::string getLobbyState();
+    // Full snapshot: online count, open room count and every open room
+    void getLobbyState(StateSerializer &out);
+    // Online count and only the rooms changed since the last broadcast, closed ones as "R<id>;-"
+    void getLobbyDelta(StateSerializer &out);
 
-    // Assigns a player to a specific game room
-    bool assignPlayerToRoom(std::shared_ptr<Player> player, int roomId);
+    // Hands a player over to the shard of a specific game room, 'player' is gone on success
+    bool assignPlayerToRoom(Player &player, int roomId);
+    // Same for watching the room without a seat
+    bool assignSpectatorToRoom(Player &player, int roomId);
 
+    // Runs every lobby pass, broadcasts once the lobby state was marked dirty and the
+    // rate limit allows it
     void update();
 
     void broadcastMessage(const std::string &command, const std::string &args);
 
     void dirtyPlayerState() { playerStateChanged = true; }
 
+    // Shutdown: saves every balance and closes the lobby connections after a DISCONNECT notice
+    void disconnectAll(const std::string &reason);
+    // Hot restart, old process: every lobby player and kept session, connection buffers not filled in
+    std::vector<HotRestart::PlayerState> getRestartState();
+    // Hot restart, new process: takes the players back, their connections are already adopted.
+    // Seated players are seated again, tables that sat together stay together
+    void restorePlayers(const std::vector<HotRestart::PlayerState> &states);
+
 private:
-    std::map<int, std::shared_ptr<Player>> players;
-    std::map<std::string, std::shared_ptr<Player>> disconnectedPlayers;
-    std::map<int, GameRoom> rooms;
+    // Command handlers, registered in buildHandlerTable()
+    void handleLogin(Player &player, const MessageView &msg);
+    void handleJoin(Player &player, const MessageView &msg);
+    void handleWatch(Player &player, const MessageView &msg);
+    void handleLeaveRoom(Player &player, const MessageView &msg);
+    // Nickname checks and ACK after a session in a room was ruled out
+    void completeLogin(Player &player, const std::string &nickname);
+    // Drops the nickname index entry if it still points at this player's FD
+    void unindexNickname(const Player &player);
+    // Sends the delta to players holding the previous version, a snapshot to everyone else
+    void broadcastLobbyState();
+    void setRoomSummary(int roomId, int playerCount, GameState state);
+    // Open, not closing, waiting for players and a free seat, as far as the directory knows
+    bool isJoinable(int roomId) const;
+    // Queues the room for the next delta
+    void markRoomChanged(int roomId);
+    // Puts the room in or takes it out of the seat index after its summary changed
+    void reindexRoom(int roomId);
+    // Joinable room with the most players, a newly opened one if there is none. -1 at the room limit
+    int matchRoom();
+    // Allocates the lowest free room ID, the shard creates the room with the first JOIN
+    int openRoom();
+    // Reclaims an on-demand room once it was empty for the idle timeout
+    void armReclaimTimer(int roomId);
+
+    static constexpr size_t PLAYER_STATE_COUNT = 4;
+    using Handler = void (Lobby::*)(Player &, const MessageView &);
+    using HandlerTable = std::array<std::array<Handler, COMMAND_COUNT>, PLAYER_STATE_COUNT>;
+    static constexpr HandlerTable buildHandlerTable();
+    static const HandlerTable handlerTable;
+
+    // Connected lobby players, by socket FD
+    PlayerTable players;
+    // Nickname -> FD of logged in lobby players, kept in step with 'players'
+    std::unordered_map<std::string, int> nicknameIndex;
+    SessionStore sessions;
+    // Last status reported by the owning shard, indexed by room ID
+    struct RoomSummary
+    {
+        int playerCount = 0;
+        GameState state = GameState::WAITING_FOR_PLAYERS;
+        bool changed = false; // since the last broadcast
+        bool open = false;    // ID in use, the room is listed unless closing
+        bool closing = false; // CLOSE_ROOM sent, waiting for the shard
+        bool onShard = false; // the shard has created the room
+        TimerWheel::Clock::time_point idleSince{};
+        TimerWheel::TimerId reclaimTimer = 0;
+    };
+    std::vector<RoomSummary> rooms;
+    // Rooms with changed == true, in the order they changed
+    std::vector<int> changedRooms;
+    SeatIndex<MAX_PLAYERS> joinable;
+    // Released by reclaimed rooms, the lowest is handed out first to keep the directory dense
+    std::priority_queue<int, std::vector<int>, std::greater<int>> freeRoomIds;
+    size_t openRooms = 0;
+    // IDs below this are the startup rooms, never reclaimed
+    int fixedRooms = 0;
+    size_t maxRooms;
+    std::chrono::seconds roomIdleTimeout;
+    // Bumped on every broadcast, players remember the version they got
+    uint64_t lobbyVersion = 0;
+    std::chrono::milliseconds broadcastInterval;
+    TimerWheel::Clock::time_point nextBroadcast;
+    TimerWheel::TimerId broadcastTimer = 0;
+    // Nicknames currently owned by a shard (seated, watching or on the way), with their room
+    std::unordered_map<std::string, int> seatedPlayers;
+    // Disconnected mid-round, the seat is kept in the room and LOGIN reattaches to it
+    std::unordered_map<std::string, int> parkedSessions;
     TcpServer &server;
     bool playerStateChanged = false;
 };
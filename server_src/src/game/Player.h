@@ -12,13 +12,15 @@
 #define PLAYER_H
 
 #include <string>
-#include <vector>
 #include <chrono>
+#include <cstdint>
+#include "Card.h"
 
 enum class PlayerState
 {
     LOBBY,
     IN_GAMEROOM,
+    SPECTATING, // watching a room from the room's shard, without a seat
     DISCONNECTED
 };
 
@@ -26,7 +28,7 @@ class Player
 {
 public:
     Player(int socketFd)
-        : fd(socketFd), state(PlayerState::LOBBY), invalidMsgCount(0), roomId(-1)
+        : fd(socketFd), state(PlayerState::LOBBY), roomId(-1), seat(-1), offline(false), invalidMsgCount(0), lobbyVersion(0)
     {
         credits = 1000; // Default starting credits
         resetGameAttributes();
@@ -45,6 +47,9 @@ public:
     void resetInvalidMsgCount() { invalidMsgCount = 0; }
     int getRoomId() const { return roomId; }
     void setRoomId(int id) { roomId = id; }
+    // Seat number within the room, kept for the whole stay; -1 = not seated
+    int getSeat() const { return seat; }
+    void setSeat(int number) { seat = number; }
 
     void setTurn(bool turn) { hasTurn = turn; }
     bool getTurn() const { return hasTurn; }
@@ -56,24 +61,18 @@ public:
     bool getPlacedBet() const { return placedBet; }
     void setBetAmount(int amount) { betAmount = amount; }
     int getBetAmount() const { return betAmount; }
-    void addPlayerCard(const std::string &card) { playerCards.push_back(card); }
-    const std::string getPlayerCards() const
-    {
-        std::string cards;
-        if (playerCards.empty())
-            return "NO";
-        for (const auto &card : playerCards)
-        {
-            if (!cards.empty())
-                cards += ";";
-            cards += card;
-        }
-        return cards;
-    }
-    void clearPlayerCards() { playerCards.clear(); }
+    void addPlayerCard(Card card) { hand.add(card); }
+    const Hand &getHand() const { return hand; }
+    // Wire form, "NO" without cards
+    std::string getPlayerCards() const { return hand.toString(); }
+    void clearPlayerCards() { hand.clear(); }
     int getCredits() const { return credits; }
     void setCredits(int amount) { credits = amount; }
 
+    // Lobby state version this player last received, 0 = needs a full LBBYINFO snapshot
+    uint64_t getLobbyVersion() const { return lobbyVersion; }
+    void setLobbyVersion(uint64_t version) { lobbyVersion = version; }
+
     void resetGameAttributes()
     {
         hasTurn = false;
@@ -81,37 +80,42 @@ public:
         placedBet = false;
         isWaiting = true;
         betAmount = 0;
-        playerCards.clear();
+        hand.clear();
     }
 
-    void refreshLastActivity()
-    {
-        lastActivity = std::chrono::steady_clock::now();
-    }
+    // 'now' is the owning loop's pass time. Seated players come back online only through
+    // GameRoom::setPlayerOffline, which keeps the room's offline counter in step
+    void refreshLastActivity(std::chrono::steady_clock::time_point now) { lastActivity = now; }
+    std::chrono::steady_clock::time_point getLastActivity() const { return lastActivity; }
 
-    long getSecondsSinceLastActivity() const
-    {
-        auto now = std::chrono::steady_clock::now();
-        return std::chrono::duration_cast<std::chrono::seconds>(now - lastActivity).count();
-    }
+    // Only through GameRoom::setPlayerOffline: by the room's offline timer once a disconnected
+    // player was inactive for OFFLINE_TIMEOUT, and on reattaching
+    void setOffline(bool value) { offline = value; }
+    bool isOffline() const { return offline; }
 
-    bool isOffline() const { return getSecondsSinceLastActivity() > 9; }
+    static constexpr std::chrono::seconds OFFLINE_TIMEOUT{10};
 
 private:
+    // Hot fields first, read on every heartbeat, lookup and broadcast; with players stored
+    // inline in a PlayerTable they share the first cache line of each slot
     int fd;
-    std::string nickname;
     PlayerState state;
+    int roomId;
+    int seat;
+    bool offline;
     std::chrono::steady_clock::time_point lastActivity;
+
+    std::string nickname;
     int invalidMsgCount;
-    int roomId;
     int credits;
+    uint64_t lobbyVersion;
 
     // game-related attributes
     bool hasTurn;
     bool isReady;
     bool placedBet;
     int betAmount;
-    std::vector<std::string> playerCards;
+    Hand hand;
     bool isWaiting;
 };
 
@@ -0,0 +1,53 @@
+#include "PlayerTable.h"
+
+PlayerHandle PlayerTable::add(Player player)
+{
+    int fd = player.getFd();
+    PlayerHandle handle = players.emplace(std::move(player));
+    index(fd, handle);
+    return handle;
+}
+
+void PlayerTable::attach(PlayerHandle handle, int fd)
+{
+    Player *player = players.get(handle);
+    if (player == nullptr)
+        return;
+    unindex(player->getFd(), handle);
+    player->setFd(fd);
+    index(fd, handle);
+}
+
+void PlayerTable::detach(PlayerHandle handle)
+{
+    Player *player = players.get(handle);
+    if (player == nullptr)
+        return;
+    unindex(player->getFd(), handle);
+    // Stale FD must not receive messages once the number is reused
+    player->setFd(-1);
+}
+
+std::optional<Player> PlayerTable::take(PlayerHandle handle)
+{
+    Player *player = players.get(handle);
+    if (player == nullptr)
+        return std::nullopt;
+    unindex(player->getFd(), handle);
+    return players.take(handle);
+}
+
+void PlayerTable::index(int fd, PlayerHandle handle)
+{
+    if (fd < 0)
+        return;
+    if (static_cast<size_t>(fd) >= byFd.size())
+        byFd.resize(static_cast<size_t>(fd) + 1);
+    byFd[fd] = handle;
+}
+
+void PlayerTable::unindex(int fd, PlayerHandle handle)
+{
+    if (fd >= 0 && static_cast<size_t>(fd) < byFd.size() && byFd[fd] == handle)
+        byFd[fd] = PlayerHandle{};
+}
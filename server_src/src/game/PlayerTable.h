@@ -0,0 +1,58 @@
+/**
+ * Server for blackjack
+ * Author: Marek Manzel
+ *
+ * PlayerTable.h - Players owned by one event loop
+ * Players are stored by value in a SlotMap and referenced by generational
+ * handles (rooms, turn order, timers). Connected players are additionally
+ * indexed by socket FD in a flat array, so the per-message lookup is a plain
+ * array access. Not thread-safe, players move between loops by value.
+ */
+
+#ifndef PLAYER_TABLE_H
+#define PLAYER_TABLE_H
+
+#include "Player.h"
+#include "../core/SlotMap.h"
+#include <optional>
+#include <vector>
+
+using PlayerHandle = SlotHandle;
+
+class PlayerTable
+{
+public:
+    // Stores the player, a player with a connection (fd >= 0) is indexed by it
+    PlayerHandle add(Player player);
+
+    Player *get(PlayerHandle handle) { return players.get(handle); }
+    const Player *get(PlayerHandle handle) const { return players.get(handle); }
+    // Connected player on 'fd', nullptr if none
+    Player *findByFd(int fd) { return players.get(handleOf(fd)); }
+    PlayerHandle handleOf(int fd) const
+    {
+        return (fd >= 0 && static_cast<size_t>(fd) < byFd.size()) ? byFd[fd] : PlayerHandle{};
+    }
+
+    // Binds a player without a connection to 'fd'
+    void attach(PlayerHandle handle, int fd);
+    // Player keeps its slot but loses its connection, the FD is set to -1
+    void detach(PlayerHandle handle);
+    // Removes the player and returns it, its FD is left as is for the new owner
+    std::optional<Player> take(PlayerHandle handle);
+
+    size_t size() const { return players.size(); }
+
+    // f(PlayerHandle, Player &), must not add or remove players
+    template <typename F>
+    void forEach(F f) { players.forEach(f); }
+
+private:
+    void index(int fd, PlayerHandle handle);
+    void unindex(int fd, PlayerHandle handle);
+
+    SlotMap<Player> players;
+    std::vector<PlayerHandle> byFd;
+};
+
+#endif
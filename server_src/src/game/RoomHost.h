@@ -0,0 +1,65 @@
+/**
+ * Server for blackjack
+ * Author: Marek Manzel
+ *
+ * RoomHost.h - What a GameRoom needs from the loop it runs in
+ * The room engine never touches sockets: its output, timers, clock and the
+ * players it lets go all go through this interface. The Shard implements it
+ * for the server, the headless simulator in bench/ implements it without any
+ * network, so rounds can be played and replayed in isolation.
+ * Everything is called from the owner's thread only.
+ */
+
+#ifndef ROOM_HOST_H
+#define ROOM_HOST_H
+
+#include "../core/Config.h"
+#include "../core/TimerWheel.h"
+#include "../protocol/Frame.h"
+#include "../protocol/Wire.h"
+#include "Player.h"
+#include "PlayerTable.h"
+#include <string>
+
+class GameRoom;
+class CommandLog;
+class RoundJournal;
+
+class RoomHost
+{
+public:
+    virtual ~RoomHost() = default;
+
+    // Seated players and spectators of all rooms of this host
+    virtual PlayerTable &getPlayers() = 0;
+    virtual const Config &getConfig() const = 0;
+    virtual TimerWheel &getTimers() = 0;
+    virtual TimerWheel::Clock::time_point now() const = 0;
+    // Shutting down, rooms do not start new rounds
+    virtual bool isDraining() const = 0;
+
+    // Output sink, 'fd' is the player's connection
+    virtual WireFormat getWireFormat(int fd) const = 0;
+    virtual void sendMessage(int fd, const std::string &command, const std::string &args) = 0;
+    virtual void sendFrame(int fd, const Frame &frame, uint8_t snapshotKind = SNAPSHOT_NONE) = 0;
+    // Player count / state of the room changed
+    virtual void publishRoomStatus(const GameRoom &room) = 0;
+    // Balance changed at the end of a round
+    virtual void persistCredits(const Player &player) = 0;
+
+    // The room wants update() / fanOutToSpectators() run later in this pass
+    virtual void scheduleRoomUpdate(GameRoom &room) = 0;
+    virtual void scheduleSpectatorFanOut(GameRoom &room) = 0;
+
+    // Player was removed from its room: back to the lobby, session kept offline, or dropped
+    virtual void returnToLobby(PlayerHandle player) = 0;
+    virtual void evictPlayer(PlayerHandle player) = 0;
+    virtual void destroyPlayer(PlayerHandle player) = 0;
+
+    // Records the room's inputs for replay, nullptr while not recording
+    virtual CommandLog *getCommandLog() { return nullptr; }
+    // Per-round event journal the rooms open their rings in, nullptr if disabled
+    virtual RoundJournal *getJournal() { return nullptr; }
+};
+
+#endif
@@ -0,0 +1,116 @@
+#include "RoundJournal.h"
+#include "../core/Logger.h"
+#include "../core/Metrics.h"
+#include "../core/Utils.h"
+#include <fcntl.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstring>
+
+RoundJournal::~RoundJournal()
+{
+    if (writer.joinable())
+    {
+        {
+            std::lock_guard<std::mutex> lock(wakeMutex);
+            isRunning = false;
+        }
+        wake.notify_one();
+        writer.join();
+    }
+    if (fd != -1)
+        close(fd);
+}
+
+bool RoundJournal::open(const std::string &journalPath, uint64_t seed)
+{
+    path = journalPath;
+    fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0)
+        return false;
+
+    origin = TimerWheel::Clock::now();
+    lastWrite = origin;
+    JournalHeader header;
+    std::memcpy(header.magic, JOURNAL_MAGIC, sizeof(header.magic));
+    header.version = JOURNAL_VERSION;
+    header.startTime = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::system_clock::now().time_since_epoch()).count());
+    header.seed = seed;
+    if (!Utils::writeAll(fd, &header, sizeof(header)))
+        return false;
+
+    // Allocated once, collecting never grows it in the common case
+    batch.reserve(2 * WRITE_EVENTS);
+    isRunning = true;
+    writer = std::thread([this]()
+                         { run(); });
+    return true;
+}
+
+std::shared_ptr<JournalRing> RoundJournal::openRing(int roomId)
+{
+    auto ring = std::make_shared<JournalRing>(roomId, origin);
+    std::lock_guard<std::mutex> lock(ringsMutex);
+    rings.push_back(ring);
+    return ring;
+}
+
+void RoundJournal::run()
+{
+    while (true)
+    {
+        bool stopping;
+        {
+            std::unique_lock<std::mutex> lock(wakeMutex);
+            wake.wait_for(lock, DRAIN_INTERVAL, [this]()
+                          { return !isRunning; });
+            stopping = !isRunning;
+        }
+        // Draining often keeps the rings small, writing rarely keeps the writes large
+        collect();
+        if (batch.size() >= WRITE_EVENTS || TimerWheel::Clock::now() - lastWrite >= WRITE_INTERVAL || stopping)
+            write();
+        if (stopping)
+            break;
+    }
+}
+
+void RoundJournal::collect()
+{
+    std::lock_guard<std::mutex> lock(ringsMutex);
+    for (size_t i = 0; i < rings.size();)
+    {
+        JournalRing &ring = *rings[i];
+        bool retired = ring.retired.load(std::memory_order_acquire);
+        ring.drainTo(batch);
+        uint64_t dropped = ring.dropped.exchange(0, std::memory_order_relaxed);
+        if (dropped > 0)
+        {
+            batch.push_back(JournalEvent::make(ring.elapsed(TimerWheel::Clock::now()), JournalEventType::LOST, ring.getRoomId(), 0, JOURNAL_DEALER,
+                                               JOURNAL_NO_CARD, 0, static_cast<int32_t>(std::min<uint64_t>(dropped, INT32_MAX))));
+            Metrics::journalLost.add(dropped);
+        }
+        if (retired)
+        {
+            rings[i] = rings.back();
+            rings.pop_back();
+            continue;
+        }
+        ++i;
+    }
+}
+
+void RoundJournal::write()
+{
+    lastWrite = TimerWheel::Clock::now();
+    if (batch.empty())
+        return;
+    if (!Utils::writeAll(fd, batch.data(), batch.size() * sizeof(JournalEvent)))
+    {
+        LOG_ERROR_LIMITED("RoundJournal: writing " + path + " failed: " + std::strerror(errno));
+        Metrics::journalLost.add(batch.size());
+    }
+    else
+        Metrics::journalEvents.add(batch.size());
+    batch.clear();
+}
@@ -0,0 +1,235 @@
+/**
+ * Server for blackjack
+ * Author: Marek Manzel
+ *
+ * RoundJournal.h - Binary per-round event journal with bounded memory
+ * Rooms record what happens in a round (bets, every card dealt, hits, stands,
+ * busts, turn timeouts, dealer draws and payouts) as fixed 24-byte events
+ * stamped with the loop time. Each room writes into its own preallocated
+ * single-producer ring, recording an event is a few stores and never
+ * allocates, formats or blocks. A writer thread drains all rings and appends
+ * the events to the journal file in large sequential writes. A room whose
+ * ring is full drops events; the writer notes how many in a LOST event, so
+ * memory stays at RING_EVENTS per room whatever the disk does.
+ * The file is a JournalHeader followed by events, tools/bj_journal decodes it.
+ */
+
+#ifndef ROUND_JOURNAL_H
+#define ROUND_JOURNAL_H
+
+#include "Card.h"
+#include "../core/TimerWheel.h"
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+enum class JournalEventType : uint8_t
+{
+    ROUND_BEGIN, // betting opened, seat = number of players
+    SEAT,        // player of a seat in this round, carries the nickname
+    BET,         // amount = bet
+    DEAL,        // card dealt at the start of the round, to a seat or the dealer
+    HIT,         // card drawn by a seat
+    STAND,       // turn of a seat over (standing, bust, 21 or timeout)
+    BUST,
+    TIMEOUT,     // turn timer ran out, the seat is stood
+    DEALER_DRAW, // card drawn by the dealer after the last turn
+    PAYOUT,      // card = JournalOutcome, amount = winnings as reported to the player
+    ROUND_END,   // total = dealer's hand
+    ROUND_ABORT, // round called off (everyone offline, shutdown), bets returned
+    LOST         // written by the journal, amount = events the room's full ring dropped
+};
+
+constexpr size_t JOURNAL_EVENT_TYPES = 13;
+
+enum class JournalOutcome : uint8_t
+{
+    LOSS,
+    PUSH,
+    BLACKJACK,
+    WIN
+};
+
+// Seat of the dealer's events
+constexpr uint8_t JOURNAL_DEALER = 0xFF;
+// Card of events without one
+constexpr uint8_t JOURNAL_NO_CARD = 0xFF;
+// Nicknames are validated to at most this many characters
+constexpr size_t JOURNAL_NICKNAME = 10;
+
+// On-disk layout, little-endian host order. The 10 data bytes hold round, amount, card
+// and hand total, or the nickname of a SEAT event (NUL-padded)
+struct JournalEvent
+{
+    uint64_t time; // microseconds since the journal was opened
+    uint32_t roomId;
+    uint8_t type;
+    uint8_t seat;
+    char data[10];
+
+    static JournalEvent make(uint64_t time, JournalEventType type, int roomId, uint32_t round, int seat, uint8_t card, int total, int32_t amount)
+    {
+        JournalEvent event;
+        event.time = time;
+        event.roomId = static_cast<uint32_t>(roomId);
+        event.type = static_cast<uint8_t>(type);
+        event.seat = static_cast<uint8_t>(seat);
+        std::memcpy(event.data, &round, 4);
+        std::memcpy(event.data + 4, &amount, 4);
+        event.data[8] = static_cast<char>(card);
+        event.data[9] = static_cast<char>(static_cast<uint8_t>(total));
+        return event;
+    }
+    static JournalEvent makeSeat(uint64_t time, int roomId, int seat, const std::string &nickname)
+    {
+        JournalEvent event;
+        event.time = time;
+        event.roomId = static_cast<uint32_t>(roomId);
+        event.type = static_cast<uint8_t>(JournalEventType::SEAT);
+        event.seat = static_cast<uint8_t>(seat);
+        std::memset(event.data, 0, sizeof(event.data));
+        std::memcpy(event.data, nickname.data(), std::min(nickname.size(), JOURNAL_NICKNAME));
+        return event;
+    }
+
+    JournalEventType getType() const { return static_cast<JournalEventType>(type); }
+    uint32_t getRound() const
+    {
+        uint32_t round;
+        std::memcpy(&round, data, 4);
+        return round;
+    }
+    int32_t getAmount() const
+    {
+        int32_t amount;
+        std::memcpy(&amount, data + 4, 4);
+        return amount;
+    }
+    uint8_t getCard() const { return static_cast<uint8_t>(data[8]); }
+    int getTotal() const { return static_cast<uint8_t>(data[9]); }
+    std::string getNickname() const { return std::string(data, strnlen(data, JOURNAL_NICKNAME)); }
+};
+
+static_assert(sizeof(JournalEvent) == 24, "Journal event layout changed");
+
+struct JournalHeader
+{
+    char magic[4]; // "BJRJ"
+    uint32_t version;
+    uint64_t startTime; // wall clock at opening, microseconds since the epoch
+    uint64_t seed;      // server shoe seed, every card follows from it
+};
+
+static_assert(sizeof(JournalHeader) == 24, "Journal header layout changed");
+
+constexpr char JOURNAL_MAGIC[4] = {'B', 'J', 'R', 'J'};
+constexpr uint32_t JOURNAL_VERSION = 1;
+
+// Events of one room, written by the room's thread and drained by the journal writer
+class JournalRing
+{
+public:
+    // A 7-player round is about 60 events, the writer drains every DRAIN_INTERVAL
+    static constexpr size_t RING_EVENTS = 512;
+    using TimePoint = TimerWheel::Clock::time_point;
+
+    JournalRing(int roomId, TimePoint origin) : roomId(roomId), origin(origin) {}
+
+    // Room thread. Dropped (and counted) while the ring is full
+    void record(TimePoint now, JournalEventType type, uint32_t round, int seat, uint8_t card, int total, int32_t amount)
+    {
+        push(JournalEvent::make(elapsed(now), type, roomId, round, seat, card, total, amount));
+    }
+    void recordSeat(TimePoint now, int seat, const std::string &nickname) { push(JournalEvent::makeSeat(elapsed(now), roomId, seat, nickname)); }
+
+    // Writer thread. Appends everything published so far to 'out'
+    void drainTo(std::vector<JournalEvent> &out)
+    {
+        size_t h = head.load(std::memory_order_relaxed);
+        size_t t = tail.load(std::memory_order_acquire);
+        for (; h != t; ++h)
+            out.push_back(events[h % RING_EVENTS]);
+        head.store(t, std::memory_order_release);
+    }
+
+    int getRoomId() const { return roomId; }
+    uint64_t elapsed(TimePoint now) const
+    {
+        return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(now - origin).count());
+    }
+
+    std::atomic<uint64_t> dropped{0};
+    std::atomic<bool> retired{false}; // room reclaimed, drained one last time
+
+private:
+    void push(const JournalEvent &event)
+    {
+        size_t t = tail.load(std::memory_order_relaxed);
+        if (t - head.load(std::memory_order_acquire) == RING_EVENTS)
+        {
+            dropped.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+        events[t % RING_EVENTS] = event;
+        tail.store(t + 1, std::memory_order_release);
+    }
+
+    int roomId;
+    TimePoint origin;
+    JournalEvent events[RING_EVENTS];
+    alignas(64) std::atomic<size_t> head{0};
+    alignas(64) std::atomic<size_t> tail{0};
+};
+
+class RoundJournal
+{
+public:
+    // Events collected before one write, the writer also writes at least every WRITE_INTERVAL
+    static constexpr size_t WRITE_EVENTS = 16 * 1024;
+    static constexpr std::chrono::milliseconds DRAIN_INTERVAL{20};
+    static constexpr std::chrono::milliseconds WRITE_INTERVAL{1000};
+
+    RoundJournal() = default;
+    // Drains the rings a last time and closes the file
+    ~RoundJournal();
+
+    RoundJournal(const RoundJournal &) = delete;
+    RoundJournal &operator=(const RoundJournal &) = delete;
+
+    // Creates the journal at 'path' and starts the writer, false if it cannot be created
+    bool open(const std::string &path, uint64_t seed);
+
+    // Any thread, when a room is created. The ring stays valid while the room holds it,
+    // the room marks it retired when it goes away
+    std::shared_ptr<JournalRing> openRing(int roomId);
+
+private:
+    void run();
+    // Moves the rings' events into the batch, drops the rings of reclaimed rooms
+    void collect();
+    // Appends the batch to the file in one write
+    void write();
+
+    int fd = -1;
+    std::string path;
+    JournalRing::TimePoint origin{};
+    std::vector<JournalEvent> batch;
+    JournalRing::TimePoint lastWrite{};
+
+    std::mutex ringsMutex; // registration and draining only, never while recording
+    std::vector<std::shared_ptr<JournalRing>> rings;
+
+    std::atomic<bool> isRunning{false};
+    std::mutex wakeMutex;
+    std::condition_variable wake;
+    std::thread writer;
+};
+
+#endif
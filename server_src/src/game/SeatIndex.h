@@ -0,0 +1,76 @@
+/**
+ * Server for blackjack
+ * Author: Marek Manzel
+ *
+ * SeatIndex.h - Joinable rooms bucketed by the number of taken seats
+ * The lobby keeps every room that currently takes players (waiting, not full)
+ * in the bucket of its player count. A bitmask of non-empty buckets finds the
+ * fullest joinable room with one bit scan, insert/erase swap within a bucket,
+ * so auto-matchmaking is O(1) no matter how many rooms exist.
+ */
+
+#ifndef SEAT_INDEX_H
+#define SEAT_INDEX_H
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+template <size_t SEATS>
+class SeatIndex
+{
+    static_assert(SEATS > 0 && SEATS <= 32, "Seat buckets must fit the mask");
+
+public:
+    // 'roomId' takes players and has 'taken' of SEATS seats filled, replaces an earlier entry
+    void insert(int roomId, int taken)
+    {
+        erase(roomId);
+        if (static_cast<size_t>(roomId) >= entries.size())
+            entries.resize(static_cast<size_t>(roomId) + 1);
+        std::vector<int> &bucket = buckets[static_cast<size_t>(taken)];
+        entries[static_cast<size_t>(roomId)] = Entry{taken, bucket.size()};
+        bucket.push_back(roomId);
+        mask |= uint32_t{1} << taken;
+    }
+
+    void erase(int roomId)
+    {
+        if (static_cast<size_t>(roomId) >= entries.size() || entries[static_cast<size_t>(roomId)].taken < 0)
+            return;
+        Entry &entry = entries[static_cast<size_t>(roomId)];
+        std::vector<int> &bucket = buckets[static_cast<size_t>(entry.taken)];
+        // Last room of the bucket takes the freed position
+        int moved = bucket.back();
+        bucket[entry.position] = moved;
+        entries[static_cast<size_t>(moved)].position = entry.position;
+        bucket.pop_back();
+        if (bucket.empty())
+            mask &= ~(uint32_t{1} << entry.taken);
+        entry = Entry{};
+    }
+
+    // Joinable room with the most players, rounds start sooner than when spreading players out.
+    // -1 if no room takes players
+    int pick() const
+    {
+        if (mask == 0)
+            return -1;
+        return buckets[static_cast<size_t>(31 - __builtin_clz(mask))].back();
+    }
+
+private:
+    struct Entry
+    {
+        int taken = -1; // -1 = not indexed
+        size_t position = 0;
+    };
+
+    std::array<std::vector<int>, SEATS> buckets;
+    // Indexed by room ID
+    std::vector<Entry> entries;
+    uint32_t mask = 0;
+};
+
+#endif
@@ -0,0 +1,74 @@
+#include "SessionStore.h"
+#include "../core/Logger.h"
+
+SessionStore::SessionStore(TimerWheel &wheel, std::chrono::seconds sessionTtl, size_t maxSessions)
+    : timers(wheel), ttl(sessionTtl), capacity(maxSessions), expired(0), evicted(0) {}
+
+SessionStore::~SessionStore()
+{
+    for (auto &pair : sessions)
+    {
+        timers.cancel(pair.second.timer);
+    }
+}
+
+void SessionStore::park(Player player, TimerWheel::Clock::time_point now)
+{
+    const std::string nickname = player.getNickname();
+    auto existing = sessions.find(nickname);
+    if (existing != sessions.end())
+    {
+        timers.cancel(existing->second.timer);
+        byAge.erase(existing->second.age);
+        sessions.erase(existing);
+    }
+
+    if (capacity == 0)
+    {
+        if (onEvict)
+            onEvict(player);
+        ++evicted;
+        return;
+    }
+    while (sessions.size() >= capacity)
+    {
+        auto oldest = sessions.find(byAge.front());
+        LOG_INFO("Lobby: Session of " + oldest->first + " evicted (limit of " + std::to_string(capacity) + " sessions)");
+        ++evicted;
+        drop(oldest);
+    }
+
+    byAge.push_back(nickname);
+    TimerWheel::TimerId timer = timers.schedule(now + ttl, [this, nickname]()
+                                                {
+                                                    auto it = sessions.find(nickname);
+                                                    if (it == sessions.end())
+                                                        return;
+                                                    it->second.timer = 0;
+                                                    LOG_INFO("Lobby: Session of " + nickname + " expired");
+                                                    ++expired;
+                                                    drop(it); });
+    sessions.emplace(nickname, Session{std::move(player), timer, std::prev(byAge.end())});
+}
+
+std::optional<Player> SessionStore::take(const std::string &nickname)
+{
+    auto it = sessions.find(nickname);
+    if (it == sessions.end())
+        return std::nullopt;
+    std::optional<Player> player(std::move(it->second.player));
+    timers.cancel(it->second.timer);
+    byAge.erase(it->second.age);
+    sessions.erase(it);
+    return player;
+}
+
+void SessionStore::drop(std::unordered_map<std::string, Session>::iterator it)
+{
+    Player player = std::move(it->second.player);
+    timers.cancel(it->second.timer);
+    byAge.erase(it->second.age);
+    sessions.erase(it);
+    if (onEvict)
+        onEvict(player);
+}
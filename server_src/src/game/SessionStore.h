@@ -0,0 +1,74 @@
+/**
+ * Server for blackjack
+ * Author: Marek Manzel
+ *
+ * SessionStore.h - Disconnected player sessions kept for reconnect
+ * Sessions are looked up by nickname in O(1) and expire after a TTL driven
+ * by the owning loop's timer wheel. Above the cap the oldest session is
+ * evicted. Every expiry or eviction goes through the eviction callback (e.g.
+ * to persist credits). Not thread-safe, owned by the lobby loop.
+ */
+
+#ifndef SESSION_STORE_H
+#define SESSION_STORE_H
+
+#include "Player.h"
+#include "../core/TimerWheel.h"
+#include <chrono>
+#include <functional>
+#include <list>
+#include <optional>
+#include <string>
+#include <unordered_map>
+
+class SessionStore
+{
+public:
+    using EvictCallback = std::function<void(const Player &)>;
+
+    SessionStore(TimerWheel &timers, std::chrono::seconds ttl, size_t capacity);
+    ~SessionStore();
+
+    SessionStore(const SessionStore &) = delete;
+    SessionStore &operator=(const SessionStore &) = delete;
+
+    void setEvictCallback(EvictCallback callback) { onEvict = std::move(callback); }
+
+    // Keeps the session of a disconnected player, a session with the same nickname is replaced
+    void park(Player player, TimerWheel::Clock::time_point now);
+    // Removes and returns the session, empty if there is none
+    std::optional<Player> take(const std::string &nickname);
+    bool contains(const std::string &nickname) const { return sessions.count(nickname) > 0; }
+
+    size_t size() const { return sessions.size(); }
+    template <typename F>
+    void forEach(F f) const
+    {
+        for (const auto &pair : sessions)
+            f(pair.second.player);
+    }
+    uint64_t getExpiredCount() const { return expired; }
+    uint64_t getEvictedCount() const { return evicted; }
+
+private:
+    struct Session
+    {
+        Player player;
+        TimerWheel::TimerId timer;
+        std::list<std::string>::iterator age;
+    };
+
+    void drop(std::unordered_map<std::string, Session>::iterator it);
+
+    TimerWheel &timers;
+    std::chrono::seconds ttl;
+    size_t capacity;
+    EvictCallback onEvict;
+
+    std::unordered_map<std::string, Session> sessions;
+    std::list<std::string> byAge; // oldest first
+    uint64_t expired;
+    uint64_t evicted;
+};
+
+#endif
@@ -0,0 +1,45 @@
+#include "Shoe.h"
+#include "../core/Logger.h"
+#include <utility>
+
+Shoe::Shoe(int decks, uint64_t seed) : position(0), cutCard(0), shuffleSeed(0), seeds(seed), rng(0)
+{
+    cards.resize(static_cast<size_t>(decks) * DECK_SIZE);
+    cutCard = cards.size() * PENETRATION_PERCENT / 100;
+    shuffle();
+}
+
+void Shoe::shuffle()
+{
+    shuffleSeed = seeds.next();
+    rng.reseed(shuffleSeed);
+    // Start from deck order so the result depends only on the seed, then one Fisher-Yates pass
+    for (size_t i = 0; i < cards.size(); ++i)
+    {
+        cards[i] = static_cast<Card>(i % DECK_SIZE);
+    }
+    for (size_t i = cards.size() - 1; i > 0; --i)
+    {
+        size_t j = static_cast<size_t>(rng.below(i + 1));
+        std::swap(cards[i], cards[j]);
+    }
+    position = 0;
+}
+
+bool Shoe::beginRound()
+{
+    if (position < cutCard)
+        return false;
+    shuffle();
+    return true;
+}
+
+Card Shoe::draw()
+{
+    if (position >= cards.size())
+    {
+        LOG_INFO("Shoe: ran out of cards mid-round, reshuffling");
+        shuffle();
+    }
+    return cards[position++];
+}
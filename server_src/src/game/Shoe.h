@@ -0,0 +1,50 @@
+/**
+ * Server for blackjack
+ * Author: Marek Manzel
+ *
+ * Shoe.h - Multi-deck card shoe with a cut card
+ * Holds 'decks' full decks, shuffled in one Fisher-Yates pass by a PRNG seeded
+ * per shuffle. Cards are dealt in order; once the cut card is passed the shoe
+ * is reshuffled at the start of the next round. The shuffle seed together with
+ * the position at round start reproduces every card of a round.
+ */
+
+#ifndef SHOE_H
+#define SHOE_H
+
+#include "Card.h"
+#include "../core/Random.h"
+#include <cstdint>
+#include <vector>
+
+class Shoe
+{
+public:
+    // 'seed' drives the seeds of all shuffles of this shoe
+    Shoe(int decks, uint64_t seed);
+
+    // Reshuffles if the cut card was passed, returns true if it did
+    bool beginRound();
+
+    // Next card; a shoe emptied mid-round is reshuffled on the spot
+    Card draw();
+
+    uint64_t getShuffleSeed() const { return shuffleSeed; }
+    size_t getPosition() const { return position; }
+    size_t size() const { return cards.size(); }
+
+    // Deals after the cut card (75 % of the shoe) trigger a reshuffle
+    static constexpr int PENETRATION_PERCENT = 75;
+
+private:
+    void shuffle();
+
+    std::vector<Card> cards;
+    size_t position;
+    size_t cutCard;
+    uint64_t shuffleSeed;
+    Xoshiro256 seeds; // one seed per shuffle
+    Xoshiro256 rng;   // reseeded for every shuffle
+};
+
+#endif
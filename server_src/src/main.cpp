@@ -1,13 +1,20 @@
 #include "core/Config.h"
 #include "core/Logger.h"
 #include "network/TcpServer.h"
+#include "network/Transport.h"
 #include <iostream>
 #include <csignal>
+#include <unistd.h>
+
+static TcpServer *runningServer = nullptr;
 
 void signalHandler(int signum)
 {
-    Logger::info("Signal " + std::to_string(signum) + " received. Shutting down.");
-    exit(signum);
+    // Only async-signal-safe work here, the lobby loop does the rest. A second Ctrl+C
+    // does not wait for the running rounds
+    if (runningServer == nullptr || (signum != SIGUSR2 && runningServer->isShuttingDown()))
+        _exit(128 + signum);
+    runningServer->requestShutdown(signum == SIGUSR2);
 }
 
 void print_help()
@@ -16,8 +23,28 @@ void print_help()
     std::cout << "Options:\n";
     std::cout << "  -i <ip>       IP address to bind to (default: 0.0.0.0)\n";
     std::cout << "  -p <port>     Port number (default: 10000)\n";
-    std::cout << "  -r <rooms>    Number of rooms (1-20, default: 6)\n";
-    std::cout << "  -m <players>  Max players (1-300, default: 20)\n";
+    std::cout << "  -r <rooms>    Rooms open at startup, never reclaimed (1-10000, default: 6)\n";
+    std::cout << "  -x <rooms>    Max rooms incl. ones opened on demand (1-10000, default: 1000)\n";
+    std::cout << "  -k <seconds>  Reclaim on-demand rooms empty this long (1-86400, default: 60)\n";
+    std::cout << "  -m <players>  Max players (1-100000, default: 20)\n";
+    std::cout << "  -w <threads>  Room worker threads (1-64, default: one per core)\n";
+    std::cout << "  -d <decks>    Decks per room shoe (1-8, default: 6)\n";
+    std::cout << "  -s <seed>     Shoe seed for reproducible games (default: random)\n";
+    std::cout << "  -t <seconds>  Keep disconnected sessions for reconnect (1-86400, default: 1800)\n";
+    std::cout << "  -c <sessions> Max disconnected sessions kept (0-100000, default: 1000)\n";
+    std::cout << "  -u <ms>       Min interval between lobby updates (0-10000, default: 100)\n";
+    std::cout << "  -a <port>     Serve Prometheus metrics on GET /metrics (1-65535, default: off)\n";
+    std::cout << "  -b <dir>      Save player credits in <dir> across restarts (default: off)\n";
+    std::cout << "  -g <seconds>  Time running rounds get to finish on shutdown (1-3600, default: 30)\n";
+    std::cout << "  -q <backlog>  Pending connections queued per listening socket (1-65535, default: 1024)\n";
+    std::cout << "  -e <0|1>      Also accept on every worker thread via SO_REUSEPORT (default: 0)\n";
+    std::cout << "  -n <tokens>   Rate limit, command cost tokens per second per connection (0-100000, 0 = off, default: 40)\n";
+    std::cout << "  -y <tokens>   Rate limit burst, tokens a connection can save up (8-100000, default: 80)\n";
+    std::cout << "  -z <prefix>   Record room commands to <prefix>.<pid>.<shard> for replay with bench/bj_sim (default: off)\n";
+    std::cout << "  -j <prefix>   Journal every round to <prefix>.<pid>, decode with tools/bj_journal (default: off)\n";
+    std::cout << "  -f <file>     Inject network faults described by the file (FAULTS=1 builds only)\n";
+    std::cout << "  -l <level>    Log level: error, warn, info, debug (default: debug)\n";
+    std::cout << "  -o <file>     Append log to file instead of stdout\n";
     std::cout << "  -h, --help    Show this help message\n";
 }
 
@@ -50,14 +77,14 @@ int parse_arguments(int argc, char *argv[], Config &config)
             }
             catch (const std::exception &e)
             {
-                Logger::error("Invalid port format provided: '" + portStr + "'. Using default port " + std::to_string(Config().port));
+                LOG_ERROR("Invalid port format provided: '" + portStr + "'. Using default port " + std::to_string(Config().port));
                 config.port = Config().port;
             }
 
             // Check 2: Is it within valid TCP/UDP range?
             if (config.port < 0 || config.port > 65535)
             {
-                Logger::error("Port number out of valid range (0-65535). Using default port " + std::to_string(Config().port));
+                LOG_ERROR("Port number out of valid range (0-65535). Using default port " + std::to_string(Config().port));
                 config.port = Config().port;
             }
         }
@@ -69,15 +96,49 @@ int parse_arguments(int argc, char *argv[], Config &config)
             }
             catch (const std::exception &e)
             {
-                Logger::error("Invalid rooms number provided. Using default rooms " + std::to_string(Config().rooms));
+                LOG_ERROR("Invalid rooms number provided. Using default rooms " + std::to_string(Config().rooms));
                 config.rooms = Config().rooms;
             }
-            if (config.rooms < 1 || config.rooms > 20)
+            if (config.rooms < 1 || config.rooms > 10000)
             {
-                Logger::error("Rooms number out of valid range (1-20). Using default rooms " + std::to_string(Config().rooms));
+                LOG_ERROR("Rooms number out of valid range (1-10000). Using default rooms " + std::to_string(Config().rooms));
                 config.rooms = Config().rooms;
             }
         }
+        else if (std::string(argv[i]) == "-x" && i + 1 < argc)
+        {
+            try
+            {
+                config.maxRooms = std::stoi(argv[++i]);
+            }
+            catch (const std::exception &e)
+            {
+                LOG_ERROR("Invalid max rooms number provided. Using default max rooms " + std::to_string(Config().maxRooms));
+                config.maxRooms = Config().maxRooms;
+            }
+            if (config.maxRooms < 1 || config.maxRooms > 10000)
+            {
+                LOG_ERROR("Max rooms number out of valid range (1-10000). Using default max rooms " + std::to_string(Config().maxRooms));
+                config.maxRooms = Config().maxRooms;
+            }
+        }
+        else if (std::string(argv[i]) == "-k" && i + 1 < argc)
+        {
+            try
+            {
+                config.roomIdleTimeout = std::stoi(argv[++i]);
+            }
+            catch (const std::exception &e)
+            {
+                LOG_ERROR("Invalid room idle timeout provided. Using default " + std::to_string(Config().roomIdleTimeout) + " s");
+                config.roomIdleTimeout = Config().roomIdleTimeout;
+            }
+            if (config.roomIdleTimeout < 1 || config.roomIdleTimeout > 86400)
+            {
+                LOG_ERROR("Room idle timeout out of valid range (1-86400). Using default " + std::to_string(Config().roomIdleTimeout) + " s");
+                config.roomIdleTimeout = Config().roomIdleTimeout;
+            }
+        }
         else if (std::string(argv[i]) == "-m" && i + 1 < argc)
         {
             try
@@ -86,15 +147,255 @@ int parse_arguments(int argc, char *argv[], Config &config)
             }
             catch (const std::exception &e)
             {
-                Logger::error("Invalid max players number provided. Using default max players " + std::to_string(Config().maxPlayers));
+                LOG_ERROR("Invalid max players number provided. Using default max players " + std::to_string(Config().maxPlayers));
                 config.maxPlayers = Config().maxPlayers;
             }
-            if (config.maxPlayers < 1 || config.maxPlayers > 300)
+            if (config.maxPlayers < 1 || config.maxPlayers > 100000)
             {
-                Logger::error("Max players number out of valid range (1-300). Using default max players " + std::to_string(Config().maxPlayers));
+                LOG_ERROR("Max players number out of valid range (1-100000). Using default max players " + std::to_string(Config().maxPlayers));
                 config.maxPlayers = Config().maxPlayers;
             }
         }
+        else if (std::string(argv[i]) == "-w" && i + 1 < argc)
+        {
+            try
+            {
+                config.workers = std::stoi(argv[++i]);
+            }
+            catch (const std::exception &e)
+            {
+                LOG_ERROR("Invalid worker threads number provided. Using one per core");
+                config.workers = Config().workers;
+            }
+            if (config.workers < 1 || config.workers > 64)
+            {
+                LOG_ERROR("Worker threads number out of valid range (1-64). Using one per core");
+                config.workers = Config().workers;
+            }
+        }
+        else if (std::string(argv[i]) == "-d" && i + 1 < argc)
+        {
+            try
+            {
+                config.decks = std::stoi(argv[++i]);
+            }
+            catch (const std::exception &e)
+            {
+                LOG_ERROR("Invalid decks number provided. Using default decks " + std::to_string(Config().decks));
+                config.decks = Config().decks;
+            }
+            if (config.decks < 1 || config.decks > 8)
+            {
+                LOG_ERROR("Decks number out of valid range (1-8). Using default decks " + std::to_string(Config().decks));
+                config.decks = Config().decks;
+            }
+        }
+        else if (std::string(argv[i]) == "-s" && i + 1 < argc)
+        {
+            try
+            {
+                config.seed = std::stoull(argv[++i]);
+            }
+            catch (const std::exception &e)
+            {
+                LOG_ERROR("Invalid seed provided. Using a random seed");
+                config.seed = Config().seed;
+            }
+        }
+        else if (std::string(argv[i]) == "-t" && i + 1 < argc)
+        {
+            try
+            {
+                config.sessionTtl = std::stoi(argv[++i]);
+            }
+            catch (const std::exception &e)
+            {
+                LOG_ERROR("Invalid session lifetime provided. Using default " + std::to_string(Config().sessionTtl));
+                config.sessionTtl = Config().sessionTtl;
+            }
+            if (config.sessionTtl < 1 || config.sessionTtl > 86400)
+            {
+                LOG_ERROR("Session lifetime out of valid range (1-86400). Using default " + std::to_string(Config().sessionTtl));
+                config.sessionTtl = Config().sessionTtl;
+            }
+        }
+        else if (std::string(argv[i]) == "-c" && i + 1 < argc)
+        {
+            int maxSessions = -1;
+            try
+            {
+                maxSessions = std::stoi(argv[++i]);
+            }
+            catch (const std::exception &e)
+            {
+                maxSessions = -1;
+            }
+            if (maxSessions < 0 || maxSessions > 100000)
+            {
+                LOG_ERROR("Max sessions out of valid range (0-100000). Using default " + std::to_string(Config().maxSessions));
+                maxSessions = static_cast<int>(Config().maxSessions);
+            }
+            config.maxSessions = static_cast<size_t>(maxSessions);
+        }
+        else if (std::string(argv[i]) == "-u" && i + 1 < argc)
+        {
+            try
+            {
+                config.lobbyInterval = std::stoi(argv[++i]);
+            }
+            catch (const std::exception &e)
+            {
+                LOG_ERROR("Invalid lobby update interval provided. Using default " + std::to_string(Config().lobbyInterval));
+                config.lobbyInterval = Config().lobbyInterval;
+            }
+            if (config.lobbyInterval < 0 || config.lobbyInterval > 10000)
+            {
+                LOG_ERROR("Lobby update interval out of valid range (0-10000). Using default " + std::to_string(Config().lobbyInterval));
+                config.lobbyInterval = Config().lobbyInterval;
+            }
+        }
+        else if (std::string(argv[i]) == "-a" && i + 1 < argc)
+        {
+            try
+            {
+                config.adminPort = std::stoi(argv[++i]);
+            }
+            catch (const std::exception &e)
+            {
+                LOG_ERROR("Invalid admin port provided. Admin endpoint disabled");
+                config.adminPort = Config().adminPort;
+            }
+            if (config.adminPort < 0 || config.adminPort > 65535)
+            {
+                LOG_ERROR("Admin port out of valid range (1-65535). Admin endpoint disabled");
+                config.adminPort = Config().adminPort;
+            }
+        }
+        else if (std::string(argv[i]) == "-b" && i + 1 < argc)
+        {
+            config.dataDir = argv[++i];
+        }
+        else if (std::string(argv[i]) == "-z" && i + 1 < argc)
+        {
+            config.commandLog = argv[++i];
+        }
+        else if (std::string(argv[i]) == "-j" && i + 1 < argc)
+        {
+            config.journal = argv[++i];
+        }
+        else if (std::string(argv[i]) == "-f" && i + 1 < argc)
+        {
+            std::string faultFile = argv[++i];
+#ifdef BJ_FAULT_INJECTION
+            if (!FaultTransport::load(faultFile))
+            {
+                LOG_ERROR("Cannot open fault injection file '" + faultFile + "'. Running without faults");
+            }
+#else
+            LOG_ERROR("Server built without fault injection (make FAULTS=1), ignoring '" + faultFile + "'");
+#endif
+        }
+        else if (std::string(argv[i]) == "-g" && i + 1 < argc)
+        {
+            try
+            {
+                config.drainTimeout = std::stoi(argv[++i]);
+            }
+            catch (const std::exception &e)
+            {
+                LOG_ERROR("Invalid drain timeout provided. Using default " + std::to_string(Config().drainTimeout) + " s");
+                config.drainTimeout = Config().drainTimeout;
+            }
+            if (config.drainTimeout < 1 || config.drainTimeout > 3600)
+            {
+                LOG_ERROR("Drain timeout out of valid range (1-3600). Using default " + std::to_string(Config().drainTimeout) + " s");
+                config.drainTimeout = Config().drainTimeout;
+            }
+        }
+        else if (std::string(argv[i]) == "-q" && i + 1 < argc)
+        {
+            try
+            {
+                config.listenBacklog = std::stoi(argv[++i]);
+            }
+            catch (const std::exception &e)
+            {
+                LOG_ERROR("Invalid listen backlog provided. Using default " + std::to_string(Config().listenBacklog));
+                config.listenBacklog = Config().listenBacklog;
+            }
+            if (config.listenBacklog < 1 || config.listenBacklog > 65535)
+            {
+                LOG_ERROR("Listen backlog out of valid range (1-65535). Using default " + std::to_string(Config().listenBacklog));
+                config.listenBacklog = Config().listenBacklog;
+            }
+        }
+        else if (std::string(argv[i]) == "-e" && i + 1 < argc)
+        {
+            std::string reuse = argv[++i];
+            if (reuse == "0" || reuse == "1")
+            {
+                config.reusePort = reuse == "1";
+            }
+            else
+            {
+                LOG_ERROR("Invalid worker accept setting provided: '" + reuse + "'. Accepting on the lobby thread only");
+            }
+        }
+        else if (std::string(argv[i]) == "-n" && i + 1 < argc)
+        {
+            try
+            {
+                config.rateLimit = std::stoi(argv[++i]);
+            }
+            catch (const std::exception &e)
+            {
+                LOG_ERROR("Invalid rate limit provided. Using default " + std::to_string(Config().rateLimit) + " tokens/s");
+                config.rateLimit = Config().rateLimit;
+            }
+            if (config.rateLimit < 0 || config.rateLimit > 100000)
+            {
+                LOG_ERROR("Rate limit out of valid range (0-100000). Using default " + std::to_string(Config().rateLimit) + " tokens/s");
+                config.rateLimit = Config().rateLimit;
+            }
+        }
+        else if (std::string(argv[i]) == "-y" && i + 1 < argc)
+        {
+            try
+            {
+                config.rateBurst = std::stoi(argv[++i]);
+            }
+            catch (const std::exception &e)
+            {
+                LOG_ERROR("Invalid rate limit burst provided. Using default " + std::to_string(Config().rateBurst) + " tokens");
+                config.rateBurst = Config().rateBurst;
+            }
+            // Below the cost of a room command those could never pass
+            if (config.rateBurst < 8 || config.rateBurst > 100000)
+            {
+                LOG_ERROR("Rate limit burst out of valid range (8-100000). Using default " + std::to_string(Config().rateBurst) + " tokens");
+                config.rateBurst = Config().rateBurst;
+            }
+        }
+        else if (std::string(argv[i]) == "-l" && i + 1 < argc)
+        {
+            LogLevel level;
+            if (Logger::parseLevel(argv[++i], level))
+            {
+                Logger::setLevel(level);
+            }
+            else
+            {
+                LOG_ERROR("Invalid log level provided: '" + std::string(argv[i]) + "'. Using debug");
+            }
+        }
+        else if (std::string(argv[i]) == "-o" && i + 1 < argc)
+        {
+            std::string logFile = argv[++i];
+            if (!Logger::setOutputFile(logFile))
+            {
+                LOG_ERROR("Cannot open log file '" + logFile + "'. Logging to stdout");
+            }
+        }
         else if (std::string(argv[i]) == "-h" || std::string(argv[i]) == "--help")
         {
             print_help();
@@ -102,11 +403,18 @@ int parse_arguments(int argc, char *argv[], Config &config)
         }
         else
         {
-            Logger::error("Unknown argument: " + std::string(argv[i]));
+            LOG_ERROR("Unknown argument: " + std::string(argv[i]));
             return 1;
         }
     }
 
+    // The startup rooms count towards the limit
+    if (config.maxRooms < config.rooms)
+    {
+        LOG_WARN("Max rooms below the startup rooms. Using " + std::to_string(config.rooms));
+        config.maxRooms = config.rooms;
+    }
+
     return 0;
 }
 
@@ -119,10 +427,10 @@ int main(int argc, char *argv[])
     switch (parseResult)
     {
     case 0:
-        Logger::info("Arguments processed successfully.");
+        LOG_INFO("Arguments processed successfully.");
         break;
     case 1:
-        Logger::error("Error parsing arguments.");
+        LOG_ERROR("Error parsing arguments.");
         print_help();
         return 1;
     case 2:
@@ -132,22 +440,25 @@ int main(int argc, char *argv[])
         break;
     }
 
-    // 1. Handle SIGINT (Ctrl+C) for graceful exit
-    signal(SIGINT, signalHandler);
-
-    // 2. Ignore SIGPIPE: Writing to a closed socket should return error, not kill process
+    // 1. Ignore SIGPIPE: Writing to a closed socket should return error, not kill process
     signal(SIGPIPE, SIG_IGN);
 
-    Logger::info("Starting Blackjack Server...");
+    LOG_INFO("Starting Blackjack Server...");
 
     try
     {
         TcpServer server(config);
+        // 2. SIGINT (Ctrl+C) / SIGTERM drain and exit, SIGUSR2 hands over to a new process
+        runningServer = &server;
+        signal(SIGINT, signalHandler);
+        signal(SIGTERM, signalHandler);
+        signal(SIGUSR2, signalHandler);
         server.run();
+        runningServer = nullptr;
     }
     catch (const std::exception &e)
     {
-        Logger::error("Fatal error: " + std::string(e.what()));
+        LOG_ERROR("Fatal error: " + std::string(e.what()));
         return 1;
     }
 
@@ -0,0 +1,135 @@
+#include "AdminServer.h"
+#include "../core/Logger.h"
+#include "../core/Metrics.h"
+#include <sys/socket.h>
+#include <sys/eventfd.h>
+#include <sys/time.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <poll.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstring>
+
+AdminServer::AdminServer(const std::string &ip, int listenPort)
+    : ipAddress(ip), port(listenPort), listenFd(-1), wakeupFd(-1), isRunning(false) {}
+
+AdminServer::~AdminServer()
+{
+    stop();
+}
+
+bool AdminServer::start()
+{
+    listenFd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    wakeupFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (listenFd < 0 || wakeupFd < 0)
+        return false;
+
+    int opt = 1;
+    setsockopt(listenFd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
+
+    sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    if (ipAddress == "0.0.0.0" || ipAddress == "localhost")
+        addr.sin_addr.s_addr = INADDR_ANY;
+    else if (inet_pton(AF_INET, ipAddress.c_str(), &addr.sin_addr) <= 0)
+        return false;
+    addr.sin_port = htons(port);
+
+    if (bind(listenFd, (struct sockaddr *)&addr, sizeof(addr)) < 0 || listen(listenFd, 4) < 0)
+        return false;
+
+    isRunning = true;
+    thread = std::thread([this]()
+                         { run(); });
+    LOG_INFO("Admin endpoint listening on port " + std::to_string(port) + " (GET /metrics)");
+    return true;
+}
+
+void AdminServer::stop()
+{
+    if (thread.joinable())
+    {
+        isRunning = false;
+        uint64_t one = 1;
+        ssize_t written = write(wakeupFd, &one, sizeof(one));
+        (void)written;
+        thread.join();
+    }
+    if (listenFd != -1)
+        close(listenFd);
+    if (wakeupFd != -1)
+        close(wakeupFd);
+    listenFd = wakeupFd = -1;
+}
+
+void AdminServer::run()
+{
+    pollfd fds[2] = {{listenFd, POLLIN, 0}, {wakeupFd, POLLIN, 0}};
+    while (isRunning)
+    {
+        if (poll(fds, 2, -1) < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            LOG_ERROR("Admin endpoint poll error");
+            return;
+        }
+        if (!(fds[0].revents & POLLIN))
+            continue;
+
+        int fd = accept4(listenFd, nullptr, nullptr, SOCK_CLOEXEC);
+        if (fd < 0)
+            continue;
+        serve(fd);
+        close(fd);
+    }
+}
+
+void AdminServer::serve(int fd)
+{
+    // Blocking with a deadline, a stuck scraper only delays the next scrape
+    timeval timeout{1, 0};
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+
+    // Only the request line matters, the headers are read until the blank line and ignored
+    std::string request;
+    char buffer[1024];
+    while (request.find("\r\n\r\n") == std::string::npos && request.find("\n\n") == std::string::npos && request.size() < 8192)
+    {
+        ssize_t received = recv(fd, buffer, sizeof(buffer), 0);
+        if (received < 0 && errno == EINTR)
+            continue;
+        if (received <= 0)
+            break;
+        request.append(buffer, static_cast<size_t>(received));
+    }
+
+    std::string status = "200 OK";
+    std::string body;
+    if (request.compare(0, 13, "GET /metrics ") == 0 || request.compare(0, 14, "GET /metrics\r\n") == 0)
+        body = Metrics::renderPrometheus();
+    else
+    {
+        status = "404 Not Found";
+        body = "Only GET /metrics is served\n";
+    }
+
+    std::string response = "HTTP/1.1 " + status + "\r\n"
+                           "Content-Type: text/plain; version=0.0.4\r\n"
+                           "Content-Length: " + std::to_string(body.size()) + "\r\n"
+                           "Connection: close\r\n\r\n" + body;
+    size_t offset = 0;
+    while (offset < response.size())
+    {
+        ssize_t sent = send(fd, response.data() + offset, response.size() - offset, MSG_NOSIGNAL);
+        if (sent < 0 && errno == EINTR)
+            continue;
+        if (sent <= 0)
+            return;
+        offset += static_cast<size_t>(sent);
+    }
+}
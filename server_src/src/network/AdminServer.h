@@ -0,0 +1,45 @@
+/**
+ * Server for blackjack
+ * Author: Marek Manzel
+ *
+ * AdminServer.h - HTTP endpoint for monitoring on a separate port
+ * Runs its own thread and listening socket, so a scraper never competes with
+ * game traffic for the lobby loop or the main listen queue. Answers
+ * "GET /metrics" with Metrics::renderPrometheus(), one request per
+ * connection, requests are served one after another.
+ */
+
+#ifndef ADMIN_SERVER_H
+#define ADMIN_SERVER_H
+
+#include <atomic>
+#include <string>
+#include <thread>
+
+class AdminServer
+{
+public:
+    AdminServer(const std::string &ipAddress, int port);
+    ~AdminServer();
+
+    AdminServer(const AdminServer &) = delete;
+    AdminServer &operator=(const AdminServer &) = delete;
+
+    // Binds and starts the thread, false if the port cannot be used
+    bool start();
+    // Stops the thread and closes the socket
+    void stop();
+
+private:
+    void run();
+    void serve(int fd);
+
+    std::string ipAddress;
+    int port;
+    int listenFd;
+    int wakeupFd;
+    std::atomic<bool> isRunning;
+    std::thread thread;
+};
+
+#endif
@@ -1,36 +1,201 @@
 #include "ClientConnection.h"
+#include "../core/Metrics.h"
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
 
-ClientConnection::ClientConnection(int fd) : socketFd(fd) {}
+ClientConnection::ClientConnection(int fd, size_t sendHighWaterMark)
+    : socketFd(fd), readPos(0), scanPos(0), writePos(0), oversized(false), wireFormat(WireFormat::TEXT), outHeadOffset(0), outBytes(0), highWaterMark(sendHighWaterMark), closing(false), flushPending(false), handoffPending(false), heartbeatTimer(0) {}
 
-bool ClientConnection::appendBuffer(const char *data, size_t length)
+char *ClientConnection::getWritePtr()
 {
-    buffer.append(data, length);
-    // Simple check: is there a newline?
-    return buffer.find('\n') != std::string::npos;
+    if (readPos == writePos)
+    {
+        // Everything consumed, start over at the front
+        readPos = scanPos = writePos = 0;
+    }
+    else if (readPos > 0 && RECV_BUFFER_SIZE - writePos < MAX_LINE_LENGTH)
+    {
+        // Only the partial tail line is moved, it is bounded by MAX_LINE_LENGTH
+        size_t pending = writePos - readPos;
+        std::memmove(recvBuffer, recvBuffer + readPos, pending);
+        scanPos -= readPos;
+        writePos = pending;
+        readPos = 0;
+    }
+    return recvBuffer + writePos;
 }
 
-std::vector<std::string> ClientConnection::getMessages()
+bool ClientConnection::nextMessage(std::string_view &message, bool &binary)
 {
-    std::vector<std::string> messages;
-    size_t pos;
-
-    // Extract all complete lines ending in \n
-    while ((pos = buffer.find('\n')) != std::string::npos)
+    while (scanPos < writePos)
     {
-        std::string msg = buffer.substr(0, pos);
+        // A binary frame can only start where the previous message ended
+        if (scanPos == readPos && static_cast<uint8_t>(recvBuffer[readPos]) == Wire::MARKER)
+        {
+            std::string_view rest(recvBuffer + readPos + 1, writePos - readPos - 1);
+            // Only the bytes a valid length can take are decoded, a longer varint is rejected
+            std::string_view lengthBytes = rest.substr(0, MAX_LENGTH_BYTES);
+            size_t available = lengthBytes.size();
+            uint64_t length = 0;
+            if (!Wire::getVarint(lengthBytes, length))
+            {
+                oversized = available == MAX_LENGTH_BYTES;
+                return false;
+            }
+            size_t header = 1 + available - lengthBytes.size();
+            rest.remove_prefix(header - 1);
+            // Header included, a partial frame then never trips the line limit either
+            if (length > MAX_LINE_LENGTH - header)
+            {
+                oversized = true;
+                return false;
+            }
+            if (rest.size() < length)
+                return false;
 
+            message = rest.substr(0, length);
+            binary = true;
+            readPos = scanPos = static_cast<size_t>(rest.data() + length - recvBuffer);
+            return true;
+        }
+
+        // Scan only bytes not looked at before
+        const char *start = recvBuffer + scanPos;
+        const char *newline = static_cast<const char *>(std::memchr(start, '\n', writePos - scanPos));
+        if (newline == nullptr)
+        {
+            scanPos = writePos;
+            return false;
+        }
+
+        size_t end = newline - recvBuffer;
+        size_t length = end - readPos;
         // Handle Windows-style \r\n
-        if (!msg.empty() && msg.back() == '\r')
+        if (length > 0 && recvBuffer[end - 1] == '\r')
+        {
+            length--;
+        }
+
+        message = std::string_view(recvBuffer + readPos, length);
+        binary = false;
+        readPos = scanPos = end + 1;
+        if (!message.empty())
         {
-            msg.pop_back();
+            return true;
         }
+    }
+    return false;
+}
 
-        if (!msg.empty())
+bool ClientConnection::queueOutput(const Frame &frame, uint8_t snapshotKind)
+{
+    if (snapshotKind != SNAPSHOT_NONE)
+    {
+        // The front frame may be partially written already, it has to stay
+        auto it = outQueue.begin();
+        if (it != outQueue.end() && outHeadOffset > 0)
+            ++it;
+        for (; it != outQueue.end(); ++it)
         {
-            messages.push_back(msg);
+            if (it->snapshotKind == snapshotKind)
+            {
+                outBytes -= it->data->size();
+                outQueue.erase(it);
+                break;
+            }
         }
+    }
 
-        buffer.erase(0, pos + 1);
+    if (outBytes + frame->size() > highWaterMark)
+    {
+        return false;
     }
-    return messages;
-}
\ No newline at end of file
+    outBytes += frame->size();
+    outQueue.push_back({frame, snapshotKind});
+    return true;
+}
+
+std::string ClientConnection::getPendingOutput() const
+{
+    std::string pending;
+    pending.reserve(outBytes);
+    for (auto it = outQueue.begin(); it != outQueue.end(); ++it)
+    {
+        size_t offset = (it == outQueue.begin()) ? outHeadOffset : 0;
+        pending.append(*it->data, offset, std::string::npos);
+    }
+    return pending;
+}
+
+void ClientConnection::restoreBuffers(std::string_view input, const std::string &output)
+{
+    // The old process held at most one slab of input, the new slab is empty
+    size_t length = std::min(input.size(), getWritableBytes());
+    std::memcpy(getWritePtr(), input.data(), length);
+    commitWrite(length);
+    if (!output.empty())
+    {
+        // Sent ahead of anything else, the high-water mark does not apply to what was already accepted
+        outBytes += output.size();
+        outQueue.push_back({std::make_shared<const std::string>(output), SNAPSHOT_NONE});
+    }
+}
+
+bool ClientConnection::flushOutput()
+{
+    constexpr size_t MAX_IOV = 64;
+    iovec iov[MAX_IOV];
+
+    while (!outQueue.empty())
+    {
+        size_t count = 0;
+        size_t batchBytes = 0;
+        for (auto it = outQueue.begin(); it != outQueue.end() && count < MAX_IOV; ++it, ++count)
+        {
+            size_t offset = (count == 0) ? outHeadOffset : 0;
+            iov[count].iov_base = const_cast<char *>(it->data->data() + offset);
+            iov[count].iov_len = it->data->size() - offset;
+            batchBytes += iov[count].iov_len;
+        }
+
+        msghdr msg{};
+        msg.msg_iov = iov;
+        msg.msg_iovlen = count;
+        ssize_t sent = Transport::sendmsg(transportState, socketFd, &msg);
+
+        if (sent < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            // Socket buffer full, wait for the next writable event
+            if (errno == EWOULDBLOCK || errno == EAGAIN)
+                return true;
+            return false;
+        }
+
+        // Drop every frame that went out completely, remember the offset into a partial one
+        size_t remaining = static_cast<size_t>(sent);
+        outBytes -= remaining;
+        Metrics::bytesOut.add(remaining);
+        while (remaining > 0)
+        {
+            size_t frontLeft = outQueue.front().data->size() - outHeadOffset;
+            if (remaining < frontLeft)
+            {
+                outHeadOffset += remaining;
+                break;
+            }
+            remaining -= frontLeft;
+            outQueue.pop_front();
+            outHeadOffset = 0;
+        }
+
+        // Short write means the socket buffer is full
+        if (static_cast<size_t>(sent) < batchBytes)
+            return true;
+    }
+    return true;
+}
@@ -4,30 +4,140 @@
  * 
  * ClientConnection.h - Client connection handler for individual socket connections
  * Manages buffering of incoming data from clients and extracts complete messages
- * delimited by newlines. Handles partial message reception and reconstruction.
+ * delimited by newlines. Data is received straight into a fixed-size slab, only
+ * newly arrived bytes are scanned, and complete lines are handed out as views.
+ * Length-prefixed binary frames (see Wire.h) may arrive in between the lines.
+ * Handles partial message reception and reconstruction.
+ * Owns the outbound byte queue, which is flushed once per event-loop pass with a
+ * single vectored write and resumed whenever the socket becomes writable again.
  */
 
 #ifndef CLIENT_CONNECTION_H
 #define CLIENT_CONNECTION_H
 
 #include <string>
-#include <vector>
+#include <string_view>
+#include <deque>
+#include <cstdint>
+#include "../protocol/Frame.h"
+#include "../protocol/Wire.h"
+#include "../core/TokenBucket.h"
+#include "Transport.h"
 
 class ClientConnection
 {
 public:
-    ClientConnection(int fd);
+    static constexpr size_t RECV_BUFFER_SIZE = 4096;
+    // A partial line or a binary frame longer than this is a protocol violation
+    static constexpr size_t MAX_LINE_LENGTH = 1024;
+    // Varint bytes of a binary frame length, every length within MAX_LINE_LENGTH fits
+    static constexpr size_t MAX_LENGTH_BYTES = 2;
+    static_assert(MAX_LINE_LENGTH < (1u << (7 * MAX_LENGTH_BYTES)), "Frame lengths need more varint bytes");
 
-    // Returns true if data was appended successfully
-    // Returns true and buffer has content if '\n' was found
-    bool appendBuffer(const char *data, size_t length);
+    ClientConnection(int fd, size_t sendHighWaterMark);
 
-    // Extracts full lines from the internal buffer
-    std::vector<std::string> getMessages();
+    int getFd() const { return socketFd; }
+
+    // Free space at the end of the receive slab to recv() into directly
+    // Invalidates line views handed out before
+    char *getWritePtr();
+    size_t getWritableBytes() const { return RECV_BUFFER_SIZE - writePos; }
+    void commitWrite(size_t length) { writePos += length; }
+
+    // Extracts the next full message from the receive slab: a line (without \r\n, empty lines are
+    // skipped) or, with 'binary' set, the opcode and payload of a binary frame
+    // The view stays valid until the next getWritePtr() call
+    bool nextMessage(std::string_view &message, bool &binary);
+
+    // The unterminated tail or an announced binary frame exceeds MAX_LINE_LENGTH
+    bool isLineTooLong() const { return oversized || writePos - readPos > MAX_LINE_LENGTH; }
+
+    // Format of the messages sent to this client, negotiated at login
+    WireFormat getWireFormat() const { return wireFormat; }
+    void setWireFormat(WireFormat format) { wireFormat = format; }
+
+    // Queues a shared frame for sending, the bytes are not copied
+    // A snapshotKind other than SNAPSHOT_NONE marks a full state snapshot, an older
+    // unsent frame of the same kind is superseded and dropped from the queue
+    // Returns false when the unsent backlog would exceed the high-water mark
+    bool queueOutput(const Frame &frame, uint8_t snapshotKind = SNAPSHOT_NONE);
+
+    // Writes as much of the queue as the socket accepts without blocking, batched into writev calls
+    // Returns false on a fatal socket error, the rest is sent on the next writable event
+    bool flushOutput();
+
+    // Flags the connection for the end-of-tick flush, returns false if it was already flagged
+    bool markFlushPending()
+    {
+        bool wasPending = flushPending;
+        flushPending = true;
+        return !wasPending;
+    }
+    void clearFlushPending() { flushPending = false; }
+
+    bool hasPendingOutput() const { return !outQueue.empty(); }
+    size_t getPendingOutputBytes() const { return outBytes; }
+
+    // Connection is scheduled for disconnect, no more output is accepted
+    void markClosing() { closing = true; }
+    bool isClosing() const { return closing; }
+
+    // Connection is about to move to another event loop, no more input is processed here
+    void markHandoffPending() { handoffPending = true; }
+    bool isHandoffPending() const { return handoffPending; }
+
+    // Heartbeat timer in the owning loop's timer wheel, 0 if none
+    void setHeartbeatTimer(uint64_t timerId) { heartbeatTimer = timerId; }
+    uint64_t getHeartbeatTimer() const { return heartbeatTimer; }
+
+    // Per-connection state of the socket I/O policy
+    Transport::State &getTransportState() { return transportState; }
+
+    // Command rate limit, travels with the connection between loops
+    TokenBucket &getRateLimiter() { return rateLimiter; }
+
+    // Unprocessed input and unsent output, carried to the new process on a hot restart
+    std::string_view getBufferedInput() const { return std::string_view(recvBuffer + readPos, writePos - readPos); }
+    std::string getPendingOutput() const;
+    // Puts carried-over bytes back on a fresh connection
+    void restoreBuffers(std::string_view input, const std::string &output);
+
+    // Clears the per-loop flags when another loop adopts the connection
+    void resetLoopFlags()
+    {
+        closing = false;
+        flushPending = false;
+        handoffPending = false;
+        heartbeatTimer = 0;
+    }
 
 private:
     int socketFd;
-    std::string buffer;
+
+    // Receive slab: [readPos, writePos) is unconsumed, [readPos, scanPos) has no newline
+    char recvBuffer[RECV_BUFFER_SIZE];
+    size_t readPos;
+    size_t scanPos;
+    size_t writePos;
+    bool oversized;
+    WireFormat wireFormat;
+
+    struct OutFrame
+    {
+        Frame data;
+        uint8_t snapshotKind;
+    };
+
+    std::deque<OutFrame> outQueue;
+    size_t outHeadOffset; // bytes of outQueue.front() already written
+    size_t outBytes;      // unsent bytes across the whole queue
+    size_t highWaterMark;
+    bool closing;
+    bool flushPending;
+    bool handoffPending;
+    uint64_t heartbeatTimer;
+    Transport::State transportState;
+    TokenBucket rateLimiter;
 };
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,102 @@
+#include "EpollPoller.h"
+#include "../core/Logger.h"
+#include <unistd.h>
+#include <cerrno>
+#include <stdexcept>
+
+std::unique_ptr<Poller> Poller::create()
+{
+    return std::make_unique<EpollPoller>();
+}
+
+EpollPoller::EpollPoller() : epollFd(epoll_create1(EPOLL_CLOEXEC)), events(256)
+{
+    if (epollFd < 0)
+    {
+        throw std::runtime_error("Failed to create epoll instance");
+    }
+}
+
+EpollPoller::~EpollPoller()
+{
+    if (epollFd != -1)
+        close(epollFd);
+}
+
+uint32_t EpollPoller::toEpoll(uint32_t flags)
+{
+    uint32_t ev = EPOLLET;
+    if (flags & POLL_READABLE)
+        ev |= EPOLLIN | EPOLLRDHUP;
+    if (flags & POLL_WRITABLE)
+        ev |= EPOLLOUT;
+    return ev;
+}
+
+uint32_t EpollPoller::fromEpoll(uint32_t ev)
+{
+    uint32_t flags = 0;
+    if (ev & EPOLLIN)
+        flags |= POLL_READABLE;
+    if (ev & EPOLLOUT)
+        flags |= POLL_WRITABLE;
+    if (ev & (EPOLLHUP | EPOLLRDHUP))
+        flags |= POLL_HANGUP;
+    if (ev & EPOLLERR)
+        flags |= POLL_ERROR;
+    return flags;
+}
+
+bool EpollPoller::add(int fd, uint32_t flags)
+{
+    epoll_event ev{};
+    ev.events = toEpoll(flags);
+    ev.data.fd = fd;
+    if (epoll_ctl(epollFd, EPOLL_CTL_ADD, fd, &ev) < 0)
+    {
+        LOG_ERROR("epoll_ctl ADD failed for FD " + std::to_string(fd));
+        return false;
+    }
+    return true;
+}
+
+bool EpollPoller::modify(int fd, uint32_t flags)
+{
+    epoll_event ev{};
+    ev.events = toEpoll(flags);
+    ev.data.fd = fd;
+    if (epoll_ctl(epollFd, EPOLL_CTL_MOD, fd, &ev) < 0)
+    {
+        LOG_ERROR("epoll_ctl MOD failed for FD " + std::to_string(fd));
+        return false;
+    }
+    return true;
+}
+
+void EpollPoller::remove(int fd)
+{
+    // Closing the fd removes it as well, explicit removal keeps the set exact when the fd is still open elsewhere
+    epoll_ctl(epollFd, EPOLL_CTL_DEL, fd, nullptr);
+}
+
+int EpollPoller::wait(std::vector<PollEvent> &ready, int timeoutMs)
+{
+    ready.clear();
+    int n = epoll_wait(epollFd, events.data(), static_cast<int>(events.size()), timeoutMs);
+    if (n < 0)
+    {
+        return errno == EINTR ? 0 : -1;
+    }
+
+    for (int i = 0; i < n; ++i)
+    {
+        ready.push_back({events[i].data.fd, fromEpoll(events[i].events)});
+    }
+
+    // Full batch, grow so a storm of ready sockets is picked up in fewer calls
+    if (static_cast<size_t>(n) == events.size())
+    {
+        events.resize(events.size() * 2);
+    }
+    return n;
+}
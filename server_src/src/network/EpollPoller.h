@@ -0,0 +1,38 @@
+/**
+ * Server for blackjack
+ * Author: Marek Manzel
+ *
+ * EpollPoller.h - Linux epoll backend of the Poller interface
+ * Registers descriptors in edge-triggered mode so a wakeup costs
+ * O(ready descriptors) instead of O(all connections).
+ */
+
+#ifndef EPOLL_POLLER_H
+#define EPOLL_POLLER_H
+
+#include "Poller.h"
+#include <sys/epoll.h>
+
+class EpollPoller : public Poller
+{
+public:
+    EpollPoller();
+    ~EpollPoller() override;
+
+    EpollPoller(const EpollPoller &) = delete;
+    EpollPoller &operator=(const EpollPoller &) = delete;
+
+    bool add(int fd, uint32_t events) override;
+    bool modify(int fd, uint32_t events) override;
+    void remove(int fd) override;
+    int wait(std::vector<PollEvent> &ready, int timeoutMs) override;
+
+private:
+    static uint32_t toEpoll(uint32_t events);
+    static uint32_t fromEpoll(uint32_t events);
+
+    int epollFd;
+    std::vector<epoll_event> events;
+};
+
+#endif
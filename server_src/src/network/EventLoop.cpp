@@ -0,0 +1,544 @@
+#include "EventLoop.h"
+#include "../core/Logger.h"
+#include "../core/Metrics.h"
+#include "../game/CreditStore.h"
+#include "../protocol/Parser.h"
+#include <sys/socket.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+#include <algorithm>
+#include <stdexcept>
+#include <thread>
+
+EventLoop::EventLoop(const Config &cfg)
+    : config(cfg), poller(Poller::create()), isRunning(false), wakeupFd(eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)),
+      loopTime(TimerWheel::Clock::now())
+{
+    if (wakeupFd < 0 || !poller->add(wakeupFd, POLL_READABLE))
+    {
+        throw std::runtime_error("Failed to create event loop wakeup descriptor");
+    }
+}
+
+EventLoop::~EventLoop()
+{
+    // Cleanup connections, the table frees them
+    connections.forEach([](int fd, ClientConnection &)
+                        { close(fd); });
+    if (wakeupFd != -1)
+        close(wakeupFd);
+}
+
+void EventLoop::stop()
+{
+    isRunning = false;
+    wakeup();
+}
+
+void EventLoop::wakeup()
+{
+    uint64_t one = 1;
+    ssize_t written = write(wakeupFd, &one, sizeof(one));
+    (void)written; // counter overflow only happens with the loop already awake
+}
+
+void EventLoop::runLoop()
+{
+    isRunning = true;
+
+    while (isRunning)
+    {
+        // Sleep until the next timer is due, short while posts wait for a full mailbox
+        int timeout = deferredPosts.empty() ? timers.timeoutMs(TimerWheel::Clock::now()) : 1;
+        int activity = poller->wait(readyEvents, timeout);
+        loopTime = TimerWheel::Clock::now();
+
+        if (activity < 0)
+        {
+            LOG_ERROR("Poll error");
+            break;
+        }
+
+        // Only descriptors that are actually ready are reported
+        for (const auto &event : readyEvents)
+        {
+            if (event.fd == wakeupFd)
+            {
+                uint64_t count;
+                while (read(wakeupFd, &count, sizeof(count)) > 0)
+                {
+                }
+                onWakeup();
+                continue;
+            }
+
+            ClientConnection *conn = connections.find(event.fd);
+            if (conn == nullptr)
+            {
+                handleForeignEvent(event);
+                continue;
+            }
+            if (conn->isClosing() || conn->isHandoffPending())
+                continue;
+
+            // Hangups and errors surface as recv() returning 0 / -1
+            if (event.events & (POLL_READABLE | POLL_HANGUP | POLL_ERROR))
+                handleClientData(event.fd);
+            if ((event.events & POLL_WRITABLE) && connections.find(event.fd) != nullptr)
+                handleClientWritable(event.fd);
+        }
+
+        // Heartbeats, turn timeouts, offline marking
+        timers.advance(loopTime);
+
+        onTick();
+        flushPendingOutput();
+        processPendingHandoffs();
+        processPendingDisconnects();
+        retryDeferredPosts();
+        Metrics::loopPass.recordSince(loopTime);
+    }
+}
+
+void EventLoop::persistCredits(const Player &player)
+{
+    if (creditStore == nullptr || player.getNickname().empty())
+        return;
+    postOrDefer([store = creditStore, nickname = player.getNickname(), credits = player.getCredits()]()
+                { return store->record(nickname, credits); });
+}
+
+void EventLoop::armHeartbeat(ClientConnection &conn, TimerWheel::Clock::time_point deadline)
+{
+    auto handle = connections.handleOf(conn.getFd());
+    timers.cancel(conn.getHeartbeatTimer());
+    conn.setHeartbeatTimer(timers.schedule(deadline, [this, handle]()
+                                           { onHeartbeat(handle); }));
+}
+
+void EventLoop::cancelHeartbeat(ClientConnection &conn)
+{
+    timers.cancel(conn.getHeartbeatTimer());
+    conn.setHeartbeatTimer(0);
+}
+
+void EventLoop::onHeartbeat(FdTable<ClientConnection>::Handle handle)
+{
+    ClientConnection *conn = connections.find(handle);
+    if (conn == nullptr)
+        return;
+    int fd = handle.fd;
+    conn->setHeartbeatTimer(0);
+    if (conn->isClosing() || conn->isHandoffPending())
+        return;
+
+    Player *player = findPlayer(fd);
+    if (player == nullptr)
+    {
+        armHeartbeat(*conn, loopTime + HEARTBEAT_INTERVAL);
+        return;
+    }
+
+    // Activity only stores a timestamp, the timer works out what is due when it fires
+    auto lastActivity = player->getLastActivity();
+    auto idle = loopTime - lastActivity;
+    if (idle >= HEARTBEAT_TIMEOUT)
+    {
+        LOG_INFO("Client timed out (No heartbeat): " + std::to_string(fd));
+        Metrics::heartbeatTimeouts.add();
+        scheduleDisconnect(fd);
+    }
+    else if (idle >= HEARTBEAT_INTERVAL)
+    {
+        // Send PING to check if client is alive
+        sendMessage(fd, "PING____", "");
+        armHeartbeat(*conn, std::min(loopTime + HEARTBEAT_INTERVAL, lastActivity + HEARTBEAT_TIMEOUT));
+    }
+    else
+    {
+        armHeartbeat(*conn, lastActivity + HEARTBEAT_INTERVAL);
+    }
+}
+
+bool EventLoop::addConnection(int fd)
+{
+    // Writable edges drive flushing of the outbound queue
+    if (!poller->add(fd, POLL_READABLE | POLL_WRITABLE))
+    {
+        return false;
+    }
+
+    // Create tracking objects
+    connections.insert(fd, std::make_unique<ClientConnection>(fd, config.sendHighWaterMark));
+    Metrics::connections.add(1);
+    armHeartbeat(*connections.find(fd), loopTime + HEARTBEAT_INTERVAL);
+    return true;
+}
+
+bool EventLoop::adoptConnection(std::unique_ptr<ClientConnection> owned)
+{
+    int fd = owned->getFd();
+    bool wasClosing = owned->isClosing();
+    owned->resetLoopFlags();
+
+    if (!poller->add(fd, POLL_READABLE | POLL_WRITABLE))
+    {
+        close(fd);
+        releaseConnection();
+        owned.reset();
+        onDisconnect(fd);
+        return false;
+    }
+    connections.insert(fd, std::move(owned));
+    ClientConnection *conn = connections.find(fd);
+    armHeartbeat(*conn, loopTime + HEARTBEAT_INTERVAL);
+
+    if (wasClosing)
+    {
+        scheduleDisconnect(fd);
+        return true;
+    }
+    if (conn->hasPendingOutput() && conn->markFlushPending())
+    {
+        pendingFlush.push_back(fd);
+    }
+    return true;
+}
+
+void EventLoop::releaseConnection()
+{
+    Metrics::connections.add(-1);
+    if (connectionCount != nullptr)
+        connectionCount->fetch_sub(1, std::memory_order_relaxed);
+}
+
+void EventLoop::resumeConnection(int fd)
+{
+    ClientConnection *conn = connections.find(fd);
+    if (conn == nullptr || conn->isClosing())
+        return;
+    // Lines that arrived before the handoff are still in the slab
+    handleClientData(fd);
+}
+
+// Full state snapshots, a newer one makes an older unsent one of the same kind redundant
+static uint8_t snapshotKind(const std::string &command)
+{
+    if (command == "GAMESTAT")
+        return SNAPSHOT_GAMESTAT;
+    if (command == "ROMSTAUP")
+        return SNAPSHOT_ROMSTAUP;
+    if (command == "LBBYINFO")
+        return SNAPSHOT_LBBYINFO;
+    return SNAPSHOT_NONE;
+}
+
+void EventLoop::sendMessage(int fd, const std::string &command, const std::string &args)
+{
+    ClientConnection *conn = connections.find(fd);
+    WireFormat format = conn != nullptr ? conn->getWireFormat() : WireFormat::TEXT;
+    sendFrame(fd, makeFrame(format, command, args), snapshotKind(command));
+}
+
+WireFormat EventLoop::getWireFormat(int fd) const
+{
+    const ClientConnection *conn = connections.find(fd);
+    return conn != nullptr ? conn->getWireFormat() : WireFormat::TEXT;
+}
+
+void EventLoop::setWireFormat(int fd, WireFormat format)
+{
+    ClientConnection *conn = connections.find(fd);
+    if (conn != nullptr)
+        conn->setWireFormat(format);
+}
+
+void EventLoop::sendFrame(int fd, const Frame &frame, uint8_t kind)
+{
+    // Queue on the connection, the whole queue is written at the end of the loop pass
+    ClientConnection *conn = connections.find(fd);
+    if (conn == nullptr || conn->isClosing())
+    {
+        LOG_DEBUG("Dropping message for closed FD " + std::to_string(fd));
+        return;
+    }
+
+    if (!conn->queueOutput(frame, kind))
+    {
+        LOG_ERROR_LIMITED("Send queue for FD " + std::to_string(fd) + " over high-water mark, disconnecting slow client");
+        Metrics::slowClientDrops.add();
+        scheduleDisconnect(fd);
+        return;
+    }
+
+    if (conn->markFlushPending())
+    {
+        pendingFlush.push_back(fd);
+    }
+
+    if (Wire::isBinary(frame))
+        LOG_DEBUG("Sent to FD " + std::to_string(fd) + ": binary frame of " + std::to_string(frame->size()) + " bytes");
+    else if (frame->compare(0, 11, "BJ:PING____") != 0)
+        LOG_DEBUG("Sent to FD " + std::to_string(fd) + ": " + *frame);
+}
+
+void EventLoop::handleClientWritable(int fd)
+{
+    ClientConnection *conn = connections.find(fd);
+    if (conn->hasPendingOutput() && !conn->flushOutput())
+    {
+        LOG_ERROR_LIMITED("Failed to send to FD " + std::to_string(fd));
+        scheduleDisconnect(fd);
+        return;
+    }
+    retryHeldOutput(*conn);
+}
+
+void EventLoop::retryHeldOutput(ClientConnection &conn)
+{
+    // A delaying transport reports EAGAIN without a writable edge to follow, wake up for it instead
+    if constexpr (Transport::INJECTS_FAULTS)
+    {
+        auto due = Transport::heldUntil(conn.getTransportState());
+        if (due == TimerWheel::Clock::time_point{} || !conn.hasPendingOutput())
+            return;
+        auto handle = connections.handleOf(conn.getFd());
+        timers.schedule(due, [this, handle]()
+                        {
+                            ClientConnection *held = connections.find(handle);
+                            if (held != nullptr && !held->isClosing() && held->markFlushPending())
+                                pendingFlush.push_back(handle.fd); });
+    }
+}
+
+void EventLoop::handleClientData(int fd)
+{
+    ClientConnection *conn = connections.find(fd);
+
+    // Edge-triggered: keep reading until the socket reports EAGAIN
+    // The first pass only drains lines already buffered (e.g. before a handoff)
+    bool buffered = true;
+    while (true)
+    {
+        if (!buffered)
+        {
+            // Receive straight into the connection's slab, no intermediate copy
+            // (getWritePtr may compact the slab, so it has to run before getWritableBytes)
+            char *dest = conn->getWritePtr();
+            int bytesRead = Transport::recv(conn->getTransportState(), fd, dest, conn->getWritableBytes());
+
+            if (bytesRead < 0 && errno == EINTR)
+                continue;
+            if (bytesRead < 0 && (errno == EWOULDBLOCK || errno == EAGAIN))
+                return;
+
+            if (bytesRead <= 0)
+            {
+                // 0 = Closed by client, <0 = Error
+                disconnectClient(fd);
+                return;
+            }
+            conn->commitWrite(bytesRead);
+            Metrics::bytesIn.add(static_cast<uint64_t>(bytesRead));
+        }
+        buffered = false;
+
+        // keep player activity updated trough slow trafic
+        Player *player = findPlayer(fd);
+        if (player != nullptr)
+        {
+            player->refreshLastActivity(loopTime);
+        }
+
+        // Process every complete message, views point into the slab
+        std::string_view line;
+        bool binary = false;
+        while (conn->nextMessage(line, binary))
+        {
+            // Over the rate limit, dropped before parsing and never answered or broadcast
+            if (config.rateLimit > 0 && !conn->getRateLimiter().take(loopTime, commandCost(Parser::peekCommand(line, binary)), config.rateLimit, config.rateBurst))
+            {
+                Metrics::rateLimitedMessages.add();
+                if (conn->getRateLimiter().getConsecutiveDenied() >= MAX_RATE_LIMITED)
+                {
+                    LOG_INFO("Kicking client (Ignores the rate limit): " + std::to_string(fd));
+                    Metrics::rateLimitKicks.add();
+                    disconnectClient(fd);
+                    return;
+                }
+                LOG_WARN_LIMITED("Rate limit exceeded by FD " + std::to_string(fd) + ", dropping message");
+                continue;
+            }
+
+            auto parseStart = std::chrono::steady_clock::now();
+            MessageView msg = binary ? Parser::parseBinaryView(line) : Parser::parseView(line);
+            auto dispatchStart = std::chrono::steady_clock::now();
+            Metrics::parse.record(dispatchStart - parseStart);
+
+            if (!msg.valid)
+            {
+                LOG_WARN_LIMITED("Invalid message format from FD" + std::to_string(fd));
+                if (player != nullptr)
+                {
+                    player->incrementInvalidMsg();
+                    // Requirement: Disconnect after N invalid messages
+                    if (player->getInvalidMsgCount() >= 3)
+                    {
+                        LOG_INFO("Kicking client (Too many invalid msgs): " + std::to_string(fd));
+                        Metrics::invalidMessageKicks.add();
+                        disconnectClient(fd);
+                        return;
+                    }
+                }
+            }
+            else
+            {
+                LOG_DEBUG("Recv FD " + std::to_string(fd) + ": " + msg.commandName());
+                // Route valid messages (e.g., to Lobby or GameRoom) and update last activity for timeout tracking
+                if (player != nullptr)
+                {
+                    switch (msg.command)
+                    {
+                    case Command::PING:
+                        // Handle PING command (keep-alive)
+                        sendMessage(fd, "PONG____", "");
+                        LOG_DEBUG("Responded to PING from FD " + std::to_string(fd));
+                        break;
+                    case Command::PONG:
+                        player->refreshLastActivity(loopTime);
+                        break;
+                    default:
+                        onMessage(*player, msg);
+                        Metrics::command(msg.command).recordSince(dispatchStart);
+                        break;
+                    }
+                }
+            }
+
+            // The connection moves to another loop or goes away, the rest is not ours
+            if (conn->isHandoffPending() || conn->isClosing())
+                return;
+            // The player may change with the message (e.g. reconnect)
+            player = findPlayer(fd);
+        }
+
+        if (conn->isLineTooLong())
+        {
+            LOG_INFO("Kicking client (Line exceeds " + std::to_string(ClientConnection::MAX_LINE_LENGTH) + " bytes): " + std::to_string(fd));
+            Metrics::invalidMessageKicks.add();
+            disconnectClient(fd);
+            return;
+        }
+    }
+}
+
+void EventLoop::disconnectClient(int fd)
+{
+    poller->remove(fd);
+    close(fd);
+
+    ClientConnection *conn = connections.find(fd);
+    if (conn != nullptr)
+    {
+        cancelHeartbeat(*conn);
+        connections.erase(fd);
+        releaseConnection();
+    }
+
+    onDisconnect(fd);
+    LOG_INFO("Client disconnected FD " + std::to_string(fd));
+}
+
+void EventLoop::flushPendingOutput()
+{
+    for (int fd : pendingFlush)
+    {
+        ClientConnection *conn = connections.find(fd);
+        if (conn == nullptr)
+            continue;
+        conn->clearFlushPending();
+        Metrics::sendQueueBytes.record(conn->getPendingOutputBytes());
+        // Closing connections still get their last lines (e.g. a DISCONNECT notice) before the close
+        if (!conn->flushOutput() && !conn->isClosing())
+        {
+            LOG_ERROR_LIMITED("Failed to send to FD " + std::to_string(fd));
+            scheduleDisconnect(fd);
+            continue;
+        }
+        retryHeldOutput(*conn);
+    }
+    pendingFlush.clear();
+}
+
+void EventLoop::scheduleDisconnect(int fd)
+{
+    ClientConnection *conn = connections.find(fd);
+    if (conn == nullptr || conn->isClosing())
+        return;
+    conn->markClosing();
+    // A connection that is being handed off is closed by the loop adopting it
+    if (!conn->isHandoffPending())
+        pendingDisconnects.push_back(fd);
+}
+
+void EventLoop::queueHandoff(int fd, std::function<void(std::unique_ptr<ClientConnection>)> deliver)
+{
+    ClientConnection *conn = connections.find(fd);
+    if (conn == nullptr || conn->isHandoffPending())
+        return;
+    conn->markHandoffPending();
+    pendingHandoffs.emplace_back(fd, std::move(deliver));
+}
+
+void EventLoop::retryDeferredPosts()
+{
+    if (deferredPosts.empty())
+        return;
+    while (!deferredPosts.empty() && deferredPosts.front()())
+    {
+        deferredPosts.pop_front();
+    }
+    if (!deferredPosts.empty())
+        LOG_DEBUG("Mailbox full, " + std::to_string(deferredPosts.size()) + " posts waiting");
+}
+
+void EventLoop::flushDeferredPosts(std::chrono::milliseconds limit)
+{
+    auto deadline = TimerWheel::Clock::now() + limit;
+    while (!deferredPosts.empty() && TimerWheel::Clock::now() < deadline)
+    {
+        retryDeferredPosts();
+        if (!deferredPosts.empty())
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    if (!deferredPosts.empty())
+        LOG_WARN("Dropping " + std::to_string(deferredPosts.size()) + " posts at shutdown");
+    deferredPosts.clear();
+}
+
+void EventLoop::processPendingHandoffs()
+{
+    std::vector<std::pair<int, std::function<void(std::unique_ptr<ClientConnection>)>>> handoffs;
+    handoffs.swap(pendingHandoffs);
+    for (auto &handoff : handoffs)
+    {
+        ClientConnection *conn = connections.find(handoff.first);
+        if (conn == nullptr)
+            continue;
+        cancelHeartbeat(*conn);
+        poller->remove(handoff.first);
+        // From here on the connection belongs to the receiving loop
+        handoff.second(connections.release(handoff.first));
+    }
+}
+
+void EventLoop::processPendingDisconnects()
+{
+    std::vector<int> fds;
+    fds.swap(pendingDisconnects);
+    for (int fd : fds)
+    {
+        if (connections.find(fd) != nullptr)
+            disconnectClient(fd);
+    }
+}
@@ -0,0 +1,176 @@
+/**
+ * Server for blackjack
+ * Author: Marek Manzel
+ *
+ * EventLoop.h - Single-threaded reactor shared by the lobby loop and room shards
+ * Owns a Poller, the connections currently served by this loop and their
+ * outbound queues. Reads and frames client data, answers PING/PONG and hands
+ * every other command to the derived loop. Connections can be moved between
+ * loops: the sending loop releases them at the end of its pass, the receiving
+ * loop adopts them and keeps processing already buffered lines.
+ * Connections are owned through an FdTable indexed by descriptor; each one
+ * stays boxed because of its inline receive slab, so a handoff moves a pointer.
+ */
+
+#ifndef EVENT_LOOP_H
+#define EVENT_LOOP_H
+
+#include "../core/Config.h"
+#include "../core/SlotMap.h"
+#include "../core/TimerWheel.h"
+#include "../game/Player.h"
+#include "../protocol/Message.h"
+#include "../protocol/Frame.h"
+#include "ClientConnection.h"
+#include "Poller.h"
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <vector>
+
+class CreditStore;
+
+class EventLoop
+{
+public:
+    EventLoop(const Config &config);
+    virtual ~EventLoop();
+
+    EventLoop(const EventLoop &) = delete;
+    EventLoop &operator=(const EventLoop &) = delete;
+
+    void sendMessage(int fd, const std::string &command, const std::string &args);
+    // Queues an already framed message, shared frames are not copied per recipient
+    void sendFrame(int fd, const Frame &frame, uint8_t snapshotKind = SNAPSHOT_NONE);
+
+    // Format the client gets its messages in, TEXT until it asks for binary at login
+    WireFormat getWireFormat(int fd) const;
+    void setWireFormat(int fd, WireFormat format);
+
+    // Defers a disconnect to the end of the current loop pass (safe while iterating players)
+    void scheduleDisconnect(int fd);
+
+    // Releases the connection at the end of the current loop pass and passes it to 'deliver',
+    // which posts it to another loop. No more lines of this connection are processed here.
+    // 'deliver' may be move-only (it usually carries the player), it runs exactly once.
+    template <typename Deliver>
+    void scheduleHandoff(int fd, Deliver deliver)
+    {
+        auto boxed = std::make_shared<Deliver>(std::move(deliver));
+        queueHandoff(fd, [boxed](std::unique_ptr<ClientConnection> conn)
+                     { (*boxed)(std::move(conn)); });
+    }
+
+    // Takes over a connection released by another loop. Returns false if it could not be
+    // registered, the connection is closed and onDisconnect() has run in that case.
+    bool adoptConnection(std::unique_ptr<ClientConnection> conn);
+    // Processes lines buffered before the handoff, call after the adoption replies were queued
+    void resumeConnection(int fd);
+
+    // Durable balances, shared by all loops. nullptr if credits are not saved
+    void setCreditStore(CreditStore *store) { creditStore = store; }
+    CreditStore *getCreditStore() const { return creditStore; }
+    // Hands the player's balance to the credit store, retried from this loop while its queue is full
+    void persistCredits(const Player &player);
+
+    // Connected sockets of all loops together, released here as connections close. nullptr = not counted
+    void setConnectionCount(std::atomic<int> *count) { connectionCount = count; }
+
+    // Thread-safe: makes runLoop() return after the current pass
+    void stop();
+
+    // Loop thread only. Time taken once per pass, use instead of steady_clock::now()
+    TimerWheel::Clock::time_point now() const { return loopTime; }
+    TimerWheel &getTimers() { return timers; }
+    const Config &getConfig() const { return config; }
+
+    // Idle client gets a PING after HEARTBEAT_INTERVAL, is dropped after HEARTBEAT_TIMEOUT
+    static constexpr std::chrono::seconds HEARTBEAT_INTERVAL{3};
+    static constexpr std::chrono::seconds HEARTBEAT_TIMEOUT{10};
+    // Messages in a row dropped by the rate limit before the client is disconnected
+    static constexpr uint32_t MAX_RATE_LIMITED = 256;
+
+protected:
+    // Blocking loop, returns after stop()
+    void runLoop();
+
+    // Wakes the loop from another thread, onWakeup() runs on the loop thread
+    void wakeup();
+
+    // Registers a freshly accepted socket
+    bool addConnection(int fd);
+
+    // Posts to another loop's mailbox through 'attempt' (true = accepted). While a mailbox
+    // is full the attempts are kept in order and retried every pass, the loop never blocks.
+    // 'attempt' may be move-only, it is only boxed once it actually has to wait
+    template <typename Attempt>
+    void postOrDefer(Attempt attempt)
+    {
+        if (deferredPosts.empty() && attempt())
+            return;
+        auto boxed = std::make_shared<Attempt>(std::move(attempt));
+        deferredPosts.emplace_back([boxed]()
+                                   { return (*boxed)(); });
+    }
+
+    // Shutdown, no further pass runs: retries the deferred posts until they went through or
+    // 'limit' passed, the rest is dropped
+    void flushDeferredPosts(std::chrono::milliseconds limit);
+
+    // Hooks for the concrete loop
+    // The player stays valid until the loop removes it, no longer than the current call
+    virtual Player *findPlayer(int fd) = 0;
+    virtual void onMessage(Player &player, const MessageView &msg) = 0;
+    // Connection is already closed and forgotten when this runs
+    virtual void onDisconnect(int fd) = 0;
+    // Runs once per loop pass after all ready events were handled
+    virtual void onTick() = 0;
+    // Mailbox work posted by other threads
+    virtual void onWakeup() = 0;
+    // Descriptors that are not connections (listening socket), returns true if handled
+    virtual bool handleForeignEvent(const PollEvent &) { return false; }
+
+    void disconnectClient(int fd);
+
+    Config config;
+    std::unique_ptr<Poller> poller;
+
+private:
+    CreditStore *creditStore = nullptr;
+    std::atomic<int> *connectionCount = nullptr;
+
+    // Socket of a registered connection was closed
+    void releaseConnection();
+    void handleClientData(int fd);
+    void handleClientWritable(int fd);
+    // Writes everything queued during this loop pass, one batched write per connection
+    void flushPendingOutput();
+    // Re-queues a flush when the transport holds output back (fault injection builds only)
+    void retryHeldOutput(ClientConnection &conn);
+    void queueHandoff(int fd, std::function<void(std::unique_ptr<ClientConnection>)> deliver);
+    void processPendingHandoffs();
+    void processPendingDisconnects();
+    void retryDeferredPosts();
+    // (Re)arms the heartbeat timer of a connection owned by this loop
+    void armHeartbeat(ClientConnection &conn, TimerWheel::Clock::time_point deadline);
+    void cancelHeartbeat(ClientConnection &conn);
+    // PING an idle player, drop it if not answering
+    void onHeartbeat(FdTable<ClientConnection>::Handle connection);
+
+    std::atomic<bool> isRunning;
+    int wakeupFd;
+    std::vector<PollEvent> readyEvents;
+    TimerWheel timers;
+    TimerWheel::Clock::time_point loopTime;
+
+    // Tracking active connections
+    FdTable<ClientConnection> connections;
+    std::vector<int> pendingDisconnects;
+    std::vector<int> pendingFlush;
+    std::vector<std::pair<int, std::function<void(std::unique_ptr<ClientConnection>)>>> pendingHandoffs;
+    std::deque<std::function<bool()>> deferredPosts;
+};
+
+#endif
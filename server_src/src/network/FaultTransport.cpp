@@ -0,0 +1,269 @@
+#ifdef BJ_FAULT_INJECTION
+
+#include "FaultTransport.h"
+#include "../core/Logger.h"
+#include <sys/ioctl.h>
+#include <sys/uio.h>
+#include <cerrno>
+#include <fstream>
+#include <random>
+#include <sstream>
+
+namespace
+{
+    // Probabilities per send / recv call, as in intcptor_config.cfg
+    struct FaultSettings
+    {
+        double send1BSends = 0;
+        double send2BSends = 0;
+        double send2SeparateSends = 0;
+        double send2BSendsAndSecondSend = 0;
+        double recv1BLess = 0;
+        double recv2BLess = 0;
+        double recvHalf = 0;
+        double recv2B = 0;
+        double sendDelayMsMean = 0;
+        double sendDelayMsSigma = 0;
+        bool dropConnections = false;
+        int dropDelayMsMin = 0;
+        int dropDelayMsMax = 0;
+        bool logEnabled = false;
+    };
+
+    FaultSettings settings;
+
+    std::mt19937_64 &generator()
+    {
+        thread_local std::mt19937_64 random(std::random_device{}());
+        return random;
+    }
+
+    double uniform()
+    {
+        return std::uniform_real_distribution<double>(0.0, 1.0)(generator());
+    }
+
+    // Picks one of the exclusive modes, -1 for none (probabilities sum to at most 1)
+    int pick(std::initializer_list<double> probabilities)
+    {
+        double roll = uniform();
+        int mode = 0;
+        for (double p : probabilities)
+        {
+            if (roll < p)
+                return mode;
+            roll -= p;
+            ++mode;
+        }
+        return -1;
+    }
+
+    void logFault(const std::string &what, int fd)
+    {
+        if (settings.logEnabled)
+            LOG_DEBUG("Fault injection: " + what + " on FD " + std::to_string(fd));
+    }
+
+    // Separate send() calls of at most 'piece' bytes, returns bytes sent or -1 if nothing was
+    ssize_t sendPieces(int fd, const char *data, size_t length, size_t piece)
+    {
+        size_t sent = 0;
+        while (sent < length)
+        {
+            size_t want = std::min(piece, length - sent);
+            ssize_t n = ::send(fd, data + sent, want, MSG_NOSIGNAL);
+            if (n < 0)
+            {
+                if (errno == EINTR)
+                    continue;
+                return sent > 0 ? static_cast<ssize_t>(sent) : -1;
+            }
+            sent += static_cast<size_t>(n);
+            if (static_cast<size_t>(n) < want)
+                break; // socket buffer full
+        }
+        return static_cast<ssize_t>(sent);
+    }
+
+    // One frame, possibly split. Returns bytes sent or -1 if nothing was
+    ssize_t sendFrame(int fd, const char *data, size_t length)
+    {
+        switch (pick({settings.send1BSends, settings.send2BSends, settings.send2SeparateSends, settings.send2BSendsAndSecondSend}))
+        {
+        case 0:
+            logFault("1 byte sends", fd);
+            return sendPieces(fd, data, length, 1);
+        case 1:
+            logFault("2 byte sends", fd);
+            return sendPieces(fd, data, length, 2);
+        case 2:
+            logFault("2 separate sends", fd);
+            return sendPieces(fd, data, length, (length + 1) / 2);
+        case 3:
+        {
+            logFault("2 bytes and second send", fd);
+            ssize_t first = sendPieces(fd, data, std::min<size_t>(2, length), 2);
+            if (first < 0 || static_cast<size_t>(first) == length || first < 2)
+                return first;
+            ssize_t rest = sendPieces(fd, data + first, length - static_cast<size_t>(first), length);
+            return rest < 0 ? first : first + rest;
+        }
+        default:
+            return sendPieces(fd, data, length, length);
+        }
+    }
+
+    // Drops the connection once its lifetime is over, both directions see EOF / an error
+    bool dropDue(FaultTransport::State &state, int fd)
+    {
+        if (FaultTransport::Clock::now() < state.dropAt)
+            return false;
+        if (state.dropAt != FaultTransport::Clock::time_point::min())
+        {
+            logFault("dropping connection", fd);
+            shutdown(fd, SHUT_RDWR);
+            state.dropAt = FaultTransport::Clock::time_point::min();
+        }
+        errno = ECONNRESET;
+        return true;
+    }
+}
+
+FaultTransport::State::State() : dropAt(Clock::time_point::max())
+{
+    if (settings.dropConnections)
+    {
+        std::uniform_int_distribution<int> lifetime(settings.dropDelayMsMin, std::max(settings.dropDelayMsMin, settings.dropDelayMsMax));
+        dropAt = Clock::now() + std::chrono::milliseconds(lifetime(generator()));
+    }
+}
+
+bool FaultTransport::load(const std::string &path)
+{
+    std::ifstream file(path);
+    if (!file)
+        return false;
+
+    std::string line;
+    while (std::getline(file, line))
+    {
+        std::istringstream fields(line);
+        std::string key;
+        double value;
+        if (!(fields >> key) || key[0] == '#')
+            continue;
+        if (!(fields >> value))
+        {
+            LOG_WARN("Fault injection: no value for " + key);
+            continue;
+        }
+
+        if (key == "Send__1B_Sends")
+            settings.send1BSends = value;
+        else if (key == "Send__2B_Sends")
+            settings.send2BSends = value;
+        else if (key == "Send__2_Separate_Sends")
+            settings.send2SeparateSends = value;
+        else if (key == "Send__2B_Sends_And_Second_Send")
+            settings.send2BSendsAndSecondSend = value;
+        else if (key == "Recv__1B_Less")
+            settings.recv1BLess = value;
+        else if (key == "Recv__2B_Less")
+            settings.recv2BLess = value;
+        else if (key == "Recv__Half")
+            settings.recvHalf = value;
+        else if (key == "Recv__2B")
+            settings.recv2B = value;
+        else if (key == "Send_Delay_Ms_Mean")
+            settings.sendDelayMsMean = value;
+        else if (key == "Send_Delay_Ms_Sigma")
+            settings.sendDelayMsSigma = value;
+        else if (key == "Drop_Connections")
+            settings.dropConnections = value != 0;
+        else if (key == "Drop_Connection_Delay_Ms_Min")
+            settings.dropDelayMsMin = static_cast<int>(value);
+        else if (key == "Drop_Connection_Delay_Ms_Max")
+            settings.dropDelayMsMax = static_cast<int>(value);
+        else if (key == "Log_Enabled")
+            settings.logEnabled = value != 0;
+        else
+            LOG_WARN("Fault injection: unknown setting " + key);
+    }
+    LOG_INFO("Fault injection enabled from " + path);
+    return true;
+}
+
+ssize_t FaultTransport::recv(State &state, int fd, void *buffer, size_t length)
+{
+    if (dropDue(state, fd))
+        return -1;
+
+    // Short reads need to know what is waiting, the rest stays for the next call
+    int available = 0;
+    int mode = pick({settings.recv1BLess, settings.recv2BLess, settings.recvHalf, settings.recv2B});
+    if (mode >= 0 && ioctl(fd, FIONREAD, &available) == 0 && available > 2)
+    {
+        size_t limit = static_cast<size_t>(available);
+        switch (mode)
+        {
+        case 0:
+            limit -= 1;
+            logFault("recv 1 byte less", fd);
+            break;
+        case 1:
+            limit -= 2;
+            logFault("recv 2 bytes less", fd);
+            break;
+        case 2:
+            limit /= 2;
+            logFault("recv half", fd);
+            break;
+        default:
+            limit = 2;
+            logFault("recv 2 bytes", fd);
+            break;
+        }
+        length = std::min(length, limit);
+    }
+    return ::recv(fd, buffer, length, 0);
+}
+
+ssize_t FaultTransport::sendmsg(State &state, int fd, const msghdr *msg)
+{
+    if (dropDue(state, fd))
+        return -1;
+
+    // The whole batch waits for one delay, the loop retries once heldUntil() has passed
+    if (settings.sendDelayMsMean > 0)
+    {
+        auto now = Clock::now();
+        if (state.sendAt == Clock::time_point{})
+        {
+            std::normal_distribution<double> delay(settings.sendDelayMsMean, settings.sendDelayMsSigma);
+            double ms = std::max(0.0, delay(generator()));
+            state.sendAt = now + std::chrono::microseconds(static_cast<int64_t>(ms * 1000));
+        }
+        if (now < state.sendAt)
+        {
+            errno = EAGAIN;
+            return -1;
+        }
+        state.sendAt = Clock::time_point{};
+    }
+
+    // Frame by frame, each one possibly fragmented into separate writes
+    size_t total = 0;
+    for (size_t i = 0; i < msg->msg_iovlen; ++i)
+    {
+        const iovec &part = msg->msg_iov[i];
+        ssize_t sent = sendFrame(fd, static_cast<const char *>(part.iov_base), part.iov_len);
+        if (sent < 0)
+            return total > 0 ? static_cast<ssize_t>(total) : -1;
+        total += static_cast<size_t>(sent);
+        if (static_cast<size_t>(sent) < part.iov_len)
+            break;
+    }
+    return static_cast<ssize_t>(total);
+}
+
+#endif
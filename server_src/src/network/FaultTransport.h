@@ -0,0 +1,49 @@
+/**
+ * Server for blackjack
+ * Author: Marek Manzel
+ *
+ * FaultTransport.h - Fault-injecting socket I/O for testing, see Transport.h
+ * Replays the faults of the external interceptor inside the server: sends
+ * split into 1 / 2 byte pieces or separate writes, short reads, delayed sends
+ * and connections dropped after a random lifetime. Probabilities come from
+ * an intcptor_config.cfg file loaded once at startup, after that the settings
+ * are read-only and each thread draws from its own generator.
+ * Only compiled with -DBJ_FAULT_INJECTION.
+ */
+
+#ifndef FAULT_TRANSPORT_H
+#define FAULT_TRANSPORT_H
+
+#ifdef BJ_FAULT_INJECTION
+
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <chrono>
+#include <string>
+
+class FaultTransport
+{
+public:
+    static constexpr bool INJECTS_FAULTS = true;
+    using Clock = std::chrono::steady_clock;
+
+    struct State
+    {
+        State();
+
+        Clock::time_point dropAt;     // connection is cut from then on, max() = never
+        Clock::time_point sendAt{};   // delayed output goes out then, default = not delayed
+    };
+
+    // Reads "Key value" lines, false if the file cannot be opened
+    static bool load(const std::string &path);
+
+    static ssize_t recv(State &state, int fd, void *buffer, size_t length);
+    static ssize_t sendmsg(State &state, int fd, const msghdr *msg);
+
+    static Clock::time_point heldUntil(const State &state) { return state.sendAt; }
+};
+
+#endif
+
+#endif
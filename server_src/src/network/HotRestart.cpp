@@ -0,0 +1,316 @@
+#include "HotRestart.h"
+#include "../core/Logger.h"
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <sys/time.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <utility>
+
+namespace
+{
+    constexpr char MAGIC[4] = {'B', 'J', 'H', 'R'};
+    constexpr uint32_t VERSION = 2;
+    // Descriptors per sendmsg, well below the kernel's SCM_MAX_FD
+    constexpr size_t FDS_PER_MESSAGE = 64;
+    // The new process has this long to start up and read its state
+    constexpr int TIMEOUT_SECONDS = 10;
+#ifndef CLOSE_RANGE_CLOEXEC
+    constexpr unsigned CLOSE_RANGE_CLOEXEC = 1U << 2;
+#endif
+
+    // Control buffer for one batch of descriptors, aligned for cmsghdr
+    union ControlBuffer
+    {
+        char data[CMSG_SPACE(sizeof(int) * FDS_PER_MESSAGE)];
+        cmsghdr align;
+    };
+
+    void putU32(std::string &out, uint32_t value)
+    {
+        out.append(reinterpret_cast<const char *>(&value), sizeof(value));
+    }
+
+    void putString(std::string &out, const std::string &value)
+    {
+        putU32(out, static_cast<uint32_t>(value.size()));
+        out += value;
+    }
+
+    // Bounds-checked reads out of the received state, a short blob fails instead of overrunning
+    class Reader
+    {
+    public:
+        explicit Reader(std::string blob) : data(std::move(blob)), pos(0), valid(true) {}
+
+        uint32_t u32()
+        {
+            uint32_t value = 0;
+            if (!take(sizeof(value)))
+                return 0;
+            std::memcpy(&value, data.data() + pos - sizeof(value), sizeof(value));
+            return value;
+        }
+        std::string string() { return raw(u32()); }
+        std::string raw(size_t size)
+        {
+            if (!take(size))
+                return "";
+            return data.substr(pos - size, size);
+        }
+        bool ok() const { return valid; }
+
+    private:
+        bool take(size_t size)
+        {
+            if (!valid || data.size() - pos < size)
+                return valid = false;
+            pos += size;
+            return true;
+        }
+
+        std::string data;
+        size_t pos;
+        bool valid;
+    };
+
+    void setTimeout(int fd, int option)
+    {
+        timeval timeout{TIMEOUT_SECONDS, 0};
+        setsockopt(fd, SOL_SOCKET, option, &timeout, sizeof(timeout));
+    }
+
+    bool sendAll(int fd, const char *data, size_t size)
+    {
+        while (size > 0)
+        {
+            ssize_t sent = send(fd, data, size, MSG_NOSIGNAL);
+            if (sent < 0)
+            {
+                if (errno == EINTR)
+                    continue;
+                return false;
+            }
+            data += sent;
+            size -= static_cast<size_t>(sent);
+        }
+        return true;
+    }
+
+    // Arguments this process was started with, the new one gets the same
+    std::vector<std::string> ownArguments()
+    {
+        std::ifstream file("/proc/self/cmdline", std::ios::binary);
+        std::string all((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+        std::vector<std::string> args;
+        size_t start = 0;
+        for (size_t end; (end = all.find('\0', start)) != std::string::npos; start = end + 1)
+            args.push_back(all.substr(start, end - start));
+        return args;
+    }
+}
+
+bool HotRestart::handOver(int listenFd, const std::vector<PlayerState> &players)
+{
+    std::vector<std::string> args = ownArguments();
+    if (args.empty())
+    {
+        LOG_ERROR("HotRestart: cannot read own command line");
+        return false;
+    }
+
+    // Descriptors travel separately in order: the listening socket, then every connected player
+    std::string blob(MAGIC, sizeof(MAGIC));
+    putU32(blob, VERSION);
+    putU32(blob, static_cast<uint32_t>(players.size()));
+    std::vector<int> fds{listenFd};
+    for (const PlayerState &player : players)
+    {
+        blob += static_cast<char>(player.fd >= 0);
+        putString(blob, player.nickname);
+        putU32(blob, static_cast<uint32_t>(player.credits));
+        putU32(blob, static_cast<uint32_t>(player.roomId));
+        putString(blob, player.input);
+        putString(blob, player.output);
+        blob += static_cast<char>(player.binary);
+        if (player.fd >= 0)
+            fds.push_back(player.fd);
+    }
+    uint64_t length = blob.size();
+    std::string stream(reinterpret_cast<const char *>(&length), sizeof(length));
+    stream += blob;
+
+    int pair[2];
+    if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, pair) < 0)
+    {
+        LOG_ERROR("HotRestart: socketpair failed: " + std::string(std::strerror(errno)));
+        return false;
+    }
+    setTimeout(pair[0], SO_SNDTIMEO);
+
+    // Prepared before the fork, the child only makes async-signal-safe calls
+    std::vector<char *> argv;
+    for (std::string &arg : args)
+        argv.push_back(arg.data());
+    argv.push_back(nullptr);
+    rlimit limit{};
+    int maxFd = getrlimit(RLIMIT_NOFILE, &limit) == 0 ? static_cast<int>(std::min<rlim_t>(limit.rlim_cur, 65536)) : 1024;
+    setenv(ENV_FD, std::to_string(pair[1]).c_str(), 1);
+
+    pid_t child = fork();
+    if (child == 0)
+    {
+        // Only the state socket survives the exec, the client sockets arrive through it
+#ifdef SYS_close_range
+        if (syscall(SYS_close_range, 3U, ~0U, CLOSE_RANGE_CLOEXEC) < 0)
+#endif
+        {
+            for (int fd = 3; fd < maxFd; ++fd)
+                fcntl(fd, F_SETFD, FD_CLOEXEC);
+        }
+        fcntl(pair[1], F_SETFD, 0);
+        execvp(argv[0], argv.data());
+        _exit(127);
+    }
+    unsetenv(ENV_FD);
+    close(pair[1]);
+    if (child < 0)
+    {
+        LOG_ERROR("HotRestart: fork failed: " + std::string(std::strerror(errno)));
+        close(pair[0]);
+        return false;
+    }
+    LOG_INFO("HotRestart: started " + args[0] + " as PID " + std::to_string(child) + ", handing over " + std::to_string(players.size()) +
+             " players on " + std::to_string(fds.size() - 1) + " connections");
+
+    // Every batch of descriptors rides on one byte of the stream, the rest follows plainly
+    size_t offset = 0;
+    bool sent = true;
+    for (size_t first = 0; first < fds.size() && sent; first += FDS_PER_MESSAGE)
+    {
+        size_t count = std::min(FDS_PER_MESSAGE, fds.size() - first);
+        ControlBuffer control{};
+        iovec iov{&stream[offset], 1};
+        msghdr msg{};
+        msg.msg_iov = &iov;
+        msg.msg_iovlen = 1;
+        msg.msg_control = control.data;
+        msg.msg_controllen = CMSG_SPACE(sizeof(int) * count);
+        cmsghdr *header = CMSG_FIRSTHDR(&msg);
+        header->cmsg_level = SOL_SOCKET;
+        header->cmsg_type = SCM_RIGHTS;
+        header->cmsg_len = CMSG_LEN(sizeof(int) * count);
+        std::memcpy(CMSG_DATA(header), &fds[first], sizeof(int) * count);
+
+        ssize_t written;
+        do
+            written = sendmsg(pair[0], &msg, MSG_NOSIGNAL);
+        while (written < 0 && errno == EINTR);
+        sent = written == 1;
+        ++offset;
+    }
+    sent = sent && sendAll(pair[0], stream.data() + offset, stream.size() - offset);
+
+    // The new process confirms once it holds everything
+    char ack = 0;
+    pollfd waiting{pair[0], POLLIN, 0};
+    bool confirmed = sent && poll(&waiting, 1, TIMEOUT_SECONDS * 1000) > 0 && read(pair[0], &ack, 1) == 1 && ack == 'K';
+    close(pair[0]);
+    if (!confirmed)
+        LOG_ERROR("HotRestart: new process did not take over");
+    return confirmed;
+}
+
+bool HotRestart::isInherited()
+{
+    return std::getenv(ENV_FD) != nullptr;
+}
+
+bool HotRestart::receive(int &listenFd, std::vector<PlayerState> &players)
+{
+    int sock = std::atoi(std::getenv(ENV_FD));
+    unsetenv(ENV_FD);
+    fcntl(sock, F_SETFD, FD_CLOEXEC);
+    setTimeout(sock, SO_RCVTIMEO);
+
+    std::vector<int> fds;
+    std::string stream;
+    uint64_t length = 0;
+    char buffer[64 * 1024];
+    bool ok = true;
+    while (ok && (stream.size() < sizeof(length) || stream.size() - sizeof(length) < length))
+    {
+        ControlBuffer control{};
+        iovec iov{buffer, sizeof(buffer)};
+        msghdr msg{};
+        msg.msg_iov = &iov;
+        msg.msg_iovlen = 1;
+        msg.msg_control = control.data;
+        msg.msg_controllen = sizeof(control.data);
+        ssize_t got = recvmsg(sock, &msg, MSG_CMSG_CLOEXEC);
+        if (got < 0 && errno == EINTR)
+            continue;
+        ok = got > 0 && !(msg.msg_flags & MSG_CTRUNC);
+        for (cmsghdr *header = CMSG_FIRSTHDR(&msg); ok && header != nullptr; header = CMSG_NXTHDR(&msg, header))
+        {
+            if (header->cmsg_level != SOL_SOCKET || header->cmsg_type != SCM_RIGHTS)
+                continue;
+            size_t count = (header->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+            const int *received = reinterpret_cast<const int *>(CMSG_DATA(header));
+            fds.insert(fds.end(), received, received + count);
+        }
+        if (got > 0)
+            stream.append(buffer, static_cast<size_t>(got));
+        if (stream.size() >= sizeof(length))
+            std::memcpy(&length, stream.data(), sizeof(length));
+    }
+
+    // Receiving stops at the announced length, only a complete, well-formed state is used
+    Reader reader(ok ? stream.substr(sizeof(length)) : std::string());
+    ok = ok && reader.raw(sizeof(MAGIC)) == std::string(MAGIC, sizeof(MAGIC)) && reader.u32() == VERSION;
+    uint32_t count = ok ? reader.u32() : 0;
+    size_t nextFd = 1;
+    for (uint32_t i = 0; ok && i < count; ++i)
+    {
+        PlayerState player;
+        bool connected = reader.raw(1) == std::string(1, '\1');
+        player.nickname = reader.string();
+        player.credits = static_cast<int>(reader.u32());
+        player.roomId = static_cast<int>(reader.u32());
+        player.input = reader.string();
+        player.output = reader.string();
+        player.binary = reader.raw(1) == std::string(1, '\1');
+        if (connected)
+        {
+            ok = nextFd < fds.size();
+            player.fd = ok ? fds[nextFd++] : -1;
+        }
+        ok = ok && reader.ok();
+        players.push_back(std::move(player));
+    }
+    ok = ok && !fds.empty() && nextFd == fds.size();
+
+    if (!ok)
+    {
+        LOG_ERROR("HotRestart: incomplete state from the old process");
+        for (int fd : fds)
+            close(fd);
+        players.clear();
+        close(sock);
+        return false;
+    }
+    listenFd = fds[0];
+    char ack = 'K';
+    bool confirmed = write(sock, &ack, 1) == 1;
+    close(sock);
+    return confirmed;
+}
@@ -0,0 +1,50 @@
+/**
+ * Server for blackjack
+ * Author: Marek Manzel
+ *
+ * HotRestart.h - Hands the listening socket and live players to a new process
+ * On SIGUSR2 the server drains its rounds like on shutdown, then starts its
+ * binary again with the same arguments. The new process finds a descriptor
+ * in BJ_RESTART_FD and reads its state from it: the listening socket and every
+ * client socket passed with SCM_RIGHTS, plus per player the nickname, credits,
+ * seat, wire format and not yet processed / not yet sent bytes. Clients keep
+ * their TCP connections and never see the restart beyond a fresh room snapshot.
+ * The handover happens between rounds, so no hands or shoes are carried over.
+ */
+
+#ifndef HOT_RESTART_H
+#define HOT_RESTART_H
+
+#include <string>
+#include <vector>
+
+class HotRestart
+{
+public:
+    // One player carried from the old process to the new one
+    struct PlayerState
+    {
+        int fd = -1; // -1 = disconnected session kept for reconnect
+        std::string nickname; // empty = connected, not logged in yet
+        int credits = 0;
+        int roomId = -1; // seated in this room, -1 = lobby
+        std::string input;  // received, not processed yet
+        std::string output; // queued, not sent yet
+        bool binary = false; // negotiated the binary wire format at login
+    };
+
+    // Names the descriptor the new process reads its state from
+    static constexpr const char *ENV_FD = "BJ_RESTART_FD";
+
+    // Old process, single-threaded by now (forks). Starts the binary again and sends it the state.
+    // True once the new process confirmed it took over; the descriptors are then open in both
+    // and the caller closes its copies without affecting the clients
+    static bool handOver(int listenFd, const std::vector<PlayerState> &players);
+
+    // New process: started by handOver()
+    static bool isInherited();
+    // New process: reads the state sent by handOver() and confirms it, false on any error
+    static bool receive(int &listenFd, std::vector<PlayerState> &players);
+};
+
+#endif
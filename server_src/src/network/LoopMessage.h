@@ -0,0 +1,73 @@
+/**
+ * Server for blackjack
+ * Author: Marek Manzel
+ *
+ * LoopMessage.h - Messages passed between the lobby loop and room shards
+ * Players and their connections are owned by exactly one loop at a time,
+ * moving them (JOIN, WATCH, LVRO, reconnect) or reporting on them is done only
+ * through these messages, never by touching the other loop's state.
+ * A message owns what it carries: the connection and the player by value.
+ */
+
+#ifndef LOOP_MESSAGE_H
+#define LOOP_MESSAGE_H
+
+#include "../game/Player.h"
+#include "../game/GameRoom.h"
+#include "ClientConnection.h"
+#include <memory>
+#include <optional>
+#include <string>
+
+// Lobby loop -> shard
+struct ShardMessage
+{
+    enum class Type
+    {
+        JOIN_ROOM,  // seat 'player' (arriving with 'conn') in 'roomId', created first if 'openRoom'
+        WATCH_ROOM, // like JOIN_ROOM, 'player' watches 'roomId' without a seat
+        REATTACH,   // 'conn' logged in as 'nickname', a disconnected player seated in 'roomId'
+        CLOSE_ROOM, // reclaim 'roomId' if it is still empty
+        DRAIN       // shutdown: finish the running rounds, then release the players ('restart') or disconnect them
+    };
+
+    explicit ShardMessage(Type t) : type(t) {}
+
+    Type type;
+    std::unique_ptr<ClientConnection> conn;
+    std::optional<Player> player;
+    int roomId = -1;
+    std::string nickname;
+    bool openRoom = false; // JOIN_ROOM / WATCH_ROOM: the lobby just allocated 'roomId', the shard has no room for it yet
+    bool restart = false;  // DRAIN: players go back to the lobby with their connections for a hot restart
+};
+
+// Shard -> lobby loop
+struct LobbyMessage
+{
+    enum class Type
+    {
+        RETURN_TO_LOBBY,  // 'player' left its room, 'conn' comes back with it
+        REATTACH_FAILED,  // session for 'nickname' was gone, 'conn' comes back without a player
+        SESSION_RETURNED, // 'player' is disconnected and no longer seated, lobby keeps it for reconnect
+        SESSION_PARKED,   // 'nickname' disconnected mid-round and stays seated in 'roomId'
+        PLAYER_DESTROYED, // 'nickname' was kicked from its room
+        ROOM_STATUS,      // 'roomId' now has 'playerCount' players and is in 'roomState'
+        ROOM_CLOSED,      // 'roomId' was reclaimed, the lobby may hand the ID out again
+        SHARD_DRAINED,    // the shard's rounds are over and its players released, sent after their messages
+        NEW_CONNECTION    // 'conn' was accepted on the shard's listener, the lobby registers it and asks for a login
+    };
+
+    explicit LobbyMessage(Type t) : type(t) {}
+
+    Type type;
+    std::unique_ptr<ClientConnection> conn;
+    std::optional<Player> player;
+    std::string nickname;
+    int roomId = -1;
+    int playerCount = 0;
+    GameState roomState = GameState::WAITING_FOR_PLAYERS;
+    bool wasConnected = false; // SESSION_RETURNED: the player was online until now
+};
+
+#endif
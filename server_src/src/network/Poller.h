@@ -0,0 +1,52 @@
+/**
+ * Server for blackjack
+ * Author: Marek Manzel
+ *
+ * Poller.h - Readiness notification abstraction used by the server event loop
+ * Hides the OS specific multiplexing call (epoll on Linux) behind a small
+ * interface, so each wakeup only reports descriptors that are actually ready.
+ * Other backends (kqueue, poll) only need to implement this interface.
+ */
+
+#ifndef POLLER_H
+#define POLLER_H
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+// Interest / readiness flags, independent of the backend
+enum PollFlags : uint32_t
+{
+    POLL_READABLE = 1u << 0,
+    POLL_WRITABLE = 1u << 1,
+    POLL_HANGUP = 1u << 2,
+    POLL_ERROR = 1u << 3
+};
+
+struct PollEvent
+{
+    int fd;
+    uint32_t events;
+};
+
+class Poller
+{
+public:
+    virtual ~Poller() = default;
+
+    // Registers a descriptor, notifications are edge-triggered:
+    // the owner has to drain the descriptor until EAGAIN on every wakeup
+    virtual bool add(int fd, uint32_t events) = 0;
+    virtual bool modify(int fd, uint32_t events) = 0;
+    virtual void remove(int fd) = 0;
+
+    // Blocks up to timeoutMs (-1 = forever) and fills 'ready' with the ready descriptors
+    // Returns number of events, 0 on timeout/interrupt, -1 on error
+    virtual int wait(std::vector<PollEvent> &ready, int timeoutMs) = 0;
+
+    // Creates the best backend available on this platform
+    static std::unique_ptr<Poller> create();
+};
+
+#endif
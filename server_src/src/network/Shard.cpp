@@ -0,0 +1,626 @@
+#include "Shard.h"
+#include "TcpServer.h"
+#include "../core/Logger.h"
+#include "../core/Metrics.h"
+#include <unistd.h>
+#include <algorithm>
+
+Shard::Shard(int idx, int shardCount, const Config &cfg, TcpServer &srv) : EventLoop(cfg), index(idx), count(shardCount), server(srv) {}
+
+Shard::~Shard()
+{
+    join();
+    closeListener();
+}
+
+bool Shard::setListener(int fd)
+{
+    if (!poller->add(fd, POLL_READABLE))
+    {
+        close(fd);
+        return false;
+    }
+    listenFd = fd;
+    return true;
+}
+
+bool Shard::openCommandLog(const std::string &path)
+{
+    if (!commandLog.open(path, config.seed, config.decks, now()))
+        return false;
+    LOG_INFO("Shard " + std::to_string(index) + ": Recording room commands to " + path);
+    return true;
+}
+
+void Shard::closeListener()
+{
+    if (listenFd == -1)
+        return;
+    poller->remove(listenFd);
+    close(listenFd);
+    listenFd = -1;
+}
+
+bool Shard::handleForeignEvent(const PollEvent &event)
+{
+    if (event.fd != listenFd)
+        return false;
+    int fd;
+    while ((fd = server.acceptConnection(listenFd)) >= 0)
+    {
+        Metrics::connections.add(1);
+        Metrics::accepted.add();
+        LOG_INFO("Shard " + std::to_string(index) + ": New client connected on FD " + std::to_string(fd));
+        // Logins are the lobby's, the connection is registered there
+        LobbyMessage msg{LobbyMessage::Type::NEW_CONNECTION};
+        msg.conn = std::make_unique<ClientConnection>(fd, config.sendHighWaterMark);
+        notifyLobby(std::move(msg));
+    }
+    return true;
+}
+
+void Shard::addRoom(int roomId)
+{
+    size_t slot = static_cast<size_t>(roomId / count);
+    while (rooms.size() <= slot)
+        rooms.emplace_back();
+    if (!rooms[slot])
+        rooms[slot].emplace(roomId, *this);
+}
+
+size_t Shard::getRoomCount() const
+{
+    size_t open = 0;
+    for (const auto &room : rooms)
+        open += room.has_value();
+    return open;
+}
+
+void Shard::start()
+{
+    thread = std::thread([this]()
+                         { runLoop(); });
+    LOG_INFO("Shard " + std::to_string(index) + ": Started with " + std::to_string(getRoomCount()) + " rooms");
+}
+
+void Shard::join()
+{
+    if (thread.joinable())
+    {
+        stop();
+        thread.join();
+        LOG_INFO("Shard " + std::to_string(index) + ": mailbox high-water " + std::to_string(mailbox.getHighWater()) + "/" +
+                     std::to_string(mailbox.capacity()) + ", rejected " + std::to_string(mailbox.getRejected()));
+    }
+}
+
+bool Shard::post(ShardMessage &message)
+{
+    if (!mailbox.post(message))
+        return false;
+    wakeup();
+    return true;
+}
+
+void Shard::notifyLobby(LobbyMessage msg)
+{
+    postOrDefer([this, msg = std::move(msg)]() mutable
+                { return server.postToLobby(msg); });
+}
+
+GameRoom *Shard::findRoom(int roomId)
+{
+    size_t slot = static_cast<size_t>(roomId / count);
+    if (roomId < 0 || roomId % count != index || slot >= rooms.size() || !rooms[slot])
+        return nullptr;
+    return &*rooms[slot];
+}
+
+Player *Shard::findPlayer(int fd)
+{
+    return players.findByFd(fd);
+}
+
+void Shard::onMessage(Player &player, const MessageView &msg)
+{
+    PlayerHandle id = players.handleOf(player.getFd());
+    if (player.getState() == PlayerState::SPECTATING)
+    {
+        handleSpectatorMessage(id, msg);
+        return;
+    }
+    if (msg.command == Command::LEAVE_ROOM)
+    {
+        handleLeaveRoom(id);
+        return;
+    }
+
+    // Forward message to the appropriate game room
+    GameRoom *room = findRoom(player.getRoomId());
+    if (room != nullptr)
+    {
+        commandLog.command(now(), room->getId(), player, msg);
+        room->handle(id, msg);
+    }
+    else
+    {
+        LOG_ERROR("Shard: Player FD " + std::to_string(player.getFd()) + " is in unknown room " + std::to_string(player.getRoomId()));
+    }
+}
+
+void Shard::handleLeaveRoom(PlayerHandle id)
+{
+    // Player wants to leave the game room
+    Player &player = *players.get(id);
+    GameRoom *room = findRoom(player.getRoomId());
+    if (room == nullptr)
+    {
+        LOG_ERROR("Shard: Player FD " + std::to_string(player.getFd()) + " is in unknown room " + std::to_string(player.getRoomId()));
+        sendMessage(player.getFd(), "NACKLVRO", "Not in a valid room");
+        return;
+    }
+
+    commandLog.left(now(), room->getId(), player);
+    room->removePlayer(id);
+    sendMessage(player.getFd(), "ACK_LVRO", " ");
+    if (room->getPlayerCount() == 0)
+    {
+        commandLog.reset(now(), room->getId());
+        room->ResetDefaultState();
+        LOG_INFO("Shard: Room " + std::to_string(room->getId()) + " reset to default state (no players left)");
+    }
+    else if (room->getState() == GameState::WAITING_FOR_PLAYERS) // Only broadcast if in waiting state - avoid mid-game updates
+    {
+        room->broadcastRoomState();
+    }
+    publishRoomStatus(*room);
+    returnToLobby(id);
+}
+
+void Shard::handleSpectatorMessage(PlayerHandle id, const MessageView &msg)
+{
+    Player &spectator = *players.get(id);
+    GameRoom *room = findRoom(spectator.getRoomId());
+    if (room == nullptr)
+    {
+        LOG_ERROR("Shard: Spectator FD " + std::to_string(spectator.getFd()) + " is in unknown room " + std::to_string(spectator.getRoomId()));
+        return;
+    }
+
+    switch (msg.command)
+    {
+    case Command::LEAVE_ROOM:
+        room->removeSpectator(id);
+        sendMessage(spectator.getFd(), "ACK_LVRO", " ");
+        returnToLobby(id);
+        break;
+    case Command::RECONNECT_GAME:
+        room->sendSpectatorSnapshot(id);
+        break;
+    default:
+        spectator.incrementInvalidMsg();
+        sendMessage(spectator.getFd(), "NACK_CMD", "Spectators cannot play");
+        if (spectator.getInvalidMsgCount() > 5)
+        {
+            LOG_ERROR("Shard: Spectator " + spectator.getNickname() + " exceeded invalid message limit in room " + std::to_string(room->getId()));
+            Metrics::invalidMessageKicks.add();
+            sendMessage(spectator.getFd(), "DISCONNECT", "Too many invalid messages");
+            room->removeSpectator(id);
+            destroyPlayer(id);
+        }
+        break;
+    }
+}
+
+void Shard::onDisconnect(int fd)
+{
+    PlayerHandle id = players.handleOf(fd);
+    Player *player = players.get(id);
+    if (player == nullptr)
+        return;
+
+    players.detach(id);
+
+    GameRoom *room = findRoom(player->getRoomId());
+    if (player->getState() == PlayerState::SPECTATING)
+    {
+        // Nothing to keep for a spectator, the session goes back as a lobby player
+        if (room != nullptr)
+            room->removeSpectator(id);
+        LobbyMessage msg{LobbyMessage::Type::SESSION_RETURNED};
+        msg.nickname = player->getNickname();
+        msg.player = players.take(id);
+        msg.wasConnected = true;
+        notifyLobby(std::move(msg));
+    }
+    else if (room != nullptr && room->getState() != GameState::PLAYING)
+    {
+        commandLog.left(now(), room->getId(), *player);
+        room->removePlayer(id);
+        room->broadcastRoomState();
+        publishRoomStatus(*room);
+
+        LobbyMessage msg{LobbyMessage::Type::SESSION_RETURNED};
+        msg.nickname = player->getNickname();
+        msg.player = players.take(id);
+        msg.wasConnected = true;
+        notifyLobby(std::move(msg));
+    }
+    else
+    {
+        // Mid-round the seat is kept, the player can reconnect into it
+        if (room != nullptr)
+            room->broadcastGameState();
+        armOfflineTimer(id);
+
+        LobbyMessage msg{LobbyMessage::Type::SESSION_PARKED};
+        msg.nickname = player->getNickname();
+        msg.roomId = player->getRoomId();
+        notifyLobby(std::move(msg));
+    }
+    LOG_DEBUG("Shard: Player flagged as disconnected on FD " + std::to_string(fd));
+}
+
+void Shard::onTick()
+{
+    // An update can queue further ones (e.g. offline players removed at reset), those run in the same pass
+    while (!pendingUpdates.empty())
+    {
+        std::vector<GameRoom *> due;
+        due.swap(pendingUpdates);
+        for (GameRoom *room : due)
+        {
+            if (!room->takeUpdateRequest())
+                continue;
+            // Round results stay up until a player continues, unless nobody is left to see them
+            if (room->getState() != GameState::ROUND_END || room->areAllPlayersOffline())
+            {
+                commandLog.update(now(), room->getId());
+                room->update();
+            }
+        }
+    }
+    // After the updates, so a spectator gets only the last snapshot of each kind per pass
+    for (GameRoom *room : pendingFanOuts)
+        room->fanOutToSpectators();
+    pendingFanOuts.clear();
+    if (draining && !drained)
+        checkDrain();
+    commandLog.flush(now(), std::chrono::seconds(1));
+}
+
+void Shard::onWakeup()
+{
+    if (drainReportPending)
+    {
+        drainReportPending = false;
+        notifyLobby(LobbyMessage{LobbyMessage::Type::SHARD_DRAINED});
+    }
+
+    mailbox.drain(inbox);
+    for (auto &msg : inbox)
+    {
+        switch (msg.type)
+        {
+        case ShardMessage::Type::JOIN_ROOM:
+            handleJoinRoom(msg);
+            break;
+        case ShardMessage::Type::WATCH_ROOM:
+            handleWatchRoom(msg);
+            break;
+        case ShardMessage::Type::REATTACH:
+            handleReattach(msg);
+            break;
+        case ShardMessage::Type::CLOSE_ROOM:
+            handleCloseRoom(msg.roomId);
+            break;
+        case ShardMessage::Type::DRAIN:
+            handleDrain(msg.restart);
+            break;
+        }
+    }
+    inbox.clear();
+}
+
+void Shard::handleJoinRoom(ShardMessage &msg)
+{
+    int fd = msg.conn->getFd();
+    if (msg.openRoom)
+    {
+        addRoom(msg.roomId);
+        LOG_INFO("Shard " + std::to_string(index) + ": Opened room " + std::to_string(msg.roomId));
+    }
+    GameRoom *room = findRoom(msg.roomId);
+
+    // The lobby only saw a possibly outdated room status, the room decides
+    if (room == nullptr || room->getPlayerCount() >= MAX_PLAYERS || room->getState() != GameState::WAITING_FOR_PLAYERS || draining)
+    {
+        LOG_ERROR("Shard: Room " + std::to_string(msg.roomId) + " cannot take player FD " + std::to_string(fd));
+        msg.conn->queueOutput(makeFrame(msg.conn->getWireFormat(), "NACK_JON", "Cannot join room"));
+        if (room != nullptr)
+            publishRoomStatus(*room);
+
+        LobbyMessage back{LobbyMessage::Type::RETURN_TO_LOBBY};
+        back.nickname = msg.player->getNickname();
+        back.conn = std::move(msg.conn);
+        back.player = std::move(msg.player);
+        notifyLobby(std::move(back));
+        return;
+    }
+
+    msg.player->setRoomId(msg.roomId);
+    msg.player->setState(PlayerState::IN_GAMEROOM);
+    PlayerHandle id = players.add(std::move(*msg.player));
+    commandLog.seated(now(), msg.roomId, *players.get(id));
+    room->addPlayer(id);
+    LOG_INFO("Shard: Player FD " + std::to_string(fd) + " assigned to room " + std::to_string(msg.roomId));
+
+    if (!adoptConnection(std::move(msg.conn)))
+        return;
+    sendMessage(fd, "ACK__JON", std::to_string(msg.roomId));
+    room->broadcastRoomState();
+    publishRoomStatus(*room);
+    resumeConnection(fd);
+}
+
+void Shard::handleWatchRoom(ShardMessage &msg)
+{
+    int fd = msg.conn->getFd();
+    if (msg.openRoom)
+    {
+        addRoom(msg.roomId);
+        LOG_INFO("Shard " + std::to_string(index) + ": Opened room " + std::to_string(msg.roomId));
+    }
+    GameRoom *room = findRoom(msg.roomId);
+
+    if (room == nullptr || draining)
+    {
+        LOG_ERROR("Shard: Room " + std::to_string(msg.roomId) + " cannot take spectator FD " + std::to_string(fd));
+        msg.conn->queueOutput(makeFrame(msg.conn->getWireFormat(), "NACK_WAT", "Cannot watch room"));
+
+        LobbyMessage back{LobbyMessage::Type::RETURN_TO_LOBBY};
+        back.nickname = msg.player->getNickname();
+        back.conn = std::move(msg.conn);
+        back.player = std::move(msg.player);
+        notifyLobby(std::move(back));
+        return;
+    }
+
+    PlayerHandle id = players.add(std::move(*msg.player));
+    if (!adoptConnection(std::move(msg.conn)))
+        return;
+    sendMessage(fd, "ACK__WAT", std::to_string(msg.roomId));
+    room->addSpectator(id);
+    resumeConnection(fd);
+}
+
+void Shard::handleCloseRoom(int roomId)
+{
+    GameRoom *room = findRoom(roomId);
+    if (room == nullptr)
+        return;
+    // A player may have been seated since the lobby's last report, the room then stays
+    if (room->getPlayerCount() > 0 || room->getState() != GameState::WAITING_FOR_PLAYERS)
+    {
+        publishRoomStatus(*room);
+        return;
+    }
+
+    // Spectators do not keep a room open, they go back to the lobby
+    std::vector<PlayerHandle> spectators = room->getSpectators();
+    for (PlayerHandle id : spectators)
+    {
+        sendMessage(players.get(id)->getFd(), "ACK_LVRO", " ");
+        room->removeSpectator(id);
+        returnToLobby(id);
+    }
+    pendingUpdates.erase(std::remove(pendingUpdates.begin(), pendingUpdates.end(), room), pendingUpdates.end());
+    pendingFanOuts.erase(std::remove(pendingFanOuts.begin(), pendingFanOuts.end(), room), pendingFanOuts.end());
+    commandLog.closed(now(), roomId);
+    rooms[static_cast<size_t>(roomId / count)].reset();
+    LOG_INFO("Shard " + std::to_string(index) + ": Reclaimed idle room " + std::to_string(roomId));
+
+    LobbyMessage msg{LobbyMessage::Type::ROOM_CLOSED};
+    msg.roomId = roomId;
+    notifyLobby(std::move(msg));
+}
+
+void Shard::handleDrain(bool restart)
+{
+    if (draining)
+        return;
+    draining = true;
+    drainForRestart = restart;
+    // Clients still queued on it are reset, they reconnect to the lobby listener or the new process
+    closeListener();
+    drainTimer = getTimers().schedule(now() + std::chrono::seconds(config.drainTimeout), [this]()
+                                      {
+                                          drainTimer = 0;
+                                          drainTimedOut = true; });
+    LOG_INFO("Shard " + std::to_string(index) + ": Draining, running rounds get " + std::to_string(config.drainTimeout) + " s");
+}
+
+void Shard::checkDrain()
+{
+    if (!drainTimedOut)
+    {
+        for (const auto &room : rooms)
+        {
+            if (room && room->getState() != GameState::WAITING_FOR_PLAYERS && room->getState() != GameState::ROUND_END)
+                return;
+        }
+    }
+    finishDrain();
+}
+
+void Shard::finishDrain()
+{
+    drained = true;
+    getTimers().cancel(drainTimer);
+    for (auto &room : rooms)
+    {
+        if (!room || room->getState() == GameState::WAITING_FOR_PLAYERS)
+            continue;
+        if (room->getState() != GameState::ROUND_END)
+            LOG_WARN("Shard " + std::to_string(index) + ": Drain timeout, calling off the round in room " + std::to_string(room->getId()));
+        commandLog.abort(now(), room->getId());
+        room->abortRound();
+    }
+    // Spectators leave their rooms first, they come back as lobby players
+    for (auto &room : rooms)
+    {
+        if (!room)
+            continue;
+        std::vector<PlayerHandle> spectators = room->getSpectators();
+        for (PlayerHandle id : spectators)
+            room->removeSpectator(id);
+    }
+
+    // Collected first, returning a player takes it out of the table
+    std::vector<PlayerHandle> seated;
+    players.forEach([this, &seated](PlayerHandle id, Player &player)
+                    {
+                        persistCredits(player);
+                        seated.push_back(id); });
+    for (PlayerHandle id : seated)
+    {
+        if (drainForRestart)
+        {
+            // Keeps its room ID, the new process seats it there again
+            returnToLobby(id);
+            continue;
+        }
+        int fd = players.get(id)->getFd();
+        if (fd >= 0)
+        {
+            sendMessage(fd, "DISCONNECT", "Server shutting down");
+            scheduleDisconnect(fd);
+        }
+    }
+    LOG_INFO("Shard " + std::to_string(index) + ": Drained, " + std::to_string(seated.size()) + " players released");
+    commandLog.flush(now());
+    drainReportPending = true;
+    wakeup();
+}
+
+void Shard::handleReattach(ShardMessage &msg)
+{
+    int fd = msg.conn->getFd();
+    GameRoom *room = findRoom(msg.roomId);
+    PlayerHandle id = room != nullptr ? room->findPlayer(msg.nickname) : PlayerHandle{};
+    Player *player = players.get(id);
+
+    // Only a seat whose owner is disconnected can be taken over
+    if (player == nullptr || player->getFd() >= 0)
+    {
+        LobbyMessage back{LobbyMessage::Type::REATTACH_FAILED};
+        back.conn = std::move(msg.conn);
+        back.nickname = msg.nickname;
+        notifyLobby(std::move(back));
+        return;
+    }
+
+    // reconnecting disconnected player
+    players.attach(id, fd);
+    commandLog.offline(now(), msg.roomId, *player, false);
+    room->setPlayerOffline(id, false);
+    player->refreshLastActivity(now());
+    player->resetInvalidMsgCount();
+
+    if (!adoptConnection(std::move(msg.conn)))
+        return;
+    sendMessage(fd, "ACK__REC", msg.nickname + ";" + std::to_string(player->getCredits()) + ";" + std::to_string(player->getRoomId()));
+    LOG_INFO("Shard: Player FD " + std::to_string(fd) + " reconnected with nickname " + player->getNickname() + " into room " + std::to_string(msg.roomId));
+    resumeConnection(fd);
+}
+
+void Shard::armOfflineTimer(PlayerHandle id)
+{
+    Player &player = *players.get(id);
+    int roomId = player.getRoomId();
+    getTimers().schedule(player.getLastActivity() + Player::OFFLINE_TIMEOUT, [this, id, roomId]()
+                         {
+                             // The handle goes stale once the seat is given up, the FD is set again on takeover
+                             Player *player = players.get(id);
+                             GameRoom *room = findRoom(roomId);
+                             if (player == nullptr || player->getFd() >= 0 || room == nullptr)
+                                 return;
+                             if (now() - player->getLastActivity() < Player::OFFLINE_TIMEOUT)
+                                 return;
+                             commandLog.offline(now(), roomId, *player, true);
+                             room->setPlayerOffline(id, true);
+                             LOG_INFO("Shard: Player " + player->getNickname() + " is offline in room " + std::to_string(roomId)); });
+}
+
+void Shard::publishRoomStatus(const GameRoom &room)
+{
+    LobbyMessage msg{LobbyMessage::Type::ROOM_STATUS};
+    msg.roomId = room.getId();
+    msg.playerCount = room.getPlayerCount();
+    msg.roomState = room.getState();
+    notifyLobby(std::move(msg));
+}
+
+void Shard::returnToLobby(PlayerHandle id)
+{
+    auto player = players.take(id);
+    if (!player)
+        return;
+    int fd = player->getFd();
+    if (fd < 0)
+    {
+        // Not connected any more, only the session goes back
+        LobbyMessage msg{LobbyMessage::Type::SESSION_RETURNED};
+        msg.nickname = player->getNickname();
+        msg.player = std::move(player);
+        notifyLobby(std::move(msg));
+        return;
+    }
+
+    scheduleHandoff(fd, [this, player = std::move(*player)](std::unique_ptr<ClientConnection> conn) mutable
+                    {
+                        LobbyMessage msg{LobbyMessage::Type::RETURN_TO_LOBBY};
+                        msg.nickname = player.getNickname();
+                        msg.conn = std::move(conn);
+                        msg.player = std::move(player);
+                        notifyLobby(std::move(msg)); });
+}
+
+void Shard::evictPlayer(PlayerHandle id)
+{
+    auto player = players.take(id);
+    if (!player)
+        return;
+    int fd = player->getFd();
+    bool connected = fd >= 0;
+    if (connected)
+    {
+        // Still connected but unresponsive, the connection goes away with the seat
+        scheduleDisconnect(fd);
+    }
+    player->setFd(-1);
+
+    LobbyMessage msg{LobbyMessage::Type::SESSION_RETURNED};
+    msg.nickname = player->getNickname();
+    msg.player = std::move(player);
+    msg.wasConnected = connected;
+    notifyLobby(std::move(msg));
+}
+
+void Shard::destroyPlayer(PlayerHandle id)
+{
+    auto player = players.take(id);
+    if (!player)
+        return;
+    int fd = player->getFd();
+    if (fd >= 0)
+    {
+        // DISCONNECT notice is flushed before the close at the end of the pass
+        scheduleDisconnect(fd);
+    }
+
+    LobbyMessage msg{LobbyMessage::Type::PLAYER_DESTROYED};
+    msg.nickname = player->getNickname();
+    notifyLobby(std::move(msg));
+    LOG_DEBUG("Shard: Player destroyed on FD " + std::to_string(fd));
+}
@@ -0,0 +1,160 @@
+/**
+ * Server for blackjack
+ * Author: Marek Manzel
+ *
+ * Shard.h - Worker event loop owning a subset of the game rooms
+ * Each shard runs on its own thread and owns its rooms together with the
+ * connections of the players seated in them. Rooms and seated players are only
+ * ever touched from the shard thread; players move in and out through the
+ * lobby <-> shard handoff messages in LoopMessage.h. Seated players, connected
+ * or not, live in the shard's PlayerTable.
+ * Room r belongs to shard r % count and sits in slot r / count of the
+ * shard's room slab, so lookups are an index and room addresses never change
+ * (timers and pending updates point at them). The lobby opens rooms on demand
+ * with the first JOIN and reclaims them again once they were empty long enough.
+ * On shutdown the shard drains: no new rounds start, running ones get the
+ * drain timeout to reach ROUND_END, then the players are disconnected or, for
+ * a hot restart, handed back to the lobby with their connections.
+ * With SO_REUSEPORT enabled every shard also owns a listening socket on the
+ * server port; what it accepts goes straight to the lobby for the login.
+ * Spectators are shard players without a seat. Rooms queue their snapshots
+ * for them and the shard fans them out once per pass, after the room updates.
+ * The shard is the RoomHost of its rooms and can record every call it makes
+ * into them to a CommandLog, which bench/bj_sim replays without a network.
+ * With a RoundJournal configured its rooms journal every step of their rounds.
+ */
+
+#ifndef SHARD_H
+#define SHARD_H
+
+#include "EventLoop.h"
+#include "LoopMessage.h"
+#include "../core/Mailbox.h"
+#include "../game/CommandLog.h"
+#include "../game/GameRoom.h"
+#include "../game/RoomHost.h"
+#include "../game/PlayerTable.h"
+#include <deque>
+#include <memory>
+#include <optional>
+#include <thread>
+#include <vector>
+
+class TcpServer;
+
+class Shard : public EventLoop, public RoomHost
+{
+public:
+    // Shard 'index' of 'count'
+    Shard(int index, int count, const Config &config, TcpServer &server);
+    ~Shard() override;
+
+    // Creates a room owned by this shard, before start() or from the shard thread
+    void addRoom(int roomId);
+    // Takes over a listening socket to accept on, before start(). False if it cannot be watched
+    bool setListener(int fd);
+    // Records the room inputs to 'path' from now on, before start(). False if it cannot be created
+    bool openCommandLog(const std::string &path);
+    // Rooms created from now on journal their rounds into 'roundJournal', before start()
+    void setJournal(RoundJournal *roundJournal) { journal = roundJournal; }
+
+    void start();
+    // Stops the loop and waits for the thread
+    void join();
+
+    // Thread-safe, called from the lobby loop. Moves from 'message' only on success,
+    // false if the mailbox is full (the lobby retries later)
+    bool post(ShardMessage &message);
+
+    const Mailbox<ShardMessage> &getMailbox() const { return mailbox; }
+
+    int getIndex() const { return index; }
+    // Shutting down, rooms do not start new rounds
+    bool isDraining() const override { return draining; }
+    PlayerTable &getPlayers() override { return players; }
+
+    // RoomHost, called by the rooms of this shard (shard thread only)
+    const Config &getConfig() const override { return EventLoop::getConfig(); }
+    TimerWheel &getTimers() override { return EventLoop::getTimers(); }
+    TimerWheel::Clock::time_point now() const override { return EventLoop::now(); }
+    WireFormat getWireFormat(int fd) const override { return EventLoop::getWireFormat(fd); }
+    void sendMessage(int fd, const std::string &command, const std::string &args) override { EventLoop::sendMessage(fd, command, args); }
+    void sendFrame(int fd, const Frame &frame, uint8_t snapshotKind = SNAPSHOT_NONE) override { EventLoop::sendFrame(fd, frame, snapshotKind); }
+    void persistCredits(const Player &player) override { EventLoop::persistCredits(player); }
+    // Reports player count / state of a room to the lobby
+    void publishRoomStatus(const GameRoom &room) override;
+    // Runs room.update() on this pass's tick, see GameRoom::requestUpdate()
+    void scheduleRoomUpdate(GameRoom &room) override { pendingUpdates.push_back(&room); }
+    // Runs room.fanOutToSpectators() on this pass's tick, after the updates
+    void scheduleSpectatorFanOut(GameRoom &room) override { pendingFanOuts.push_back(&room); }
+    // Player was removed from its room and goes back to the lobby with its connection
+    // The handle is stale afterwards
+    void returnToLobby(PlayerHandle player) override;
+    // Offline player was removed from its room at round reset, the lobby keeps the session
+    void evictPlayer(PlayerHandle player) override;
+    // Player was removed from its room and is dropped completely (invalid message limit)
+    void destroyPlayer(PlayerHandle player) override;
+    CommandLog *getCommandLog() override { return commandLog.isOpen() ? &commandLog : nullptr; }
+    RoundJournal *getJournal() override { return journal; }
+
+protected:
+    Player *findPlayer(int fd) override;
+    void onMessage(Player &player, const MessageView &msg) override;
+    void onDisconnect(int fd) override;
+    void onTick() override;
+    void onWakeup() override;
+    bool handleForeignEvent(const PollEvent &event) override;
+
+private:
+    void handleJoinRoom(ShardMessage &msg);
+    void handleWatchRoom(ShardMessage &msg);
+    // Messages of a player in SPECTATING state, only LVRO and REC__GAM are accepted
+    void handleSpectatorMessage(PlayerHandle spectator, const MessageView &msg);
+    void handleReattach(ShardMessage &msg);
+    void handleLeaveRoom(PlayerHandle player);
+    void handleCloseRoom(int roomId);
+    void handleDrain(bool restart);
+    void closeListener();
+    // Ends the drain once every room is between rounds or the drain timeout passed
+    void checkDrain();
+    void finishDrain();
+    GameRoom *findRoom(int roomId);
+    size_t getRoomCount() const;
+    // Marks a player that disconnected mid-round offline once OFFLINE_TIMEOUT has passed
+    void armOfflineTimer(PlayerHandle player);
+    // Posts to the lobby mailbox, retried from this loop while it is full
+    void notifyLobby(LobbyMessage msg);
+
+    int index;
+    int count;
+    TcpServer &server;
+    std::thread thread;
+    // SO_REUSEPORT listener, -1 = the lobby accepts alone
+    int listenFd = -1;
+
+    // Declared before the rooms, which keep a reference to it
+    PlayerTable players;
+    // Slot roomId / count, empty once reclaimed. A deque keeps the rooms in place as it grows
+    std::deque<std::optional<GameRoom>> rooms;
+    // Rooms due for re-evaluation, idle rooms cost nothing per pass
+    std::vector<GameRoom *> pendingUpdates;
+    // Rooms with snapshots queued for their spectators
+    std::vector<GameRoom *> pendingFanOuts;
+
+    bool draining = false;
+    bool drainForRestart = false;
+    bool drainTimedOut = false;
+    bool drained = false;
+    // SHARD_DRAINED goes out on the pass after the players' handoffs were posted
+    bool drainReportPending = false;
+    TimerWheel::TimerId drainTimer = 0;
+
+    CommandLog commandLog;
+    // Owned by the server, outlives the shard thread
+    RoundJournal *journal = nullptr;
+
+    Mailbox<ShardMessage> mailbox;
+    std::vector<ShardMessage> inbox;
+};
+
+#endif
@@ -1,48 +1,54 @@
 #include "TcpServer.h"
 #include "../core/Logger.h"
-#include "../protocol/Parser.h"
+#include "../core/Metrics.h"
 #include <sys/socket.h>
 #include <netinet/in.h>
 #include <unistd.h>
-#include <fcntl.h>
 #include <arpa/inet.h>
+#include <algorithm>
 #include <cstring>
-#include <vector>
-#include <chrono>
+#include <random>
+#include <thread>
 
 TcpServer::TcpServer(const Config &cfg)
-    : lobby(*this), config(cfg), serverSocket(-1), isRunning(false), maxFd(0)
+    : EventLoop(cfg), lobby(*this), serverSocket(-1)
 {
-    FD_ZERO(&masterSet);
+    setConnectionCount(&connectionCount);
 }
 
 TcpServer::~TcpServer()
 {
-    if (serverSocket != -1)
-        close(serverSocket);
-    // Cleanup connections
-    for (auto &pair : connections)
+    if (admin)
+        admin->stop();
+    // Shards post to the lobby loop, stop them first
+    for (auto &shard : shards)
     {
-        delete pair.second;
+        shard->join();
     }
+    LOG_INFO("Lobby: mailbox high-water " + std::to_string(mailbox.getHighWater()) + "/" + std::to_string(mailbox.capacity()) +
+                 ", rejected " + std::to_string(mailbox.getRejected()));
+    if (serverSocket != -1)
+        close(serverSocket);
 }
 
-void TcpServer::initSocket()
+int TcpServer::openListener()
 {
-    serverSocket = socket(AF_INET, SOCK_STREAM, 0);
-    if (serverSocket < 0)
+    int listenFd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (listenFd < 0)
     {
-        Logger::error("Failed to create socket");
+        LOG_ERROR("Failed to create socket");
         exit(EXIT_FAILURE);
     }
 
     // Allow immediate port reuse after restart
     int opt = 1;
-    setsockopt(serverSocket, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
-
-    // Set non-blocking
-    int flags = fcntl(serverSocket, F_GETFL, 0);
-    fcntl(serverSocket, F_SETFL, flags | O_NONBLOCK);
+    setsockopt(listenFd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
+    // Every listener of the group needs it, the lobby's included; the kernel spreads new connections over them
+    if (config.reusePort && setsockopt(listenFd, SOL_SOCKET, SO_REUSEPORT, &opt, sizeof(opt)) < 0)
+    {
+        LOG_ERROR("Failed to enable SO_REUSEPORT");
+        exit(EXIT_FAILURE);
+    }
 
     sockaddr_in addr;
     memset(&addr, 0, sizeof(addr));
@@ -51,281 +57,427 @@ void TcpServer::initSocket()
         addr.sin_addr.s_addr = INADDR_ANY;
     else if (inet_pton(AF_INET, config.ipAddress.c_str(), &addr.sin_addr) <= 0)
     {
-        Logger::error("Invalid IP address: " + config.ipAddress);
+        LOG_ERROR("Invalid IP address: " + config.ipAddress);
         exit(EXIT_FAILURE);
     }
     addr.sin_port = htons(config.port);
 
-    if (bind(serverSocket, (struct sockaddr *)&addr, sizeof(addr)) < 0)
+    if (bind(listenFd, (struct sockaddr *)&addr, sizeof(addr)) < 0)
     {
-        Logger::error("Failed to bind to port " + std::to_string(config.port));
+        LOG_ERROR("Failed to bind to port " + std::to_string(config.port));
         exit(EXIT_FAILURE);
     }
 
-    if (listen(serverSocket, 10) < 0)
+    // A reconnect storm fills a short queue at once, SYNs beyond it are dropped (capped by net.core.somaxconn)
+    if (listen(listenFd, config.listenBacklog) < 0)
     {
-        Logger::error("Failed to listen");
+        LOG_ERROR("Failed to listen");
         exit(EXIT_FAILURE);
     }
+    return listenFd;
+}
+
+void TcpServer::initSocket()
+{
+    // Inherited from the previous process on a hot restart, already bound and listening
+    if (serverSocket == -1)
+        serverSocket = openListener();
 
-    FD_SET(serverSocket, &masterSet);
-    maxFd = serverSocket;
-    Logger::info("Server listening on port " + std::to_string(config.port));
+    if (!poller->add(serverSocket, POLL_READABLE))
+    {
+        LOG_ERROR("Failed to register listening socket");
+        exit(EXIT_FAILURE);
+    }
+    LOG_INFO("Server listening on port " + std::to_string(config.port));
 
-    GameRoom::setServer(this);
-    // Initialize game rooms in the lobby
+    // Initialize the room directory in the lobby
     if (!lobby.initGamerooms(config.rooms))
     {
-        Logger::error("Failed to initialize game rooms");
+        LOG_ERROR("Failed to initialize game rooms");
         exit(EXIT_FAILURE);
     }
 }
 
-void TcpServer::run()
+void TcpServer::initShards()
 {
-    initSocket();
-    isRunning = true;
-
-    auto lastTask = std::chrono::steady_clock::now();
-
-    while (isRunning)
+    // 0 workers = one per core, more shards than rooms can ever use would idle
+    int workers = config.workers;
+    if (workers <= 0)
+        workers = static_cast<int>(std::thread::hardware_concurrency());
+    workers = std::max(1, std::min(workers, config.maxRooms));
+
+    // Shards copy the config, fix the seed first so every room derives from the logged one
+    if (config.seed == 0)
     {
-        fd_set readFds = masterSet;
-        // 1-second timeout for select to allow periodic cleanup tasks
-        struct timeval tv = {1, 0};
-
-        int activity = select(maxFd + 1, &readFds, nullptr, nullptr, &tv);
+        std::random_device device;
+        config.seed = (static_cast<uint64_t>(device()) << 32) | device();
+    }
+    LOG_INFO("Server shoe seed " + std::to_string(config.seed) + ", " + std::to_string(config.decks) + " decks per room");
+    // Records the seed, the rooms open their rings in it
+    initJournal();
 
-        if (activity < 0 && errno != EINTR)
+    for (int i = 0; i < workers; ++i)
+    {
+        shards.push_back(std::make_unique<Shard>(i, workers, config, *this));
+        shards.back()->setCreditStore(credits.get());
+        shards.back()->setJournal(journal.get());
+        shards.back()->setConnectionCount(&connectionCount);
+        if (config.reusePort && !shards.back()->setListener(openListener()))
         {
-            Logger::error("Select error");
-            break;
+            LOG_ERROR("Failed to register listening socket of shard " + std::to_string(i));
+            exit(EXIT_FAILURE);
         }
-
-        if (activity > 0)
+        // The PID keeps the logs of a hot restart's old and new process apart
+        if (!config.commandLog.empty() && !shards.back()->openCommandLog(config.commandLog + "." + std::to_string(getpid()) + "." + std::to_string(i)))
         {
-            // 1. Check for new incoming connections
-            if (FD_ISSET(serverSocket, &readFds))
-            {
-                handleNewConnection();
-            }
-
-            // 2. Check data from existing clients
-            // Create a list of FDs to check to safely modify map inside loop
-            std::vector<int> fdsToCheck;
-            for (auto const &[fd, conn] : connections)
-            {
-                fdsToCheck.push_back(fd);
-            }
-
-            for (int fd : fdsToCheck)
-            {
-                if (FD_ISSET(fd, &readFds))
-                {
-                    handleClientData(fd);
-                }
-            }
+            LOG_ERROR("Failed to create the command log of shard " + std::to_string(i));
+            exit(EXIT_FAILURE);
         }
-
-        lobby.update();
-        // -------------------------------------------------------------
-        // PERIODIC TASK: Run every 3 Seconds
-        // -------------------------------------------------------------
-
-        auto now = std::chrono::steady_clock::now();
-        auto elapsed = std::chrono::duration_cast<std::chrono::seconds>(now - lastTask).count();
-
-        if (elapsed >= 3)
-        {
-            auto allPlayers = lobby.getAllPlayers();
-            for (auto &pair : allPlayers)
-            {
-                int fd = pair.first;
-                auto player = pair.second;
-
-                long inactiveSeconds = player->getSecondsSinceLastActivity();
-                if (inactiveSeconds >= 10)
-                {
-                    Logger::info("Client timed out (No heartbeat): " + std::to_string(fd));
-                    disconnectClient(fd);
-                }
-                else if (inactiveSeconds >= 3)
-                {
-                    // Send PING to check if client is alive
-                    sendMessage(fd, "PING____", "");
-                }
-            }
-        }
-
-        // -------------------------------------------------------------
     }
+    for (int room = 0; room < config.rooms; ++room)
+    {
+        shardForRoom(room).addRoom(room);
+    }
+    for (auto &shard : shards)
+    {
+        shard->start();
+    }
+    LOG_INFO("Server running " + std::to_string(config.rooms) + " rooms (up to " + std::to_string(config.maxRooms) + ") on " +
+             std::to_string(workers) + " shards" + (config.reusePort ? ", all accepting" : ""));
 }
 
-void TcpServer::handleNewConnection()
+void TcpServer::initCredits()
 {
-    sockaddr_in clientAddr;
-    socklen_t clientLen = sizeof(clientAddr);
-    int newFd = accept(serverSocket, (struct sockaddr *)&clientAddr, &clientLen);
-
-    if (newFd < 0)
-    {
-        if (errno != EWOULDBLOCK)
-            Logger::error("Accept failed");
+    if (config.dataDir.empty())
         return;
+    credits = std::make_unique<CreditStore>(config.dataDir);
+    if (!credits->open())
+    {
+        LOG_ERROR("Failed to load player credits from " + config.dataDir);
+        exit(EXIT_FAILURE);
     }
+    setCreditStore(credits.get());
+}
 
-    if (lobby.getAllPlayers().size() >= static_cast<size_t>(config.maxPlayers))
-    {
-        Logger::info("Rejected connection: Max players reached");
-        sendMessage(newFd, "CON_FAIL", "Max players reached");
-        close(newFd);
+void TcpServer::initJournal()
+{
+    if (config.journal.empty())
         return;
+    // One file per process like the command logs, a hot restart's new process starts its own
+    std::string path = config.journal + "." + std::to_string(getpid());
+    journal = std::make_unique<RoundJournal>();
+    if (!journal->open(path, config.seed))
+    {
+        LOG_ERROR("Failed to create the round journal " + path);
+        exit(EXIT_FAILURE);
     }
-    // Set non-blocking
-    int flags = fcntl(newFd, F_GETFL, 0);
-    fcntl(newFd, F_SETFL, flags | O_NONBLOCK);
-
-    FD_SET(newFd, &masterSet);
-    if (newFd > maxFd)
-        maxFd = newFd;
-
-    // Create tracking objects
-    connections[newFd] = new ClientConnection(newFd);
-    Logger::info("New client connected on FD " + std::to_string(newFd));
-    lobby.addPlayer(newFd);
+    LOG_INFO("Journaling rounds to " + path);
 }
 
-void TcpServer::sendMessage(int fd, std::string command, std::string args)
+void TcpServer::initAdmin()
 {
-    // 1. Protocol Requirement: Start with "BJ:"
-    std::string finalMessage = "BJ:" + command;
-
-    // Add arguments if they exist (assuming a space separator)
-    if (!args.empty())
+    if (config.adminPort == 0)
+        return;
+    admin = std::make_unique<AdminServer>(config.ipAddress, config.adminPort);
+    if (!admin->start())
     {
-        finalMessage += ":" + args;
+        LOG_ERROR("Failed to bind admin endpoint to port " + std::to_string(config.adminPort));
+        exit(EXIT_FAILURE);
     }
+}
 
-    // 2. Protocol Requirement: Messages must be newline-terminated
-    if (finalMessage.back() != '\n')
+Shard &TcpServer::shardForRoom(int roomId)
+{
+    return *shards[static_cast<size_t>(roomId) % shards.size()];
+}
+
+void TcpServer::run()
+{
+    std::vector<HotRestart::PlayerState> inherited;
+    if (HotRestart::isInherited())
     {
-        finalMessage += '\n';
+        if (!HotRestart::receive(serverSocket, inherited))
+        {
+            LOG_ERROR("Failed to take over from the previous process");
+            exit(EXIT_FAILURE);
+        }
+        LOG_INFO("Took over the listening socket and " + std::to_string(inherited.size()) + " players from the previous process");
     }
+    initSocket();
+    initCredits();
+    initShards();
+    initAdmin();
+    if (!inherited.empty())
+        restorePlayers(inherited);
+    runLoop();
+}
 
-    // 3. Send data using the standard BSD socket call
-    ssize_t bytesSent = -1;
-    try
+void TcpServer::restorePlayers(std::vector<HotRestart::PlayerState> &players)
+{
+    for (HotRestart::PlayerState &state : players)
     {
-        bytesSent = send(fd, finalMessage.c_str(), finalMessage.size(), 0);
+        if (state.fd < 0)
+            continue;
+        auto conn = std::make_unique<ClientConnection>(state.fd, config.sendHighWaterMark);
+        conn->restoreBuffers(state.input, state.output);
+        if (state.binary)
+            conn->setWireFormat(WireFormat::BINARY);
+        Metrics::connections.add(1);
+        // Already admitted by the previous process
+        connectionCount.fetch_add(1, std::memory_order_relaxed);
+        // Registration failed, the connection is closed and the player kept as a session
+        if (!adoptConnection(std::move(conn)))
+            state.fd = -1;
     }
-    catch (const std::exception &e)
+    lobby.restorePlayers(players);
+}
+
+bool TcpServer::handleForeignEvent(const PollEvent &event)
+{
+    if (event.fd != serverSocket)
+        return false;
+    handleNewConnection();
+    return true;
+}
+
+void TcpServer::handleNewConnection()
+{
+    // Edge-triggered listener: drain the whole accept queue on every wakeup
+    int newFd;
+    while ((newFd = acceptConnection(serverSocket)) >= 0)
     {
-        Logger::error("Exception during send to FD " + std::to_string(fd) + ": " + e.what());
+        if (!addConnection(newFd))
+        {
+            close(newFd);
+            connectionCount.fetch_sub(1, std::memory_order_relaxed);
+            continue;
+        }
+        Metrics::accepted.add();
+        LOG_INFO("New client connected on FD " + std::to_string(newFd));
+        lobby.addPlayer(newFd);
     }
+}
 
-    if (bytesSent < 0)
+int TcpServer::acceptConnection(int listenFd)
+{
+    while (true)
     {
-        // Handle send errors
-        if (errno == EWOULDBLOCK || errno == EAGAIN)
+        // Non-blocking and close-on-exec straight from the accept, no fcntl calls per socket
+        int newFd = accept4(listenFd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (newFd < 0)
         {
-            Logger::error("Socket buffer full for FD " + std::to_string(fd));
+            // The client gave up while queued, the next one may still be there
+            if (errno == EINTR || errno == ECONNABORTED)
+                continue;
+            if (errno != EWOULDBLOCK && errno != EAGAIN)
+                LOG_ERROR_LIMITED("Accept failed: " + std::string(strerror(errno)));
+            return -1;
         }
-        else
+
+        // Reserved before the socket is registered, concurrent acceptors cannot overshoot the limit.
+        // Counts sockets that have not logged in yet, a storm cannot slip in ahead of its logins
+        if (connectionCount.fetch_add(1, std::memory_order_relaxed) >= config.maxPlayers)
         {
-            Logger::error("Failed to send to FD " + std::to_string(fd));
+            connectionCount.fetch_sub(1, std::memory_order_relaxed);
+            LOG_WARN_LIMITED("Rejected connection: Max players reached");
+            Metrics::rejected.add();
+            // Not tracked yet, best effort write straight to the socket
+            const std::string reject = "BJ:CON_FAIL:Max players reached\n";
+            send(newFd, reject.data(), reject.size(), MSG_NOSIGNAL | MSG_DONTWAIT);
+            close(newFd);
+            continue;
         }
+        return newFd;
     }
-    else
+}
+
+bool TcpServer::postToLobby(LobbyMessage &message)
+{
+    if (!mailbox.post(message))
+        return false;
+    wakeup();
+    return true;
+}
+
+void TcpServer::handOffToShard(int fd, ShardMessage message)
+{
+    Shard *shard = &shardForRoom(message.roomId);
+    scheduleHandoff(fd, [this, shard, message = std::move(message)](std::unique_ptr<ClientConnection> conn) mutable
+                    {
+                        message.conn = std::move(conn);
+                        postOrDefer([shard, message = std::move(message)]() mutable
+                                    { return shard->post(message); }); });
+}
+
+void TcpServer::closeRoom(int roomId)
+{
+    Shard *shard = &shardForRoom(roomId);
+    postOrDefer([shard, roomId]()
+                {
+                    ShardMessage close{ShardMessage::Type::CLOSE_ROOM};
+                    close.roomId = roomId;
+                    return shard->post(close); });
+}
+
+void TcpServer::requestShutdown(bool restart)
+{
+    // Only the first request counts, a restart is not turned into a drain or the other way round
+    int expected = SHUTDOWN_NONE;
+    shutdownRequest.compare_exchange_strong(expected, restart ? SHUTDOWN_RESTART : SHUTDOWN_DRAIN);
+    wakeup();
+}
+
+void TcpServer::beginShutdown()
+{
+    shutdown = shutdownRequest.load();
+    poller->remove(serverSocket);
+    // The new process keeps listening on a restart, pending connections wait in the backlog for it
+    if (shutdown == SHUTDOWN_DRAIN)
     {
-        // 4. Log the actual message sent (trimming the newline for cleaner logs is optional but nice)
-        // We use finalMessage here to see exactly what went over the wire.
-        if (command != "PING____")
-            Logger::debug("Sent to FD " + std::to_string(fd) + ": " + finalMessage);
+        close(serverSocket);
+        serverSocket = -1;
     }
+    drainingShards = shards.size();
+    LOG_INFO(std::string(shutdown == SHUTDOWN_RESTART ? "Hot restart" : "Shutdown") + " requested, draining " +
+             std::to_string(drainingShards) + " shards");
 }
 
-void TcpServer::handleClientData(int fd)
+void TcpServer::postDrain()
 {
-    char buf[1024];
-    int bytesRead = recv(fd, buf, sizeof(buf), 0);
+    bool restart = shutdown == SHUTDOWN_RESTART;
+    for (auto &shard : shards)
+    {
+        Shard *target = shard.get();
+        postOrDefer([target, restart]()
+                    {
+                        ShardMessage drain{ShardMessage::Type::DRAIN};
+                        drain.restart = restart;
+                        return target->post(drain); });
+    }
+}
+
+void TcpServer::onShardDrained()
+{
+    if (drainingShards == 0 || --drainingShards > 0)
+        return;
 
-    if (bytesRead <= 0)
+    if (shutdown == SHUTDOWN_DRAIN)
     {
-        // 0 = Closed by client, <0 = Error
-        disconnectClient(fd);
+        LOG_INFO("All rounds finished, disconnecting players");
+        lobby.disconnectAll("Server shutting down");
+        // The DISCONNECTs are written at the end of this pass, the loop returns after it
+        flushDeferredPosts(std::chrono::seconds(1));
+        stop();
+        return;
     }
-    else
+
+    // Lobby connections are released at the end of this pass, the restart completes on the next
+    lobby.getAllPlayers().forEach([this](PlayerHandle, Player &player)
+                                  {
+                                      int fd = player.getFd();
+                                      scheduleHandoff(fd, [this, fd](std::unique_ptr<ClientConnection> conn)
+                                                      { restartConnections[fd] = std::move(conn); }); });
+    restartPending = true;
+    wakeup();
+}
+
+void TcpServer::completeRestart()
+{
+    std::vector<HotRestart::PlayerState> states = lobby.getRestartState();
+    for (HotRestart::PlayerState &state : states)
     {
-        // keep player activity updated trough slow trafic
-        auto player = lobby.getPlayer(fd);
-        if (player)
+        if (state.fd < 0)
+            continue;
+        auto it = restartConnections.find(state.fd);
+        if (it == restartConnections.end())
         {
-            player->refreshLastActivity();
+            state.fd = -1;
+            continue;
         }
-        // Append data to buffer
-        auto conn = connections[fd];
-        if (conn->appendBuffer(buf, bytesRead))
-        {
-            // If we have complete lines, process them
-            auto msgs = conn->getMessages();
-
-            for (const auto &rawMsg : msgs)
-            {
-                Message msg = Parser::parse(rawMsg);
+        // Whatever the socket takes now need not be carried over
+        it->second->flushOutput();
+        state.input = std::string(it->second->getBufferedInput());
+        state.output = it->second->getPendingOutput();
+        state.binary = it->second->getWireFormat() == WireFormat::BINARY;
+    }
 
-                if (!msg.valid)
-                {
-                    Logger::log(LogLevel::WARNING, "Invalid message format from FD" + std::to_string(fd));
-                    if (player)
-                    {
-                        player->incrementInvalidMsg();
-                        // Requirement: Disconnect after N invalid messages
-                        if (player->getInvalidMsgCount() >= 3)
-                        {
-                            Logger::info("Kicking client (Too many invalid msgs): " + std::to_string(fd));
-                            disconnectClient(fd);
-                            return;
-                        }
-                    }
-                }
-                else
-                {
-                    Logger::debug("Recv FD " + std::to_string(fd) + ": " + msg.command);
-                    // Route valid messages (e.g., to Lobby or GameRoom) and update last activity for timeout tracking
-                    if (player)
-                    {
-                        if (msg.command == "PING____")
-                        {
-                            // Handle PING command (keep-alive)
-                            sendMessage(fd, "PONG____", "");
-                            Logger::debug("Responded to PING from FD " + std::to_string(fd));
-                        }
-                        else if (msg.command == "PONG____")
-                        {
-                            player->refreshLastActivity();
-                        }
-                        else
-                        {
-                            lobby.handle(player, msg);
-                        }
-                    }
-                }
-            }
-        }
+    // The new process binds the admin port and opens the credit files itself
+    flushDeferredPosts(std::chrono::seconds(1));
+    if (admin)
+    {
+        admin->stop();
+        admin.reset();
+    }
+    for (auto &shard : shards)
+    {
+        shard->join();
+        shard->setCreditStore(nullptr);
     }
+    setCreditStore(nullptr);
+    credits.reset();
+    // Writes out what the rooms journaled before the handover
+    journal.reset();
+
+    bool handedOver = HotRestart::handOver(serverSocket, states);
+    // Both processes hold the sockets now, closing ours leaves the clients connected to the new one
+    for (auto &entry : restartConnections)
+        close(entry.first);
+    Metrics::connections.add(-static_cast<int64_t>(restartConnections.size()));
+    connectionCount.fetch_sub(static_cast<int>(restartConnections.size()), std::memory_order_relaxed);
+    restartConnections.clear();
+    close(serverSocket);
+    serverSocket = -1;
+    if (handedOver)
+        LOG_INFO("Hot restart complete, " + std::to_string(states.size()) + " players handed over");
+    else
+        LOG_ERROR("Hot restart failed, players were disconnected");
+    stop();
 }
 
-void TcpServer::disconnectClient(int fd)
+void TcpServer::onWakeup()
 {
-    close(fd);
-    FD_CLR(fd, &masterSet);
+    if (restartPending)
+    {
+        restartPending = false;
+        completeRestart();
+        return;
+    }
+    if (drainPending)
+    {
+        drainPending = false;
+        postDrain();
+    }
+    if (shutdown == SHUTDOWN_NONE && shutdownRequest.load() != SHUTDOWN_NONE)
+    {
+        beginShutdown();
+        drainPending = true;
+        wakeup();
+    }
 
-    if (connections.count(fd))
+    mailbox.drain(inbox);
+    for (auto &msg : inbox)
     {
-        delete connections[fd];
-        connections.erase(fd);
+        lobby.handleShardMessage(msg);
     }
+    inbox.clear();
+}
+
+Player *TcpServer::findPlayer(int fd)
+{
+    return lobby.getPlayer(fd);
+}
 
+void TcpServer::onMessage(Player &player, const MessageView &msg)
+{
+    lobby.handle(player, msg);
+}
+
+void TcpServer::onDisconnect(int fd)
+{
     lobby.removePlayer(fd);
-    Logger::info("Client disconnected FD " + std::to_string(fd));
-}
\ No newline at end of file
+}
+
+void TcpServer::onTick()
+{
+    lobby.update();
+}
@@ -3,54 +3,129 @@
  * Author: Marek Manzel
  *
  * TcpServer.h - Main TCP server class for the blackjack game
- * Handles incoming client connections, manages socket operations using select(),
- * and coordinates between network layer and game logic through the Lobby system.
+ * Accepts client connections and runs the lobby event loop. Game rooms are
+ * spread over worker shards, players joining a room are handed over to the
+ * room's shard together with their connection and come back on leaving.
+ * Shutdown is driven from here: the listener stops, the shards drain their
+ * rounds, then the players are disconnected or, for a hot restart, handed
+ * to a new process together with the listening socket (see HotRestart.h).
+ * Optionally every shard accepts on its own SO_REUSEPORT listener as well,
+ * admission is counted on one atomic across all acceptors.
  */
 
 #ifndef TCP_SERVER_H
 #define TCP_SERVER_H
 
 #include "../core/Config.h"
+#include "../core/Mailbox.h"
+#include "../game/CreditStore.h"
 #include "../game/Lobby.h"
-#include "ClientConnection.h"
-#include <sys/select.h>
-#include <map>
+#include "../game/RoundJournal.h"
+#include "AdminServer.h"
+#include "EventLoop.h"
+#include "HotRestart.h"
+#include "LoopMessage.h"
+#include "Shard.h"
+#include <atomic>
+#include <memory>
+#include <unordered_map>
+#include <vector>
 
-class TcpServer
+class TcpServer : public EventLoop
 {
 public:
     TcpServer(const Config &config);
-    ~TcpServer();
-
-    TcpServer(const TcpServer &) = delete;
-    TcpServer &operator=(const TcpServer &) = delete;
-    TcpServer(TcpServer &&) = delete;
-    TcpServer &operator=(TcpServer &&) = delete;
+    ~TcpServer() override;
 
     // Main blocking loop
     void run();
-    void sendMessage(int fd, std::string command, std::string args);
+
+    // Thread-safe, shards report to the lobby through this. Moves from 'message' only on
+    // success, false if the lobby mailbox is full (the shard retries later)
+    bool postToLobby(LobbyMessage &message);
+
+    const Mailbox<LobbyMessage> &getMailbox() const { return mailbox; }
+
+    // Moves the connection of 'fd' to the shard owning message.roomId at the end of the pass
+    void handOffToShard(int fd, ShardMessage message);
+    // Thread-safe, for every accepting loop. Next admitted socket queued on 'listenFd' (non-blocking),
+    // -1 once the queue is empty. Sockets over the connection limit are turned away here
+    int acceptConnection(int listenFd);
+
+    // Asks the owning shard to reclaim an empty room, it answers with ROOM_CLOSED or a ROOM_STATUS
+    void closeRoom(int roomId);
+
+    // Async-signal-safe: stops accepting and lets running rounds finish, then returns from run().
+    // With 'restart' everything is handed to a new process instead of disconnected
+    void requestShutdown(bool restart);
+    bool isShuttingDown() const { return shutdownRequest.load() != SHUTDOWN_NONE; }
+    // Lobby loop only, true from the first pass of the shutdown on; rooms take no more players
+    bool isDraining() const { return shutdown != SHUTDOWN_NONE; }
+    bool isRestarting() const { return shutdown == SHUTDOWN_RESTART; }
+    // A shard has finished its rounds and released its players
+    void onShardDrained();
 
     // Game State
     Lobby lobby;
 
+protected:
+    Player *findPlayer(int fd) override;
+    void onMessage(Player &player, const MessageView &msg) override;
+    void onDisconnect(int fd) override;
+    void onTick() override;
+    void onWakeup() override;
+    bool handleForeignEvent(const PollEvent &event) override;
+
 private:
+    enum Shutdown : int
+    {
+        SHUTDOWN_NONE,
+        SHUTDOWN_DRAIN,
+        SHUTDOWN_RESTART
+    };
+
     // Core networking methods
     void initSocket();
+    // Fresh listening socket bound to the configured address, SO_REUSEPORT for shard listeners
+    int openListener();
+    void initShards();
+    // Loads saved credits, only if a data directory is configured
+    void initCredits();
+    // Opens the round journal, only if a journal prefix is configured
+    void initJournal();
+    // Metrics endpoint, only if an admin port is configured
+    void initAdmin();
     void handleNewConnection();
-    void handleClientData(int fd);
-    void disconnectClient(int fd);
+    Shard &shardForRoom(int roomId);
+    void beginShutdown();
+    void postDrain();
+    // Old process side of the hot restart, once the lobby connections were released
+    void completeRestart();
+    // New process: adopts the inherited connections and gives the players back to the lobby
+    void restorePlayers(std::vector<HotRestart::PlayerState> &players);
 
-    Config config;
     int serverSocket;
-    bool isRunning;
+    // Connected sockets on all loops, logged in or not, limited by maxPlayers
+    std::atomic<int> connectionCount{0};
 
-    // Tracking active connections
-    std::map<int, ClientConnection *> connections;
+    std::vector<std::unique_ptr<Shard>> shards;
+    Mailbox<LobbyMessage> mailbox;
+    std::vector<LobbyMessage> inbox;
+    std::unique_ptr<AdminServer> admin;
+    // Outlives the shards, they are joined in the destructor body
+    std::unique_ptr<CreditStore> credits;
+    // Same, rooms open their rings in it from the shard threads
+    std::unique_ptr<RoundJournal> journal;
 
-    // Select() file descriptor sets
-    fd_set masterSet;
-    int maxFd;
+    std::atomic<int> shutdownRequest{SHUTDOWN_NONE};
+    int shutdown = SHUTDOWN_NONE;
+    // The shard drains are posted / the restart completed on the pass after the triggering one,
+    // so that handoffs released at the end of that pass arrive first
+    bool drainPending = false;
+    bool restartPending = false;
+    size_t drainingShards = 0;
+    // Lobby connections released for the hot restart, by FD
+    std::unordered_map<int, std::unique_ptr<ClientConnection>> restartConnections;
 };
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,44 @@
+/**
+ * Server for blackjack
+ * Author: Marek Manzel
+ *
+ * Transport.h - Compile-time socket I/O policy of client connections
+ * Every recv() and sendmsg() on a client socket goes through the Transport
+ * type. The default SystemTransport forwards straight to the kernel and has
+ * no per-connection state, so it compiles down to the plain calls. Building
+ * with -DBJ_FAULT_INJECTION (make FAULTS=1) selects FaultTransport instead,
+ * which fragments, delays and drops traffic as described by an
+ * intcptor_config.cfg file.
+ */
+
+#ifndef TRANSPORT_H
+#define TRANSPORT_H
+
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <chrono>
+
+struct SystemTransport
+{
+    static constexpr bool INJECTS_FAULTS = false;
+
+    // Per-connection state, none needed
+    struct State
+    {
+    };
+
+    static ssize_t recv(State &, int fd, void *buffer, size_t length) { return ::recv(fd, buffer, length, 0); }
+    static ssize_t sendmsg(State &, int fd, const msghdr *msg) { return ::sendmsg(fd, msg, MSG_NOSIGNAL); }
+
+    // Queued output held back by the transport is due at this time, none here
+    static std::chrono::steady_clock::time_point heldUntil(const State &) { return {}; }
+};
+
+#ifdef BJ_FAULT_INJECTION
+#include "FaultTransport.h"
+using Transport = FaultTransport;
+#else
+using Transport = SystemTransport;
+#endif
+
+#endif
@@ -0,0 +1,167 @@
+/**
+ * Server for blackjack
+ * Author: Marek Manzel
+ *
+ * Commands.h - Compile-time registry of client commands and server messages
+ * Every client command is exactly 8 characters, so its bytes packed into a
+ * uint64_t form the opcode. The registry below generates the Command enum, the
+ * opcode constants and the opcode -> Command decoding. Adding a command is one
+ * entry here plus one entry in the handler table of whoever processes it.
+ * Both registries also fix the one-byte opcode of every message in the binary
+ * wire format (see Wire.h). Binary opcodes are never reused or renumbered.
+ */
+
+#ifndef COMMANDS_H
+#define COMMANDS_H
+
+#include <cstdint>
+#include <cstddef>
+#include <string>
+#include <string_view>
+
+// X(name, wire form, binary opcode, rate limit cost). The cost is roughly the number of messages
+// the command makes the server send: 1 for a reply to the sender, 8 for a broadcast to a room
+#define BJ_CLIENT_COMMANDS(X)                 \
+    X(PING, "PING____", 0x01, 1)              \
+    X(PONG, "PONG____", 0x02, 1)              \
+    X(LOGIN, "LOGIN___", 0x03, 2)             \
+    X(JOIN, "JOIN____", 0x04, 8)              \
+    X(LEAVE_ROOM, "LVRO____", 0x05, 8)        \
+    X(READY, "RDY_____", 0x06, 8)             \
+    X(NOT_READY, "NRD_____", 0x07, 8)         \
+    X(PLAY_AGAIN, "PAG_____", 0x08, 8)        \
+    X(BET, "BT______", 0x09, 8)               \
+    X(HIT, "HIT_____", 0x0A, 8)               \
+    X(STAND, "STAND___", 0x0B, 8)             \
+    X(RECONNECT_GAME, "REC__GAM", 0x0C, 8)   \
+    X(WATCH, "WATCH___", 0x0D, 2)
+
+// Server -> client messages, X(wire form, binary opcode). ROSTER__ exists in the binary format only
+#define BJ_SERVER_MESSAGES(X) \
+    X("PING____", 0x01)       \
+    X("PONG____", 0x02)       \
+    X("REQ_NICK", 0x10)       \
+    X("ACK__NIC", 0x11)       \
+    X("NACK_NIC", 0x12)       \
+    X("ACK__REC", 0x13)       \
+    X("INV_MESS", 0x14)       \
+    X("DISCONNECT", 0x15)     \
+    X("CON_FAIL", 0x16)       \
+    X("LBBYINFO", 0x20)       \
+    X("LBBYDELT", 0x21)       \
+    X("ACK__JON", 0x22)       \
+    X("NACK_JON", 0x23)       \
+    X("ACK_LVRO", 0x24)       \
+    X("NACKLVRO", 0x25)       \
+    X("ACK__WAT", 0x26)       \
+    X("NACK_WAT", 0x27)       \
+    X("ROMSTAUP", 0x30)       \
+    X("ROSTER__", 0x31)       \
+    X("GAMESTAT", 0x32)       \
+    X("ACK__RDY", 0x33)       \
+    X("ACK__NRD", 0x34)       \
+    X("REQ_BET_", 0x35)       \
+    X("ACK___BT", 0x36)       \
+    X("NACK__BT", 0x37)       \
+    X("NACK_HIT", 0x38)       \
+    X("BUST____", 0x39)       \
+    X("HIT21___", 0x3A)       \
+    X("ACK_STND", 0x3B)       \
+    X("ROUNDEND", 0x3C)       \
+    X("ACK__PAG", 0x3D)       \
+    X("NACK_PAG", 0x3E)       \
+    X("NACK_CMD", 0x3F)
+
+// Packs an 8 character command into an integer, first character in the lowest byte
+constexpr uint64_t makeOpcode(const char (&command)[9])
+{
+    uint64_t op = 0;
+    for (int i = 7; i >= 0; --i)
+    {
+        op = (op << 8) | static_cast<unsigned char>(command[i]);
+    }
+    return op;
+}
+
+// Inverse of makeOpcode, for logging
+inline std::string opcodeToString(uint64_t op)
+{
+    std::string command(8, '\0');
+    for (int i = 0; i < 8; ++i)
+    {
+        command[i] = static_cast<char>((op >> (8 * i)) & 0xFF);
+    }
+    return command;
+}
+
+namespace Opcode
+{
+#define BJ_OPCODE_CONSTANT(name, wire, binary, cost) constexpr uint64_t name = makeOpcode(wire);
+    BJ_CLIENT_COMMANDS(BJ_OPCODE_CONSTANT)
+#undef BJ_OPCODE_CONSTANT
+}
+
+enum class Command : uint8_t
+{
+#define BJ_COMMAND_ENUM(name, wire, binary, cost) name,
+    BJ_CLIENT_COMMANDS(BJ_COMMAND_ENUM)
+#undef BJ_COMMAND_ENUM
+    UNKNOWN,
+    COUNT
+};
+
+constexpr size_t COMMAND_COUNT = static_cast<size_t>(Command::COUNT);
+
+// Opcode -> Command, the switch over constants compiles to a jump/search table
+constexpr Command commandFromOpcode(uint64_t op)
+{
+    switch (op)
+    {
+#define BJ_COMMAND_CASE(name, wire, binary, cost) \
+    case Opcode::name:                            \
+        return Command::name;
+        BJ_CLIENT_COMMANDS(BJ_COMMAND_CASE)
+#undef BJ_COMMAND_CASE
+    default:
+        return Command::UNKNOWN;
+    }
+}
+
+// Binary opcode of a client command -> its text opcode, 0 if unknown
+constexpr uint64_t opcodeFromBinary(uint8_t binary)
+{
+    switch (binary)
+    {
+#define BJ_BINARY_CASE(name, wire, code, cost) \
+    case code:                                 \
+        return Opcode::name;
+        BJ_CLIENT_COMMANDS(BJ_BINARY_CASE)
+#undef BJ_BINARY_CASE
+    default:
+        return 0;
+    }
+}
+
+// Rate limit tokens a command takes, unknown commands and garbage cost 1
+constexpr uint32_t commandCost(Command command)
+{
+    constexpr uint32_t costs[COMMAND_COUNT] = {
+#define BJ_COMMAND_COST(name, wire, binary, cost) cost,
+        BJ_CLIENT_COMMANDS(BJ_COMMAND_COST)
+#undef BJ_COMMAND_COST
+        1};
+    return costs[static_cast<size_t>(command)];
+}
+
+// Binary opcode of a server message, 0 if it has none (it then goes out as text)
+constexpr uint8_t serverBinaryOpcode(std::string_view message)
+{
+#define BJ_SERVER_CASE(wire, code) \
+    if (message == wire)           \
+        return code;
+    BJ_SERVER_MESSAGES(BJ_SERVER_CASE)
+#undef BJ_SERVER_CASE
+    return 0;
+}
+
+#endif
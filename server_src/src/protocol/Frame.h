@@ -0,0 +1,48 @@
+/**
+ * Server for blackjack
+ * Author: Marek Manzel
+ *
+ * Frame.h - Immutable pre-framed protocol line shared between write queues
+ * A frame holds the complete wire form "BJ:<command>:<args>\n". It is built once
+ * and handed by reference count to every recipient, so a broadcast to N players
+ * costs one serialization and N pointer copies.
+ */
+
+#ifndef FRAME_H
+#define FRAME_H
+
+#include <memory>
+#include <string>
+#include <cstdint>
+
+using Frame = std::shared_ptr<const std::string>;
+
+// Full state snapshots, a newer unsent one supersedes an older one of the same kind
+enum SnapshotKind : uint8_t
+{
+    SNAPSHOT_NONE = 0,
+    SNAPSHOT_GAMESTAT,
+    SNAPSHOT_ROMSTAUP,
+    SNAPSHOT_LBBYINFO
+};
+
+inline Frame makeFrame(const std::string &command, const std::string &args)
+{
+    // Protocol Requirement: Start with "BJ:" and end with newline
+    std::string wire;
+    wire.reserve(3 + command.size() + 1 + args.size() + 1);
+    wire += "BJ:";
+    wire += command;
+    if (!args.empty())
+    {
+        wire += ':';
+        wire += args;
+    }
+    if (wire.back() != '\n')
+    {
+        wire += '\n';
+    }
+    return std::make_shared<const std::string>(std::move(wire));
+}
+
+#endif
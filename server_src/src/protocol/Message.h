@@ -4,14 +4,23 @@
  * 
  * Message.h - Protocol message structure definition
  * Defines the Message structure used to represent parsed client commands
- * with a command string, arguments vector, and validity flag.
+ * with a command string, arguments vector, and validity flag, and the
+ * allocation-free MessageView used on the hot path. Commands are decoded to
+ * a Command id through the registry in Commands.h.
  */
 
 #ifndef MESSAGE_H
 #define MESSAGE_H
 
 #include <string>
+#include <string_view>
 #include <vector>
+#include <cstdint>
+#include "core/FixedVector.h"
+#include "Commands.h"
+
+// Upper bound on arguments of one message, more marks the message invalid
+constexpr size_t MAX_MESSAGE_ARGS = 8;
 
 // Structure representing a parsed command: "CMD arg1 arg2"
 struct Message
@@ -23,4 +32,18 @@ struct Message
     Message() : valid(false) {}
 };
 
-#endif
\ No newline at end of file
+// Non-owning parsed command, args are slices into the received line and are
+// valid only as long as the line buffer is
+struct MessageView
+{
+    uint64_t opcode;
+    Command command;
+    FixedVector<std::string_view, MAX_MESSAGE_ARGS> args;
+    bool valid;
+
+    MessageView() : opcode(0), command(Command::UNKNOWN), valid(false) {}
+
+    std::string commandName() const { return opcodeToString(opcode); }
+};
+
+#endif
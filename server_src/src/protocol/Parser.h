@@ -5,68 +5,157 @@
  * Parser.h - Protocol message parser for client commands
  * Parses incoming client messages according to the blackjack protocol format.
  * Validates message structure, extracts commands and arguments, and handles
- * protocol-specific formatting requirements.
+ * protocol-specific formatting requirements. Binary frames (see Wire.h) decode
+ * into the same MessageView, so handlers never see which format a client uses.
  */
 
 #ifndef PARSER_H
 #define PARSER_H
 
 #include "Message.h"
-#include <core/Utils.h>
-#include <sstream>
-#include <algorithm>
+#include "Wire.h"
+#include <string_view>
+#include <charconv>
+#include <cctype>
 
 class Parser
 {
 public:
-    static Message parse(const std::string &rawLine)
+    // Zero-allocation parse, the returned view points into 'rawLine'
+    static MessageView parseView(std::string_view rawLine)
     {
-        Message msg;
+        MessageView msg;
 
         if (rawLine.empty())
         {
             return msg;
         }
 
-        // Tokenize the string by delimiter ':'
-        std::vector<std::string> tokens = Utils::splitString(rawLine, ':');
-
-        // Validation: Must have Header and Command
-        if (tokens.size() < 2)
+        // Header must be "BJ:"
+        if (rawLine.size() < 3 || rawLine.compare(0, 3, "BJ:") != 0)
         {
             return msg;
         }
 
-        // First token must be "BJ"
-        if (tokens[0] != "BJ")
+        // Command must be length 8, i first thought messages will be fixed length, now its not mendatory but still prevents when someone sends garbage
+        std::string_view rest = rawLine.substr(3);
+        size_t end = rest.find(':');
+        std::string_view rawCommand = rest.substr(0, end);
+        if (rawCommand.length() != 8)
         {
             return msg;
         }
 
-        // Second token (Command) must be length 8, i first thought messages will be fixed length, now its not mendatory but still prevents when someone sends garbage
-        std::string rawCommand = tokens[1];
-        if (rawCommand.length() != 8)
+        uint64_t op = packCommand(rawCommand);
+        msg.opcode = op;
+        msg.command = commandFromOpcode(op);
+
+        // Remaining ':' separated tokens are args, a trailing ':' does not add an empty arg
+        while (end != std::string_view::npos)
+        {
+            rest = rest.substr(end + 1);
+            if (rest.empty())
+                break;
+            end = rest.find(':');
+            if (!msg.args.push_back(rest.substr(0, end)))
+            {
+                return msg; // too many args
+            }
+        }
+
+        // If we reached here, the message is valid
+        msg.valid = true;
+        return msg;
+    }
+
+    // Command of a line or binary payload without parsing the arguments, UNKNOWN if malformed
+    // Cheap enough to run on every message before deciding whether to parse it at all
+    static Command peekCommand(std::string_view message, bool binary)
+    {
+        if (binary)
+        {
+            return message.empty() ? Command::UNKNOWN : commandFromOpcode(opcodeFromBinary(static_cast<uint8_t>(message[0])));
+        }
+        if (message.size() < 11 || message.compare(0, 3, "BJ:") != 0 || (message.size() > 11 && message[11] != ':'))
+        {
+            return Command::UNKNOWN;
+        }
+        return commandFromOpcode(packCommand(message.substr(3, 8)));
+    }
+
+    // Zero-allocation parse of a binary frame payload: opcode byte, then varint-length arguments
+    static MessageView parseBinaryView(std::string_view payload)
+    {
+        MessageView msg;
+
+        if (payload.empty())
         {
             return msg;
         }
+        msg.opcode = opcodeFromBinary(static_cast<uint8_t>(payload[0]));
+        if (msg.opcode == 0)
+        {
+            return msg;
+        }
+        msg.command = commandFromOpcode(msg.opcode);
+
+        std::string_view rest = payload.substr(1);
+        while (!rest.empty())
+        {
+            uint64_t length = 0;
+            if (!Wire::getVarint(rest, length) || length > rest.size())
+            {
+                return msg; // truncated argument
+            }
+            if (!msg.args.push_back(rest.substr(0, length)))
+            {
+                return msg; // too many args
+            }
+            rest.remove_prefix(length);
+        }
 
-        // Convert to Uppercase
-        std::transform(rawCommand.begin(), rawCommand.end(), rawCommand.begin(),
-                       [](unsigned char c)
-                       { return std::toupper(c); });
-        msg.command = rawCommand;
+        msg.valid = true;
+        return msg;
+    }
 
-        // Add remaining tokens to args
-        // skipping BJ and Command
-        for (size_t i = 2; i < tokens.size(); ++i)
+    // Owning parse, copies the command and args out of the line
+    static Message parse(const std::string &rawLine)
+    {
+        Message msg;
+        MessageView view = parseView(rawLine);
+        if (!view.valid)
         {
-            msg.args.push_back(tokens[i]);
+            return msg;
         }
 
-        // If we reached here, the message is valid
+        msg.command = view.commandName();
+        for (const auto &arg : view.args)
+        {
+            msg.args.emplace_back(arg);
+        }
         msg.valid = true;
         return msg;
     }
+
+    // Uppercase while packing the 8 command characters into the opcode
+    static uint64_t packCommand(std::string_view rawCommand)
+    {
+        uint64_t op = 0;
+        for (int i = 7; i >= 0; --i)
+        {
+            op = (op << 8) | static_cast<unsigned char>(std::toupper(static_cast<unsigned char>(rawCommand[i])));
+        }
+        return op;
+    }
+
+    // Parses a whole token as a decimal integer, without allocation or exceptions
+    static bool parseInt(std::string_view token, int &value)
+    {
+        if (token.empty())
+            return false;
+        auto result = std::from_chars(token.data(), token.data() + token.size(), value);
+        return result.ec == std::errc() && result.ptr == token.data() + token.size();
+    }
 };
 
-#endif
\ No newline at end of file
+#endif
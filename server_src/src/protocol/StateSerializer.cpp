@@ -0,0 +1,129 @@
+#include "StateSerializer.h"
+
+namespace
+{
+    // Marks a closed room in place of its player count
+    constexpr uint8_t ROOM_CLOSED = 0xFF;
+}
+
+void TextStateSerializer::online(int players)
+{
+    out += "ONLINE;" + std::to_string(players) + ":";
+}
+
+void TextStateSerializer::roomCount(size_t rooms)
+{
+    out += "ROOMS;" + std::to_string(rooms) + ":";
+}
+
+void TextStateSerializer::room(int roomId, int players, int seats, int state)
+{
+    out += "R" + std::to_string(roomId) + ";" + std::to_string(players) + "/" + std::to_string(seats) + ";" + std::to_string(state) + ":";
+}
+
+void TextStateSerializer::roomClosed(int roomId)
+{
+    out += "R" + std::to_string(roomId) + ";-:";
+}
+
+void TextStateSerializer::seatStatus(int, const std::string &nickname, int status, int bet)
+{
+    // Appended piece by piece, a concatenated temporary per seat is a heap allocation per seat
+    out += "P;";
+    out += nickname;
+    out += ';';
+    out += std::to_string(status);
+    out += ";BET;";
+    out += std::to_string(bet);
+    out += ':';
+}
+
+void TextStateSerializer::dealer(const Hand &hand)
+{
+    out += "D;";
+    hand.appendTo(out);
+    out += ":";
+}
+
+void TextStateSerializer::seatHand(int, const std::string &nickname, int status, const Hand &hand)
+{
+    out += "P;";
+    out += nickname;
+    out += ';';
+    out += std::to_string(status);
+    out += ';';
+    hand.appendTo(out);
+    out += ":";
+}
+
+Frame TextStateSerializer::finish(const char *command)
+{
+    return makeFrame(command, out);
+}
+
+void BinaryStateSerializer::online(int players)
+{
+    Wire::putVarint(out, static_cast<uint64_t>(players));
+}
+
+void BinaryStateSerializer::roomCount(size_t rooms)
+{
+    Wire::putVarint(out, rooms);
+}
+
+void BinaryStateSerializer::room(int roomId, int players, int seats, int state)
+{
+    Wire::putVarint(out, static_cast<uint64_t>(roomId));
+    out += static_cast<char>(players);
+    out += static_cast<char>(seats);
+    out += static_cast<char>(state);
+}
+
+void BinaryStateSerializer::roomClosed(int roomId)
+{
+    Wire::putVarint(out, static_cast<uint64_t>(roomId));
+    out += static_cast<char>(ROOM_CLOSED);
+}
+
+void BinaryStateSerializer::seatStatus(int seat, const std::string &nickname, int status, int bet)
+{
+    out += static_cast<char>(seat);
+    out += static_cast<char>(status);
+    Wire::putVarint(out, static_cast<uint64_t>(bet));
+    Wire::putString(out, nickname);
+}
+
+void BinaryStateSerializer::dealer(const Hand &hand)
+{
+    putHand(hand);
+}
+
+void BinaryStateSerializer::seatHand(int seat, const std::string &, int status, const Hand &hand)
+{
+    out += static_cast<char>(seat);
+    out += static_cast<char>(status);
+    putHand(hand);
+}
+
+void BinaryStateSerializer::seatName(int seat, const std::string &nickname)
+{
+    out += static_cast<char>(seat);
+    Wire::putString(out, nickname);
+}
+
+void BinaryStateSerializer::putHand(const Hand &hand)
+{
+    // Card bytes as in Card.h (rank * 4 + suit)
+    out += static_cast<char>(hand.size());
+    for (size_t i = 0; i < hand.size(); ++i)
+        out += static_cast<char>(hand[i]);
+}
+
+Frame BinaryStateSerializer::finish(const char *command)
+{
+    std::string body;
+    body.reserve(1 + out.size());
+    body += static_cast<char>(serverBinaryOpcode(command));
+    body += out;
+    return Wire::finishFrame(body);
+}
@@ -0,0 +1,100 @@
+/**
+ * Server for blackjack
+ * Author: Marek Manzel
+ *
+ * StateSerializer.h - Encoders for the lobby, room and game state snapshots
+ * The lobby and the rooms describe their state entry by entry to a serializer
+ * and never build wire strings themselves. TextStateSerializer produces the
+ * ':' / ';' separated "BJ:" arguments, BinaryStateSerializer the compact
+ * payload of the binary format: varint counts, IDs and bets, single byte
+ * cards and statuses, and seat numbers instead of nicknames where the client
+ * already knows them. Every message is built at most once per format.
+ */
+
+#ifndef STATE_SERIALIZER_H
+#define STATE_SERIALIZER_H
+
+#include "Frame.h"
+#include "Wire.h"
+#include "../game/Card.h"
+#include <string>
+
+class StateSerializer
+{
+public:
+    virtual ~StateSerializer() = default;
+
+    // Lobby: LBBYINFO is online, roomCount and every open room, LBBYDELT online and the changed rooms
+    virtual void online(int players) = 0;
+    virtual void roomCount(size_t rooms) = 0;
+    virtual void room(int roomId, int players, int seats, int state) = 0;
+    virtual void roomClosed(int roomId) = 0;
+
+    // ROMSTAUP: one entry per seated player, status 0 = not ready, 1 = ready, 2 = offline
+    virtual void seatStatus(int seat, const std::string &nickname, int status, int bet) = 0;
+
+    // GAMESTAT: the dealer, then one entry per seated player, status 0 = waiting, 1 = on turn, 2 = offline
+    virtual void dealer(const Hand &hand) = 0;
+    virtual void seatHand(int seat, const std::string &nickname, int status, const Hand &hand) = 0;
+
+    // Frames everything written so far as 'command'
+    virtual Frame finish(const char *command) = 0;
+};
+
+class TextStateSerializer : public StateSerializer
+{
+public:
+    void online(int players) override;
+    void roomCount(size_t rooms) override;
+    void room(int roomId, int players, int seats, int state) override;
+    void roomClosed(int roomId) override;
+    void seatStatus(int seat, const std::string &nickname, int status, int bet) override;
+    void dealer(const Hand &hand) override;
+    void seatHand(int seat, const std::string &nickname, int status, const Hand &hand) override;
+    Frame finish(const char *command) override;
+
+    // Arguments written so far, without the "BJ:<command>:" framing
+    const std::string &text() const { return out; }
+
+private:
+    std::string out;
+};
+
+// Entries follow each other without separators, the payload ends with the frame
+class BinaryStateSerializer : public StateSerializer
+{
+public:
+    void online(int players) override;
+    void roomCount(size_t rooms) override;
+    void room(int roomId, int players, int seats, int state) override;
+    void roomClosed(int roomId) override;
+    void seatStatus(int seat, const std::string &nickname, int status, int bet) override;
+    void dealer(const Hand &hand) override;
+    void seatHand(int seat, const std::string &nickname, int status, const Hand &hand) override;
+    Frame finish(const char *command) override;
+
+    // ROSTER__ (binary only): seat -> nickname, the key to the nameless GAMESTAT entries
+    void seatName(int seat, const std::string &nickname);
+
+private:
+    void putHand(const Hand &hand);
+
+    std::string out;
+};
+
+// Runs 'fill' against the serializer for 'format' and frames the result as 'command'
+template <typename Fill>
+Frame serializeState(WireFormat format, const char *command, Fill fill)
+{
+    if (format == WireFormat::BINARY)
+    {
+        BinaryStateSerializer binary;
+        fill(binary);
+        return binary.finish(command);
+    }
+    TextStateSerializer text;
+    fill(text);
+    return text.finish(command);
+}
+
+#endif
@@ -0,0 +1,110 @@
+/**
+ * Server for blackjack
+ * Author: Marek Manzel
+ *
+ * Wire.h - Binary framing next to the text "BJ:" protocol
+ * A client asks for the binary format by appending BIN1 to its LOGIN___
+ * arguments (older servers ignore it). From the reply on, it gets every
+ * message in binary as [marker][varint length][opcode][payload]. Text lines
+ * always start with 'B' and binary frames with the marker byte, so both
+ * sides read either form at any time and the switch cannot race with lines
+ * already in flight. Client frames carry their arguments as varint-length
+ * strings, server state messages have their own compact payloads (see
+ * StateSerializer.h), every other server message carries its text arguments.
+ */
+
+#ifndef WIRE_H
+#define WIRE_H
+
+#include "Commands.h"
+#include "Frame.h"
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+enum class WireFormat : uint8_t
+{
+    TEXT,
+    BINARY
+};
+
+constexpr size_t WIRE_FORMATS = 2;
+
+namespace Wire
+{
+    // First byte of every binary frame, never the start of a text line
+    constexpr uint8_t MARKER = 0xB1;
+    // LOGIN___ argument after the nickname asking for binary server messages
+    constexpr std::string_view LOGIN_TOKEN = "BIN1";
+
+    // LEB128, 7 bits per byte, low bits first
+    inline void putVarint(std::string &out, uint64_t value)
+    {
+        while (value >= 0x80)
+        {
+            out += static_cast<char>((value & 0x7F) | 0x80);
+            value >>= 7;
+        }
+        out += static_cast<char>(value);
+    }
+
+    // Zigzag first, small negative numbers stay short
+    inline void putSignedVarint(std::string &out, int64_t value)
+    {
+        putVarint(out, (static_cast<uint64_t>(value) << 1) ^ static_cast<uint64_t>(value >> 63));
+    }
+
+    inline void putString(std::string &out, std::string_view value)
+    {
+        putVarint(out, value.size());
+        out.append(value);
+    }
+
+    // Consumes a varint from the front of 'in', false if it is incomplete or too long
+    inline bool getVarint(std::string_view &in, uint64_t &value)
+    {
+        value = 0;
+        for (size_t i = 0; i < in.size() && i < 10; ++i)
+        {
+            uint8_t byte = static_cast<uint8_t>(in[i]);
+            value |= static_cast<uint64_t>(byte & 0x7F) << (7 * i);
+            if ((byte & 0x80) == 0)
+            {
+                in.remove_prefix(i + 1);
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // 'body' starts with the opcode byte, the marker and length go in front
+    inline Frame finishFrame(const std::string &body)
+    {
+        std::string wire;
+        wire.reserve(body.size() + 4);
+        wire += static_cast<char>(MARKER);
+        putVarint(wire, body.size());
+        wire += body;
+        return std::make_shared<const std::string>(std::move(wire));
+    }
+
+    inline bool isBinary(const Frame &frame)
+    {
+        return !frame->empty() && static_cast<uint8_t>((*frame)[0]) == MARKER;
+    }
+}
+
+// Frame of 'command' in the recipient's format. Messages without a binary opcode stay text
+inline Frame makeFrame(WireFormat format, const std::string &command, const std::string &args)
+{
+    uint8_t opcode = format == WireFormat::BINARY ? serverBinaryOpcode(command) : 0;
+    if (opcode == 0)
+        return makeFrame(command, args);
+    std::string body;
+    body.reserve(1 + args.size());
+    body += static_cast<char>(opcode);
+    body += args;
+    return Wire::finishFrame(body);
+}
+
+#endif
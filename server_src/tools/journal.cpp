@@ -0,0 +1,321 @@
+#include "game/Card.h"
+#include "game/RoundJournal.h"
+#include <algorithm>
+#include <array>
+#include <cstdio>
+#include <ctime>
+#include <iostream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Decodes a round journal written by the server's -j: one line per event, or with -s a summary
+// of the rounds (outcomes, RTP, lost events) and of where their time went (betting, player
+// decisions, whole rounds).
+
+namespace
+{
+    struct Options
+    {
+        int roomId = -1; // all rooms
+        bool summary = false;
+        std::vector<std::string> paths;
+    };
+
+    const char *const typeNames[JOURNAL_EVENT_TYPES] = {"BEGIN", "SEAT", "BET", "DEAL", "HIT", "STAND", "BUST",
+                                                        "TIMEOUT", "DRAW", "PAYOUT", "END", "ABORT", "LOST"};
+    const char *const outcomeNames[] = {"loss", "push", "blackjack", "win"};
+
+    // Per room, what the events of the current round refer back to
+    struct RoomState
+    {
+        std::array<std::string, 32> names;
+        uint64_t roundStart = 0;
+        // Last event that handed the turn to a seat: the deal, a stand, the seat's own hit
+        uint64_t turnStart = 0;
+        JournalEventType lastType = JournalEventType::ROUND_END;
+        int lastTotal = 0;
+    };
+
+    struct Summary
+    {
+        std::array<uint64_t, JOURNAL_EVENT_TYPES> counts{};
+        std::array<uint64_t, 4> outcomes{};
+        int64_t wagered = 0;
+        int64_t returned = 0;
+        uint64_t lost = 0;
+        // Microseconds
+        std::vector<uint64_t> betTimes;
+        std::vector<uint64_t> decisionTimes;
+        std::vector<uint64_t> roundTimes;
+    };
+
+    std::string cardName(uint8_t card)
+    {
+        std::string out;
+        if (card < DECK_SIZE)
+            appendCard(out, card);
+        return out;
+    }
+
+    std::string seatName(const RoomState &room, uint8_t seat)
+    {
+        if (seat == JOURNAL_DEALER)
+            return "dealer";
+        std::string name = "seat " + std::to_string(seat);
+        if (seat < room.names.size() && !room.names[seat].empty())
+            name += " (" + room.names[seat] + ")";
+        return name;
+    }
+
+    void printTime(uint64_t startTime, uint64_t time)
+    {
+        uint64_t us = startTime + time;
+        std::time_t seconds = static_cast<std::time_t>(us / 1000000);
+        std::tm local;
+        localtime_r(&seconds, &local);
+        char buf[32];
+        std::strftime(buf, sizeof(buf), "%Y-%m-%d %H:%M:%S", &local);
+        std::printf("%s.%06u", buf, static_cast<unsigned>(us % 1000000));
+    }
+
+    void printEvent(const JournalHeader &header, const JournalEvent &event, const RoomState &room)
+    {
+        JournalEventType type = event.getType();
+        printTime(header.startTime, event.time);
+        if (type == JournalEventType::SEAT)
+        {
+            std::printf(" room %u SEAT seat %u %s\n", event.roomId, event.seat, event.getNickname().c_str());
+            return;
+        }
+        std::printf(" room %u round %u %-7s", event.roomId, event.getRound(), typeNames[event.type]);
+        switch (type)
+        {
+        case JournalEventType::ROUND_BEGIN:
+            std::printf(" %u players\n", event.seat);
+            break;
+        case JournalEventType::BET:
+            std::printf(" %s %d\n", seatName(room, event.seat).c_str(), event.getAmount());
+            break;
+        case JournalEventType::DEAL:
+        case JournalEventType::HIT:
+        case JournalEventType::DEALER_DRAW:
+            std::printf(" %s %s total %d\n", seatName(room, event.seat).c_str(), cardName(event.getCard()).c_str(), event.getTotal());
+            break;
+        case JournalEventType::STAND:
+        case JournalEventType::BUST:
+        case JournalEventType::TIMEOUT:
+            std::printf(" %s total %d\n", seatName(room, event.seat).c_str(), event.getTotal());
+            break;
+        case JournalEventType::PAYOUT:
+            std::printf(" %s %s total %d winnings %d\n", seatName(room, event.seat).c_str(),
+                        event.getCard() < 4 ? outcomeNames[event.getCard()] : "?", event.getTotal(), event.getAmount());
+            break;
+        case JournalEventType::ROUND_END:
+            std::printf(" dealer total %d\n", event.getTotal());
+            break;
+        case JournalEventType::LOST:
+            std::printf(" %d events dropped\n", event.getAmount());
+            break;
+        default:
+            std::printf("\n");
+            break;
+        }
+    }
+
+    void account(Summary &summary, const JournalEvent &event, RoomState &room)
+    {
+        JournalEventType type = event.getType();
+        ++summary.counts[event.type];
+        switch (type)
+        {
+        case JournalEventType::ROUND_BEGIN:
+            room.roundStart = event.time;
+            break;
+        case JournalEventType::BET:
+            summary.betTimes.push_back(event.time - room.roundStart);
+            summary.wagered += event.getAmount();
+            break;
+        case JournalEventType::DEAL:
+            room.turnStart = event.time;
+            break;
+        case JournalEventType::HIT:
+            summary.decisionTimes.push_back(event.time - room.turnStart);
+            room.turnStart = event.time;
+            break;
+        case JournalEventType::STAND:
+            // Standing on a bust, on 21 or by timeout was not the player's decision
+            if (room.lastType != JournalEventType::BUST && room.lastType != JournalEventType::TIMEOUT &&
+                !(room.lastType == JournalEventType::HIT && room.lastTotal == 21))
+                summary.decisionTimes.push_back(event.time - room.turnStart);
+            room.turnStart = event.time;
+            break;
+        case JournalEventType::PAYOUT:
+            if (event.getCard() < summary.outcomes.size())
+                ++summary.outcomes[event.getCard()];
+            // Winnings as the server reports them: the stake back on a push, nothing extra on a loss
+            if (event.getAmount() > 0)
+                summary.returned += event.getAmount();
+            break;
+        case JournalEventType::ROUND_END:
+            summary.roundTimes.push_back(event.time - room.roundStart);
+            break;
+        case JournalEventType::LOST:
+            summary.lost += static_cast<uint64_t>(event.getAmount());
+            break;
+        default:
+            break;
+        }
+    }
+
+    void printDistribution(const char *name, std::vector<uint64_t> &values)
+    {
+        if (values.empty())
+        {
+            std::printf("%-16s none\n", name);
+            return;
+        }
+        std::sort(values.begin(), values.end());
+        auto at = [&values](double q)
+        { return values[std::min(values.size() - 1, static_cast<size_t>(q * static_cast<double>(values.size())))] / 1000.0; };
+        std::printf("%-16s %8zu  p50 %10.1f ms  p90 %10.1f ms  p99 %10.1f ms  max %10.1f ms\n", name, values.size(), at(0.5), at(0.9),
+                    at(0.99), values.back() / 1000.0);
+    }
+
+    void printSummary(Summary &summary)
+    {
+        std::printf("events:");
+        for (size_t i = 0; i < JOURNAL_EVENT_TYPES; ++i)
+            std::printf(" %s %llu", typeNames[i], static_cast<unsigned long long>(summary.counts[i]));
+        std::printf("\n");
+        uint64_t hands = 0;
+        for (uint64_t count : summary.outcomes)
+            hands += count;
+        std::printf("hands %llu:", static_cast<unsigned long long>(hands));
+        for (size_t i = 0; i < summary.outcomes.size(); ++i)
+            std::printf(" %s %.2f %%", outcomeNames[i], hands == 0 ? 0.0 : 100.0 * static_cast<double>(summary.outcomes[i]) / static_cast<double>(hands));
+        std::printf("\n");
+        std::printf("RTP %.3f %%: %lld returned of %lld wagered\n",
+                    summary.wagered == 0 ? 0.0 : 100.0 * static_cast<double>(summary.returned) / static_cast<double>(summary.wagered),
+                    static_cast<long long>(summary.returned), static_cast<long long>(summary.wagered));
+        if (summary.lost > 0)
+            std::printf("WARNING: %llu events were dropped by full room rings\n", static_cast<unsigned long long>(summary.lost));
+        printDistribution("bet after open", summary.betTimes);
+        printDistribution("player decision", summary.decisionTimes);
+        printDistribution("round", summary.roundTimes);
+    }
+
+    // False if the file is not a journal or ends in a partial event
+    bool decode(const std::string &path, const Options &options, Summary &summary)
+    {
+        FILE *in = std::fopen(path.c_str(), "rb");
+        if (in == nullptr)
+        {
+            std::cerr << "Cannot open " << path << "\n";
+            return false;
+        }
+        JournalHeader header;
+        if (std::fread(&header, sizeof(header), 1, in) != 1 || !std::equal(header.magic, header.magic + 4, JOURNAL_MAGIC) ||
+            header.version != JOURNAL_VERSION)
+        {
+            std::cerr << path << " is not a round journal\n";
+            std::fclose(in);
+            return false;
+        }
+        if (!options.summary)
+        {
+            std::printf("# %s: shoe seed %llu, started ", path.c_str(), static_cast<unsigned long long>(header.seed));
+            printTime(header.startTime, 0);
+            std::printf("\n");
+        }
+
+        std::unordered_map<uint32_t, RoomState> rooms;
+        std::vector<JournalEvent> events(4096);
+        size_t count;
+        while ((count = std::fread(events.data(), sizeof(JournalEvent), events.size(), in)) > 0)
+        {
+            for (size_t i = 0; i < count; ++i)
+            {
+                const JournalEvent &event = events[i];
+                if (event.type >= JOURNAL_EVENT_TYPES || (options.roomId >= 0 && event.roomId != static_cast<uint32_t>(options.roomId)))
+                    continue;
+                RoomState &room = rooms[event.roomId];
+                if (event.getType() == JournalEventType::SEAT && event.seat < room.names.size())
+                    room.names[event.seat] = event.getNickname();
+                if (options.summary)
+                    account(summary, event, room);
+                else
+                    printEvent(header, event, room);
+                if (event.getType() != JournalEventType::SEAT)
+                {
+                    room.lastType = event.getType();
+                    room.lastTotal = event.getTotal();
+                }
+            }
+        }
+        // The writer appends whole events, a partial one means the file was cut off
+        bool complete = std::feof(in) && std::ftell(in) % static_cast<long>(sizeof(JournalEvent)) == 0;
+        std::fclose(in);
+        if (!complete)
+            std::cerr << path << ": cut off in the middle of an event\n";
+        return complete;
+    }
+}
+
+static void printHelp()
+{
+    std::cout << "Usage: ./bj_journal [options] <journal>...\n";
+    std::cout << "Options:\n";
+    std::cout << "  -r <room>     Only the events of this room (default: all)\n";
+    std::cout << "  -s            Summary of outcomes and timings instead of the events\n";
+    std::cout << "  -h, --help    Show this help message\n";
+}
+
+int main(int argc, char *argv[])
+{
+    Options options;
+    for (int i = 1; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        if (arg == "-h" || arg == "--help")
+        {
+            printHelp();
+            return 0;
+        }
+        else if (arg == "-s")
+            options.summary = true;
+        else if (arg == "-r" && i + 1 < argc)
+        {
+            try
+            {
+                options.roomId = std::stoi(argv[++i]);
+            }
+            catch (const std::exception &)
+            {
+                std::cerr << "Invalid room: '" << argv[i] << "'\n";
+                return 1;
+            }
+        }
+        else if (!arg.empty() && arg[0] == '-')
+        {
+            std::cerr << "Unknown argument: " << arg << "\n";
+            printHelp();
+            return 1;
+        }
+        else
+            options.paths.push_back(arg);
+    }
+    if (options.paths.empty())
+    {
+        printHelp();
+        return 1;
+    }
+
+    Summary summary;
+    bool valid = true;
+    for (const std::string &path : options.paths)
+        valid = decode(path, options, summary) && valid;
+    if (options.summary)
+        printSummary(summary);
+    return valid ? 0 : 1;
+}